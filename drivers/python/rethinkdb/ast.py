@@ -967,9 +967,11 @@ class Table(RqlQuery):
     def get_all(self, *keys, **kwargs):
         return GetAll(self, *keys, **kwargs)
 
-    def index_create(self, name, fundef=(), multi=()):
+    def index_create(self, name, fundef=(), multi=(), covering=()):
         args = [self, name] + ([func_wrap(fundef)] if fundef else [])
         kwargs = {"multi" : multi} if multi else {}
+        if covering != ():
+            kwargs["covering"] = covering
         return IndexCreate(*args, **kwargs)
 
     def index_drop(self, name):
@@ -0,0 +1,569 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "arch/io/disk/aio.hpp"
+
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux
+#include <linux/aio_abi.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define AIO_DISKMGR_HAVE_IO_URING 1
+#endif
+#endif
+#endif  // __linux
+
+#include <algorithm>
+
+#include "arch/io/disk.hpp"
+
+/* `kernel_io_queue_t` hides the differences between io_uring and native AIO.
+Requests are prepared one by one with `prep_*`, and handed to the kernel all at
+once by `submit()`.  Every request carries an opaque `tag` that is handed back
+by `reap()` along with the result (a byte count, or a negated errno value). */
+class kernel_io_queue_t {
+public:
+    virtual ~kernel_io_queue_t() { }
+
+    virtual const char *name() const = 0;
+    virtual bool supports_datasync() const = 0;
+
+    virtual void prep_rw(bool is_read, fd_t fd, iovec *vecs, size_t vecs_len,
+                         int64_t offset, void *tag) = 0;
+    virtual void prep_datasync(fd_t fd, void *tag) = 0;
+    virtual void submit() = 0;
+
+    virtual void reap(std::vector<std::pair<void *, int64_t> > *completions_out) = 0;
+};
+
+#ifdef AIO_DISKMGR_HAVE_IO_URING
+
+class uring_queue_t : public kernel_io_queue_t {
+public:
+    // Returns NULL if io_uring isn't available.
+    static uring_queue_t *create(int depth, int notify_fd) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int ring_fd = syscall(__NR_io_uring_setup, depth, &params);
+        if (ring_fd == -1) {
+            return NULL;
+        }
+        scoped_ptr_t<uring_queue_t> q(new uring_queue_t(ring_fd, params));
+        if (!q->map_rings()) {
+            return NULL;
+        }
+        int res = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_EVENTFD,
+                          &notify_fd, 1);
+        if (res == -1) {
+            return NULL;
+        }
+        return q.release();
+    }
+
+    ~uring_queue_t() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        }
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+            munmap(cq_ptr, cq_size);
+        }
+        if (sq_ptr != MAP_FAILED) {
+            munmap(sq_ptr, sq_size);
+        }
+        close(ring_fd);
+    }
+
+    const char *name() const { return "io_uring"; }
+    bool supports_datasync() const { return true; }
+
+    void prep_rw(bool is_read, fd_t fd, iovec *vecs, size_t vecs_len,
+                 int64_t offset, void *tag) {
+        io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = is_read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->addr = reinterpret_cast<uintptr_t>(vecs);
+        sqe->len = vecs_len;
+        sqe->user_data = reinterpret_cast<uintptr_t>(tag);
+    }
+
+    void prep_datasync(fd_t fd, void *tag) {
+        io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = reinterpret_cast<uintptr_t>(tag);
+    }
+
+    void submit() {
+        while (to_submit > 0) {
+            int res = syscall(__NR_io_uring_enter, ring_fd, to_submit, 0, 0, NULL, 0);
+            if (res == -1) {
+                guarantee_err(get_errno() == EINTR || get_errno() == EAGAIN
+                              || get_errno() == EBUSY,
+                              "io_uring_enter failed");
+                continue;
+            }
+            to_submit -= res;
+        }
+    }
+
+    void reap(std::vector<std::pair<void *, int64_t> > *completions_out) {
+        unsigned head = *cq_head;
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe = cqes[head & *cq_mask];
+            completions_out->push_back(
+                std::make_pair(reinterpret_cast<void *>(cqe.user_data),
+                               static_cast<int64_t>(cqe.res)));
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    uring_queue_t(int _ring_fd, const io_uring_params &_params)
+        : ring_fd(_ring_fd), params(_params), to_submit(0),
+          sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sqes(MAP_FAILED) { }
+
+    bool map_rings() {
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+
+        sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            return false;
+        }
+        cq_ptr = single_mmap
+            ? sq_ptr
+            : mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            return false;
+        }
+        sqes = mmap(NULL, params.sq_entries * sizeof(io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char *sq = static_cast<char *>(sq_ptr);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+        char *cq = static_cast<char *>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    io_uring_sqe *next_sqe() {
+        // `aio_diskmgr_t` never has more requests in flight than the queue depth,
+        // so the submission queue can't be full.
+        guarantee(to_submit < params.sq_entries);
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe *sqe = &static_cast<io_uring_sqe *>(sqes)[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit;
+        return sqe;
+    }
+
+    const int ring_fd;
+    const io_uring_params params;
+    unsigned to_submit;
+
+    size_t sq_size, cq_size;
+    void *sq_ptr, *cq_ptr, *sqes;
+
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+
+    DISABLE_COPYING(uring_queue_t);
+};
+
+#endif  // AIO_DISKMGR_HAVE_IO_URING
+
+#ifdef __linux
+
+class native_aio_queue_t : public kernel_io_queue_t {
+public:
+    // Returns NULL if native AIO isn't available.
+    static native_aio_queue_t *create(int depth, int notify_fd) {
+        aio_context_t context = 0;
+        int res = syscall(__NR_io_setup, depth, &context);
+        if (res == -1) {
+            return NULL;
+        }
+        return new native_aio_queue_t(context, depth, notify_fd);
+    }
+
+    ~native_aio_queue_t() {
+        int res = syscall(__NR_io_destroy, context);
+        guarantee_err(res == 0, "io_destroy failed");
+    }
+
+    const char *name() const { return "native AIO"; }
+    // IOCB_CMD_FDSYNC is rejected by most filesystems.
+    bool supports_datasync() const { return false; }
+
+    void prep_rw(bool is_read, fd_t fd, iovec *vecs, size_t vecs_len,
+                 int64_t offset, void *tag) {
+        guarantee(pending.size() < iocbs.size());
+        iocb *cb = &iocbs[free_iocbs.back()];
+        free_iocbs.pop_back();
+        memset(cb, 0, sizeof(*cb));
+        cb->aio_data = reinterpret_cast<uintptr_t>(tag);
+        cb->aio_lio_opcode = is_read ? IOCB_CMD_PREADV : IOCB_CMD_PWRITEV;
+        cb->aio_fildes = fd;
+        cb->aio_buf = reinterpret_cast<uintptr_t>(vecs);
+        cb->aio_nbytes = vecs_len;
+        cb->aio_offset = offset;
+        cb->aio_flags = IOCB_FLAG_RESFD;
+        cb->aio_resfd = notify_fd;
+        pending.push_back(cb);
+    }
+
+    void prep_datasync(fd_t, void *) {
+        unreachable();
+    }
+
+    void submit() {
+        size_t submitted = 0;
+        while (submitted < pending.size()) {
+            int res = syscall(__NR_io_submit, context, pending.size() - submitted,
+                              pending.data() + submitted);
+            if (res == -1) {
+                guarantee_err(get_errno() == EINTR || get_errno() == EAGAIN,
+                              "io_submit failed");
+                continue;
+            }
+            submitted += res;
+        }
+        pending.clear();
+    }
+
+    void reap(std::vector<std::pair<void *, int64_t> > *completions_out) {
+        const timespec no_wait = { 0, 0 };
+        int res;
+        do {
+            res = syscall(__NR_io_getevents, context, 0, events.size(),
+                          events.data(), &no_wait);
+            if (res == -1) {
+                guarantee_err(get_errno() == EINTR, "io_getevents failed");
+                continue;
+            }
+            for (int i = 0; i < res; ++i) {
+                iocb *cb = reinterpret_cast<iocb *>(events[i].obj);
+                free_iocbs.push_back(cb - iocbs.data());
+                completions_out->push_back(
+                    std::make_pair(reinterpret_cast<void *>(events[i].data),
+                                   static_cast<int64_t>(events[i].res)));
+            }
+        } while (res == -1 || res == static_cast<int>(events.size()));
+    }
+
+private:
+    native_aio_queue_t(aio_context_t _context, int depth, int _notify_fd)
+        : context(_context), notify_fd(_notify_fd), iocbs(depth), events(depth) {
+        free_iocbs.reserve(depth);
+        for (int i = 0; i < depth; ++i) {
+            free_iocbs.push_back(i);
+        }
+        pending.reserve(depth);
+    }
+
+    const aio_context_t context;
+    const int notify_fd;
+
+    scoped_array_t<iocb> iocbs;
+    std::vector<size_t> free_iocbs;
+    std::vector<iocb *> pending;
+    scoped_array_t<io_event> events;
+
+    DISABLE_COPYING(native_aio_queue_t);
+};
+
+#endif  // __linux
+
+/* The state of an action that has been popped from `source`.  A write that has
+to be wrapped in datasyncs goes through all three steps; everything else only
+does `io`.  The I/O step may take several kernel requests if the action has more
+than IOV_MAX buffers. */
+struct aio_diskmgr_t::op_t {
+    enum step_t { pre_datasync, io, post_datasync, finished };
+
+    action_t *action;
+    step_t step;
+    size_t next_vec;
+    int64_t next_offset;
+    int64_t chunk_length;
+    int64_t transferred;
+};
+
+class aio_diskmgr_t::datasync_job_t : public blocker_pool_t::job_t {
+public:
+    datasync_job_t(aio_diskmgr_t *_parent, op_t *_op)
+        : parent(_parent), op(_op), errcode(0) { }
+
+    void run() {
+        errcode = perform_datasync(op->action->get_fd());
+    }
+
+    void done() {
+        aio_diskmgr_t *p = parent;
+        op_t *o = op;
+        int64_t result = errcode == 0 ? 0 : -errcode;
+        delete this;
+        p->on_request_complete(o, result);
+        p->kernel_queue->submit();
+    }
+
+private:
+    aio_diskmgr_t *parent;
+    op_t *op;
+    int errcode;
+};
+
+aio_diskmgr_t *aio_diskmgr_t::create(linux_event_queue_t *queue,
+                                     passive_producer_t<action_t *> *source,
+                                     int max_concurrent_io_requests,
+                                     file_direct_io_mode_t direct_io_mode) {
+    std::vector<kernel_io_interface_t> interfaces;
+    interfaces.push_back(kernel_io_interface_t::io_uring);
+    // `io_submit` blocks the event queue thread on buffered files.
+    if (direct_io_mode == file_direct_io_mode_t::direct_desired) {
+        interfaces.push_back(kernel_io_interface_t::native_aio);
+    }
+    return create_with_interfaces(queue, source, max_concurrent_io_requests,
+                                  interfaces);
+}
+
+aio_diskmgr_t *aio_diskmgr_t::create_with_interface(linux_event_queue_t *queue,
+                                                    passive_producer_t<action_t *> *source,
+                                                    int max_concurrent_io_requests,
+                                                    kernel_io_interface_t interface) {
+    return create_with_interfaces(queue, source, max_concurrent_io_requests,
+                                  std::vector<kernel_io_interface_t>(1, interface));
+}
+
+aio_diskmgr_t *aio_diskmgr_t::create_with_interfaces(
+        linux_event_queue_t *queue,
+        passive_producer_t<action_t *> *source,
+        int max_concurrent_io_requests,
+        const std::vector<kernel_io_interface_t> &interfaces) {
+#ifdef __linux
+    // io_uring refuses rings with more than 32768 entries.
+    const int depth = std::min(max_concurrent_io_requests, 32768);
+
+    scoped_ptr_t<system_event_t> probe_event(new system_event_t);
+    scoped_ptr_t<kernel_io_queue_t> kernel_queue;
+    for (auto it = interfaces.begin(); it != interfaces.end() && !kernel_queue.has(); ++it) {
+        switch (*it) {
+        case kernel_io_interface_t::io_uring:
+#ifdef AIO_DISKMGR_HAVE_IO_URING
+            kernel_queue.init(uring_queue_t::create(depth, probe_event->get_notify_fd()));
+#endif
+            break;
+        case kernel_io_interface_t::native_aio:
+            kernel_queue.init(native_aio_queue_t::create(depth, probe_event->get_notify_fd()));
+            break;
+        default:
+            unreachable();
+        }
+    }
+    if (!kernel_queue.has()) {
+        return NULL;
+    }
+    return new aio_diskmgr_t(queue, source, std::move(kernel_queue),
+                             std::move(probe_event), depth);
+#else
+    (void)queue;
+    (void)source;
+    (void)max_concurrent_io_requests;
+    (void)interfaces;
+    return NULL;
+#endif
+}
+
+aio_diskmgr_t::aio_diskmgr_t(linux_event_queue_t *_queue,
+                             passive_producer_t<action_t *> *_source,
+                             scoped_ptr_t<kernel_io_queue_t> &&_kernel_queue,
+                             scoped_ptr_t<system_event_t> &&_completion_event,
+                             int depth)
+    : queue(_queue),
+      source(_source),
+      completion_event(std::move(_completion_event)),
+      kernel_queue(std::move(_kernel_queue)),
+      ops(depth) {
+    if (!kernel_queue->supports_datasync()) {
+        datasync_pool.init(new blocker_pool_t(1, queue));
+    }
+    free_ops.reserve(depth);
+    for (size_t i = 0; i < ops.size(); ++i) {
+        free_ops.push_back(&ops[i]);
+    }
+    queue->watch_resource(completion_event->get_notify_fd(), poll_event_in, this);
+
+    if (source->available->get()) { pump(); }
+    source->available->set_callback(this);
+}
+
+aio_diskmgr_t::~aio_diskmgr_t() {
+    assert_thread();
+    source->available->unset_callback();
+    rassert(free_ops.size() == ops.size(),
+            "Destroying the AIO disk manager with requests in flight");
+    queue->forget_resource(completion_event->get_notify_fd(), this);
+}
+
+const char *aio_diskmgr_t::kernel_interface_name() const {
+    return kernel_queue->name();
+}
+
+void aio_diskmgr_t::on_source_availability_changed() {
+    assert_thread();
+    if (source->available->get()) pump();
+}
+
+void aio_diskmgr_t::on_event(DEBUG_VAR int events) {
+    assert_thread();
+    rassert(events == poll_event_in);
+    // Consume the notifications before reaping, so that a completion that races
+    // with us will trigger another event.
+    completion_event->consume_wakey_wakeys();
+
+    std::vector<std::pair<void *, int64_t> > completions;
+    kernel_queue->reap(&completions);
+    for (auto it = completions.begin(); it != completions.end(); ++it) {
+        on_request_complete(static_cast<op_t *>(it->first), it->second);
+    }
+
+    // Follow-up requests (the next chunk of a large write, or the datasync after
+    // it) are all handed to the kernel at once.
+    kernel_queue->submit();
+}
+
+void aio_diskmgr_t::pump() {
+    assert_thread();
+    while (source->available->get() && !free_ops.empty()) {
+        op_t *op = free_ops.back();
+        free_ops.pop_back();
+
+        action_t *a = source->pop();
+        op->action = a;
+        op->step = a->wrap_in_datasyncs ? op_t::pre_datasync : op_t::io;
+        op->next_vec = 0;
+        op->next_offset = a->get_offset();
+        op->chunk_length = 0;
+        op->transferred = 0;
+        advance(op);
+    }
+    kernel_queue->submit();
+}
+
+void aio_diskmgr_t::advance(op_t *op) {
+    switch (op->step) {
+    case op_t::pre_datasync:
+    case op_t::post_datasync:
+        submit_datasync(op);
+        break;
+    case op_t::io:
+        submit_next_chunk(op);
+        break;
+    case op_t::finished:
+        finish(op);
+        break;
+    default:
+        unreachable();
+    }
+}
+
+void aio_diskmgr_t::submit_datasync(op_t *op) {
+    if (datasync_pool.has()) {
+        datasync_pool->do_job(new datasync_job_t(this, op));
+    } else {
+        kernel_queue->prep_datasync(op->action->get_fd(), op);
+    }
+}
+
+void aio_diskmgr_t::submit_next_chunk(op_t *op) {
+    iovec *vecs;
+    size_t vecs_len;
+    op->action->get_bufs(&vecs, &vecs_len);
+    rassert(op->next_vec < vecs_len);
+
+    const size_t len = std::min<size_t>(IOV_MAX, vecs_len - op->next_vec);
+    int64_t chunk_length = 0;
+    for (size_t i = op->next_vec; i < op->next_vec + len; ++i) {
+        chunk_length += vecs[i].iov_len;
+    }
+
+    kernel_queue->prep_rw(op->action->get_is_read(), op->action->get_fd(),
+                          vecs + op->next_vec, len, op->next_offset, op);
+    op->next_vec += len;
+    op->chunk_length = chunk_length;
+}
+
+void aio_diskmgr_t::on_request_complete(op_t *op, int64_t result) {
+    action_t *a = op->action;
+    if (result < 0) {
+        a->io_result = result;
+        finish(op);
+        return;
+    }
+
+    switch (op->step) {
+    case op_t::pre_datasync:
+        op->step = op_t::io;
+        break;
+    case op_t::io: {
+        guarantee(result == op->chunk_length,
+                  "Short %s (%" PRIi64 " of %" PRIi64 " bytes)",
+                  a->get_is_read() ? "read" : "write", result, op->chunk_length);
+        op->transferred += result;
+        op->next_offset += result;
+
+        iovec *vecs;
+        size_t vecs_len;
+        a->get_bufs(&vecs, &vecs_len);
+        if (op->next_vec == vecs_len) {
+            a->io_result = op->transferred;
+            op->step = a->wrap_in_datasyncs ? op_t::post_datasync : op_t::finished;
+        }
+    } break;
+    case op_t::post_datasync:
+        op->step = op_t::finished;
+        break;
+    case op_t::finished:
+    default:
+        unreachable();
+    }
+
+    advance(op);
+}
+
+void aio_diskmgr_t::finish(op_t *op) {
+    action_t *a = op->action;
+    op->action = NULL;
+    free_ops.push_back(op);
+    pump();
+    done_fun(a);
+}
@@ -0,0 +1,114 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef ARCH_IO_DISK_AIO_HPP_
+#define ARCH_IO_DISK_AIO_HPP_
+
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/function.hpp>
+
+#include "arch/types.hpp"
+#include "arch/runtime/event_queue.hpp"
+#include "arch/runtime/system_event.hpp"
+#include "arch/io/blocker_pool.hpp"
+#include "arch/io/disk/pool.hpp"
+#include "concurrency/queue/passive_producer.hpp"
+#include "containers/scoped.hpp"
+
+class kernel_io_queue_t;
+
+enum class kernel_io_interface_t {
+    io_uring,
+    native_aio
+};
+
+/* The AIO disk manager is a drop-in replacement for `pool_diskmgr_t` that hands
+reads, writes and datasyncs directly to the kernel's asynchronous I/O interface,
+from the event queue thread, instead of running blocking calls in a thread pool.
+It uses io_uring when the kernel supports it and falls back to Linux native AIO
+(`io_submit`) otherwise.  Native AIO is only truly asynchronous on files opened
+with O_DIRECT (on buffered files, `io_submit` blocks until the I/O is done), so it
+is only used if direct I/O was asked for.  It can't be trusted with datasyncs
+either, so in that mode datasyncs are still run on a (single-threaded) blocker
+pool.
+
+Completions are signalled through an eventfd that is watched by the regular
+`linux_event_queue_t`, so they get reaped in the same loop as every other
+event.  All operations popped from `source` in a single pass are submitted to
+the kernel with a single system call. */
+
+class aio_diskmgr_t :
+    private availability_callback_t,
+    private linux_event_callback_t,
+    public home_thread_mixin_debug_only_t {
+public:
+    typedef pool_diskmgr_t::action_t action_t;
+
+    /* Returns NULL if no kernel interface that suits `direct_io_mode` can be set
+    up on this system (for example because io_uring is disabled by a seccomp
+    filter and the files are buffered), in which case the caller should fall
+    back to `pool_diskmgr_t`. */
+    static aio_diskmgr_t *create(linux_event_queue_t *queue,
+                                 passive_producer_t<action_t *> *source,
+                                 int max_concurrent_io_requests,
+                                 file_direct_io_mode_t direct_io_mode);
+
+    /* Like `create()`, but only tries `interface`.  Used by the unit tests. */
+    static aio_diskmgr_t *create_with_interface(linux_event_queue_t *queue,
+                                                passive_producer_t<action_t *> *source,
+                                                int max_concurrent_io_requests,
+                                                kernel_io_interface_t interface);
+
+    boost::function<void(action_t *)> done_fun;
+    ~aio_diskmgr_t();
+
+    const char *kernel_interface_name() const;
+
+private:
+    struct op_t;
+    class datasync_job_t;
+
+    aio_diskmgr_t(linux_event_queue_t *queue,
+                  passive_producer_t<action_t *> *source,
+                  scoped_ptr_t<kernel_io_queue_t> &&kernel_queue,
+                  scoped_ptr_t<system_event_t> &&completion_event,
+                  int depth);
+
+    static aio_diskmgr_t *create_with_interfaces(
+        linux_event_queue_t *queue,
+        passive_producer_t<action_t *> *source,
+        int max_concurrent_io_requests,
+        const std::vector<kernel_io_interface_t> &interfaces);
+
+    void on_source_availability_changed();
+    void on_event(int events);
+
+    void pump();
+    // Prepares the next kernel request for `op`, or finishes the action if there
+    // is nothing left to do.
+    void advance(op_t *op);
+    void on_request_complete(op_t *op, int64_t result);
+    void finish(op_t *op);
+
+    void submit_datasync(op_t *op);
+    void submit_next_chunk(op_t *op);
+
+    linux_event_queue_t *const queue;
+    passive_producer_t<action_t *> *const source;
+    // Signalled by the kernel whenever a request completes.  It has to exist
+    // before `kernel_queue` is set up, and outlive it.
+    const scoped_ptr_t<system_event_t> completion_event;
+    const scoped_ptr_t<kernel_io_queue_t> kernel_queue;
+
+    // Only used if the kernel interface can't do datasyncs by itself.
+    scoped_ptr_t<blocker_pool_t> datasync_pool;
+
+    // One slot per request that can be in flight at the same time.  Each action
+    // has at most one kernel request outstanding at any moment.
+    scoped_array_t<op_t> ops;
+    std::vector<op_t *> free_ops;
+
+    DISABLE_COPYING(aio_diskmgr_t);
+};
+
+#endif /* ARCH_IO_DISK_AIO_HPP_ */
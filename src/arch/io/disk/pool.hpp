@@ -88,6 +88,7 @@ struct pool_diskmgr_action_t
 
 private:
     friend class pool_diskmgr_t;
+    friend class aio_diskmgr_t;
     pool_diskmgr_t *parent;
 
     bool is_read;
@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <ifaddrs.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -105,6 +106,11 @@ public:
     pipe and throws `tcp_conn_write_closed_exc_t`. */
     void write(const void *buf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
 
+    /* writev() is like write(), but gathers the data from several buffers, so
+    that they can go out in one system call without being copied together
+    first. */
+    void writev(const struct iovec *iov, size_t iovcnt, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
     /* write_buffered() is like write(), but it might not send the data until
     flush_buffer*() or write() is called. Internally, it bundles together the
     buffered writes; this may improve performance. */
@@ -112,6 +118,17 @@ public:
 
     void writef(signal_t *closer, const char *format, ...) THROWS_ONLY(tcp_conn_write_closed_exc_t) __attribute__ ((format (printf, 3, 4)));
 
+    /* These let you serialize straight into the write buffer instead of copying in
+    a serialized buffer with write_buffered(); they work like the `Next()` and
+    `BackUp()` methods of protobuf's `ZeroCopyOutputStream`.
+    get_write_buffer_space() hands out the free space at the end of the current
+    write buffer (flushing it first if it's full) and counts all of it as
+    written. back_up_write_buffer() gives back the last `count` bytes of what it
+    handed out, if they weren't used. As with write_buffered(), nothing gets sent
+    until the buffer fills up or gets flushed. */
+    void get_write_buffer_space(char **buf_out, size_t *size_out, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+    void back_up_write_buffer(size_t count);
+
     void flush_buffer(signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);   // Blocks until flush is done
     void flush_buffer_eventually(signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);   // Blocks only if the queue is backed up
 
@@ -244,6 +261,9 @@ private:
         write_buffer_t *dealloc;
         const void *buffer;
         size_t size;
+        /* Only used by writev(), in which case `buffer` is NULL. */
+        struct iovec *iov;
+        size_t iovcnt;
         cond_t *cond;
         auto_drainer_t::lock_t keepalive;
     };
@@ -302,6 +322,10 @@ private:
     `size` bytes from `buffer` to the socket. */
     void perform_write(const void *buffer, size_t size);
 
+    /* Like `perform_write()`, for the `iovcnt` buffers in `iov`. Modifies `iov` as
+    it goes. */
+    void perform_writev(struct iovec *iov, size_t iovcnt);
+
     scoped_ptr_t<auto_drainer_t> drainer;
 };
 
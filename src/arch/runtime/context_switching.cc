@@ -5,6 +5,8 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <vector>
+
 #ifndef NDEBUG
 #include <cxxabi.h>   // For __cxa_current_exception_type (see below)
 #endif
@@ -16,9 +18,12 @@
 #include "arch/runtime/thread_pool.hpp"
 #include "arch/runtime/coroutines.hpp"
 #include "arch/io/concurrency.hpp"
+#include "config/args.hpp"
+#include "containers/intrusive_list.hpp"
 #include "containers/scoped.hpp"
 #include "errors.hpp"
 #include "math.hpp"
+#include "thread_local.hpp"
 #include "utils.hpp"
 
 /* We have a custom implementation of `swapcontext()` that doesn't swap the
@@ -38,14 +43,127 @@ bool artificial_stack_context_ref_t::is_nil() {
     return pointer == NULL;
 }
 
+/* Coroutine stacks are carved out of memory mappings that hold
+`COROUTINE_STACKS_PER_MAPPING` stacks each, so that setting up a stack doesn't take
+any system calls. The kernel only backs the pages of a mapping that have been
+touched, so a stack only takes up as much memory as it has actually used. The
+first page of every stack is protected when the mapping is created, so that we
+crash when we get a stack overflow instead of corrupting memory. */
+class coro_stack_mapping_t : public intrusive_list_node_t<coro_stack_mapping_t> {
+public:
+    explicit coro_stack_mapping_t(size_t _slot_size) : slot_size(_slot_size) {
+        void *res = mmap(NULL, slot_size * COROUTINE_STACKS_PER_MAPPING,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE,
+                         -1, 0);
+        guarantee_err(res != MAP_FAILED, "Could not map memory for coroutine stacks");
+        base = static_cast<char *>(res);
+        // We hand out the slots in ascending order.
+        for (int i = COROUTINE_STACKS_PER_MAPPING - 1; i >= 0; --i) {
+            int protect_res = mprotect(base + i * slot_size, getpagesize(), PROT_NONE);
+            guarantee_err(protect_res == 0, "Could not protect a coroutine stack");
+            free_slots.push_back(i);
+        }
+    }
+
+    ~coro_stack_mapping_t() {
+        rassert(is_unused());
+        int res = munmap(base, slot_size * COROUTINE_STACKS_PER_MAPPING);
+        guarantee_err(res == 0, "Could not unmap coroutine stacks");
+    }
+
+    void *allocate() {
+        rassert(!free_slots.empty());
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        return base + slot * slot_size;
+    }
+
+    void release(void *stack) {
+        char *slot_start = static_cast<char *>(stack);
+        rassert(slot_start >= base
+                && slot_start < base + slot_size * COROUTINE_STACKS_PER_MAPPING);
+        /* Give everything but the guard page and the topmost page back to the OS.
+        The next stack in this slot will touch the topmost page right away. */
+        const size_t page_size = getpagesize();
+        if (slot_size > 2 * page_size) {
+            madvise(slot_start + page_size, slot_size - 2 * page_size, MADV_DONTNEED);
+        }
+        free_slots.push_back((slot_start - base) / slot_size);
+    }
+
+    bool has_free_slots() const { return !free_slots.empty(); }
+    bool is_unused() const { return free_slots.size() == COROUTINE_STACKS_PER_MAPPING; }
+
+    const size_t slot_size;
+
+private:
+    char *base;
+    std::vector<int> free_slots;
+
+    DISABLE_COPYING(coro_stack_mapping_t);
+};
+
+/* There is one `coro_stack_pool_t` per thread. It gets created along with the
+thread's first stack, and lives until `destroy_coro_stack_pool()` gets called, even
+while the thread has no stacks. */
+class coro_stack_pool_t {
+public:
+    coro_stack_pool_t() : num_stacks(0) { }
+
+    ~coro_stack_pool_t() {
+        rassert(num_stacks == 0);
+        while (coro_stack_mapping_t *mapping = mappings.head()) {
+            mappings.remove(mapping);
+            delete mapping;
+        }
+    }
+
+    void *allocate(size_t stack_size, coro_stack_mapping_t **mapping_out) {
+        const size_t slot_size = ceil_aligned(stack_size, getpagesize());
+        coro_stack_mapping_t *mapping = mappings.head();
+        while (mapping != NULL
+               && (mapping->slot_size != slot_size || !mapping->has_free_slots())) {
+            mapping = mappings.next(mapping);
+        }
+        if (mapping == NULL) {
+            mapping = new coro_stack_mapping_t(slot_size);
+            mappings.push_front(mapping);
+        }
+        ++num_stacks;
+        *mapping_out = mapping;
+        return mapping->allocate();
+    }
+
+    void release(coro_stack_mapping_t *mapping, void *stack) {
+        rassert(num_stacks > 0);
+        --num_stacks;
+        mapping->release(stack);
+        /* We keep one mapping around even if it's unused, so that a thread that
+        keeps creating and destroying a single stack doesn't map memory each time. */
+        if (mapping->is_unused() && mappings.size() > 1) {
+            mappings.remove(mapping);
+            delete mapping;
+        }
+    }
+
+    bool empty() const { return num_stacks == 0; }
+
+private:
+    intrusive_list_t<coro_stack_mapping_t> mappings;
+    size_t num_stacks;
+
+    DISABLE_COPYING(coro_stack_pool_t);
+};
+
+TLS_with_init(coro_stack_pool_t *, coro_stack_pool, NULL);
+
 artificial_stack_t::artificial_stack_t(void (*initial_fun)(void), size_t _stack_size)
     : stack_size(_stack_size) {
     /* Allocate the stack */
-    stack = malloc_aligned(stack_size, getpagesize());
-
-    /* Protect the end of the stack so that we crash when we get a stack
-    overflow instead of corrupting memory. */
-    mprotect(stack, getpagesize(), PROT_NONE);
+    if (TLS_get_coro_stack_pool() == NULL) {
+        TLS_set_coro_stack_pool(new coro_stack_pool_t);
+    }
+    stack = TLS_get_coro_stack_pool()->allocate(stack_size, &mapping);
 
     /* Register our stack with Valgrind so that it understands what's going on
     and doesn't create spurious errors */
@@ -135,11 +253,74 @@ artificial_stack_t::~artificial_stack_t() {
 #endif
 #endif
 
-    /* Undo protections changes */
-    mprotect(stack, getpagesize(), PROT_READ | PROT_WRITE);
-
     /* Release the stack we allocated */
-    free(stack);
+    coro_stack_pool_t *pool = TLS_get_coro_stack_pool();
+    guarantee(pool != NULL, "coroutine stack freed on the wrong thread");
+    pool->release(mapping, stack);
+}
+
+void destroy_coro_stack_pool() {
+    coro_stack_pool_t *pool = TLS_get_coro_stack_pool();
+    if (pool != NULL) {
+        guarantee(pool->empty(), "coroutine stacks outlived the coroutine runtime");
+        delete pool;
+        TLS_set_coro_stack_pool(NULL);
+    }
+}
+
+#ifdef __MACH__
+typedef char mincore_vec_t;
+#else
+typedef unsigned char mincore_vec_t;
+#endif
+
+uintptr_t artificial_stack_t::lowest_touched_address() {
+    const uintptr_t page_size = getpagesize();
+    // Everything between the guard page and the top of the stack.
+    const uintptr_t bottom = reinterpret_cast<uintptr_t>(stack) + page_size;
+    const uintptr_t top = ceil_aligned(reinterpret_cast<uintptr_t>(get_stack_base()),
+                                       page_size);
+
+    /* The stack grows downwards, so the lowest page that is resident tells us how
+    deep it has ever gone. */
+    std::vector<mincore_vec_t> resident((top - bottom) / page_size);
+    int res = mincore(reinterpret_cast<void *>(bottom), top - bottom, resident.data());
+    guarantee_err(res == 0, "mincore failed on a coroutine stack");
+    size_t lowest_page = 0;
+    while (lowest_page < resident.size() && (resident[lowest_page] & 1) == 0) {
+        ++lowest_page;
+    }
+    return bottom + lowest_page * page_size;
+}
+
+size_t artificial_stack_t::touched_bytes() {
+    const uintptr_t base = reinterpret_cast<uintptr_t>(get_stack_base());
+    const uintptr_t lowest_touched = lowest_touched_address();
+    return lowest_touched < base ? base - lowest_touched : 0;
+}
+
+size_t artificial_stack_t::release_unused_pages() {
+    rassert(!context.is_nil(), "cannot shrink a running stack");
+
+    const uintptr_t base = reinterpret_cast<uintptr_t>(get_stack_base());
+    const uintptr_t lowest_touched = lowest_touched_address();
+    if (lowest_touched >= base) {
+        return 0;
+    }
+
+    /* Nothing lives below the saved stack pointer, except maybe in the red zone
+    that the x86-64 ABI reserves below it. */
+    const uintptr_t red_zone_size = 128;
+    const uintptr_t page_size = getpagesize();
+    const uintptr_t unused_end =
+        floor_aligned(reinterpret_cast<uintptr_t>(context.pointer) - red_zone_size,
+                      page_size);
+    if (unused_end > lowest_touched) {
+        madvise(reinterpret_cast<void *>(lowest_touched), unused_end - lowest_touched,
+                MADV_DONTNEED);
+    }
+
+    return base - lowest_touched;
 }
 
 bool artificial_stack_t::address_in_stack(void *addr) {
@@ -450,6 +631,14 @@ void *threaded_stack_t::get_stack_bound() {
     return stackaddr;
 }
 
+size_t threaded_stack_t::touched_bytes() {
+    return dummy_stack.touched_bytes();
+}
+
+size_t threaded_stack_t::release_unused_pages() {
+    return dummy_stack.release_unused_pages();
+}
+
 void threaded_stack_t::get_stack_addr_size(void **stackaddr_out,
                                            size_t *stacksize_out) {
 #ifdef __MACH__
@@ -3,6 +3,7 @@
 #define ARCH_RUNTIME_CONTEXT_SWITCHING_HPP_
 
 #include <pthread.h>
+#include <stdint.h>
 
 #include "errors.hpp"
 
@@ -40,6 +41,14 @@ private:
     DISABLE_COPYING(artificial_stack_context_ref_t);
 };
 
+class coro_stack_mapping_t;
+
+/* Artificial stacks come out of a per-thread pool, which keeps a mapping around
+when the thread has no stacks left, so that a thread that keeps creating and
+destroying a single stack doesn't map memory each time. `coro_runtime_t` calls this
+once the thread's coroutines are gone, to unmap what's left. */
+void destroy_coro_stack_pool();
+
 class artificial_stack_t {
 public:
 
@@ -65,9 +74,24 @@ public:
     /* Returns the end of the stack */
     void *get_stack_bound() { return stack; }
 
+    /* Gives the pages below the context's saved stack pointer back to the OS. The
+    context must not be running. Returns how many bytes of the stack have been
+    touched since it was set up or last shrunk. */
+    size_t release_unused_pages();
+
+    /* Returns how many bytes of the stack have been touched since it was set up or
+    last shrunk, without shrinking it. */
+    size_t touched_bytes();
+
 private:
+    /* The address of the lowest resident page of the stack, or the top of the stack
+    if none of it is resident. */
+    uintptr_t lowest_touched_address();
+
     void *stack;
     size_t stack_size;
+    // The mapping that `stack` was carved out of.
+    coro_stack_mapping_t *mapping;
 #ifdef VALGRIND
     int valgrind_stack_id;
 #endif
@@ -174,6 +198,11 @@ public:
     /* Returns the end of the stack */
     void *get_stack_bound();
 
+    /* The thread's stack is managed by pthreads, so this only shrinks the
+    `dummy_stack`. */
+    size_t release_unused_pages();
+    size_t touched_bytes();
+
 private:
     static void *internal_run(void *p);
     void get_stack_addr_size(void **stackaddr_out, size_t *stacksize_out);
@@ -40,9 +40,15 @@ struct coro_globals_t {
     /* The previous context. */
     coro_t *prev_coro;
 
-    /* A list of coro_t objects that are not in use. */
+    /* A list of coro_t objects that are not in use. We take them from the back,
+    so the ones at the front have been unused the longest. */
     intrusive_list_t<coro_t> free_coros;
 
+    /* Once there are more than `COROUTINE_WARM_FREE_LIST_SIZE` coroutines in
+    `free_coros`, the ones at its front have their stacks shrunk and move here.
+    Like `free_coros`, we take them from the back. */
+    intrusive_list_t<coro_t> shrunk_free_coros;
+
 #ifndef NDEBUG
 
     /* An integer counting the number of coros on this thread */
@@ -84,6 +90,10 @@ struct coro_globals_t {
             free_coros.remove(s);
             delete s;
         }
+        while (coro_t *s = shrunk_free_coros.head()) {
+            shrunk_free_coros.remove(s);
+            delete s;
+        }
     }
 
 };
@@ -94,9 +104,14 @@ TLS_with_init(coro_globals_t *, cglobals, NULL);
 // construction depends on coro_t::coroutines_have_been_initialized() which in turn
 // depends on cglobals.
 static perfmon_counter_t pm_active_coroutines, pm_allocated_coroutines;
+// How many bytes of their stacks coroutines have used, measured whenever their
+// stacks are shrunk or freed. That doesn't happen very often, so we look at a whole
+// minute at a time.
+static perfmon_sampler_t pm_coroutine_stack_usage(secs_to_ticks(60), false);
 static perfmon_multi_membership_t pm_coroutines_membership(&get_global_perfmon_collection(),
     &pm_active_coroutines, "active_coroutines",
-    &pm_allocated_coroutines, "allocated_coroutines");
+    &pm_allocated_coroutines, "allocated_coroutines",
+    &pm_coroutine_stack_usage, "coroutine_stack_usage");
 
 coro_runtime_t::coro_runtime_t() {
     rassert(!TLS_get_cglobals(), "coro runtime initialized twice on this thread");
@@ -107,6 +122,7 @@ coro_runtime_t::~coro_runtime_t() {
     rassert(TLS_get_cglobals());
     delete TLS_get_cglobals();
     TLS_set_cglobals(NULL);
+    destroy_coro_stack_pool();
 }
 
 #ifndef NDEBUG
@@ -124,6 +140,7 @@ TLS_with_init(int64_t, coro_selfname_counter, 0);
 
 coro_t::coro_t() :
     stack(&coro_t::run, coro_stack_size),
+    stack_usage_recorded_(false),
     current_thread_(linux_thread_pool_t::get_thread_id()),
     notified_(false),
     waiting_(false)
@@ -149,14 +166,33 @@ coro_t::coro_t() :
 }
 
 void coro_t::return_coro_to_free_list(coro_t *coro) {
-    TLS_get_cglobals()->free_coros.push_back(coro);
+    coro_globals_t *cglobals = TLS_get_cglobals();
+    cglobals->free_coros.push_back(coro);
+
+    /* The coroutine that has been unused the longest is unlikely to be needed
+    again soon, so we give the memory that its stack doesn't need any more back to
+    the OS. `coro` itself may still be running, but it's at the other end of the
+    list. */
+    if (cglobals->free_coros.size() > COROUTINE_WARM_FREE_LIST_SIZE) {
+        coro_t *idle_coro = cglobals->free_coros.head();
+        rassert(idle_coro != coro);
+        cglobals->free_coros.remove(idle_coro);
+        pm_coroutine_stack_usage.record(idle_coro->stack.release_unused_pages());
+        idle_coro->stack_usage_recorded_ = true;
+        cglobals->shrunk_free_coros.push_back(idle_coro);
+    }
 }
 
 void coro_t::maybe_evict_from_free_list() {
     coro_globals_t *cglobals = TLS_get_cglobals();
-    while (cglobals->free_coros.size() > COROUTINE_FREE_LIST_SIZE) {
-        coro_t *coro_to_delete = cglobals->free_coros.tail();
-        cglobals->free_coros.remove(coro_to_delete);
+    while (cglobals->free_coros.size() + cglobals->shrunk_free_coros.size()
+           > COROUTINE_FREE_LIST_SIZE) {
+        // Evict the coroutine that has been unused the longest.
+        intrusive_list_t<coro_t> *free_list = cglobals->shrunk_free_coros.empty()
+            ? &cglobals->free_coros
+            : &cglobals->shrunk_free_coros;
+        coro_t *coro_to_delete = free_list->head();
+        free_list->remove(coro_to_delete);
         delete coro_to_delete;
     }
 }
@@ -165,6 +201,12 @@ coro_t::~coro_t() {
     /* We never move contexts from one thread to another any more. */
     rassert(get_thread_id() == home_thread());
 
+    /* The stack is about to be given back to the OS as a whole, so there's no
+    point in shrinking it first. */
+    if (!stack_usage_recorded_) {
+        pm_coroutine_stack_usage.record(stack.touched_bytes());
+    }
+
 #ifndef NDEBUG
     TLS_get_cglobals()->coro_count--;
 #endif
@@ -377,11 +419,16 @@ coro_t * coro_t::get_coro() {
     rassert(coroutines_have_been_initialized());
     coro_t *coro;
 
-    if (TLS_get_cglobals()->free_coros.size() == 0) {
+    // Prefer coroutines whose stacks are still warm.
+    intrusive_list_t<coro_t> *free_list = !TLS_get_cglobals()->free_coros.empty()
+        ? &TLS_get_cglobals()->free_coros
+        : &TLS_get_cglobals()->shrunk_free_coros;
+    if (free_list->empty()) {
         coro = new coro_t();
     } else {
-        coro = TLS_get_cglobals()->free_coros.tail();
-        TLS_get_cglobals()->free_coros.remove(coro);
+        coro = free_list->tail();
+        free_list->remove(coro);
+        coro->stack_usage_recorded_ = false;
 
         /* We cannot easily delete coroutines at the time where we return
         them to the free list, because coro_t::run() requires the coro_t pointer to remain
@@ -200,6 +200,10 @@ private:
 
     coro_stack_t stack;
 
+    /* Whether the stack's usage has been recorded since the coroutine last ran, so
+    that the destructor doesn't record it a second time. */
+    bool stack_usage_recorded_;
+
     threadnum_t current_thread_;
 
     // Sanity check variables
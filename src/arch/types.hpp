@@ -101,6 +101,13 @@ enum class file_direct_io_mode_t {
     buffered_desired
 };
 
+enum class io_backend_t {
+    // Blocking system calls run in a pool of threads (`pool_diskmgr_t`).
+    pool,
+    // The kernel's asynchronous I/O interface (`aio_diskmgr_t`), if available.
+    native
+};
+
 
 
 class semantic_checking_file_t {
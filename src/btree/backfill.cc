@@ -104,11 +104,10 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
             block_id_t id;
             ids_source->get_block_id_and_bounding_interval(i, &id, &left, &right);
             if (overlaps(left, right, key_range_.left, key_range_.right)) {
-                repli_timestamp_t recency;
-                {
-                    buf_lock_t lock(parent, id, access_t::read);
-                    recency = lock.get_recency();
-                }
+                // Getting the recency this way doesn't load the child, so
+                // subtrees that haven't changed since `since_when_` never get
+                // read from disk.
+                repli_timestamp_t recency = buf_lock_t::get_child_recency(parent, id);
                 if (recency >= since_when_) {
                     cb->receive_interesting_child(i);
                 }
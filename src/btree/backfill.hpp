@@ -15,6 +15,13 @@
 // each not too much larger than this value.
 #define BACKFILL_MAX_KVPAIRS_SIZE (1024 * 512)
 
+// Backfilling a key range traverses up to this many sub-ranges of it at the same
+// time. The sub-ranges are chosen from the split points in the top
+// BACKFILL_SPLIT_DEPTH levels of the B-tree, so that they hold roughly the same
+// number of keys.
+#define BACKFILL_MAX_PARALLEL_RANGES 8
+#define BACKFILL_SPLIT_DEPTH 2
+
 class buf_parent_t;
 class buf_lock_t;
 struct btree_key_t;
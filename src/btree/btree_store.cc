@@ -26,6 +26,8 @@ template <class protocol_t>
 btree_store_t<protocol_t>::btree_store_t(serializer_t *serializer,
                                          const std::string &perfmon_name,
                                          int64_t cache_target,
+                                         const page_cache_config_t &cache_config,
+                                         cache_balancer_t *balancer,
                                          bool create,
                                          perfmon_collection_t *parent_perfmon_collection,
                                          typename protocol_t::context_t *,
@@ -38,8 +40,9 @@ btree_store_t<protocol_t>::btree_store_t(serializer_t *serializer,
 {
     {
         alt_cache_config_t config;
+        config.page_config = cache_config;
         config.page_config.memory_limit = cache_target;
-        cache.init(new cache_t(serializer, config, &perfmon_collection));
+        cache.init(new cache_t(serializer, config, balancer, &perfmon_collection));
         general_cache_conn.init(new cache_conn_t(cache.get()));
     }
 
@@ -455,6 +458,7 @@ void btree_store_t<protocol_t>::set_sindexes(
             clear_sindex(sindex_block->txn(), it->second.superblock,
                          sizer, deleter, interruptor);
             secondary_index_slices.erase(it->first);
+            compiled_sindexes.erase(it->second.id);
         }
     }
 
@@ -541,16 +545,30 @@ MUST_USE bool btree_store_t<protocol_t>::drop_sindex(
         clear_sindex(txn, sindex.superblock,
                      sizer, deleter, interruptor);
         secondary_index_slices.erase(id);
+        compiled_sindexes.erase(sindex.id);
     }
     return true;
 }
 
+template <class protocol_t>
+counted_t<compiled_sindex_t> btree_store_t<protocol_t>::get_compiled_sindex(
+        const secondary_index_t &sindex) {
+    assert_thread();
+    auto it = compiled_sindexes.find(sindex.id);
+    if (it == compiled_sindexes.end()) {
+        it = compiled_sindexes.insert(
+            std::make_pair(sindex.id, protocol_compile_sindex(sindex))).first;
+    }
+    return it->second;
+}
+
 template <class protocol_t>
 MUST_USE bool btree_store_t<protocol_t>::acquire_sindex_superblock_for_read(
         const std::string &id,
         superblock_t *superblock,
         scoped_ptr_t<real_superblock_t> *sindex_sb_out,
-        std::vector<char> *opaque_definition_out)
+        std::vector<char> *opaque_definition_out,
+        bool release_superblock)
     THROWS_ONLY(sindex_not_post_constructed_exc_t) {
     assert_thread();
 
@@ -558,7 +576,9 @@ MUST_USE bool btree_store_t<protocol_t>::acquire_sindex_superblock_for_read(
     buf_lock_t sindex_block
         = acquire_sindex_block_for_read(superblock->expose_buf(),
                                         superblock->get_sindex_block_id());
-    superblock->release();
+    if (release_superblock) {
+        superblock->release();
+    }
 
     /* Figure out what the superblock for this index is. */
     secondary_index_t sindex;
@@ -682,7 +702,8 @@ bool btree_store_t<protocol_t>::acquire_sindex_superblocks_for_write(
                 sindex_block, it->second.superblock, access_t::write);
 
         sindex_sbs_out->push_back(new
-                sindex_access_t(get_sindex_slice(it->first), it->second, new
+                sindex_access_t(get_sindex_slice(it->first), it->second,
+                    get_compiled_sindex(it->second), new
                     real_superblock_t(std::move(superblock_lock))));
     }
 
@@ -714,7 +735,8 @@ bool btree_store_t<protocol_t>::acquire_sindex_superblocks_for_write(
                 sindex_block, it->second.superblock, access_t::write);
 
         sindex_sbs_out->push_back(new
-                sindex_access_t(get_sindex_slice(it->first), it->second, new
+                sindex_access_t(get_sindex_slice(it->first), it->second,
+                    get_compiled_sindex(it->second), new
                     real_superblock_t(std::move(superblock_lock))));
     }
 
@@ -18,6 +18,7 @@
 #include "buffer_cache/types.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/mutex.hpp"
+#include "containers/counted.hpp"
 #include "containers/map_sentries.hpp"
 #include "perfmon/perfmon.hpp"
 #include "protocol_api.hpp"
@@ -26,10 +27,12 @@
 struct rdb_protocol_t;
 template <class T> class btree_store_t;
 class btree_slice_t;
+class cache_balancer_t;
 class cache_conn_t;
 class cache_t;
 class internal_disk_backed_queue_t;
 class io_backender_t;
+class page_cache_config_t;
 class real_superblock_t;
 class superblock_t;
 class txn_t;
@@ -43,14 +46,26 @@ private:
     std::string info;
 };
 
+/* What a protocol compiles a sindex's opaque definition into in order to update
+the sindex.  `btree_store_t` keeps these around by sindex id, so that they aren't
+compiled again for every write. */
+class compiled_sindex_t : public single_threaded_countable_t<compiled_sindex_t> {
+public:
+    virtual ~compiled_sindex_t() { }
+};
+
 template <class protocol_t>
 class btree_store_t : public store_view_t<protocol_t> {
 public:
     using home_thread_mixin_t::assert_thread;
 
+    // The cache gets `cache_config`'s settings, except that its memory limit is
+    // `cache_target`.
     btree_store_t(serializer_t *serializer,
                   const std::string &perfmon_name,
                   int64_t cache_target,
+                  const page_cache_config_t &cache_config,
+                  cache_balancer_t *balancer,
                   bool create,
                   perfmon_collection_t *parent_perfmon_collection,
                   typename protocol_t::context_t *,
@@ -186,9 +201,10 @@ public:
 
     MUST_USE bool acquire_sindex_superblock_for_read(
             const std::string &id,
-            superblock_t *superblock,  // releases this.
+            superblock_t *superblock,  // releases this, if `release_superblock`.
             scoped_ptr_t<real_superblock_t> *sindex_sb_out,
-            std::vector<char> *opaque_definition_out) // Optional, may be NULL
+            std::vector<char> *opaque_definition_out, // Optional, may be NULL
+            bool release_superblock = true)
         THROWS_ONLY(sindex_not_post_constructed_exc_t);
 
     MUST_USE bool acquire_sindex_superblock_for_write(
@@ -199,13 +215,16 @@ public:
 
     struct sindex_access_t {
         sindex_access_t(btree_slice_t *_btree, secondary_index_t _sindex,
+                counted_t<compiled_sindex_t> _compiled,
                 real_superblock_t *_super_block)
-            : btree(_btree), sindex(_sindex),
+            : btree(_btree), sindex(_sindex), compiled(_compiled),
               super_block(_super_block)
         { }
 
         btree_slice_t *btree;
         secondary_index_t sindex;
+        // What `protocol_compile_sindex()` made of `sindex`.
+        counted_t<compiled_sindex_t> compiled;
         scoped_ptr_t<real_superblock_t> super_block;
     };
 
@@ -275,6 +294,12 @@ public:
                                      superblock_t *superblock,
                                      signal_t *interruptor) = 0;
 
+    virtual counted_t<compiled_sindex_t> protocol_compile_sindex(
+            const secondary_index_t &sindex) = 0;
+
+    // Returns the compiled form of `sindex`, compiling it if we haven't yet.
+    counted_t<compiled_sindex_t> get_compiled_sindex(const secondary_index_t &sindex);
+
     void get_metainfo_internal(buf_lock_t *sb_buf,
                                region_map_t<protocol_t, binary_blob_t> *out)
         const THROWS_NOTHING;
@@ -346,6 +371,9 @@ public:
 
     boost::ptr_map<const std::string, btree_slice_t> secondary_index_slices;
 
+    // Entries are removed when their sindex is dropped.
+    std::map<uuid_u, counted_t<compiled_sindex_t> > compiled_sindexes;
+
     std::vector<internal_disk_backed_queue_t *> sindex_queues;
     // KSI: mutex_t is a horrible type.
     mutex_t sindex_queue_mutex;
@@ -0,0 +1,190 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "btree/bulk_load.hpp"
+
+#include "btree/internal_node.hpp"
+#include "btree/leaf_node.hpp"
+#include "btree/operations.hpp"
+#include "btree/slice.hpp"
+
+btree_bulk_loader_t::btree_bulk_loader_t(value_sizer_t<void> *sizer,
+                                         superblock_t *superblock,
+                                         repli_timestamp_t tstamp,
+                                         btree_stats_t *stats)
+    : sizer_(sizer), superblock_(superblock), tstamp_(tstamp), stats_(stats),
+      num_pairs_(0), finished_(false) {
+    guarantee(superblock_->get_root_block_id() == NULL_BLOCK_ID,
+              "Only an empty btree can be bulk loaded.");
+}
+
+btree_bulk_loader_t::~btree_bulk_loader_t() {
+    rassert(finished_ || num_pairs_ == 0);
+}
+
+buf_parent_t btree_bulk_loader_t::expose_leaf() {
+    guarantee(!finished_);
+    if (leaf_.empty()) {
+        start_leaf();
+    }
+    return buf_parent_t(&leaf_);
+}
+
+void btree_bulk_loader_t::add(const btree_key_t *key, const void *value) {
+    guarantee(!finished_);
+    if (leaf_.empty()) {
+        start_leaf();
+    } else {
+        rassert(num_pairs_ == 0 || btree_key_cmp(last_key_.btree_key(), key) < 0,
+                "Keys must be bulk loaded in increasing order.");
+        bool full;
+        {
+            buf_read_t read(&leaf_);
+            full = leaf::is_full(sizer_,
+                                 static_cast<const leaf_node_t *>(read.get_data_read()),
+                                 key, value);
+        }
+        if (full) {
+            start_leaf();
+        }
+    }
+
+    {
+        buf_write_t write(&leaf_);
+        leaf::insert(sizer_,
+                     static_cast<leaf_node_t *>(write.get_data_write()),
+                     key, value, tstamp_,
+                     key_modification_proof_t::real_proof());
+    }
+    last_key_.assign(key);
+    ++num_pairs_;
+    if (stats_ != NULL) {
+        stats_->pm_keys_set.record();
+    }
+}
+
+void btree_bulk_loader_t::finish() {
+    guarantee(!finished_);
+    finished_ = true;
+
+    leaf_.reset_buf_lock();
+    for (auto it = levels_.begin(); it != levels_.end(); ++it) {
+        it->node.reset_buf_lock();
+    }
+
+    if (num_pairs_ == 0) {
+        return;
+    }
+
+    // Every level but the top one has a node, so the top level's lone child is the
+    // root.
+    rassert(!levels_.empty() && levels_.back().node.empty());
+    guarantee(levels_.back().lone_child != NULL_BLOCK_ID);
+    insert_root(levels_.back().lone_child, superblock_);
+
+    ensure_stat_block(superblock_);
+    buf_lock_t stat_block(buf_parent_t(superblock_->expose_buf().txn()),
+                          superblock_->get_stat_block_id(), access_t::write);
+    buf_write_t stat_block_write(&stat_block);
+    auto stat_block_buf
+        = static_cast<btree_statblock_t *>(stat_block_write.get_data_write());
+    stat_block_buf->population += num_pairs_;
+}
+
+void btree_bulk_loader_t::start_leaf() {
+    const bool first_leaf = levels_.empty();
+
+    buf_lock_t new_leaf(superblock_->expose_buf(), alt_create_t::create);
+    {
+        buf_write_t write(&new_leaf);
+        leaf::init(sizer_, static_cast<leaf_node_t *>(write.get_data_write()));
+    }
+    append_child(0, new_leaf.block_id(),
+                 first_leaf ? NULL : last_key_.btree_key());
+    leaf_ = std::move(new_leaf);
+}
+
+void btree_bulk_loader_t::append_child(size_t level,
+                                       block_id_t child,
+                                       const btree_key_t *separator) {
+    if (level == levels_.size()) {
+        levels_.push_back(level_t());
+    }
+
+    if (separator == NULL) {
+        // This is the leftmost node on the level below.
+        rassert(levels_[level].node.empty()
+                && levels_[level].lone_child == NULL_BLOCK_ID);
+        levels_[level].lone_child = child;
+        return;
+    }
+
+    const block_size_t block_size = sizer_->block_size();
+
+    if (levels_[level].node.empty()) {
+        // The lone child finally gets a sibling; put both of them into the first
+        // node on this level.
+        rassert(levels_[level].lone_child != NULL_BLOCK_ID);
+        buf_lock_t node(superblock_->expose_buf(), alt_create_t::create);
+        {
+            buf_write_t write(&node);
+            auto node_data = static_cast<internal_node_t *>(write.get_data_write());
+            internal_node::init(block_size, node_data);
+            DEBUG_VAR bool success = internal_node::insert(
+                block_size, node_data, separator, levels_[level].lone_child, child);
+            rassert(success);
+        }
+        levels_[level].lone_child = NULL_BLOCK_ID;
+        levels_[level].node = std::move(node);
+        append_child(level + 1, levels_[level].node.block_id(), NULL);
+        return;
+    }
+
+    bool full;
+    {
+        buf_read_t read(&levels_[level].node);
+        full = internal_node::is_full(
+            static_cast<const internal_node_t *>(read.get_data_read()));
+    }
+
+    if (!full) {
+        buf_write_t write(&levels_[level].node);
+        auto node_data = static_cast<internal_node_t *>(write.get_data_write());
+        const block_id_t last_child
+            = internal_node::get_pair_by_index(node_data, node_data->npairs - 1)->lnode;
+        DEBUG_VAR bool success = internal_node::insert(
+            block_size, node_data, separator, last_child, child);
+        rassert(success);
+        return;
+    }
+
+    // The node is full. Rather than starting its right sibling with `child` alone,
+    // we move the full node's last child over as well, so that no node ends up
+    // with a single child. The key in front of that child becomes the separator
+    // between the two nodes.
+    store_key_t sibling_separator;
+    block_id_t moved_child;
+    {
+        buf_write_t write(&levels_[level].node);
+        auto node_data = static_cast<internal_node_t *>(write.get_data_write());
+        rassert(node_data->npairs >= 2);
+        moved_child
+            = internal_node::get_pair_by_index(node_data, node_data->npairs - 1)->lnode;
+        sibling_separator.assign(
+            &internal_node::get_pair_by_index(node_data, node_data->npairs - 2)->key);
+        // `separator` is greater than every key in the node, so this removes the
+        // last pair and makes the one before it the last.
+        internal_node::remove(block_size, node_data, separator);
+    }
+
+    buf_lock_t sibling(superblock_->expose_buf(), alt_create_t::create);
+    {
+        buf_write_t write(&sibling);
+        auto node_data = static_cast<internal_node_t *>(write.get_data_write());
+        internal_node::init(block_size, node_data);
+        DEBUG_VAR bool success = internal_node::insert(
+            block_size, node_data, separator, moved_child, child);
+        rassert(success);
+    }
+    levels_[level].node = std::move(sibling);
+    append_child(level + 1, levels_[level].node.block_id(),
+                 sibling_separator.btree_key());
+}
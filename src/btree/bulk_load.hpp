@@ -0,0 +1,78 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef BTREE_BULK_LOAD_HPP_
+#define BTREE_BULK_LOAD_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "btree/keys.hpp"
+#include "btree/node.hpp"
+#include "buffer_cache/alt/alt.hpp"
+#include "repli_timestamp.hpp"
+
+class btree_stats_t;
+class superblock_t;
+
+/* `btree_bulk_loader_t` builds a btree bottom-up out of key/value pairs that
+arrive in strictly increasing key order. Instead of descending from the root for
+every key, it fills one leaf at a time until the next pair doesn't fit, and it
+keeps one open internal node per level to which it appends each finished node.
+The result is a tree in which every node but the rightmost one on each level is
+full.
+
+The btree must be empty when the loader is constructed, and the caller must hold
+the superblock for write until `finish()` returns. */
+class btree_bulk_loader_t {
+public:
+    btree_bulk_loader_t(value_sizer_t<void> *sizer,
+                        superblock_t *superblock,
+                        repli_timestamp_t tstamp,
+                        btree_stats_t *stats);
+    ~btree_bulk_loader_t();
+
+    // The leaf that the next pair will most likely go into. Blobs that the next
+    // value refers to should be created under it.
+    buf_parent_t expose_leaf();
+
+    // Appends a pair. `key` must be greater than every key added before it.
+    void add(const btree_key_t *key, const void *value);
+
+    // Links the top level into the superblock and updates the population in the
+    // stat block. No pairs may be added afterwards.
+    void finish();
+
+    int64_t num_pairs() const { return num_pairs_; }
+
+private:
+    struct level_t {
+        level_t() : lone_child(NULL_BLOCK_ID) { }
+        // The rightmost node on this level, while it can still take children.
+        buf_lock_t node;
+        // The only child on this level, before there is a node to hold it.
+        block_id_t lone_child;
+    };
+
+    void start_leaf();
+
+    // Appends `child` to the rightmost node on level `level`. `separator` is the
+    // greatest key under the child to its left, or NULL if there is none.
+    void append_child(size_t level, block_id_t child, const btree_key_t *separator);
+
+    value_sizer_t<void> *const sizer_;
+    superblock_t *const superblock_;
+    const repli_timestamp_t tstamp_;
+    btree_stats_t *const stats_;
+
+    buf_lock_t leaf_;
+    // The last key that went into `leaf_`.
+    store_key_t last_key_;
+    // `levels_[0]` holds the internal nodes right above the leaves.
+    std::vector<level_t> levels_;
+    int64_t num_pairs_;
+    bool finished_;
+
+    DISABLE_COPYING(btree_bulk_loader_t);
+};
+
+#endif  // BTREE_BULK_LOAD_HPP_
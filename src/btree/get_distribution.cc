@@ -1,6 +1,8 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "btree/get_distribution.hpp"
 
+#include <algorithm>
+
 #include "btree/internal_node.hpp"
 #include "btree/node.hpp"
 #include "btree/leaf_node.hpp"
@@ -97,3 +99,31 @@ void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
     btree_parallel_traversal(superblock, &helper, &non_interruptor);
     *key_count_out = helper.key_count;
 }
+
+void divide_key_range(const key_range_t &range,
+                      const std::vector<store_key_t> &split_keys,
+                      int max_parts,
+                      std::vector<key_range_t> *parts_out) {
+    guarantee(max_parts >= 1);
+    rassert(std::is_sorted(split_keys.begin(), split_keys.end()));
+
+    /* Only keys strictly inside the range make sense as split points. */
+    std::vector<store_key_t> candidates;
+    for (auto it = split_keys.begin(); it != split_keys.end(); ++it) {
+        if (range.contains_key(*it) && range.left < *it
+            && (candidates.empty() || candidates.back() < *it)) {
+            candidates.push_back(*it);
+        }
+    }
+
+    const size_t num_parts = std::min<size_t>(max_parts, candidates.size() + 1);
+    key_range_t part = range;
+    for (size_t i = 1; i < num_parts; ++i) {
+        const store_key_t &split = candidates[i * candidates.size() / num_parts];
+        part.right = key_range_t::right_bound_t(split);
+        parts_out->push_back(part);
+        part.left = split;
+    }
+    part.right = range.right;
+    parts_out->push_back(part);
+}
@@ -13,4 +13,13 @@ void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
                                 int64_t *key_count_out,
                                 std::vector<store_key_t> *keys_out);
 
+/* Splits `range` at up to `max_parts - 1` of the keys in `split_keys`, which
+must be sorted, so that the parts have about as many split keys in them each.
+If `split_keys` came from `get_btree_key_distribution()`, that means that the
+parts have about as many keys in them each. */
+void divide_key_range(const key_range_t &range,
+                      const std::vector<store_key_t> &split_keys,
+                      int max_parts,
+                      std::vector<key_range_t> *parts_out);
+
 #endif /* BTREE_GET_DISTRIBUTION_HPP_ */
@@ -364,6 +364,79 @@ buf_lock_t get_root(value_sizer_t<void> *sizer, superblock_t *sb) {
     }
 }
 
+sorted_point_reader_t::sorted_point_reader_t(value_sizer_t<void> *sizer,
+                                             superblock_t *superblock,
+                                             btree_stats_t *stats)
+    : sizer_(sizer), stats_(stats) {
+    const block_id_t root_id = superblock->get_root_block_id();
+    rassert(root_id != SUPERBLOCK_ID);
+    if (root_id != NULL_BLOCK_ID) {
+        path_.push_back(level_t());
+        path_.back().buf = buf_lock_t(superblock->expose_buf(), root_id,
+                                      access_t::read);
+    }
+    superblock->release();
+}
+
+bool sorted_point_reader_t::lookup(const btree_key_t *key, void *value_out) {
+    stats_->pm_keys_read.record();
+    if (path_.empty()) {
+        // The tree is empty.
+        return false;
+    }
+
+    // Climb up until we're in a subtree that can contain the key. The root can
+    // contain any key.
+    while ((path_.back().right_bound_is_inclusive
+            && btree_key_cmp(key, path_.back().right_bound.btree_key()) > 0)
+           || (path_.back().has_left_bound
+               && btree_key_cmp(key, path_.back().left_bound.btree_key()) <= 0)) {
+        path_.pop_back();
+    }
+
+    for (;;) {
+        level_t child;
+        block_id_t child_id;
+        {
+            buf_read_t read(&path_.back().buf);
+            const node_t *node = static_cast<const node_t *>(read.get_data_read());
+            if (!node::is_internal(node)) {
+                return leaf::lookup(sizer_, reinterpret_cast<const leaf_node_t *>(node),
+                                    key, value_out);
+            }
+            const internal_node_t *internal
+                = reinterpret_cast<const internal_node_t *>(node);
+            const int index = internal_node::get_offset_index(internal, key);
+            const btree_internal_pair *pair
+                = internal_node::get_pair_by_index(internal, index);
+            child_id = pair->lnode;
+            if (index == 0) {
+                child.has_left_bound = path_.back().has_left_bound;
+                child.left_bound = path_.back().left_bound;
+            } else {
+                child.has_left_bound = true;
+                child.left_bound.assign(
+                    &internal_node::get_pair_by_index(internal, index - 1)->key);
+            }
+            if (index == internal->npairs - 1) {
+                child.right_bound_is_inclusive = path_.back().right_bound_is_inclusive;
+                child.right_bound = path_.back().right_bound;
+            } else {
+                child.right_bound_is_inclusive = true;
+                child.right_bound.assign(&pair->key);
+            }
+        }
+        rassert(child_id != NULL_BLOCK_ID && child_id != SUPERBLOCK_ID);
+        child.buf = buf_lock_t(&path_.back().buf, child_id, access_t::read);
+        path_.push_back(std::move(child));
+    }
+}
+
+buf_parent_t sorted_point_reader_t::expose_leaf() {
+    guarantee(!path_.empty());
+    return buf_parent_t(&path_.back().buf);
+}
+
 // Split the node if necessary. If the node is a leaf_node, provide the new
 // value that will be inserted; if it's an internal node, provide NULL (we
 // split internal nodes proactively).
@@ -158,6 +158,46 @@ class null_key_modification_callback_t : public key_modification_callback_t<Valu
 };
 
 
+/* `sorted_point_reader_t` looks up a series of keys, ideally in increasing order.
+Instead of descending from the root for every key, it keeps the path to the last
+leaf it visited locked, and only climbs back up as far as the next key requires. */
+class sorted_point_reader_t {
+public:
+    // Acquires the root and releases the superblock.
+    sorted_point_reader_t(value_sizer_t<void> *sizer, superblock_t *superblock,
+                          btree_stats_t *stats);
+
+    // Copies the value for `key` into `value_out`, which must have room for
+    // `sizer->max_possible_size()` bytes, and returns true if there is one. Keys
+    // that are greater than the one before them are the cheapest to look up.
+    bool lookup(const btree_key_t *key, void *value_out);
+
+    // The leaf that the last successful `lookup()` found its value in.
+    buf_parent_t expose_leaf();
+
+private:
+    struct level_t {
+        level_t() : has_left_bound(false), right_bound_is_inclusive(false) { }
+        buf_lock_t buf;
+        // The node only contains keys greater than this, unless it is the leftmost
+        // node on its level.
+        bool has_left_bound;
+        store_key_t left_bound;
+        // The greatest key the node can contain, unless this is the rightmost node
+        // on its level.
+        bool right_bound_is_inclusive;
+        store_key_t right_bound;
+    };
+
+    value_sizer_t<void> *const sizer_;
+    btree_stats_t *const stats_;
+    // The root comes first, and a leaf last if we have reached one.
+    std::vector<level_t> path_;
+
+    DISABLE_COPYING(sorted_point_reader_t);
+};
+
+
 /* This iterator encapsulates most of the metainfo data layout. Unfortunately,
  * functions set_superblock_metainfo and delete_superblock_metainfo also know a
  * lot about the data layout, so if it's changed, these functions must be
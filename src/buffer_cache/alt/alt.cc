@@ -60,7 +60,8 @@ alt_memory_tracker_t::~alt_memory_tracker_t() { }
 
 void alt_memory_tracker_t::inform_memory_change(UNUSED uint64_t in_memory_size,
                                                 UNUSED uint64_t memory_limit) {
-    // KSI: implement this (for issue 97).
+    // Memory is shared out between caches by cache_balancer_t, which polls the
+    // evicters itself, so nothing has to happen on every change.
 }
 
 // KSI: An interface problem here is that this is measured in blocks while
@@ -77,10 +78,12 @@ void alt_memory_tracker_t::end_txn(UNUSED tracker_acq_t acq) {
 }
 
 cache_t::cache_t(serializer_t *serializer, const alt_cache_config_t &config,
+                 cache_balancer_t *balancer,
                  perfmon_collection_t *perfmon_collection)
     : stats_(make_scoped<alt_cache_stats_t>(perfmon_collection)),
       tracker_(),
-      page_cache_(serializer, config.page_config, &tracker_) { }
+      page_cache_(serializer, config.page_config, &tracker_, balancer,
+                  &stats_->cache_collection) { }
 
 cache_t::~cache_t() { }
 
@@ -667,6 +670,33 @@ repli_timestamp_t buf_lock_t::get_recency() const {
     return current_page_acq()->recency();
 }
 
+repli_timestamp_t buf_lock_t::get_child_recency(buf_parent_t parent,
+                                                block_id_t child_id) {
+    buf_lock_t::wait_for_parent(parent, access_t::read);
+    ASSERT_FINITE_CORO_WAITING;
+    if (parent.lock_or_null_ != NULL && parent.lock_or_null_->snapshot_node_ != NULL) {
+        alt_snapshot_node_t *parent_node = parent.lock_or_null_->snapshot_node_;
+        auto it = parent_node->children_.find(child_id);
+        if (it != parent_node->children_.end()) {
+            // The child has been acquired for write since the snapshot was taken,
+            // so the snapshotted version is the one in the child snapshot node.
+            guarantee(it->second != NULL,
+                      "Tried to get the recency of a deleted block (%" PRIu64
+                      " as child of %" PRIu64 ").",
+                      child_id, parent.lock_or_null_->block_id());
+            return it->second->current_page_acq_->recency();
+        }
+        // Otherwise the current version of the child is the snapshotted one.  We
+        // don't go through get_or_create_child_snapshot_node, because snapshotting
+        // the child would load it.
+    }
+
+    cache_t *cache = parent.txn()->cache();
+    current_page_acq_t acq(&cache->page_cache_, child_id, parent.txn()->account(),
+                           read_access_t::read);
+    return acq.recency();
+}
+
 page_t *buf_lock_t::get_held_page_for_read() {
     guarantee(!empty());
     current_page_acq_t *cpa = current_page_acq();
@@ -700,12 +730,13 @@ buf_read_t::~buf_read_t() {
 }
 
 const void *buf_read_t::get_data_read(uint32_t *block_size_out) {
-    page_t *page = lock_->get_held_page_for_read();
     if (!page_acq_.has()) {
+        block_pm_histogram acquisition(&lock_->cache()->stats_->pm_block_acquisition);
+        page_t *page = lock_->get_held_page_for_read();
         page_acq_.init(page, &lock_->cache()->page_cache_,
                        lock_->txn()->account());
+        page_acq_.buf_ready_signal()->wait();
     }
-    page_acq_.buf_ready_signal()->wait();
     *block_size_out = page_acq_.get_buf_size();
     return page_acq_.get_buf_read();
 }
@@ -724,12 +755,13 @@ buf_write_t::~buf_write_t() {
 void *buf_write_t::get_data_write(uint32_t block_size) {
     // KSI: Use block_size somehow.
     (void)block_size;
-    page_t *page = lock_->get_held_page_for_write();
     if (!page_acq_.has()) {
+        block_pm_histogram acquisition(&lock_->cache()->stats_->pm_block_acquisition);
+        page_t *page = lock_->get_held_page_for_write();
         page_acq_.init(page, &lock_->cache()->page_cache_,
                        lock_->txn()->account());
+        page_acq_.buf_ready_signal()->wait();
     }
-    page_acq_.buf_ready_signal()->wait();
     return page_acq_.get_buf_write();
 }
 
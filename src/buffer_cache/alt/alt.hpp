@@ -41,9 +41,12 @@ private:
 
 class cache_t : public home_thread_mixin_t {
 public:
-    explicit cache_t(serializer_t *serializer,
-                     const alt_cache_config_t &dynamic_config,
-                     perfmon_collection_t *perfmon_collection);
+    // balancer may be NULL, in which case the cache keeps its configured memory
+    // limit.
+    cache_t(serializer_t *serializer,
+            const alt_cache_config_t &dynamic_config,
+            cache_balancer_t *balancer,
+            perfmon_collection_t *perfmon_collection);
     ~cache_t();
 
     block_size_t max_block_size() const;
@@ -69,6 +72,8 @@ private:
     void add_snapshot_node(block_id_t block_id, alt_snapshot_node_t *node);
     void remove_snapshot_node(block_id_t block_id, alt_snapshot_node_t *node);
 
+    // The page cache registers its own perfmons in stats_->cache_collection, so
+    // stats_ comes before it.
     scoped_ptr_t<alt_cache_stats_t> stats_;
 
     // tracker_ is used for throttling (which can cause the txn_t constructor to
@@ -203,6 +208,12 @@ public:
 
     repli_timestamp_t get_recency() const;
 
+    // Returns what `buf_lock_t(parent, child_id, access_t::read).get_recency()`
+    // would return.  Unlike acquiring the child, this never loads the child's page,
+    // not even when the parent is snapshotted.
+    static repli_timestamp_t get_child_recency(buf_parent_t parent,
+                                               block_id_t child_id);
+
     access_t access() const {
         guarantee(!empty());
         return current_page_acq()->access();
@@ -106,6 +106,10 @@ int ref_size(block_size_t block_size, const char *ref, int maxreflen);
 // data_length).
 bool ref_fits(block_size_t block_size, int data_length, const char *ref, int maxreflen);
 
+// Returns true if a blob of `proposed_size` bytes would be stored entirely in its
+// ref.
+bool size_would_be_small(int64_t proposed_size, int maxreflen);
+
 // Returns what the maxreflen would be, given the desired number of
 // block ids in the blob ref.
 int maxreflen_from_blockid_count(int count);
@@ -0,0 +1,127 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "buffer_cache/alt/cache_balancer.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include "arch/runtime/coroutines.hpp"
+#include "buffer_cache/alt/evicter.hpp"
+#include "concurrency/pmap.hpp"
+#include "utils.hpp"
+
+// How often the budget gets redistributed.
+static const int64_t CACHE_BALANCER_INTERVAL_MS = 1000;
+
+// Every evicter keeps at least this fraction of its configured memory limit, however
+// idle it is.
+static const uint64_t CACHE_BALANCER_FLOOR_DIVISOR = 16;
+
+cache_balancer_t::cache_balancer_t()
+    : rebalance_in_progress_(false),
+      rebalance_timer_(CACHE_BALANCER_INTERVAL_MS, this) { }
+
+cache_balancer_t::~cache_balancer_t() {
+    assert_thread();
+}
+
+void cache_balancer_t::add_evicter(alt::evicter_t *evicter) {
+    auto res = evicters_.get()->insert(evicter);
+    guarantee(res.second);
+}
+
+void cache_balancer_t::remove_evicter(alt::evicter_t *evicter) {
+    size_t num_erased = evicters_.get()->erase(evicter);
+    guarantee(num_erased == 1);
+}
+
+void cache_balancer_t::on_ring() {
+    assert_thread();
+    if (!rebalance_in_progress_) {
+        rebalance_in_progress_ = true;
+        coro_t::spawn_sometime(std::bind(&cache_balancer_t::rebalance,
+                                         this, drainer_.lock()));
+    }
+}
+
+void cache_balancer_t::rebalance(UNUSED auto_drainer_t::lock_t lock) {
+    assert_thread();
+    std::vector<std::vector<evicter_info_t> > infos(get_num_threads());
+
+    pmap(get_num_threads(), std::bind(&cache_balancer_t::collect_from_thread,
+                                      this, ph::_1, &infos));
+    compute_new_limits(&infos);
+    pmap(get_num_threads(), std::bind(&cache_balancer_t::apply_to_thread,
+                                      this, ph::_1, &infos));
+
+    rebalance_in_progress_ = false;
+}
+
+void cache_balancer_t::collect_from_thread(
+        int thread, std::vector<std::vector<evicter_info_t> > *infos) {
+    on_thread_t th((threadnum_t(thread)));
+    const std::set<alt::evicter_t *> *evicters = evicters_.get();
+    std::vector<evicter_info_t> *thread_infos = &(*infos)[thread];
+    thread_infos->reserve(evicters->size());
+    for (auto it = evicters->begin(); it != evicters->end(); ++it) {
+        evicter_info_t info;
+        info.evicter = *it;
+        info.configured_limit = (*it)->configured_memory_limit();
+        info.in_memory_size = (*it)->in_memory_size();
+        info.bytes_loaded = (*it)->consume_bytes_loaded();
+        info.new_limit = info.configured_limit;
+        thread_infos->push_back(info);
+    }
+}
+
+void cache_balancer_t::apply_to_thread(
+        int thread, const std::vector<std::vector<evicter_info_t> > *infos) {
+    on_thread_t th((threadnum_t(thread)));
+    const std::set<alt::evicter_t *> *evicters = evicters_.get();
+    const std::vector<evicter_info_t> &thread_infos = (*infos)[thread];
+    for (auto it = thread_infos.begin(); it != thread_infos.end(); ++it) {
+        // The evicter might have gone away while we were on other threads.
+        if (evicters->find(it->evicter) != evicters->end()) {
+            it->evicter->update_memory_limit(it->new_limit);
+        }
+    }
+}
+
+void cache_balancer_t::compute_new_limits(
+        std::vector<std::vector<evicter_info_t> > *infos) {
+    // An evicter's demand is what it's holding, plus whatever it had to load from
+    // disk since the last rebalance.  An evicter that loaded nothing and holds less
+    // than its limit doesn't need the rest of its limit.
+    uint64_t budget = 0;
+    uint64_t total_floor = 0;
+    uint64_t total_demand = 0;
+    for (auto t = infos->begin(); t != infos->end(); ++t) {
+        for (auto it = t->begin(); it != t->end(); ++it) {
+            const uint64_t floor = it->configured_limit / CACHE_BALANCER_FLOOR_DIVISOR;
+            budget += it->configured_limit;
+            total_floor += floor;
+            total_demand += std::max(floor, it->in_memory_size + it->bytes_loaded);
+        }
+    }
+
+    if (total_demand == total_floor) {
+        // Nobody holds anything: go back to the configured limits (which is what
+        // collect_from_thread filled in).
+        return;
+    }
+
+    // Everybody gets their floor, and the rest of the budget is split in proportion
+    // to the demand above the floor.  This shrinks everybody proportionally when the
+    // total demand exceeds the budget, and hands out the slack proportionally when
+    // it doesn't.
+    const double scale = static_cast<double>(budget - total_floor)
+        / static_cast<double>(total_demand - total_floor);
+    for (auto t = infos->begin(); t != infos->end(); ++t) {
+        for (auto it = t->begin(); it != t->end(); ++it) {
+            const uint64_t floor = it->configured_limit / CACHE_BALANCER_FLOOR_DIVISOR;
+            const uint64_t demand
+                = std::max(floor, it->in_memory_size + it->bytes_loaded);
+            it->new_limit = floor
+                + static_cast<uint64_t>(scale * static_cast<double>(demand - floor));
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef BUFFER_CACHE_ALT_CACHE_BALANCER_HPP_
+#define BUFFER_CACHE_ALT_CACHE_BALANCER_HPP_
+
+#include <stdint.h>
+
+#include <set>
+#include <vector>
+
+#include "arch/timing.hpp"
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/one_per_thread.hpp"
+#include "threading.hpp"
+
+namespace alt { class evicter_t; }
+namespace unittest { class cache_balancer_tester_t; }
+
+/* The cache balancer shares one memory budget between the caches of every table
+(and every hash shard of every table) on this server.  The budget is the sum of the
+memory limits the evicters were configured with, so the server as a whole doesn't
+use more memory than before, but every so often the budget is redistributed: a
+cache that keeps loading blocks from disk grows, and a cache that isn't using its
+limit shrinks down to what it's actually holding.  Every evicter keeps a small
+floor, so that a table that wakes up after being idle isn't left with nothing.
+
+Evicters register themselves on their own thread (see `evicter_t`), so the
+registry is kept per thread and needs no locking.  The balancer has to outlive
+every evicter registered with it. */
+class cache_balancer_t : public home_thread_mixin_t,
+                         private repeating_timer_callback_t {
+public:
+    cache_balancer_t();
+    ~cache_balancer_t();
+
+private:
+    friend class alt::evicter_t;
+    friend class unittest::cache_balancer_tester_t;
+
+    struct evicter_info_t {
+        alt::evicter_t *evicter;
+        uint64_t configured_limit;
+        uint64_t in_memory_size;
+        uint64_t bytes_loaded;
+        uint64_t new_limit;
+    };
+
+    // Called by evicter_t on the evicter's thread.
+    void add_evicter(alt::evicter_t *evicter);
+    void remove_evicter(alt::evicter_t *evicter);
+
+    void on_ring();
+    void rebalance(auto_drainer_t::lock_t lock);
+
+    void collect_from_thread(int thread,
+                             std::vector<std::vector<evicter_info_t> > *infos);
+    void apply_to_thread(int thread,
+                         const std::vector<std::vector<evicter_info_t> > *infos);
+
+    static void compute_new_limits(std::vector<std::vector<evicter_info_t> > *infos);
+
+    one_per_thread_t<std::set<alt::evicter_t *> > evicters_;
+
+    // Set while a rebalance is running, so that a slow rebalance (one that has to
+    // wait for busy threads) doesn't get a second one piled onto it.
+    bool rebalance_in_progress_;
+
+    auto_drainer_t drainer_;
+
+    // Destroyed first, so that it can't ring while drainer_ is draining.
+    repeating_timer_t rebalance_timer_;
+
+    DISABLE_COPYING(cache_balancer_t);
+};
+
+#endif  // BUFFER_CACHE_ALT_CACHE_BALANCER_HPP_
@@ -10,18 +10,42 @@
 // conform to some aspects of the interface of the mirrored cache, putting off until
 // later whether certain configuration options may be removed.
 
+// How the evicter picks which loaded page to evict.
+enum class cache_eviction_policy_t {
+    // The least recently accessed of a handful of randomly sampled pages.
+    sampled_lru = 0,
+    // A 2Q-style policy: pages enter a probationary queue, and only get into the
+    // protected queue if they get reloaded shortly after having been evicted from
+    // the probationary queue.  A single scan can therefore only flush the
+    // probationary queue, not the hot working set.
+    two_queue = 1
+};
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(cache_eviction_policy_t, int8_t,
+                                      cache_eviction_policy_t::sampled_lru,
+                                      cache_eviction_policy_t::two_queue);
+
 class page_cache_config_t {
 public:
     page_cache_config_t()
         : io_priority_reads(CACHE_READS_IO_PRIORITY),
           io_priority_writes(CACHE_WRITES_IO_PRIORITY),
-          memory_limit(GIGABYTE) { }
+          memory_limit(GIGABYTE),
+          eviction_policy(cache_eviction_policy_t::sampled_lru),
+          flush_group_window_ms(DEFAULT_FLUSH_GROUP_WINDOW_MS),
+          flush_group_max_bytes(DEFAULT_FLUSH_GROUP_MAX_BYTES) { }
 
     int32_t io_priority_reads;
     int32_t io_priority_writes;
     uint64_t memory_limit;
+    cache_eviction_policy_t eviction_policy;
+    // See DEFAULT_FLUSH_GROUP_WINDOW_MS.
+    int64_t flush_group_window_ms;
+    uint64_t flush_group_max_bytes;
 
-    RDB_MAKE_ME_SERIALIZABLE_3(io_priority_reads, io_priority_writes, memory_limit);
+    RDB_MAKE_ME_SERIALIZABLE_6(io_priority_reads, io_priority_writes, memory_limit,
+                               eviction_policy, flush_group_window_ms,
+                               flush_group_max_bytes);
 };
 
 class alt_cache_config_t {
@@ -1,15 +1,47 @@
 #include "buffer_cache/alt/evicter.hpp"
 
+#include "buffer_cache/alt/cache_balancer.hpp"
 #include "buffer_cache/alt/page.hpp"
 
 namespace alt {
 
-evicter_t::evicter_t(memory_tracker_t *tracker, uint64_t memory_limit)
-    : tracker_(tracker), memory_limit_(memory_limit),
-      access_time_counter_(INITIAL_ACCESS_TIME) { }
+// With the two_queue policy, we evict from the probationary queue (instead of the
+// protected queue) as long as it takes more than this fraction of the memory limit.
+static const uint64_t TWO_QUEUE_PROBATIONARY_SHARE_DIVISOR = 4;
+
+// With the two_queue policy, a page reloaded after being evicted from the
+// probationary queue is a "ghost hit" (and gets promoted to the protected queue) if
+// fewer bytes than this fraction of the memory limit have been evicted from the
+// probationary queue since.  This plays the role of 2Q's A1out list, without keeping
+// a separate list: evicted pages stay around (in evicted_) anyway, so we just stamp
+// them.
+static const uint64_t TWO_QUEUE_GHOST_WINDOW_DIVISOR = 2;
+
+evicter_t::evicter_t(memory_tracker_t *tracker, cache_balancer_t *balancer,
+                     uint64_t memory_limit, cache_eviction_policy_t policy,
+                     perfmon_collection_t *perfmon_collection)
+    : tracker_(tracker), balancer_(balancer),
+      configured_memory_limit_(memory_limit),
+      memory_limit_(memory_limit),
+      bytes_loaded_(0),
+      policy_(policy),
+      access_time_counter_(INITIAL_ACCESS_TIME),
+      probationary_evicted_bytes_(0),
+      pm_membership_(perfmon_collection,
+                     &pm_hits_, "hits",
+                     &pm_misses_, "misses",
+                     &pm_ghost_hits_, "ghost_hits",
+                     &pm_evictions_, "evictions") {
+    if (balancer_ != NULL) {
+        balancer_->add_evicter(this);
+    }
+}
 
 evicter_t::~evicter_t() {
     assert_thread();
+    if (balancer_ != NULL) {
+        balancer_->remove_evicter(this);
+    }
 }
 
 
@@ -22,6 +54,7 @@ void evicter_t::add_not_yet_loaded(page_t *page) {
 void evicter_t::add_now_loaded_size(uint32_t ser_buf_size) {
     assert_thread();
     unevictable_.add_size(ser_buf_size);
+    bytes_loaded_ += ser_buf_size;
     inform_tracker();
     evict_if_necessary();
 }
@@ -51,6 +84,7 @@ void evicter_t::move_unevictable_to_evictable(page_t *page) {
     unevictable_.remove(page, page->ser_buf_size_);
     eviction_bag_t *new_bag = correct_eviction_category(page);
     rassert(new_bag == &evictable_disk_backed_
+            || new_bag == &evictable_protected_
             || new_bag == &evictable_unbacked_);
     new_bag->add(page, page->ser_buf_size_);
     inform_tracker();
@@ -75,7 +109,9 @@ eviction_bag_t *evicter_t::correct_eviction_category(page_t *page) {
     } else if (!page->buf_.has()) {
         return &evicted_;
     } else if (page->block_token_.has()) {
-        return &evictable_disk_backed_;
+        return page->eviction_protected_
+            ? &evictable_protected_
+            : &evictable_disk_backed_;
     } else {
         return &evictable_unbacked_;
     }
@@ -95,9 +131,49 @@ uint64_t evicter_t::in_memory_size() const {
     assert_thread();
     return unevictable_.size()
         + evictable_disk_backed_.size()
+        + evictable_protected_.size()
         + evictable_unbacked_.size();
 }
 
+void evicter_t::note_hit() {
+    assert_thread();
+    ++pm_hits_;
+}
+
+void evicter_t::note_miss() {
+    assert_thread();
+    ++pm_misses_;
+}
+
+void evicter_t::note_reload(page_t *page) {
+    assert_thread();
+    ++pm_misses_;
+    bytes_loaded_ += page->ser_buf_size_;
+    if (page->ghost_stamp_ != 0) {
+        rassert(policy_ == cache_eviction_policy_t::two_queue);
+        if (probationary_evicted_bytes_ - page->ghost_stamp_
+            < memory_limit_ / TWO_QUEUE_GHOST_WINDOW_DIVISOR) {
+            ++pm_ghost_hits_;
+            page->eviction_protected_ = true;
+        }
+        page->ghost_stamp_ = 0;
+    }
+}
+
+uint64_t evicter_t::consume_bytes_loaded() {
+    assert_thread();
+    const uint64_t ret = bytes_loaded_;
+    bytes_loaded_ = 0;
+    return ret;
+}
+
+void evicter_t::update_memory_limit(uint64_t new_memory_limit) {
+    assert_thread();
+    memory_limit_ = new_memory_limit;
+    inform_tracker();
+    evict_if_necessary();
+}
+
 bool evicter_t::interested_in_read_ahead_block(uint32_t ser_block_size) const {
     return in_memory_size() + ser_block_size < memory_limit_;
 }
@@ -111,9 +187,40 @@ void evicter_t::evict_if_necessary() {
 
     page_t *page;
     while (in_memory_size() > memory_limit_
-           && evictable_disk_backed_.remove_oldish(&page, access_time_counter_)) {
+           && remove_eviction_victim(&page)) {
         evicted_.add(page, page->ser_buf_size_);
         page->evict_self();
+        ++pm_evictions_;
+    }
+}
+
+bool evicter_t::remove_eviction_victim(page_t **page_out) {
+    switch (policy_) {
+    case cache_eviction_policy_t::sampled_lru:
+        return evictable_disk_backed_.remove_oldish(page_out, access_time_counter_);
+    case cache_eviction_policy_t::two_queue: {
+        // Take from the probationary queue when it's over its share, or when the
+        // protected queue has nothing to give.
+        const bool probationary_first
+            = evictable_disk_backed_.size()
+              > memory_limit_ / TWO_QUEUE_PROBATIONARY_SHARE_DIVISOR
+            || evictable_protected_.size() == 0;
+        if (probationary_first
+            && evictable_disk_backed_.remove_oldish(page_out, access_time_counter_)) {
+            probationary_evicted_bytes_ += (*page_out)->ser_buf_size_;
+            (*page_out)->ghost_stamp_ = probationary_evicted_bytes_;
+            return true;
+        }
+        if (evictable_protected_.remove_oldish(page_out, access_time_counter_)) {
+            // Pages evicted from the protected queue have to prove themselves
+            // again.
+            (*page_out)->eviction_protected_ = false;
+            return true;
+        }
+        return false;
+    }
+    default:
+        unreachable();
     }
 }
 
@@ -3,9 +3,13 @@
 
 #include <stdint.h>
 
+#include "buffer_cache/alt/config.hpp"
 #include "buffer_cache/alt/eviction_bag.hpp"
+#include "perfmon/perfmon.hpp"
 #include "threading.hpp"
 
+class cache_balancer_t;
+
 class memory_tracker_t {
 public:
     virtual ~memory_tracker_t() { }
@@ -27,12 +31,28 @@ public:
     eviction_bag_t *correct_eviction_category(page_t *page);
     void remove_page(page_t *page);
 
-    explicit evicter_t(memory_tracker_t *tracker,
-                       uint64_t memory_limit);
+    // balancer may be NULL, in which case memory_limit never changes.  The
+    // evicter's stats go in perfmon_collection.
+    evicter_t(memory_tracker_t *tracker,
+              cache_balancer_t *balancer,
+              uint64_t memory_limit,
+              cache_eviction_policy_t policy,
+              perfmon_collection_t *perfmon_collection);
     ~evicter_t();
 
     bool interested_in_read_ahead_block(uint32_t ser_block_size) const;
 
+    // Called when a page is acquired and its buf is already loaded (or being
+    // loaded).
+    void note_hit();
+    // Called when a page is acquired and its buf has to be loaded from disk.  Pages
+    // being reloaded after having been evicted go through note_reload instead.
+    void note_miss();
+    // Called when an evicted page is about to be reloaded from disk.  With the
+    // two_queue policy, this decides whether the page was a "ghost" (it was
+    // evicted from the probationary queue recently) and should be promoted.
+    void note_reload(page_t *page);
+
     uint64_t next_access_time() {
         return ++access_time_counter_;
     }
@@ -40,24 +60,57 @@ public:
     static const uint64_t INITIAL_ACCESS_TIME = UINT64_MAX - 100;
 
 private:
+    friend class ::cache_balancer_t;
+
+    uint64_t configured_memory_limit() const { return configured_memory_limit_; }
+    // Returns the number of bytes of pages loaded (or copied) since the last call.
+    uint64_t consume_bytes_loaded();
+    // Called by the balancer to give this evicter a different share of the
+    // server's cache memory.
+    void update_memory_limit(uint64_t new_memory_limit);
+
     void evict_if_necessary();
+    bool remove_eviction_victim(page_t **page_out);
     uint64_t in_memory_size() const;
 
     void inform_tracker() const;
 
-    // LSI: Implement issue 97.
     memory_tracker_t *const tracker_;
+    cache_balancer_t *const balancer_;
+    // The limit this cache was configured with, which is its contribution to the
+    // balancer's budget.  memory_limit_ is the limit currently in effect.
+    const uint64_t configured_memory_limit_;
     uint64_t memory_limit_;
 
+    // Bytes of pages loaded or copied since the balancer last asked.
+    uint64_t bytes_loaded_;
+
+    const cache_eviction_policy_t policy_;
+
     // This gets incremented every time a page is accessed.
     uint64_t access_time_counter_;
 
+    // The total size of pages evicted from evictable_disk_backed_ under the
+    // two_queue policy.  Evicted pages get stamped with this value, so that we
+    // can tell how long ago (in bytes evicted) they left the cache.
+    uint64_t probationary_evicted_bytes_;
+
     // These track whether every page's eviction status.
     eviction_bag_t unevictable_;
+    // With the two_queue policy, this is the probationary queue.
     eviction_bag_t evictable_disk_backed_;
+    // Only used by the two_queue policy: disk-backed pages that proved they
+    // belong to the working set.
+    eviction_bag_t evictable_protected_;
     eviction_bag_t evictable_unbacked_;
     eviction_bag_t evicted_;
 
+    perfmon_counter_t pm_hits_;
+    perfmon_counter_t pm_misses_;
+    perfmon_counter_t pm_ghost_hits_;
+    perfmon_counter_t pm_evictions_;
+    perfmon_multi_membership_t pm_membership_;
+
     DISABLE_COPYING(evicter_t);
 };
 
@@ -18,6 +18,8 @@ page_t::page_t(block_id_t block_id, page_cache_t *page_cache,
     : destroy_ptr_(NULL),
       ser_buf_size_(0),
       access_time_(page_cache->evicter().next_access_time()),
+      eviction_protected_(false),
+      ghost_stamp_(0),
       snapshot_refcount_(0) {
     page_cache->evicter().add_not_yet_loaded(this);
     coro_t::spawn_now_dangerously(std::bind(&page_t::load_with_block_id,
@@ -33,6 +35,8 @@ page_t::page_t(block_size_t block_size, scoped_malloc_t<ser_buffer_t> buf,
       ser_buf_size_(block_size.ser_value()),
       buf_(std::move(buf)),
       access_time_(page_cache->evicter().next_access_time()),
+      eviction_protected_(false),
+      ghost_stamp_(0),
       snapshot_refcount_(0) {
     rassert(buf_.has());
     page_cache->evicter().add_to_evictable_unbacked(this);
@@ -46,6 +50,8 @@ page_t::page_t(scoped_malloc_t<ser_buffer_t> buf,
       buf_(std::move(buf)),
       block_token_(block_token),
       access_time_(READ_AHEAD_ACCESS_TIME),
+      eviction_protected_(false),
+      ghost_stamp_(0),
       snapshot_refcount_(0) {
     rassert(buf_.has());
     page_cache->evicter().add_to_evictable_disk_backed(this);
@@ -55,6 +61,8 @@ page_t::page_t(page_t *copyee, page_cache_t *page_cache, cache_account_t *accoun
     : destroy_ptr_(NULL),
       ser_buf_size_(0),
       access_time_(page_cache->evicter().next_access_time()),
+      eviction_protected_(false),
+      ghost_stamp_(0),
       snapshot_refcount_(0) {
     page_cache->evicter().add_not_yet_loaded(this);
     coro_t::spawn_now_dangerously(std::bind(&page_t::load_from_copyee,
@@ -123,6 +131,7 @@ void page_t::load_with_block_id(page_t *page, block_id_t block_id,
     page->destroy_ptr_ = &page_destroyed;
 
     auto_drainer_t::lock_t lock(page_cache->drainer_.get());
+    page_cache->evicter().note_miss();
 
     scoped_malloc_t<ser_buffer_t> buf;
     counted_t<standard_block_token_t> block_token;
@@ -204,10 +213,13 @@ void page_t::add_waiter(page_acq_t *acq, cache_account_t *account) {
     waiters_.push_back(acq);
     acq->page_cache()->evicter().change_to_correct_eviction_bag(old_bag, this);
     if (buf_.has()) {
+        acq->page_cache()->evicter().note_hit();
         acq->buf_ready_signal_.pulse();
     } else if (destroy_ptr_ != NULL) {
-        // Do nothing, the page is currently being loaded.
+        // Do nothing, the page is currently being loaded.  (Whoever started
+        // loading it already counted a miss.)
     } else if (block_token_.has()) {
+        acq->page_cache()->evicter().note_reload(this);
         coro_t::spawn_now_dangerously(std::bind(&page_t::load_using_block_token,
                                                 this,
                                                 acq->page_cache(),
@@ -76,6 +76,13 @@ private:
 
     uint64_t access_time_;
 
+    // Only used by the two_queue eviction policy.  eviction_protected_ is true if
+    // the page belongs in the evicter's protected queue.  ghost_stamp_ is nonzero if
+    // the page got evicted from the probationary queue, in which case it's the
+    // evicter's probationary_evicted_bytes_ as of that eviction.
+    bool eviction_protected_;
+    uint64_t ghost_stamp_;
+
     // How many page_ptr_t's point at this page, expecting nothing to modify it,
     // other than themselves.
     size_t snapshot_refcount_;
@@ -5,6 +5,7 @@
 #include <stack>
 
 #include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "do_on_thread.hpp"
 #include "serializer/serializer.hpp"
@@ -140,13 +141,21 @@ void page_cache_t::read_ahead_cb_is_destroyed() {
 
 page_cache_t::page_cache_t(serializer_t *serializer,
                            const page_cache_config_t &config,
-                           memory_tracker_t *tracker)
+                           memory_tracker_t *tracker,
+                           cache_balancer_t *balancer,
+                           perfmon_collection_t *perfmon_collection)
     : dynamic_config_(config),
       serializer_(serializer),
       free_list_(serializer),
-      evicter_(tracker, config.memory_limit),
+      evicter_(tracker, balancer, config.memory_limit, config.eviction_policy,
+               perfmon_collection),
+      pending_flush_group_bytes_(0),
+      flushes_in_progress_(0),
+      flush_group_window_running_(false),
       read_ahead_cb_(NULL),
-      drainer_(make_scoped<auto_drainer_t>()) {
+      drainer_(make_scoped<auto_drainer_t>()),
+      pm_flush_groups_membership_(perfmon_collection, &pm_flush_groups_,
+                                  "flush_groups") {
 
     const bool start_read_ahead = config.memory_limit > 0;
     if (start_read_ahead) {
@@ -994,6 +1003,16 @@ page_cache_t::compute_changes(const std::set<page_txn_t *> &txns) {
     return changes;
 }
 
+bool page_cache_t::txn_set_has_changes(const std::set<page_txn_t *> &txns) {
+    for (auto it = txns.begin(); it != txns.end(); ++it) {
+        if (!(*it)->snapshotted_dirtied_pages_.empty()
+            || !(*it)->touched_pages_.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 std::set<page_txn_t *>
 page_cache_t::remove_txn_set_from_graph(page_cache_t *page_cache,
                                         const std::set<page_txn_t *> &txns) {
@@ -1256,7 +1275,15 @@ void page_cache_t::do_flush_txn_set(page_cache_t *page_cache,
     std::set<page_txn_t *> unblocked
         = page_cache_t::remove_txn_set_from_graph(page_cache, txns);
 
+    rassert(page_cache->flushes_in_progress_ > 0);
+    --page_cache->flushes_in_progress_;
+
     page_cache->im_waiting_for_flush(std::move(unblocked));
+
+    // Whatever became ready to flush while we were flushing has waited long enough.
+    if (!page_cache->pending_flush_group_.empty()) {
+        page_cache->spawn_flush_group();
+    }
 }
 
 bool page_cache_t::exists_flushable_txn_set(page_txn_t *txn,
@@ -1331,8 +1358,10 @@ void page_cache_t::im_waiting_for_flush(std::set<page_txn_t *> queue) {
         // (recursively) in one atomic flush.
 
 
-        // LSI: Every transaction is getting its own flush, basically, the way things are
-        // right now.
+        // That flush doesn't necessarily start right away: the set joins the
+        // pending flush group, which gets flushed as a whole (see
+        // maybe_spawn_flush_group).  That's what keeps every transaction from
+        // getting its own index write (and datasync) under concurrent load.
 
         std::set<page_txn_t *> flush_set;
         if (exists_flushable_txn_set(txn, &flush_set)) {
@@ -1341,14 +1370,8 @@ void page_cache_t::im_waiting_for_flush(std::set<page_txn_t *> queue) {
                 (*it)->spawned_flush_ = true;
             }
 
-            std::map<block_id_t, block_change_t> changes
-                = page_cache_t::compute_changes(flush_set);
-
-            if (!changes.empty()) {
-                coro_t::spawn_now_dangerously(std::bind(&page_cache_t::do_flush_txn_set,
-                                                        this,
-                                                        &changes,
-                                                        flush_set));
+            if (txn_set_has_changes(flush_set)) {
+                add_to_flush_group(flush_set);
             } else {
                 // Flush complete.  do_flush_txn_set does this in the write case.
                 std::set<page_txn_t *> unblocked
@@ -1360,6 +1383,80 @@ void page_cache_t::im_waiting_for_flush(std::set<page_txn_t *> queue) {
             }
         }
     }
+
+    maybe_spawn_flush_group();
+}
+
+void page_cache_t::add_to_flush_group(const std::set<page_txn_t *> &flush_set) {
+    assert_thread();
+    for (auto it = flush_set.begin(); it != flush_set.end(); ++it) {
+        page_txn_t *txn = *it;
+        auto res = pending_flush_group_.insert(txn);
+        rassert(res.second);
+        for (size_t i = 0, e = txn->snapshotted_dirtied_pages_.size(); i < e; ++i) {
+            const dirtied_page_t &d = txn->snapshotted_dirtied_pages_[i];
+            if (d.ptr.has()) {
+                pending_flush_group_bytes_ += d.ptr.get_page_for_read()->ser_buf_size_;
+            }
+        }
+    }
+}
+
+void page_cache_t::maybe_spawn_flush_group() {
+    assert_thread();
+    if (pending_flush_group_.empty()) {
+        return;
+    }
+
+    if (pending_flush_group_bytes_ >= dynamic_config_.flush_group_max_bytes) {
+        // Don't let the group grow without bound behind a slow flush.
+        spawn_flush_group();
+    } else if (flushes_in_progress_ == 0) {
+        if (dynamic_config_.flush_group_window_ms <= 0) {
+            spawn_flush_group();
+        } else if (!flush_group_window_running_) {
+            flush_group_window_running_ = true;
+            coro_t::spawn_sometime(std::bind(&page_cache_t::flush_group_after_window,
+                                             this, drainer_->lock()));
+        }
+    }
+    // Otherwise, the group gets flushed when the flush in progress is done.
+}
+
+void page_cache_t::flush_group_after_window(auto_drainer_t::lock_t lock) {
+    assert_thread();
+    try {
+        nap(dynamic_config_.flush_group_window_ms, lock.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        // The cache is being destroyed.  The txns in the group hold drainer locks
+        // until they're flushed, so flush them now instead of after the window.
+    }
+    flush_group_window_running_ = false;
+    // If a flush got spawned in the meantime (because the group got too big), the
+    // group will get flushed when that's done.
+    if (!pending_flush_group_.empty() && flushes_in_progress_ == 0) {
+        spawn_flush_group();
+    }
+}
+
+void page_cache_t::spawn_flush_group() {
+    assert_thread();
+    rassert(!pending_flush_group_.empty());
+
+    std::set<page_txn_t *> flush_set;
+    flush_set.swap(pending_flush_group_);
+    pending_flush_group_bytes_ = 0;
+    ++pm_flush_groups_;
+
+    std::map<block_id_t, block_change_t> changes
+        = page_cache_t::compute_changes(flush_set);
+    rassert(!changes.empty());
+
+    ++flushes_in_progress_;
+    coro_t::spawn_now_dangerously(std::bind(&page_cache_t::do_flush_txn_set,
+                                            this,
+                                            &changes,
+                                            flush_set));
 }
 
 
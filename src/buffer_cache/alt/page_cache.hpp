@@ -296,9 +296,12 @@ private:
 
 class page_cache_t : public home_thread_mixin_t {
 public:
+    // The cache's stats (those it keeps itself) go in perfmon_collection.
     page_cache_t(serializer_t *serializer,
                  const page_cache_config_t &config,
-                 memory_tracker_t *tracker);
+                 memory_tracker_t *tracker,
+                 cache_balancer_t *balancer,
+                 perfmon_collection_t *perfmon_collection);
     ~page_cache_t();
 
     // Takes a txn to be flushed.  Calls on_flush_complete() (which resets the
@@ -374,11 +377,21 @@ private:
     static std::map<block_id_t, block_change_t>
     compute_changes(const std::set<page_txn_t *> &txns);
 
+    // Returns true if compute_changes would return a non-empty map.
+    static bool txn_set_has_changes(const std::set<page_txn_t *> &txns);
+
     bool exists_flushable_txn_set(page_txn_t *txn,
                                   std::set<page_txn_t *> *flush_set_out);
 
     void im_waiting_for_flush(std::set<page_txn_t *> txns);
 
+    // Group commit: flushable txn sets are added to pending_flush_group_, and the
+    // whole group gets flushed with a single do_flush_txn_set call.
+    void add_to_flush_group(const std::set<page_txn_t *> &flush_set);
+    void maybe_spawn_flush_group();
+    void spawn_flush_group();
+    void flush_group_after_window(auto_drainer_t::lock_t lock);
+
     repli_timestamp_t recency_for_block_id(block_id_t id) {
         return recencies_.size() <= id
             ? repli_timestamp_t::invalid
@@ -429,6 +442,16 @@ private:
 
     evicter_t evicter_;
 
+    // Txns that are ready to flush (along with all their unflushed preceders), and
+    // that will be flushed together.  They're already marked spawned_flush_.
+    std::set<page_txn_t *> pending_flush_group_;
+    // The size of the dirtied pages of the txns in pending_flush_group_.
+    uint64_t pending_flush_group_bytes_;
+    // The number of do_flush_txn_set calls that haven't finished yet.
+    int64_t flushes_in_progress_;
+    // True while a flush_group_after_window coroutine is waiting.
+    bool flush_group_window_running_;
+
     // KSI: I bet this read_ahead_cb_ and read_ahead_cb_existence_ type could be
     // packaged in some new cross_thread_ptr type.
     page_read_ahead_cb_t *read_ahead_cb_;
@@ -439,6 +462,10 @@ private:
 
     scoped_ptr_t<auto_drainer_t> drainer_;
 
+    // The number of flush groups (each flushed with one index write) so far.
+    perfmon_counter_t pm_flush_groups_;
+    perfmon_membership_t pm_flush_groups_membership_;
+
     DISABLE_COPYING(page_cache_t);
 };
 
@@ -15,6 +15,10 @@ public:
       LSI: insert perfmons here
     */
 
+    // How long it takes to get at a block's contents after asking for them, which
+    // includes waiting for other transactions' locks and for the block to load.
+    perfmon_histogram_t pm_block_acquisition;
+
     perfmon_multi_membership_t cache_collection_membership;
 };
 
@@ -23,6 +23,7 @@
 #include "arch/io/disk.hpp"
 #include "arch/os_signal.hpp"
 #include "arch/runtime/starter.hpp"
+#include "buffer_cache/alt/config.hpp"
 #include "extproc/extproc_spawner.hpp"
 #include "clustering/administration/cli/admin_command_parser.hpp"
 #include "clustering/administration/main/names.hpp"
@@ -36,6 +37,8 @@
 #include "clustering/administration/persist.hpp"
 #include "logger.hpp"
 #include "mock/dummy_protocol.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "serializer/log/block_compression.hpp"
 
 #define RETHINKDB_EXPORT_SCRIPT "rethinkdb-export"
 #define RETHINKDB_IMPORT_SCRIPT "rethinkdb-import"
@@ -308,16 +311,19 @@ public:
     serve_info_t(const std::vector<host_and_port_t> &_joins,
                  service_address_ports_t _ports,
                  std::string _web_assets,
-                 boost::optional<std::string> _config_file):
+                 boost::optional<std::string> _config_file,
+                 bool _coalesce_cluster_messages):
         joins(&_joins),
         ports(_ports),
         web_assets(_web_assets),
-        config_file(_config_file) { }
+        config_file(_config_file),
+        coalesce_cluster_messages(_coalesce_cluster_messages) { }
 
     const std::vector<host_and_port_t> *joins;
     service_address_ports_t ports;
     std::string web_assets;
     boost::optional<std::string> config_file;
+    bool coalesce_cluster_messages;
 };
 
 // Used for options that don't take parameters, such as --help or --exit-failure, tells whether the
@@ -603,6 +609,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
                           const name_string_t &machine_name,
                           const file_direct_io_mode_t direct_io_mode,
                           const int max_concurrent_io_requests,
+                          const io_backend_t io_backend,
                           bool *const result_out) {
     machine_id_t our_machine_id = generate_uuid();
 
@@ -614,7 +621,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
     machine_semilattice_metadata.datacenter = vclock_t<datacenter_id_t>(nil_uuid(), our_machine_id);
     cluster_metadata.machines.machines.insert(std::make_pair(our_machine_id, make_deletable(machine_semilattice_metadata)));
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -709,6 +716,10 @@ void run_rethinkdb_serve(const base_path_t &base_path,
                          const serve_info_t &serve_info,
                          const file_direct_io_mode_t direct_io_mode,
                          const int max_concurrent_io_requests,
+                         const io_backend_t io_backend,
+                         const block_codec_t block_codec,
+                         const page_cache_config_t &table_cache_config,
+                         const ql::row_format_t row_format,
                          const machine_id_t *our_machine_id,
                          const cluster_semilattice_metadata_t *cluster_metadata,
                          directory_lock_t *data_directory_lock,
@@ -719,7 +730,7 @@ void run_rethinkdb_serve(const base_path_t &base_path,
 
     logINF("Loading data from directory %s\n", base_path.path().c_str());
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -765,7 +776,11 @@ void run_rethinkdb_serve(const base_path_t &base_path,
                             serve_info.ports,
                             serve_info.web_assets,
                             &sigint_cond,
-                            serve_info.config_file);
+                            serve_info.config_file,
+                            serve_info.coalesce_cluster_messages,
+                            block_codec,
+                            table_cache_config,
+                            row_format);
 
     } catch (const metadata_persistence::file_in_use_exc_t &ex) {
         logINF("Directory '%s' is in use by another rethinkdb process.\n", base_path.path().c_str());
@@ -780,13 +795,18 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
                              const name_string_t &machine_name,
                              const file_direct_io_mode_t direct_io_mode,
                              const int max_concurrent_io_requests,
+                             const io_backend_t io_backend,
+                             const block_codec_t block_codec,
+                             const page_cache_config_t &table_cache_config,
+                             const ql::row_format_t row_format,
                              const bool new_directory,
                              const serve_info_t &serve_info,
                              directory_lock_t *data_directory_lock,
                              bool *const result_out) {
     if (!new_directory) {
         run_rethinkdb_serve(base_path, serve_info,
-                            direct_io_mode, max_concurrent_io_requests,
+                            direct_io_mode, max_concurrent_io_requests, io_backend,
+                            block_codec, table_cache_config, row_format,
                             NULL, NULL, data_directory_lock,
                             result_out);
     } else {
@@ -819,7 +839,8 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
         }
 
         run_rethinkdb_serve(base_path, serve_info,
-                            direct_io_mode, max_concurrent_io_requests,
+                            direct_io_mode, max_concurrent_io_requests, io_backend,
+                            block_codec, table_cache_config, row_format,
                             &our_machine_id, &cluster_metadata,
                             data_directory_lock, result_out);
     }
@@ -834,7 +855,8 @@ void run_rethinkdb_proxy(const serve_info_t &serve_info, bool *const result_out)
                                   serve_info.ports,
                                   serve_info.web_assets,
                                   &sigint_cond,
-                                  serve_info.config_file);
+                                  serve_info.config_file,
+                                  serve_info.coalesce_cluster_messages);
     } catch (const host_lookup_exc_t &ex) {
         logERR("%s\n", ex.what());
         *result_out = false;
@@ -875,6 +897,39 @@ options::help_section_t get_file_options(std::vector<options::option_t> *options
     options_out->push_back(options::option_t(options::names_t("--no-direct-io"),
                                              options::OPTIONAL_NO_PARAMETER));
     help.add("--no-direct-io", "disable direct I/O");
+    options_out->push_back(options::option_t(options::names_t("--io-backend"),
+                                             options::OPTIONAL,
+                                             "pool"));
+    help.add("--io-backend {pool | native}",
+             "how I/O operations are sent to the disk: 'pool' runs blocking calls in a "
+             "pool of threads, 'native' uses the kernel's asynchronous I/O interface "
+             "(io_uring, or Linux AIO which requires direct I/O)");
+    options_out->push_back(options::option_t(options::names_t("--field-indexed-rows"),
+                                             options::OPTIONAL_NO_PARAMETER));
+    help.add("--field-indexed-rows",
+             "store new rows with an index of their fields, so that filters on "
+             "top-level fields can skip rows without reading them; versions that "
+             "predate this option can't read such rows");
+    options_out->push_back(options::option_t(options::names_t("--block-compression"),
+                                             options::OPTIONAL,
+                                             "none"));
+    help.add("--block-compression {none | zlib}",
+             "how newly written table blocks are compressed on disk; versions that "
+             "predate this option can't read a table file with compressed blocks");
+    options_out->push_back(options::option_t(options::names_t("--cache-eviction-policy"),
+                                             options::OPTIONAL,
+                                             "lru"));
+    help.add("--cache-eviction-policy {lru | 2q}",
+             "how table caches pick which blocks to evict: 'lru' evicts the least "
+             "recently used of a few sampled blocks, '2q' keeps blocks that are "
+             "used again soon after being evicted safe from large scans");
+    options_out->push_back(options::option_t(options::names_t("--flush-group-window-ms"),
+                                             options::OPTIONAL,
+                                             strprintf("%d", DEFAULT_FLUSH_GROUP_WINDOW_MS)));
+    help.add("--flush-group-window-ms n",
+             "how many milliseconds a table waits for more transactions to flush "
+             "together with one that's ready, when no flush is running (0 means "
+             "don't wait)");
     return help;
 }
 
@@ -948,6 +1003,10 @@ options::help_section_t get_network_options(const bool join_required, std::vecto
                                              options::OPTIONAL_REPEAT));
     help.add("--canonical-address addr", "address that other rethinkdb instances will use to connect to us, can be specified multiple times");
 
+    options_out->push_back(options::option_t(options::names_t("--coalesce-cluster-messages"),
+                                             options::OPTIONAL_NO_PARAMETER));
+    help.add("--coalesce-cluster-messages", "batch up the messages sent to other nodes at the same time, trading a little latency for fewer writes");
+
     return help;
 }
 
@@ -1146,6 +1205,63 @@ MUST_USE bool parse_io_threads_option(const std::map<std::string, options::value
     return true;
 }
 
+MUST_USE bool parse_io_backend_option(const std::map<std::string, options::values_t> &opts,
+                                      io_backend_t *io_backend_out) {
+    const std::string io_backend = get_single_option(opts, "--io-backend");
+    if (io_backend == "pool") {
+        *io_backend_out = io_backend_t::pool;
+    } else if (io_backend == "native") {
+        *io_backend_out = io_backend_t::native;
+    } else {
+        fprintf(stderr, "ERROR: io-backend must be either 'pool' or 'native'\n");
+        return false;
+    }
+    return true;
+}
+
+MUST_USE bool parse_block_compression_option(const std::map<std::string, options::values_t> &opts,
+                                            block_codec_t *block_codec_out) {
+    const std::string block_compression = get_single_option(opts, "--block-compression");
+    if (block_compression == "none") {
+        *block_codec_out = block_codec_t::none;
+    } else if (block_compression == "zlib") {
+        *block_codec_out = block_codec_t::zlib;
+    } else {
+        fprintf(stderr, "ERROR: block-compression must be either 'none' or 'zlib'\n");
+        return false;
+    }
+    return true;
+}
+
+MUST_USE bool parse_table_cache_options(const std::map<std::string, options::values_t> &opts,
+                                        page_cache_config_t *config_out) {
+    page_cache_config_t config;
+    const std::string eviction_policy = get_single_option(opts, "--cache-eviction-policy");
+    if (eviction_policy == "lru") {
+        config.eviction_policy = cache_eviction_policy_t::sampled_lru;
+    } else if (eviction_policy == "2q") {
+        config.eviction_policy = cache_eviction_policy_t::two_queue;
+    } else {
+        fprintf(stderr, "ERROR: cache-eviction-policy must be either 'lru' or '2q'\n");
+        return false;
+    }
+    config.flush_group_window_ms = get_single_int(opts, "--flush-group-window-ms");
+    if (config.flush_group_window_ms < 0
+        || config.flush_group_window_ms > MAXIMUM_FLUSH_GROUP_WINDOW_MS) {
+        fprintf(stderr, "ERROR: flush-group-window-ms must be between 0 and %d\n",
+                MAXIMUM_FLUSH_GROUP_WINDOW_MS);
+        return false;
+    }
+    *config_out = config;
+    return true;
+}
+
+ql::row_format_t parse_row_format_option(const std::map<std::string, options::values_t> &opts) {
+    return exists_option(opts, "--field-indexed-rows") ?
+        ql::row_format_t::FIELD_INDEXED :
+        ql::row_format_t::PLAIN;
+}
+
 file_direct_io_mode_t parse_direct_io_mode_option(const std::map<std::string, options::values_t> &opts) {
     return exists_option(opts, "--no-direct-io") ?
         file_direct_io_mode_t::buffered_desired :
@@ -1182,6 +1298,11 @@ int main_rethinkdb_create(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
         const int num_workers = get_cpu_count();
 
         bool is_new_directory = false;
@@ -1203,6 +1324,7 @@ int main_rethinkdb_create(int argc, char *argv[]) {
                                      machine_name,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      &result),
                            num_workers);
 
@@ -1293,6 +1415,21 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
+        block_codec_t block_codec;
+        if (!parse_block_compression_option(opts, &block_codec)) {
+            return EXIT_FAILURE;
+        }
+
+        page_cache_config_t table_cache_config;
+        if (!parse_table_cache_options(opts, &table_cache_config)) {
+            return EXIT_FAILURE;
+        }
+
         // Open and lock the directory, but do not create it
         bool is_new_directory = false;
         directory_lock_t data_directory_lock(base_path, false, &is_new_directory);
@@ -1319,15 +1456,21 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
         extproc_spawner_t extproc_spawner;
 
         serve_info_t serve_info(joins, address_ports, web_path,
-                                get_optional_option(opts, "--config-file"));
+                                get_optional_option(opts, "--config-file"),
+                                exists_option(opts, "--coalesce-cluster-messages"));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
+        const ql::row_format_t row_format = parse_row_format_option(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_serve, base_path,
                                      serve_info,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
+                                     block_codec,
+                                     table_cache_config,
+                                     row_format,
                                      static_cast<machine_id_t*>(NULL),
                                      static_cast<cluster_semilattice_metadata_t*>(NULL),
                                      &data_directory_lock,
@@ -1436,7 +1579,8 @@ int main_rethinkdb_proxy(int argc, char *argv[]) {
         extproc_spawner_t extproc_spawner;
 
         serve_info_t serve_info(joins, address_ports, web_path,
-                                get_optional_option(opts, "--config-file"));
+                                get_optional_option(opts, "--config-file"),
+                                exists_option(opts, "--coalesce-cluster-messages"));
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_proxy, serve_info, &result),
@@ -1549,6 +1693,21 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
+        block_codec_t block_codec;
+        if (!parse_block_compression_option(opts, &block_codec)) {
+            return EXIT_FAILURE;
+        }
+
+        page_cache_config_t table_cache_config;
+        if (!parse_table_cache_options(opts, &table_cache_config)) {
+            return EXIT_FAILURE;
+        }
+
         // Attempt to create the directory early so that the log file can use it.
         // If we create the file, it will be cleaned up unless directory_initialized()
         // is called on it.  This will be done after the metadata files have been created.
@@ -1579,9 +1738,11 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
         extproc_spawner_t extproc_spawner;
 
         serve_info_t serve_info(joins, address_ports, web_path,
-                                get_optional_option(opts, "--config-file"));
+                                get_optional_option(opts, "--config-file"),
+                                exists_option(opts, "--coalesce-cluster-messages"));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
+        const ql::row_format_t row_format = parse_row_format_option(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_porcelain,
@@ -1589,6 +1750,10 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                      machine_name,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
+                                     block_codec,
+                                     table_cache_config,
+                                     row_format,
                                      is_new_directory,
                                      serve_info,
                                      &data_directory_lock,
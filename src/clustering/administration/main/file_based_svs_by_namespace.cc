@@ -15,10 +15,13 @@ template <class protocol_t>
 struct store_args_t {
     store_args_t(io_backender_t *_io_backender, const base_path_t &_base_path,
             namespace_id_t _namespace_id, int64_t _cache_size,
+            const page_cache_config_t &_cache_config,
+            cache_balancer_t *_balancer,
             perfmon_collection_t *_serializers_perfmon_collection, typename
             protocol_t::context_t *_ctx)
         : io_backender(_io_backender), base_path(_base_path),
           namespace_id(_namespace_id), cache_size(_cache_size),
+          cache_config(_cache_config), balancer(_balancer),
           serializers_perfmon_collection(_serializers_perfmon_collection),
           ctx(_ctx)
     { }
@@ -27,6 +30,8 @@ struct store_args_t {
     base_path_t base_path;
     namespace_id_t namespace_id;
     int64_t cache_size;
+    page_cache_config_t cache_config;
+    cache_balancer_t *balancer;
     perfmon_collection_t *serializers_perfmon_collection;
     typename protocol_t::context_t *ctx;
 };
@@ -50,7 +55,7 @@ void do_construct_existing_store(
     // TODO: Can we pass serializers_perfmon_collection across threads like this?
     typename protocol_t::store_t *store = new typename protocol_t::store_t(
         multiplexer->proxies[thread_offset], hash_shard_perfmon_name(thread_offset),
-        store_args.cache_size, false, store_args.serializers_perfmon_collection,
+        store_args.cache_size, store_args.cache_config, store_args.balancer, false, store_args.serializers_perfmon_collection,
         store_args.ctx, store_args.io_backender, store_args.base_path);
     (*stores_out_stores)[thread_offset].init(store);
     store_views[thread_offset] = store;
@@ -68,7 +73,7 @@ void do_create_new_store(
     on_thread_t th(threads[thread_offset]);
     typename protocol_t::store_t *store = new typename protocol_t::store_t(
         multiplexer->proxies[thread_offset], hash_shard_perfmon_name(thread_offset),
-        store_args.cache_size, true, store_args.serializers_perfmon_collection,
+        store_args.cache_size, store_args.cache_config, store_args.balancer, true, store_args.serializers_perfmon_collection,
         store_args.ctx, store_args.io_backender, store_args.base_path);
     (*stores_out_stores)[thread_offset].init(store);
     store_views[thread_offset] = store;
@@ -117,7 +122,9 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
         int res = access(serializer_filepath.permanent_path().c_str(), R_OK | W_OK);
         store_args_t<protocol_t> store_args(io_backender_, base_path_,
                                             namespace_id, cache_size / num_stores,
-                                            serializers_perfmon_collection, ctx);
+                                            cache_config_, balancer_,
+                                            serializers_perfmon_collection,
+                                            ctx);
         filepath_file_opener_t file_opener(serializer_filepath, io_backender_);
         if (res == 0) {
             // TODO: Could we handle failure when loading the serializer?  Right
@@ -126,7 +133,7 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
             {
                 scoped_ptr_t<serializer_t> ser
                     = make_scoped<standard_serializer_t>(
-                        standard_serializer_t::dynamic_config_t(),
+                        serializer_config_,
                         &file_opener,
                         serializers_perfmon_collection);
                 ser = make_scoped<merger_serializer_t>(std::move(ser),
@@ -152,7 +159,7 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
             {
                 scoped_ptr_t<serializer_t> ser
                     = make_scoped<standard_serializer_t>(
-                        standard_serializer_t::dynamic_config_t(),
+                        serializer_config_,
                         &file_opener,
                         serializers_perfmon_collection);
                 ser = make_scoped<merger_serializer_t>(std::move(ser),
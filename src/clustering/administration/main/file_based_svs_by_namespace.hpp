@@ -4,14 +4,24 @@
 
 #include <string>
 
+#include "buffer_cache/alt/config.hpp"
 #include "clustering/administration/reactor_driver.hpp"
+#include "serializer/config.hpp"
+
+class cache_balancer_t;
 
 template <class protocol_t>
 class file_based_svs_by_namespace_t : public svs_by_namespace_t<protocol_t> {
 public:
     file_based_svs_by_namespace_t(io_backender_t *io_backender,
-                                  const base_path_t& base_path)
-        : io_backender_(io_backender), base_path_(base_path), thread_counter_(0) { }
+                                  cache_balancer_t *balancer,
+                                  const base_path_t& base_path,
+                                  block_codec_t block_codec,
+                                  const page_cache_config_t &cache_config)
+        : io_backender_(io_backender), balancer_(balancer), base_path_(base_path),
+          cache_config_(cache_config), thread_counter_(0) {
+        serializer_config_.block_codec = block_codec;
+    }
 
     void get_svs(perfmon_collection_t *serializers_perfmon_collection,
                  namespace_id_t namespace_id,
@@ -26,7 +36,11 @@ public:
 
 private:
     io_backender_t *io_backender_;
+    cache_balancer_t *balancer_;
     const base_path_t base_path_;
+    standard_serializer_t::dynamic_config_t serializer_config_;
+    // Each store's cache starts from this, with its own share of the memory.
+    const page_cache_config_t cache_config_;
 
     threadnum_t next_thread(int num_db_threads);
     int thread_counter_; // should only be used by `next_thread`
@@ -5,6 +5,7 @@
 
 #include "arch/arch.hpp"
 #include "arch/os_signal.hpp"
+#include "buffer_cache/alt/cache_balancer.hpp"
 #include "clustering/administration/admin_tracker.hpp"
 #include "clustering/administration/auto_reconnect.hpp"
 #include "clustering/administration/http/server.hpp"
@@ -72,7 +73,11 @@ bool do_serve(
     service_address_ports_t address_ports,
     std::string web_assets,
     os_signal_cond_t *stop_cond,
-    const boost::optional<std::string> &config_file) {
+    const boost::optional<std::string> &config_file,
+    bool coalesce_cluster_messages,
+    block_codec_t block_codec,
+    const page_cache_config_t &table_cache_config,
+    ql::row_format_t row_format) {
     try {
         extproc_pool_t extproc_pool(get_num_threads());
 
@@ -96,7 +101,8 @@ bool do_serve(
 #endif
 
         connectivity_cluster_t connectivity_cluster;
-        message_multiplexer_t message_multiplexer(&connectivity_cluster);
+        message_multiplexer_t message_multiplexer(&connectivity_cluster,
+                                                  coalesce_cluster_messages);
 
         message_multiplexer_t::client_t heartbeat_manager_client(&message_multiplexer, 'H', SEMAPHORE_NO_LIMIT);
         heartbeat_manager_t heartbeat_manager(&heartbeat_manager_client);
@@ -254,8 +260,17 @@ bool do_serve(
 
         //This is an annoying chicken and egg problem here
         rdb_ctx.ns_repo = &rdb_namespace_repo;
+        if (i_am_a_server) {
+            rdb_ctx.temp_files = temp_file_location_t(io_backender, base_path);
+            rdb_ctx.row_format = row_format;
+        }
 
         {
+            // Shares the cache memory of all the tables' stores on this server.
+            // It has to outlive them, so it's constructed before the reactor
+            // drivers.
+            cache_balancer_t cache_balancer;
+
             // Reactor drivers
 
             // Dummy
@@ -266,7 +281,8 @@ bool do_serve(
 
             if (i_am_a_server) {
                 dummy_svs_source.init(new file_based_svs_by_namespace_t<mock::dummy_protocol_t>(
-                    io_backender, base_path));
+                    io_backender, &cache_balancer, base_path, block_codec,
+                    table_cache_config));
                 dummy_reactor_driver.init(new reactor_driver_t<mock::dummy_protocol_t>(
                     base_path,
                     io_backender,
@@ -299,7 +315,8 @@ bool do_serve(
 
             if (i_am_a_server) {
                 memcached_svs_source.init(new file_based_svs_by_namespace_t<memcached_protocol_t>(
-                    io_backender, base_path));
+                    io_backender, &cache_balancer, base_path, block_codec,
+                    table_cache_config));
                 memcached_reactor_driver.init(new reactor_driver_t<memcached_protocol_t>(
                     base_path,
                     io_backender,
@@ -332,7 +349,8 @@ bool do_serve(
 
             if (i_am_a_server) {
                 rdb_svs_source.init(new file_based_svs_by_namespace_t<rdb_protocol_t>(
-                    io_backender, base_path));
+                    io_backender, &cache_balancer, base_path, block_codec,
+                    table_cache_config));
                 rdb_reactor_driver.init(new reactor_driver_t<rdb_protocol_t>(
                         base_path,
                         io_backender,
@@ -485,7 +503,11 @@ bool serve(io_backender_t *io_backender,
            service_address_ports_t address_ports,
            std::string web_assets,
            os_signal_cond_t *stop_cond,
-           const boost::optional<std::string>& config_file) {
+           const boost::optional<std::string>& config_file,
+           bool coalesce_cluster_messages,
+           block_codec_t block_codec,
+           const page_cache_config_t &table_cache_config,
+           ql::row_format_t row_format) {
     return do_serve(io_backender,
                     true,
                     base_path,
@@ -495,14 +517,19 @@ bool serve(io_backender_t *io_backender,
                     address_ports,
                     web_assets,
                     stop_cond,
-                    config_file);
+                    config_file,
+                    coalesce_cluster_messages,
+                    block_codec,
+                    table_cache_config,
+                    row_format);
 }
 
 bool serve_proxy(const peer_address_set_t &joins,
                  service_address_ports_t address_ports,
                  std::string web_assets,
                  os_signal_cond_t *stop_cond,
-                 const boost::optional<std::string>& config_file) {
+                 const boost::optional<std::string>& config_file,
+                 bool coalesce_cluster_messages) {
     // TODO: filepath doesn't _seem_ ignored.
     // filepath and persistent_file are ignored for proxies, so we use the empty string & NULL respectively.
     return do_serve(NULL,
@@ -514,5 +541,9 @@ bool serve_proxy(const peer_address_set_t &joins,
                     address_ports,
                     web_assets,
                     stop_cond,
-                    config_file);
+                    config_file,
+                    coalesce_cluster_messages,
+                    block_codec_t::none,
+                    page_cache_config_t(),
+                    ql::row_format_t::PLAIN);
 }
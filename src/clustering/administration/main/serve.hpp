@@ -7,9 +7,11 @@
 
 #include "clustering/administration/metadata.hpp"
 #include "clustering/administration/persist.hpp"
+#include "serializer/log/block_compression.hpp"
 #include "arch/address.hpp"
 
 class os_signal_cond_t;
+class page_cache_config_t;
 
 class invalid_port_exc_t : public std::exception {
 public:
@@ -93,12 +95,17 @@ bool serve(io_backender_t *io_backender,
            service_address_ports_t ports,
            std::string web_assets,
            os_signal_cond_t *stop_cond,
-           const boost::optional<std::string>& config_file);
+           const boost::optional<std::string>& config_file,
+           bool coalesce_cluster_messages,
+           block_codec_t block_codec,
+           const page_cache_config_t &table_cache_config,
+           ql::row_format_t row_format);
 
 bool serve_proxy(const peer_address_set_t &joins,
                  service_address_ports_t ports,
                  std::string web_assets,
                  os_signal_cond_t *stop_cond,
-                 const boost::optional<std::string>& config_file);
+                 const boost::optional<std::string>& config_file,
+                 bool coalesce_cluster_messages);
 
 #endif /* CLUSTERING_ADMINISTRATION_MAIN_SERVE_HPP_ */
@@ -0,0 +1,53 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "clustering/immediate_consistency/branch/backfill_frame.hpp"
+
+#include <zlib.h>
+
+backfill_codec_t compress_backfill_data(std::vector<char> *data) {
+    if (data->empty()) {
+        return backfill_codec_t::none;
+    }
+
+    // There's no point in compressing if it doesn't save us anything.
+    std::vector<char> compressed(data->size() - 1);
+    uLongf compressed_size = compressed.size();
+    const int res = compress2(reinterpret_cast<Bytef *>(compressed.data()),
+                              &compressed_size,
+                              reinterpret_cast<const Bytef *>(data->data()),
+                              data->size(),
+                              Z_BEST_SPEED);
+    if (res == Z_BUF_ERROR) {
+        // It didn't fit in fewer bytes than we started with.
+        return backfill_codec_t::none;
+    }
+    guarantee(res == Z_OK, "compress2 failed (%d)", res);
+
+    compressed.resize(compressed_size);
+    data->swap(compressed);
+    return backfill_codec_t::zlib;
+}
+
+void decompress_backfill_data(backfill_codec_t codec,
+                              uint64_t uncompressed_size,
+                              std::vector<char> *data) {
+    switch (codec) {
+    case backfill_codec_t::none:
+        guarantee(data->size() == uncompressed_size,
+                  "Uncompressed backfill frame has the wrong size.");
+        break;
+    case backfill_codec_t::zlib: {
+        std::vector<char> uncompressed(uncompressed_size);
+        uLongf size = uncompressed_size;
+        const int res = uncompress(reinterpret_cast<Bytef *>(uncompressed.data()),
+                                   &size,
+                                   reinterpret_cast<const Bytef *>(data->data()),
+                                   data->size());
+        guarantee(res == Z_OK && size == uncompressed_size,
+                  "Compressed backfill frame is corrupted (%d).", res);
+        data->swap(uncompressed);
+        break;
+    }
+    default:
+        unreachable();
+    }
+}
@@ -0,0 +1,182 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef CLUSTERING_IMMEDIATE_CONSISTENCY_BRANCH_BACKFILL_FRAME_HPP_
+#define CLUSTERING_IMMEDIATE_CONSISTENCY_BRANCH_BACKFILL_FRAME_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/function.hpp>
+
+#include "concurrency/interruptor.hpp"
+#include "concurrency/mutex.hpp"
+#include "concurrency/semaphore.hpp"
+#include "concurrency/signal.hpp"
+#include "config/args.hpp"
+#include "containers/archive/archive.hpp"
+#include "containers/archive/stl_types.hpp"
+#include "containers/archive/vector_stream.hpp"
+#include "rpc/serialize_macros.hpp"
+#include "utils.hpp"
+
+/* The backfiller doesn't send backfill chunks to the backfillee one by one.
+Instead, it serializes several consecutive chunks into a `backfill_frame_t` and
+compresses the result if that makes it smaller. Every frame says how it was
+compressed, so the backfillee can read any frame regardless of what the
+backfiller decided. */
+
+// A frame is sent once its chunks take up this many bytes, serialized.
+#define BACKFILL_FRAME_SIZE (256 * KILOBYTE)
+
+// A frame is sent once it holds this many chunks. Must be well below
+// MAX_CHUNKS_OUT in backfiller.cc, since the backfiller has to acquire that many
+// allocations for a frame at once.
+#define BACKFILL_MAX_CHUNKS_PER_FRAME 16
+
+enum class backfill_codec_t : int8_t {
+    // The chunks are stored verbatim.
+    none = 0,
+    // The chunks are deflated with zlib, at its fastest compression level.
+    zlib = 1
+};
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(backfill_codec_t, int8_t,
+                                      backfill_codec_t::none, backfill_codec_t::zlib);
+
+template <class protocol_t>
+class backfill_frame_t {
+public:
+    backfill_frame_t() : codec(backfill_codec_t::none), num_chunks(0),
+                         uncompressed_size(0) { }
+
+    backfill_codec_t codec;
+    int32_t num_chunks;
+    // The size of the serialized chunks before compression.
+    uint64_t uncompressed_size;
+    std::vector<char> data;
+
+    RDB_MAKE_ME_SERIALIZABLE_4(codec, num_chunks, uncompressed_size, data);
+};
+
+// Compresses `*data` in place if that makes it smaller, and returns the codec it
+// used.
+backfill_codec_t compress_backfill_data(std::vector<char> *data);
+
+// Restores data that `compress_backfill_data()` compressed with `codec`.
+void decompress_backfill_data(backfill_codec_t codec,
+                              uint64_t uncompressed_size,
+                              std::vector<char> *data);
+
+/* `backfill_frame_builder_t` collects chunks until they are worth sending. */
+template <class protocol_t>
+class backfill_frame_builder_t {
+public:
+    backfill_frame_builder_t() : num_chunks(0) { }
+
+    void add_chunk(const typename protocol_t::backfill_chunk_t &chunk) {
+        write_message_t msg;
+        msg << chunk;
+        int res = send_write_message(&stream, &msg);
+        guarantee(res == 0);
+        ++num_chunks;
+    }
+
+    bool is_empty() const { return num_chunks == 0; }
+
+    bool is_full() {
+        return num_chunks >= BACKFILL_MAX_CHUNKS_PER_FRAME
+            || stream.vector().size() >= BACKFILL_FRAME_SIZE;
+    }
+
+    int32_t get_num_chunks() const { return num_chunks; }
+
+    // Moves the chunks collected so far into `*frame_out`, compressing them if
+    // possible, and leaves the builder empty.
+    void finish(backfill_frame_t<protocol_t> *frame_out) {
+        frame_out->num_chunks = num_chunks;
+        frame_out->data.clear();
+        stream.swap(&frame_out->data);
+        frame_out->uncompressed_size = frame_out->data.size();
+        frame_out->codec = compress_backfill_data(&frame_out->data);
+        num_chunks = 0;
+    }
+
+private:
+    vector_stream_t stream;
+    int32_t num_chunks;
+
+    DISABLE_COPYING(backfill_frame_builder_t);
+};
+
+/* `backfill_frame_sender_t` packs chunks that come in from any number of
+coroutines into frames and hands every frame to `send_fn` once it has acquired
+one unit of `chunk_semaphore` per chunk. A frame never holds more than
+`BACKFILL_MAX_CHUNKS_PER_FRAME` chunks: a chunk is only added to the builder
+while holding `send_mutex`, so a producer that arrives while a full frame waits
+for its allocations waits as well, instead of growing the next frame past what
+the semaphore could ever grant. */
+template <class protocol_t>
+class backfill_frame_sender_t {
+public:
+    backfill_frame_sender_t(
+            semaphore_t *_chunk_semaphore,
+            const boost::function<void(const backfill_frame_t<protocol_t> &)> &_send_fn)
+        : chunk_semaphore(_chunk_semaphore), send_fn(_send_fn) { }
+
+    void send_chunk(const typename protocol_t::backfill_chunk_t &chunk,
+                    signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        /* `send_mutex` also makes sure that frames acquire their allocations
+        and get sent in the order in which their chunks came in. */
+        mutex_t::acq_t acq(&send_mutex);
+        frame_builder.add_chunk(chunk);
+        if (frame_builder.is_full()) {
+            send_frame_with_lock(&acq, interruptor);
+        }
+    }
+
+    /* Sends whatever chunks haven't been sent yet. */
+    void send_frame(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        mutex_t::acq_t acq(&send_mutex);
+        send_frame_with_lock(&acq, interruptor);
+    }
+
+private:
+    void send_frame_with_lock(mutex_t::acq_t *acq, signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) {
+        acq->assert_is_holding(&send_mutex);
+        if (frame_builder.is_empty()) {
+            return;
+        }
+        const int32_t num_chunks = frame_builder.get_num_chunks();
+        rassert(num_chunks <= BACKFILL_MAX_CHUNKS_PER_FRAME);
+        backfill_frame_t<protocol_t> frame;
+        frame_builder.finish(&frame);
+        chunk_semaphore->co_lock_interruptible(interruptor, num_chunks);
+        send_fn(frame);
+    }
+
+    semaphore_t *chunk_semaphore;
+    boost::function<void(const backfill_frame_t<protocol_t> &)> send_fn;
+
+    backfill_frame_builder_t<protocol_t> frame_builder;
+    mutex_t send_mutex;
+
+    DISABLE_COPYING(backfill_frame_sender_t);
+};
+
+// Decompresses and deserializes the chunks in `frame`.
+template <class protocol_t>
+void read_backfill_frame(backfill_frame_t<protocol_t> *frame,
+                         std::vector<typename protocol_t::backfill_chunk_t> *chunks_out) {
+    decompress_backfill_data(frame->codec, frame->uncompressed_size, &frame->data);
+    guarantee(frame->num_chunks >= 0);
+    chunks_out->resize(frame->num_chunks);
+    vector_read_stream_t stream(std::move(frame->data));
+    for (int32_t i = 0; i < frame->num_chunks; ++i) {
+        archive_result_t res = deserialize(&stream, &(*chunks_out)[i]);
+        guarantee_deserialization(res, "backfill chunk");
+    }
+}
+
+#endif  // CLUSTERING_IMMEDIATE_CONSISTENCY_BRANCH_BACKFILL_FRAME_HPP_
@@ -17,27 +17,27 @@ struct backfill_queue_entry_t {
     // TODO: The fact that fifo_enforcer_queue_t requires a default
     // constructor (and assignment operator, presumably) is completely asinine.
     backfill_queue_entry_t() { }
-    backfill_queue_entry_t(bool _is_not_last_backfill_chunk,
-                           const typename protocol_t::backfill_chunk_t &_chunk,
+    backfill_queue_entry_t(bool _is_not_last_backfill_frame,
+                           const backfill_frame_t<protocol_t> &_frame,
                            fifo_enforcer_write_token_t _write_token)
-        : is_not_last_backfill_chunk(_is_not_last_backfill_chunk),
-          chunk(_chunk),
+        : is_not_last_backfill_frame(_is_not_last_backfill_frame),
+          frame(_frame),
           write_token(_write_token) { }
 
-    bool is_not_last_backfill_chunk;
-    typename protocol_t::backfill_chunk_t chunk;
+    bool is_not_last_backfill_frame;
+    backfill_frame_t<protocol_t> frame;
     fifo_enforcer_write_token_t write_token;
 };
 
 template <class protocol_t>
-void push_chunk_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue,
-                         typename protocol_t::backfill_chunk_t chunk, fifo_enforcer_write_token_t token) {
-    queue->push(token, backfill_queue_entry_t<protocol_t>(true, chunk, token));
+void push_frame_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue,
+                         const backfill_frame_t<protocol_t> &frame, fifo_enforcer_write_token_t token) {
+    queue->push(token, backfill_queue_entry_t<protocol_t>(true, frame, token));
 }
 
 template <class protocol_t>
 void push_finish_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue, fifo_enforcer_write_token_t token) {
-    queue->push(token, backfill_queue_entry_t<protocol_t>(false, typename protocol_t::backfill_chunk_t(), token));
+    queue->push(token, backfill_queue_entry_t<protocol_t>(false, backfill_frame_t<protocol_t>(), token));
 }
 
 
@@ -55,20 +55,27 @@ public:
         done_message_arrived(false), num_outstanding_chunks(0)
     { }
 
-    void apply_backfill_chunk(fifo_enforcer_write_token_t chunk_token, const typename protocol_t::backfill_chunk_t& chunk, signal_t *interruptor) {
-        write_token_pair_t token_pair;
-        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
-        svs->new_write_token_pair(&token_pair);
-        chunk_queue->finish_write(chunk_token);
+    void apply_backfill_frame(fifo_enforcer_write_token_t frame_token,
+                              const std::vector<typename protocol_t::backfill_chunk_t> &chunks,
+                              signal_t *interruptor) {
+        /* Acquire write tokens for all of the frame's chunks before letting the
+        next frame go, so that they come before the next frame's chunks. */
+        scoped_array_t<write_token_pair_t> token_pairs(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            svs->new_write_token_pair(&token_pairs[i]);
+        }
+        chunk_queue->finish_write(frame_token);
 
-        svs->receive_backfill(chunk, &token_pair, interruptor);
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            svs->receive_backfill(chunks[i], &token_pairs[i], interruptor);
+        }
     }
 
     void coro_pool_callback(backfill_queue_entry_t<protocol_t> chunk, signal_t *interruptor) {
         assert_thread();
         try {
-            if (chunk.is_not_last_backfill_chunk) {
-                /* This is an actual backfill chunk */
+            if (chunk.is_not_last_backfill_frame) {
+                /* This is an actual frame of backfill chunks */
 
                 /* Before letting the next thing go, increment
                    `num_outstanding_chunks` and acquire a write token. The
@@ -78,8 +85,11 @@ public:
                    superblock in the correct order. */
                 num_outstanding_chunks++;
 
-                // We acquire the write token in apply_backfill_chunk.
-                apply_backfill_chunk(chunk.write_token, chunk.chunk, interruptor);
+                std::vector<typename protocol_t::backfill_chunk_t> chunks;
+                read_backfill_frame(&chunk.frame, &chunks);
+
+                // We acquire the write tokens in apply_backfill_frame.
+                apply_backfill_frame(chunk.write_token, chunks, interruptor);
 
                 /* Allow the backfiller to send us more data */
                 int chunks_to_send_out = 0;
@@ -88,11 +98,11 @@ public:
                      * modifying unacked chunks, otherwise another callback may
                      * decided to send out an allocation as well. */
                     ASSERT_NO_CORO_WAITING;
-                    ++unacked_chunks;
-                    guarantee(unacked_chunks <= ALLOCATION_CHUNK);
-                    if (unacked_chunks == ALLOCATION_CHUNK) {
-                        unacked_chunks = 0;
-                        chunks_to_send_out = ALLOCATION_CHUNK;
+                    unacked_chunks += chunks.size();
+                    if (unacked_chunks >= ALLOCATION_CHUNK) {
+                        chunks_to_send_out = unacked_chunks
+                            - unacked_chunks % ALLOCATION_CHUNK;
+                        unacked_chunks -= chunks_to_send_out;
                     }
                 }
                 if (chunks_to_send_out != 0) {
@@ -185,8 +195,6 @@ void backfillee(
         boost::bind(&receive_end_point_message<protocol_t>, &end_point_cond, _1, _2));
 
     {
-        typedef typename protocol_t::backfill_chunk_t backfill_chunk_t;
-
         /* A queue of the requests the backfill chunk mailbox receives, a coro
          * pool services these requests and poops them off one at a time to
          * perform them. */
@@ -199,10 +207,10 @@ void backfillee(
             mailbox_manager,
             boost::bind(&push_finish_on_queue<protocol_t>, &chunk_queue, _1));
 
-        /* The backfiller will send individual chunks of the backfill to
-        `chunk_mailbox`. */
-        mailbox_t<void(backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_mailbox(
-            mailbox_manager, boost::bind(&push_chunk_on_queue<protocol_t>, &chunk_queue, _1, _2));
+        /* The backfiller will send the chunks of the backfill to
+        `chunk_mailbox`, several at a time. */
+        mailbox_t<void(backfill_frame_t<protocol_t>, fifo_enforcer_write_token_t)> chunk_mailbox(
+            mailbox_manager, boost::bind(&push_frame_on_queue<protocol_t>, &chunk_queue, _1, _2));
 
         /* The backfiller will register for allocations on the allocation
          * registration box. */
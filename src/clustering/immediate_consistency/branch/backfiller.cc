@@ -7,7 +7,9 @@
 #include "btree/parallel_traversal.hpp"
 #include "clustering/immediate_consistency/branch/history.hpp"
 #include "concurrency/fifo_enforcer.hpp"
+#include "concurrency/mutex.hpp"
 #include "concurrency/semaphore.hpp"
+#include "perfmon/perfmon.hpp"
 #include "rpc/semilattice/view.hpp"
 #include "stl_utils.hpp"
 
@@ -16,10 +18,19 @@
 // Each chunk can contain multiple key/value pairs, but its (approximate) maximum
 // size is limited by BACKFILL_MAX_KVPAIRS_SIZE as defined in btree/backfill.hpp.
 // When setting this value, keep memory consumption in mind.
-// Must be >= ALLOCATION_CHUNK in backfillee.cc, or backfilling will stall and
-// never finish.
+// Must be >= ALLOCATION_CHUNK in backfillee.cc plus BACKFILL_MAX_CHUNKS_PER_FRAME
+// in backfill_frame.hpp, or backfilling will stall and never finish.
 #define MAX_CHUNKS_OUT 64
 
+// How much backfill data we have sent, before and after compression. Their ratio
+// is how well backfill frames compress.
+static perfmon_counter_t pm_backfill_bytes_uncompressed, pm_backfill_bytes_sent;
+static perfmon_rate_monitor_t pm_backfill_bytes_sent_per_sec(secs_to_ticks(1));
+static perfmon_multi_membership_t pm_backfill_membership(&get_global_perfmon_collection(),
+    &pm_backfill_bytes_uncompressed, "backfill_bytes_uncompressed",
+    &pm_backfill_bytes_sent, "backfill_bytes_sent",
+    &pm_backfill_bytes_sent_per_sec, "backfill_bytes_sent_per_sec");
+
 inline state_timestamp_t get_earliest_timestamp_of_version_range(const version_range_t &vr) {
     return vr.earliest.timestamp;
 }
@@ -95,51 +106,57 @@ bool backfiller_t<protocol_t>::confirm_and_send_metainfo(typename store_view_t<p
     return true;
 }
 
-template <class protocol_t>
-void do_send_chunk(mailbox_manager_t *mbox_manager,
-                   mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_addr,
-                   const typename protocol_t::backfill_chunk_t &chunk,
-                   fifo_enforcer_source_t *fifo_src,
-                   semaphore_t *chunk_semaphore,
-                   signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
-    chunk_semaphore->co_lock_interruptible(interruptor);
-    send(mbox_manager, chunk_addr, chunk, fifo_src->enter_write());
-}
-
 template <class protocol_t>
 class backfiller_send_backfill_callback_t : public send_backfill_callback_t<protocol_t> {
 public:
     backfiller_send_backfill_callback_t(const region_map_t<protocol_t, version_range_t> *start_point,
                                         mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
                                         mailbox_manager_t *mailbox_manager,
-                                        mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+                                        mailbox_addr_t<void(backfill_frame_t<protocol_t>, fifo_enforcer_write_token_t)> frame_cont,
                                         fifo_enforcer_source_t *fifo_src,
                                         semaphore_t *chunk_semaphore,
                                         backfiller_t<protocol_t> *backfiller)
         : start_point_(start_point),
           end_point_cont_(end_point_cont),
           mailbox_manager_(mailbox_manager),
-          chunk_cont_(chunk_cont),
+          frame_cont_(frame_cont),
           fifo_src_(fifo_src),
-          chunk_semaphore_(chunk_semaphore),
-          backfiller_(backfiller) { }
+          backfiller_(backfiller),
+          frame_sender_(chunk_semaphore,
+                        boost::bind(&backfiller_send_backfill_callback_t::send_frame_to_backfillee,
+                                    this, _1)) { }
 
     bool should_backfill_impl(const typename store_view_t<protocol_t>::metainfo_t &metainfo) {
         return backfiller_->confirm_and_send_metainfo(metainfo, *start_point_, end_point_cont_);
     }
 
     void send_chunk(const typename protocol_t::backfill_chunk_t &chunk, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
-        do_send_chunk<protocol_t>(mailbox_manager_, chunk_cont_, chunk, fifo_src_, chunk_semaphore_, interruptor);
+        frame_sender_.send_chunk(chunk, interruptor);
+    }
+
+    /* Sends whatever chunks haven't been sent yet. */
+    void send_frame(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        frame_sender_.send_frame(interruptor);
     }
+
 private:
+    void send_frame_to_backfillee(const backfill_frame_t<protocol_t> &frame) {
+        pm_backfill_bytes_uncompressed += frame.uncompressed_size;
+        pm_backfill_bytes_sent += frame.data.size();
+        pm_backfill_bytes_sent_per_sec.record(frame.data.size());
+
+        send(mailbox_manager_, frame_cont_, frame, fifo_src_->enter_write());
+    }
+
     const region_map_t<protocol_t, version_range_t> *start_point_;
     mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont_;
     mailbox_manager_t *mailbox_manager_;
-    mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont_;
+    mailbox_addr_t<void(backfill_frame_t<protocol_t>, fifo_enforcer_write_token_t)> frame_cont_;
     fifo_enforcer_source_t *fifo_src_;
-    semaphore_t *chunk_semaphore_;
     backfiller_t<protocol_t> *backfiller_;
 
+    backfill_frame_sender_t<protocol_t> frame_sender_;
+
     DISABLE_COPYING(backfiller_send_backfill_callback_t);
 };
 
@@ -148,7 +165,7 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
                                            const region_map_t<protocol_t, version_range_t> &start_point,
                                            const branch_history_t<protocol_t> &start_point_associated_branch_history,
                                            mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
-                                           mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+                                           mailbox_addr_t<void(backfill_frame_t<protocol_t>, fifo_enforcer_write_token_t)> frame_cont,
                                            mailbox_addr_t<void(fifo_enforcer_write_token_t)> done_cont,
                                            mailbox_addr_t<void(mailbox_addr_t<void(int)>)> allocation_registration_box,
                                            auto_drainer_t::lock_t keepalive) {
@@ -187,7 +204,7 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
         svs->new_read_token_pair(&send_backfill_token_pair);
 
         backfiller_send_backfill_callback_t<protocol_t>
-            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, chunk_cont, &fifo_src, &chunk_semaphore, this);
+            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, frame_cont, &fifo_src, &chunk_semaphore, this);
 
         /* Actually perform the backfill */
         svs->send_backfill(
@@ -200,6 +217,9 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
                      &send_backfill_token_pair,
                      &interrupted);
 
+        /* Send the chunks that didn't fill up a whole frame */
+        send_backfill_cb.send_frame(&interrupted);
+
         /* Send a confirmation */
         send(mailbox_manager, done_cont, fifo_src.enter_write());
 
@@ -6,6 +6,7 @@
 #include <utility>
 
 #include "clustering/generic/registration_metadata.hpp"
+#include "clustering/immediate_consistency/branch/backfill_frame.hpp"
 #include "clustering/immediate_consistency/branch/history.hpp"
 #include "concurrency/fifo_checker.hpp"
 #include "concurrency/fifo_enforcer.hpp"
@@ -107,7 +108,7 @@ struct backfiller_business_card_t {
             region_map_t<protocol_t, version_range_t>,
             branch_history_t<protocol_t>
             ) >,
-        mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)>,
+        mailbox_addr_t<void(backfill_frame_t<protocol_t>, fifo_enforcer_write_token_t)>,
         mailbox_t<void(fifo_enforcer_write_token_t)>::address_t,
         mailbox_t<void(mailbox_addr_t<void(int)>)>::address_t
         )> backfill_mailbox_t;
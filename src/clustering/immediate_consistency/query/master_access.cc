@@ -6,10 +6,20 @@
 #include "arch/timing.hpp"
 #include "concurrency/promise.hpp"
 #include "containers/archive/boost_types.hpp"
+#include "perfmon/perfmon.hpp"
 
 // TODO: Was this macro supposed to be used?
 // #define THROTTLE_THRESHOLD 200
 
+// How long it takes from sending a read or write to the master until its response
+// arrives.
+static perfmon_histogram_t pm_master_read_round_trip(secs_to_ticks(1));
+static perfmon_histogram_t pm_master_write_round_trip(secs_to_ticks(1));
+static perfmon_multi_membership_t pm_master_round_trip_membership(
+    &get_global_perfmon_collection(),
+    &pm_master_read_round_trip, "master_read_round_trip",
+    &pm_master_write_round_trip, "master_write_round_trip");
+
 template <class protocol_t>
 master_access_t<protocol_t>::master_access_t(
         mailbox_manager_t *mm,
@@ -71,10 +81,12 @@ void master_access_t<protocol_t>::read(
         token_for_master,
         result_or_failure_mailbox.get_address());
 
+    ticks_t start_time = get_ticks();
     multi_throttling_client.spawn_request(read_request, &ticket, interruptor);
 
     wait_any_t waiter(result_or_failure.get_ready_signal(), get_failed_signal());
     wait_interruptible(&waiter, interruptor);
+    pm_master_read_round_trip.record(get_ticks() - start_time);
 
     if (result_or_failure.is_pulsed()) {
         if (const std::string *error
@@ -126,10 +138,12 @@ void master_access_t<protocol_t>::write(
         token_for_master,
         result_or_failure_mailbox.get_address());
 
+    ticks_t start_time = get_ticks();
     multi_throttling_client.spawn_request(write_request, &ticket, interruptor);
 
     wait_any_t waiter(result_or_failure.get_ready_signal(), get_failed_signal());
     wait_interruptible(&waiter, interruptor);
+    pm_master_write_round_trip.record(get_ticks() - start_time);
 
     if (result_or_failure.get_ready_signal()->is_pulsed()) {
         if (const std::string *error = boost::get<std::string>(&result_or_failure.wait())) {
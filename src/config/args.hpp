@@ -118,6 +118,15 @@
 // on a specific slice at any given time.
 #define DEFAULT_MAX_CONCURRENT_FLUSHES            1
 
+// Page transactions that become ready to flush while a flush is running get flushed
+// together (with a single index write) once it's done.  The window is how many
+// milliseconds to additionally wait for company when no flush is running (0 means
+// don't wait), and the byte budget is how much dirty data a group may hold before
+// it gets flushed regardless.
+#define DEFAULT_FLUSH_GROUP_WINDOW_MS             0
+#define MAXIMUM_FLUSH_GROUP_WINDOW_MS             1000
+#define DEFAULT_FLUSH_GROUP_MAX_BYTES             (16 * MEGABYTE)
+
 // How many times the page replacement algorithm tries to find an eligible page before giving up.
 // Note that (MAX_UNSAVED_DATA_LIMIT_FRACTION ** PAGE_REPL_NUM_TRIES) is the probability that the
 // page replacement algorithm will succeed on a given try, and if that probability is less than 1/2
@@ -142,6 +151,19 @@
 // have to wait until the first one finishes
 #define MAX_CONCURRENT_QUERIES_PER_CONNECTION     500
 
+// How many queries a single client connection to the RDB protocol port can have
+// running at once.  The server stops reading from the connection until one of them
+// is done.
+#define MAX_CONCURRENT_RDB_QUERIES_PER_CONNECTION 64
+
+// How many TCP connections ("lanes") we open to each peer in the cluster, at most.
+// We open one per thread, up to this many, and serve each on its own thread.
+#define CLUSTER_CONNECTION_MAX_LANES              8
+
+// How long we wait for the extra lanes of a new cluster connection to come up
+// before going ahead with the ones we have.
+#define CLUSTER_CONNECTION_LANE_TIMEOUT_MS        5000
+
 // The number of concurrent queries when loading memcached operations from a file.
 #define MAX_CONCURRENT_QUEURIES_ON_IMPORT         1000
 
@@ -204,6 +226,15 @@
 // freed. This value is per thread.
 #define COROUTINE_FREE_LIST_SIZE                  64
 
+// How many of those unused coroutines keep all the memory that their stacks have
+// touched. The others give the unused parts of their stacks back to the OS. This
+// value is per thread.
+#define COROUTINE_WARM_FREE_LIST_SIZE             16
+
+// Coroutine stacks are carved out of memory mappings that hold this many stacks
+// each.
+#define COROUTINE_STACKS_PER_MAPPING              32
+
 #define MAX_COROS_PER_THREAD                      10000
 
 
@@ -75,6 +75,26 @@ void write_message_t::append(const void *p, int64_t n) {
     }
 }
 
+char *write_message_t::reserve(int64_t n) {
+    guarantee(n >= 0 && n <= write_buffer_t::DATA_SIZE);
+    if (buffers_.empty() || buffers_.tail()->size + n > write_buffer_t::DATA_SIZE) {
+        buffers_.push_back(new write_buffer_t);
+    }
+
+    write_buffer_t *b = buffers_.tail();
+    char *ret = b->data + b->size;
+    b->size += n;
+    return ret;
+}
+
+void write_message_t::append_message(write_message_t *other) {
+    guarantee(other != this);
+    while (write_buffer_t *buffer = other->buffers_.head()) {
+        other->buffers_.remove(buffer);
+        buffers_.push_back(buffer);
+    }
+}
+
 size_t write_message_t::size() const {
     size_t ret = 0;
     for (write_buffer_t *h = buffers_.head(); h != NULL; h = buffers_.next(h)) {
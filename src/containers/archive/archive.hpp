@@ -113,6 +113,15 @@ public:
 
     void append(const void *p, int64_t n);
 
+    // Appends `n` contiguous bytes and returns a pointer to them, so that they can
+    // be filled in later, e.g. with the size of what gets appended after them.
+    // `n` may be at most `write_buffer_t::DATA_SIZE`.
+    char *reserve(int64_t n);
+
+    // Moves the buffers of `other` onto the end of this message, without copying
+    // them. Leaves `other` empty.
+    void append_message(write_message_t *other);
+
     size_t size() const;
 
     intrusive_list_t<write_buffer_t> *unsafe_expose_buffers() { return &buffers_; }
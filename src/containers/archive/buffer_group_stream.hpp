@@ -15,6 +15,10 @@ public:
 
     virtual MUST_USE int64_t read(void *p, int64_t n);
 
+    // Moves to `offset` bytes from the start of the group.  Reads past the end of
+    // the group read nothing.
+    void seek(int64_t offset);
+
     bool entire_stream_consumed() const;
 
 private:
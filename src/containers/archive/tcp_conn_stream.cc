@@ -19,6 +19,15 @@ int64_t tcp_conn_stream_t::read(void *p, int64_t n) {
     // Right now this function cannot "error".
     try {
         cond_t non_closer;
+        // Deserializing a message makes lots of small reads. Those are served
+        // from the connection's read buffer, so that we go to the kernel once per
+        // buffer rather than once per field. Big reads go straight into `p`.
+        if (n < IO_BUFFER_SIZE) {
+            const_charslice buffered = conn_->peek();
+            if (buffered.beg == buffered.end) {
+                conn_->read_more_buffered(&non_closer);
+            }
+        }
         size_t result = conn_->read_some(p, n, &non_closer);
         rassert(result > 0);
         rassert(int64_t(result) <= n);
@@ -39,6 +48,21 @@ int64_t tcp_conn_stream_t::write(const void *p, int64_t n) {
     }
 }
 
+int64_t tcp_conn_stream_t::writev(const struct iovec *iov, size_t iovcnt) {
+    try {
+        // writev writes everything or throws an exception.
+        cond_t non_closer;
+        conn_->writev(iov, iovcnt, &non_closer);
+        int64_t n = 0;
+        for (size_t i = 0; i < iovcnt; ++i) {
+            n += iov[i].iov_len;
+        }
+        return n;
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        return -1;
+    }
+}
+
 void tcp_conn_stream_t::rethread(threadnum_t new_thread) {
     conn_->rethread(new_thread);
 }
@@ -98,6 +122,14 @@ int64_t keepalive_tcp_conn_stream_t::write(const void *p, int64_t n) {
     return tcp_conn_stream_t::write(p, n);
 }
 
+int64_t keepalive_tcp_conn_stream_t::writev(const struct iovec *iov, size_t iovcnt) {
+    if (keepalive_callback != NULL) {
+        keepalive_callback->keepalive_write();
+    }
+
+    return tcp_conn_stream_t::writev(iov, iovcnt);
+}
+
 rethread_tcp_conn_stream_t::rethread_tcp_conn_stream_t(tcp_conn_stream_t *conn, threadnum_t thread)
     : conn_(conn), old_thread_(conn->home_thread()), new_thread_(thread) {
     conn->rethread(thread);
@@ -414,13 +414,15 @@ region_t memcached_protocol_t::cpu_sharding_subspace(int subregion_number, int n
 store_t::store_t(serializer_t *serializer,
                  const std::string &perfmon_name,
                  int64_t cache_size,
+                 const page_cache_config_t &cache_config,
+                 cache_balancer_t *balancer,
                  bool create,
                  perfmon_collection_t *parent_perfmon_collection,
                  context_t *ctx,
                  io_backender_t *io,
                  const base_path_t &base_path)
     : btree_store_t<memcached_protocol_t>(
-            serializer, perfmon_name, cache_size,
+            serializer, perfmon_name, cache_size, cache_config, balancer,
             create, parent_perfmon_collection, ctx, io,
             base_path)
 { }
@@ -727,6 +729,12 @@ void store_t::protocol_reset_data(const region_t& subregion,
                           superblock, interruptor);
 }
 
+counted_t<compiled_sindex_t> store_t::protocol_compile_sindex(
+        UNUSED const secondary_index_t &sindex) {
+    // Memcached has no secondary indexes.
+    return counted_t<compiled_sindex_t>();
+}
+
 class generic_debug_print_visitor_t : public boost::static_visitor<void> {
 public:
     explicit generic_debug_print_visitor_t(printf_buffer_t *buf) : buf_(buf) { }
@@ -22,6 +22,7 @@
 #include "perfmon/types.hpp"
 #include "repli_timestamp.hpp"
 
+class cache_balancer_t;
 class io_backender_t;
 class real_superblock_t;
 class traversal_progress_combiner_t;
@@ -179,6 +180,8 @@ public:
         store_t(serializer_t *serializer,
                 const std::string &perfmon_name,
                 int64_t cache_quota,
+                const page_cache_config_t &cache_config,
+                cache_balancer_t *balancer,
                 bool create,
                 perfmon_collection_t *collection,
                 context_t *,
@@ -218,6 +221,9 @@ public:
                                  btree_slice_t *btree,
                                  superblock_t *superblock,
                                  signal_t *interruptor);
+
+        counted_t<compiled_sindex_t> protocol_compile_sindex(
+                const secondary_index_t &sindex);
     };
 
 };
@@ -17,8 +17,10 @@
 #include "perfmon/types.hpp"
 #include "utils.hpp"
 
+class cache_balancer_t;
 class signal_t;
 class io_backender_t;
+class page_cache_config_t;
 class serializer_t;
 
 namespace mock {
@@ -107,7 +109,10 @@ public:
 
         store_t();
         store_t(serializer_t *serializer, const std::string &perfmon_name,
-                UNUSED int64_t cache_size, bool create,
+                UNUSED int64_t cache_size,
+                const page_cache_config_t &cache_config,
+                cache_balancer_t *balancer,
+                bool create,
                 perfmon_collection_t *collection, context_t *ctx,
                 io_backender_t *io, const base_path_t &);
         ~store_t();
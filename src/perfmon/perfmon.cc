@@ -1,7 +1,9 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "perfmon/perfmon.hpp"
 
+#include <inttypes.h>
 #include <stdarg.h>
+#include <string.h>
 #include <math.h>
 #include <map>
 
@@ -138,6 +140,184 @@ scoped_ptr_t<perfmon_result_t> perfmon_sampler_t::output_stat(const stats_t &agg
     return stat;
 }
 
+/* perfmon_histogram_t */
+
+namespace perfmon_histogram {
+
+int bucket_for_value(uint64_t value) {
+    if (value >= (static_cast<uint64_t>(1) << max_value_bits)) {
+        return num_buckets - 1;
+    }
+    if (value < (static_cast<uint64_t>(2) << sub_bucket_bits)) {
+        return static_cast<int>(value);
+    }
+    int shift = (63 - __builtin_clzll(value)) - sub_bucket_bits;
+    /* `value >> shift` has `sub_bucket_bits + 1` bits and its top bit set, so the
+    buckets for each power of two follow right after those for the one below. */
+    return (shift << sub_bucket_bits) + static_cast<int>(value >> shift);
+}
+
+uint64_t bucket_upper_bound(int bucket) {
+    rassert(bucket >= 0 && bucket < num_buckets);
+    if (bucket < (2 << sub_bucket_bits)) {
+        return bucket;
+    }
+    int shift = (bucket >> sub_bucket_bits) - 1;
+    uint64_t sub_bucket = bucket - (shift << sub_bucket_bits);
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+stats_t::stats_t()
+    : count(0), min(std::numeric_limits<uint64_t>::max()), max(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void stats_t::record(uint64_t value) {
+    ++count;
+    min = std::min(min, value);
+    max = std::max(max, value);
+    ++buckets[bucket_for_value(value)];
+}
+
+void stats_t::aggregate(const stats_t &s) {
+    if (s.count == 0) {
+        return;
+    }
+    count += s.count;
+    min = std::min(min, s.min);
+    max = std::max(max, s.max);
+    for (int i = 0; i < num_buckets; ++i) {
+        buckets[i] += s.buckets[i];
+    }
+}
+
+uint64_t stats_t::value_at_percentile(double percentile) const {
+    rassert(count > 0);
+    // The epsilon keeps e.g. 99.9% of 1000 values from rounding up to 1000 values.
+    uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100 * count - 1e-6));
+    rank = std::min(std::max<uint64_t>(rank, 1), count);
+    uint64_t seen = 0;
+    for (int i = 0; i < num_buckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            if (i == num_buckets - 1) {
+                return max;
+            }
+            return std::min(std::max(bucket_upper_bound(i), min), max);
+        }
+    }
+    unreachable();
+}
+
+}   /* namespace perfmon_histogram */
+
+static std::vector<double> default_histogram_percentiles() {
+    std::vector<double> percentiles;
+    percentiles.push_back(50);
+    percentiles.push_back(90);
+    percentiles.push_back(99);
+    percentiles.push_back(99.9);
+    return percentiles;
+}
+
+perfmon_histogram_t::perfmon_histogram_t(ticks_t _length)
+    : perfmon_perthread_t<stats_t>(), length(_length),
+      percentiles(default_histogram_percentiles()) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_data[i] = NULL;
+    }
+}
+
+perfmon_histogram_t::perfmon_histogram_t(ticks_t _length,
+                                         const std::vector<double> &_percentiles)
+    : perfmon_perthread_t<stats_t>(), length(_length), percentiles(_percentiles) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_data[i] = NULL;
+    }
+}
+
+perfmon_histogram_t::~perfmon_histogram_t() {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        delete thread_data[i];
+    }
+}
+
+perfmon_histogram_t::thread_info_t *perfmon_histogram_t::get_thread_info() {
+    rassert(get_thread_id().threadnum >= 0);
+    thread_info_t **thread = &thread_data[get_thread_id().threadnum];
+    if (*thread == NULL) {
+        *thread = new thread_info_t;
+        (*thread)->current_interval = get_ticks() / length;
+    }
+    return *thread;
+}
+
+void perfmon_histogram_t::update(thread_info_t *thread, ticks_t now) {
+    int interval = now / length;
+
+    if (thread->current_interval == interval) {
+        /* We're up to date; nothing to do */
+    } else if (thread->current_interval + 1 == interval) {
+        /* We're one step behind */
+        thread->last_stats = thread->current_stats;
+        thread->current_stats = stats_t();
+        thread->current_interval++;
+    } else {
+        /* We're more than one step behind */
+        thread->last_stats = thread->current_stats = stats_t();
+        thread->current_interval = interval;
+    }
+}
+
+void perfmon_histogram_t::record(ticks_t value) {
+    thread_info_t *thread = get_thread_info();
+    update(thread, get_ticks());
+    thread->current_stats.record(value);
+}
+
+void perfmon_histogram_t::get_thread_stat(stats_t *stat) {
+    rassert(get_thread_id().threadnum >= 0);
+    thread_info_t *thread = thread_data[get_thread_id().threadnum];
+    if (thread == NULL) {
+        /* Nothing was ever recorded on this thread, and `stat` is already empty. */
+        return;
+    }
+    update(thread, get_ticks());
+    /* Like `perfmon_sampler_t`, we report the last complete interval. */
+    *stat = thread->last_stats;
+}
+
+perfmon_histogram_t::stats_t perfmon_histogram_t::combine_stats(const stats_t *stats) {
+    stats_t aggregated;
+    for (int i = 0; i < get_num_threads(); i++) {
+        aggregated.aggregate(stats[i]);
+    }
+    return aggregated;
+}
+
+scoped_ptr_t<perfmon_result_t> perfmon_histogram_t::output_stat(const stats_t &aggregated) {
+    scoped_ptr_t<perfmon_result_t> stat = perfmon_result_t::alloc_map_result();
+
+    stat->insert(stat_count, new perfmon_result_t(strprintf("%" PRIu64, aggregated.count)));
+    if (aggregated.count > 0) {
+        stat->insert(stat_min, new perfmon_result_t(strprintf("%.8f", ticks_to_secs(aggregated.min))));
+        stat->insert(stat_max, new perfmon_result_t(strprintf("%.8f", ticks_to_secs(aggregated.max))));
+    } else {
+        stat->insert(stat_min, new perfmon_result_t(no_value));
+        stat->insert(stat_max, new perfmon_result_t(no_value));
+    }
+    for (auto it = percentiles.begin(); it != percentiles.end(); ++it) {
+        std::string name = strprintf("p%g", *it);
+        if (aggregated.count > 0) {
+            stat->insert(name, new perfmon_result_t(strprintf("%.8f", ticks_to_secs(aggregated.value_at_percentile(*it)))));
+        } else {
+            stat->insert(name, new perfmon_result_t(no_value));
+        }
+    }
+
+    return stat;
+}
+
 /* perfmon_stddev_t */
 
 stddev_t::stddev_t()
@@ -290,10 +470,11 @@ scoped_ptr_t<perfmon_result_t> perfmon_rate_monitor_t::output_stat(const double
 }
 
 perfmon_duration_sampler_t::perfmon_duration_sampler_t(ticks_t length, bool _ignore_global_full_perfmon)
-    : stat(), active(), total(), recent(length, true),
+    : stat(), active(), total(), recent(length, true), recent_histogram(length),
       active_membership(&stat, &active, "active_count"),
       total_membership(&stat, &total, "total"),
       recent_membership(&stat, &recent, "recent_duration"),
+      recent_histogram_membership(&stat, &recent_histogram, "recent_duration_percentiles"),
       ignore_global_full_perfmon(_ignore_global_full_perfmon)
 { }
 
@@ -310,7 +491,9 @@ void perfmon_duration_sampler_t::begin(ticks_t *v) {
 void perfmon_duration_sampler_t::end(ticks_t *v) {
     --active;
     if (*v != 0) {
-        recent.record(ticks_to_secs(get_ticks() - *v));
+        ticks_t duration = get_ticks() - *v;
+        recent.record(ticks_to_secs(duration));
+        recent_histogram.record(duration);
     }
 }
 
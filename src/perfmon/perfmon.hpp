@@ -8,11 +8,14 @@
 #ifndef PERFMON_PERFMON_HPP_
 #define PERFMON_PERFMON_HPP_
 
+#include <stdint.h>
+
 #include <algorithm>
 #include <limits>
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "concurrency/cache_line_padded.hpp"
 #include "config/args.hpp"
@@ -137,6 +140,70 @@ public:
     void record(double value);
 };
 
+/* perfmon_histogram_t is like perfmon_sampler_t, but instead of the average it
+ * reports percentiles, which is what we need for tail latencies. Each thread
+ * counts its records into a log-linear histogram of its own, and the histograms
+ * are only merged when the stats are collected, so record() never touches memory
+ * that another thread writes. Values are durations in ticks; the percentiles are
+ * reported in seconds.
+ */
+
+namespace perfmon_histogram {
+
+/* Values below `2 ^ (sub_bucket_bits + 1)` each have a bucket of their own. Above
+that, every power of two is split into `2 ^ sub_bucket_bits` equally wide buckets,
+so a bucket is never wider than 1/32 of its lower bound. Values of `2 ^
+max_value_bits` ticks (about 18 minutes) and more all go into the last bucket. */
+const int sub_bucket_bits = 5;
+const int max_value_bits = 40;
+const int num_buckets = (max_value_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+int bucket_for_value(uint64_t value);
+// The greatest value that `bucket_for_value` maps to `bucket`.
+uint64_t bucket_upper_bound(int bucket);
+
+struct stats_t {
+    stats_t();
+    void record(uint64_t value);
+    void aggregate(const stats_t &s);
+    // The smallest bucket bound that at least `percentile` percent of the values
+    // are less than or equal to, clamped to the range of the recorded values.
+    uint64_t value_at_percentile(double percentile) const;
+
+    uint64_t count, min, max;
+    uint32_t buckets[num_buckets];
+};
+
+}   /* namespace perfmon_histogram */
+
+class perfmon_histogram_t : public perfmon_perthread_t<perfmon_histogram::stats_t> {
+    typedef perfmon_histogram::stats_t stats_t;
+    struct thread_info_t {
+        stats_t current_stats, last_stats;
+        int current_interval;
+    };
+
+    /* A thread's histograms are allocated the first time it records something,
+    so that a histogram only costs memory on the threads that use it. */
+    thread_info_t *thread_data[MAX_THREADS];
+
+    thread_info_t *get_thread_info();
+    void get_thread_stat(stats_t *);
+    stats_t combine_stats(const stats_t *);
+    scoped_ptr_t<perfmon_result_t> output_stat(const stats_t&);
+
+    void update(thread_info_t *thread, ticks_t now);
+
+    ticks_t length;
+    std::vector<double> percentiles;
+public:
+    // Reports the 50th, 90th, 99th and 99.9th percentiles.
+    explicit perfmon_histogram_t(ticks_t _length);
+    perfmon_histogram_t(ticks_t _length, const std::vector<double> &_percentiles);
+    virtual ~perfmon_histogram_t();
+    void record(ticks_t value);
+};
+
 // One-pass variance calculation algorithm/datastructure taken from
 // http://www.cs.berkeley.edu/~mhoemmen/cs194/Tutorials/variance.pdf
 struct stddev_t {
@@ -207,8 +274,8 @@ public:
 /* perfmon_duration_sampler_t is a perfmon_t that monitors events that have a
  * starting and ending time. When something starts, call begin(); when
  * something ends, call end() with the same value as begin. It will produce
- * stats for the number of active events, the average length of an event, and
- * so on. If `global_full_perfmon` is false, it won't report any timing-related
+ * stats for the number of active events, the average length of an event, its
+ * percentiles, and so on. If `global_full_perfmon` is false, it won't report any timing-related
  * stats because `get_ticks()` is rather slow.
  *
  * Frequently we're in the case where we'd like to have a single slow perfmon
@@ -223,9 +290,11 @@ private:
     perfmon_counter_t active;
     perfmon_counter_t total;
     perfmon_sampler_t recent;
+    perfmon_histogram_t recent_histogram;
     perfmon_membership_t active_membership;
     perfmon_membership_t total_membership;
     perfmon_membership_t recent_membership;
+    perfmon_membership_t recent_histogram_membership;
 
     bool ignore_global_full_perfmon;
 public:
@@ -260,4 +329,14 @@ struct block_pm_duration {
     }
 };
 
+struct block_pm_histogram {
+    ticks_t start;
+    perfmon_histogram_t *pm;
+    explicit block_pm_histogram(perfmon_histogram_t *_pm)
+        : start(get_ticks()), pm(_pm) { }
+    ~block_pm_histogram() {
+        pm->record(get_ticks() - start);
+    }
+};
+
 #endif /* PERFMON_PERFMON_HPP_ */
@@ -0,0 +1,70 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "protob/inplace_query_stream.hpp"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/message.h>
+
+#include "arch/io/network.hpp"
+
+bool parse_protob_in_place(tcp_conn_t *conn,
+                           int32_t size,
+                           google::protobuf::Message *message_out,
+                           signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t) {
+    guarantee(size >= 0);
+    const size_t frame_size = sizeof(int32_t) + static_cast<size_t>(size);
+    const_charslice frame = conn->peek(frame_size, closer);
+    const bool res = message_out->ParseFromArray(frame.beg + sizeof(int32_t), size);
+    conn->pop(frame_size, closer);
+    return res;
+}
+
+void serialize_protob_in_place(const google::protobuf::Message &message,
+                               tcp_conn_t *conn,
+                               signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    // This caches the sizes of the nested messages for the serialization below.
+    int32_t size = message.ByteSize();
+    conn->write_buffered(&size, sizeof(size), closer);
+    tcp_conn_output_stream_t stream(conn, closer);
+    {
+        google::protobuf::io::CodedOutputStream coded_stream(&stream);
+        message.SerializeWithCachedSizes(&coded_stream);
+        // The coded stream gives back the space it didn't use when it's destroyed.
+    }
+    if (stream.is_write_closed()) {
+        throw tcp_conn_write_closed_exc_t();
+    }
+    conn->flush_buffer(closer);
+}
+
+tcp_conn_output_stream_t::tcp_conn_output_stream_t(tcp_conn_t *_conn, signal_t *_closer)
+    : conn(_conn), closer(_closer), byte_count(0), write_closed(false) { }
+
+tcp_conn_output_stream_t::~tcp_conn_output_stream_t() { }
+
+bool tcp_conn_output_stream_t::Next(void **data, int *size) {
+    if (write_closed) {
+        return false;
+    }
+    try {
+        char *buf;
+        size_t buf_size;
+        conn->get_write_buffer_space(&buf, &buf_size, closer);
+        *data = buf;
+        *size = static_cast<int>(buf_size);
+        byte_count += buf_size;
+        return true;
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        write_closed = true;
+        return false;
+    }
+}
+
+void tcp_conn_output_stream_t::BackUp(int count) {
+    guarantee(count >= 0 && count <= byte_count);
+    conn->back_up_write_buffer(count);
+    byte_count -= count;
+}
+
+int64_t tcp_conn_output_stream_t::ByteCount() const {
+    return byte_count;
+}
@@ -0,0 +1,64 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef PROTOB_INPLACE_QUERY_STREAM_HPP_
+#define PROTOB_INPLACE_QUERY_STREAM_HPP_
+
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include "arch/types.hpp"
+#include "errors.hpp"
+
+class signal_t;
+
+namespace google {
+namespace protobuf {
+class Message;
+}  // namespace protobuf
+}  // namespace google
+
+/* `protob_server_t` reads requests and writes responses with these, without copying
+them through an intermediate buffer.  A frame on the wire is a 4-byte size followed
+by the serialized message. */
+
+/* Parses the message in the frame at the front of `conn`'s read buffer, whose size
+header says it's `size` bytes long, straight out of the buffer, then pops the whole
+frame.  Returns false if the message couldn't be parsed; the frame gets popped
+either way. */
+MUST_USE bool parse_protob_in_place(tcp_conn_t *conn,
+                                    int32_t size,
+                                    google::protobuf::Message *message_out,
+                                    signal_t *closer)
+    THROWS_ONLY(tcp_conn_read_closed_exc_t);
+
+/* Writes `message` to `conn` as a frame, serializing it straight into the
+connection's write buffer, and flushes the connection. */
+void serialize_protob_in_place(const google::protobuf::Message &message,
+                               tcp_conn_t *conn,
+                               signal_t *closer)
+    THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
+/* Lets protocol buffers get serialized straight into a `tcp_conn_t`'s write buffer.
+`ZeroCopyOutputStream` can't throw, so if the connection gets closed, `Next()`
+returns false and `is_write_closed()` becomes true; the caller should check it and
+throw `tcp_conn_write_closed_exc_t` itself.  Nothing gets sent until the caller
+flushes the connection. */
+class tcp_conn_output_stream_t : public google::protobuf::io::ZeroCopyOutputStream {
+public:
+    tcp_conn_output_stream_t(tcp_conn_t *conn, signal_t *closer);
+    ~tcp_conn_output_stream_t();
+
+    bool Next(void **data, int *size);
+    void BackUp(int count);
+    int64_t ByteCount() const;
+
+    bool is_write_closed() const { return write_closed; }
+
+private:
+    tcp_conn_t *conn;
+    signal_t *closer;
+    int64_t byte_count;
+    bool write_closed;
+
+    DISABLE_COPYING(tcp_conn_output_stream_t);
+};
+
+#endif  // PROTOB_INPLACE_QUERY_STREAM_HPP_
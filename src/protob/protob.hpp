@@ -16,6 +16,9 @@
 #include "arch/timing.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/fifo_enforcer.hpp"
+#include "concurrency/mutex.hpp"
+#include "concurrency/new_semaphore.hpp"
 #include "containers/archive/archive.hpp"
 #include "http/http.hpp"
 
@@ -123,6 +126,13 @@ private:
 // request_t::protob_type *underlying_protob_value(request_t *request);
 //
 // "request_t::protob_type" does not actually have to be defined.
+//
+// In the CORO_* modes, every request is handled in its own coroutine, and up to
+// `max_concurrent_requests` requests per connection can be running at once.  The
+// coroutines are spawned with `spawn_now_dangerously`, so `f` starts running for
+// the requests in the order they arrived; anything `f` does before it first blocks
+// happens in that order too.  Requests that come over HTTP are still run one at a
+// time per session.
 
 
 template <class request_t, class response_t, class context_t>
@@ -133,13 +143,35 @@ public:
                     boost::function<bool(request_t, response_t *, context_t *)> _f,  // NOLINT(readability/casting)
                     response_t (*_on_unparsable_query)(request_t, std::string),
                     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > _auth_metadata,
-                    protob_server_callback_mode_t _cb_mode = CORO_ORDERED);
+                    protob_server_callback_mode_t _cb_mode = CORO_ORDERED,
+                    int64_t _max_concurrent_requests = 1);
     ~protob_server_t();
 
     int get_port() const;
 private:
+    // The per-connection state for the CORO_* modes.
+    struct pipeline_t {
+        explicit pipeline_t(int64_t max_concurrent_requests)
+            : slots(max_concurrent_requests) { }
+        new_semaphore_t slots;
+        // Used in CORO_ORDERED mode to send the responses in order...
+        fifo_enforcer_source_t response_order_source;
+        fifo_enforcer_sink_t response_order_sink;
+        // ... and in CORO_UNORDERED mode to keep them from getting interleaved.
+        mutex_t send_mutex;
+    };
 
     void handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn, auto_drainer_t::lock_t);
+    void handle_pipelined_request(pipeline_t *pipeline,
+                                  tcp_conn_t *conn,
+                                  context_t *ctx,
+                                  signal_t *closer,
+                                  request_t request,
+                                  bool force_response,
+                                  response_t forced_response,
+                                  fifo_enforcer_write_token_t response_order_token,
+                                  new_semaphore_acq_t *slot,
+                                  auto_drainer_t::lock_t keepalive);
     void send(const response_t &, tcp_conn_t *conn, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
     static auth_key_t read_auth_key(tcp_conn_t *conn, signal_t *interruptor);
 
@@ -152,6 +184,7 @@ private:
     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > auth_metadata;
 
     protob_server_callback_mode_t cb_mode;
+    int64_t max_concurrent_requests;
 
     /* WARNING: The order here is fragile. */
     cond_t main_shutting_down_cond;
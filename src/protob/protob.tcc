@@ -17,7 +17,9 @@
 #include "arch/io/network.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/interruptor.hpp"
 #include "containers/auth_key.hpp"
+#include "protob/inplace_query_stream.hpp"
 #include "rpc/semilattice/joins/vclock.hpp"
 #include "rpc/semilattice/view.hpp"
 #include "rdb_protocol/env.hpp"
@@ -30,14 +32,17 @@ protob_server_t<request_t, response_t, context_t>::protob_server_t(
     boost::function<bool(request_t, response_t *, context_t *)> _f,  // NOLINT(readability/casting)
     response_t (*_on_unparsable_query)(request_t, std::string),
     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > _auth_metadata,
-    protob_server_callback_mode_t _cb_mode)
+    protob_server_callback_mode_t _cb_mode,
+    int64_t _max_concurrent_requests)
     : f(_f),
       on_unparsable_query(_on_unparsable_query),
       auth_metadata(_auth_metadata),
       cb_mode(_cb_mode),
+      max_concurrent_requests(_max_concurrent_requests),
       shutting_down_conds(get_num_threads()),
       pulse_sdc_on_shutdown(&main_shutting_down_cond),
       next_thread(0) {
+    guarantee(max_concurrent_requests > 0);
 
     for (int i = 0; i < get_num_threads(); ++i) {
         cross_thread_signal_t *s =
@@ -165,8 +170,30 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
         return;
     }
 
-    //TODO figure out how to do this with less copying
+    scoped_ptr_t<pipeline_t> pipeline;
+    if (cb_mode != INLINE) {
+        pipeline.init(new pipeline_t(max_concurrent_requests));
+    }
+    // Destroyed first, so that we wait for the requests that are still running
+    // before the connection and the context go away.  Waiting for their turn to
+    // send is only interrupted by `ct_keepalive`, i.e. on shutdown; if the client
+    // went away, they find out when their write fails.  (On Linux the queries
+    // themselves also stop early, since `ctx.interruptor` watches for the client
+    // hanging up.)
+    auto_drainer_t pipeline_drainer;
+
     for (;;) {
+        scoped_ptr_t<new_semaphore_acq_t> slot;
+        if (cb_mode != INLINE) {
+            // Don't read the next request until there's room for it to run.
+            slot.init(new new_semaphore_acq_t(&pipeline->slots, 1));
+            try {
+                wait_interruptible(slot->acquisition_signal(), &ct_keepalive);
+            } catch (const interrupted_exc_t &) {
+                return;
+            }
+        }
+
         request_t request;
         make_empty_protob_bearer(&request);
         bool force_response = false;
@@ -174,17 +201,16 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
         std::string err;
         try {
             int32_t size;
-            conn->read(&size, sizeof(int32_t), &ct_keepalive);
+            const_charslice header = conn->peek(sizeof(int32_t), &ct_keepalive);
+            memcpy(&size, header.beg, sizeof(int32_t));
             if (size < 0) {
+                conn->pop(sizeof(int32_t), &ct_keepalive);
                 err = strprintf("Negative protobuf size (%d).", size);
                 forced_response = on_unparsable_query(request_t(), err);
                 force_response = true;
             } else {
-                scoped_array_t<char> data(size);
-                conn->read(data.data(), size, &ct_keepalive);
-
-                const bool res
-                    = underlying_protob_value(&request)->ParseFromArray(data.data(), size);
+                const bool res = parse_protob_in_place(
+                    conn.get(), size, underlying_protob_value(&request), &ct_keepalive);
                 if (!res) {
                     err = "Client is buggy (failed to deserialize protobuf).";
                     forced_response = on_unparsable_query(request, err);
@@ -192,8 +218,6 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
                 }
             }
         } catch (const tcp_conn_read_closed_exc_t &) {
-            //TODO need to figure out what blocks us up here in non inline cb
-            //mode
             return;
         }
 
@@ -211,34 +235,78 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
                 }
                 break;
             case CORO_ORDERED:
-                crash("unimplemented");
-                break;
             case CORO_UNORDERED:
-                crash("unimplemented");
+                coro_t::spawn_now_dangerously(std::bind(
+                    &protob_server_t<request_t, response_t, context_t>::handle_pipelined_request,
+                    this, pipeline.get(), conn.get(), &ctx, &ct_keepalive,
+                    request, force_response, forced_response,
+                    pipeline->response_order_source.enter_write(),
+                    slot.release(), pipeline_drainer.lock()));
                 break;
             default:
                 crash("unreachable");
                 break;
             }
         } catch (const tcp_conn_write_closed_exc_t &) {
-            //TODO need to figure out what blocks us up here in non inline cb
-            //mode
             return;
         }
     }
 }
 
+template <class request_t, class response_t, class context_t>
+void protob_server_t<request_t, response_t, context_t>::handle_pipelined_request(
+    pipeline_t *pipeline,
+    tcp_conn_t *conn,
+    context_t *ctx,
+    signal_t *closer,
+    request_t request,
+    bool force_response,
+    response_t forced_response,
+    fifo_enforcer_write_token_t response_order_token,
+    new_semaphore_acq_t *slot,
+    auto_drainer_t::lock_t) {
+    // The slot is held until the response is sent, so that there can't be more
+    // than `max_concurrent_requests` responses waiting for their turn either.
+    scoped_ptr_t<new_semaphore_acq_t> slot_holder(slot);
+
+    response_t response;
+    bool response_needed = true;
+    if (force_response) {
+        response.Swap(&forced_response);
+    } else {
+        response_needed = f(request, &response, ctx);
+    }
+
+    try {
+        if (cb_mode == CORO_ORDERED) {
+            // Even when there's nothing to send, we have to take our turn, or the
+            // requests behind us would wait forever.
+            fifo_enforcer_sink_t::exit_write_t exit_write(
+                &pipeline->response_order_sink, response_order_token);
+            wait_interruptible(&exit_write, closer);
+            if (response_needed) {
+                send(response, conn, closer);
+            }
+        } else if (response_needed) {
+            mutex_t::acq_t send_acq(&pipeline->send_mutex);
+            send(response, conn, closer);
+        }
+    } catch (const interrupted_exc_t &) {
+        // We're shutting down.
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        // Nobody will read the responses, so stop reading requests too.
+        if (conn->is_read_open()) {
+            conn->shutdown_read();
+        }
+    }
+}
+
 template <class request_t, class response_t, class context_t>
 void protob_server_t<request_t, response_t, context_t>::send(
     const response_t &res,
     tcp_conn_t *conn,
     signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
-    int size = res.ByteSize();
-    conn->write(&size, sizeof(res.ByteSize()), closer);
-    scoped_array_t<char> data(size);
-
-    res.SerializeToArray(data.data(), size);
-    conn->write(data.data(), size, closer);
+    serialize_protob_in_place(res, conn, closer);
 }
 
 // Used in protob_server_t::handle(...) below to combine the interruptor from the
@@ -326,8 +394,12 @@ void protob_server_t<request_t, response_t, context_t>::handle(const http_req_t
                 = underlying_protob_value(&request)->ParseFromArray(data, req_size);
 
             response_t response;
+            // Sessions only run one query at a time (see `conn_acq_t`), so the mode
+            // doesn't matter here.
             switch (cb_mode) {
             case INLINE:
+            case CORO_ORDERED:
+            case CORO_UNORDERED:
                 {
                     boost::shared_ptr<typename http_conn_cache_t<context_t>::http_conn_t> conn =
                         http_conn_cache.find(conn_id);
@@ -367,9 +439,6 @@ void protob_server_t<request_t, response_t, context_t>::handle(const http_req_t
                     }
                 }
                 break;
-            case CORO_ORDERED:
-            case CORO_UNORDERED:
-                crash("unimplemented");
             default:
                 crash("unreachable");
                 break;
@@ -17,6 +17,11 @@ static const int64_t DEFAULT_MAX_DURATION = 500 * 1000;
 // for an explanation.
 static const int64_t DIVISOR_SCALING_FACTOR = 8;
 static const int64_t SCALE_CONSTANT = 8;
+// `batch_tuner_t` never makes batches more than this many times as large as the
+// size limit the user asked for.
+static const int64_t MAX_SIZE_FACTOR = 8;
+// The weight of a new batch in `batch_tuner_t`'s average element size, as 1/N.
+static const int64_t EL_SIZE_SMOOTHING = 4;
 
 batchspec_t::batchspec_t(
     batch_type_t _batch_type,
@@ -137,6 +142,22 @@ batchspec_t batchspec_t::scale_down(int64_t divisor) const {
                        first_scaledown_factor, end_time);
 }
 
+batchspec_t batchspec_t::with_scaled_size(int64_t factor, int64_t el_size) const {
+    r_sanity_check(factor >= 1);
+    if (batch_type != batch_type_t::NORMAL) {
+        return *this;
+    }
+    int64_t new_max_size =
+        max_size > std::numeric_limits<decltype(batchspec_t().max_size)>::max() / factor
+            ? std::numeric_limits<decltype(batchspec_t().max_size)>::max()
+            : max_size * factor;
+    int64_t new_min_els = el_size <= 0
+        ? min_els
+        : std::max<int64_t>(1, std::min(min_els, new_max_size / el_size));
+    return batchspec_t(batch_type, new_min_els, max_els, new_max_size,
+                       first_scaledown_factor, end_time);
+}
+
 batcher_t batchspec_t::to_batcher() const {
     int64_t real_min_els =
         batch_type != batch_type_t::NORMAL_FIRST
@@ -183,6 +204,30 @@ batcher_t::batcher_t(
       size_left(max_size),
       end_time(_end_time) { }
 
+batch_tuner_t::batch_tuner_t() : size_factor(1), el_size(0) { }
+
+batchspec_t batch_tuner_t::adapt(const batchspec_t &batchspec) const {
+    return batchspec.with_scaled_size(size_factor, el_size);
+}
+
+void batch_tuner_t::note_batch(size_t num_els, size_t size) {
+    if (num_els == 0) {
+        return;
+    }
+    int64_t batch_el_size = std::max<int64_t>(1, size / num_els);
+    el_size = el_size == 0
+        ? batch_el_size
+        : el_size + (batch_el_size - el_size) / EL_SIZE_SMOOTHING;
+}
+
+void batch_tuner_t::note_batch_ready(bool was_ready) {
+    if (was_ready) {
+        size_factor = std::min(MAX_SIZE_FACTOR, size_factor * 2);
+    } else {
+        size_factor = std::max<int64_t>(1, size_factor / 2);
+    }
+}
+
 size_t array_size_limit() { return 100000; }
 
 } // namespace ql
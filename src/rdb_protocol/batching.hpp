@@ -75,6 +75,10 @@ public:
     batchspec_t with_new_batch_type(batch_type_t new_batch_type) const;
     batchspec_t with_at_most(uint64_t max_els) const;
     batchspec_t scale_down(int64_t divisor) const;
+    // Multiplies the size limit of a NORMAL batch by `factor`, and lowers the
+    // minimum number of elements if that many elements of `el_size` bytes each
+    // wouldn't fit into it.
+    batchspec_t with_scaled_size(int64_t factor, int64_t el_size) const;
     batcher_t to_batcher() const;
     RDB_MAKE_ME_SERIALIZABLE_6(batch_type, min_els, max_els, max_size, \
                                first_scaledown_factor, end_time);
@@ -90,6 +94,25 @@ private:
     microtime_t end_time;
 };
 
+/* `batch_tuner_t` adapts the batches of one cursor to the size of its elements and
+to how fast the client consumes them.  While the client takes longer to ask for
+the next batch than we take to fetch it, the batches grow, so that the client
+waits for fewer round trips.  Once the client has to wait for us, they shrink
+again. */
+class batch_tuner_t {
+public:
+    batch_tuner_t();
+    batchspec_t adapt(const batchspec_t &batchspec) const;
+    // Records a batch of `num_els` elements that took `size` bytes.
+    void note_batch(size_t num_els, size_t size);
+    // Records whether the batch the client asked for was ready in advance.
+    void note_batch_ready(bool was_ready);
+private:
+    int64_t size_factor;
+    // The average size of an element, or 0 before we've seen one.
+    int64_t el_size;
+};
+
 // TODO: make user-tunable.
 size_t array_size_limit();
 
@@ -1,10 +1,14 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/btree.hpp"
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "btree/backfill.hpp"
+#include "btree/bulk_load.hpp"
 #include "btree/concurrent_traversal.hpp"
 #include "btree/erase_range.hpp"
 #include "btree/get_distribution.hpp"
@@ -84,6 +88,27 @@ void rdb_get(const store_key_t &store_key, btree_slice_t *slice,
     }
 }
 
+void rdb_get_batch(const std::vector<store_key_t> &keys, btree_slice_t *slice,
+                   superblock_t *superblock, batched_point_read_response_t *response,
+                   profile::trace_t *trace) {
+    std::vector<store_key_t> sorted_keys(keys);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()),
+                      sorted_keys.end());
+
+    profile::starter_t starter("Look up a batch of keys.", trace);
+    value_sizer_t<rdb_value_t> sizer(superblock->cache()->get_block_size());
+    sorted_point_reader_t reader(&sizer, superblock, &slice->stats);
+    scoped_malloc_t<rdb_value_t> value(sizer.max_possible_size());
+    for (auto it = sorted_keys.begin(); it != sorted_keys.end(); ++it) {
+        if (reader.lookup(it->btree_key(), value.get())) {
+            response->data.insert(
+                response->data.end(),
+                std::make_pair(*it, get_data(value.get(), reader.expose_leaf())));
+        }
+    }
+}
+
 void kv_location_delete(keyvalue_location_t<rdb_value_t> *kv_location,
                         const store_key_t &key,
                         repli_timestamp_t timestamp,
@@ -115,6 +140,7 @@ void kv_location_delete(keyvalue_location_t<rdb_value_t> *kv_location,
 void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location,
                      const store_key_t &key,
                      counted_t<const ql::datum_t> data,
+                     ql::row_format_t row_format,
                      repli_timestamp_t timestamp,
                      rdb_modification_info_t *mod_info_out) {
     scoped_malloc_t<rdb_value_t> new_value(blob::btree_maxreflen);
@@ -123,7 +149,9 @@ void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location,
     const block_size_t block_size = kv_location->buf.cache()->get_block_size();
     {
         blob_t blob(block_size, new_value->value_ref(), blob::btree_maxreflen);
-        serialize_onto_blob(buf_parent_t(&kv_location->buf), &blob, data);
+        write_message_t wm;
+        ql::serialize_row(&wm, data, row_format);
+        write_onto_blob(buf_parent_t(&kv_location->buf), &blob, wm);
     }
 
     if (mod_info_out) {
@@ -249,7 +277,8 @@ batched_replace_response_t rdb_replace_and_return_superblock(
             } else {
                 conflict = resp.add("inserted", make_counted<ql::datum_t>(1.0));
                 r_sanity_check(new_val->get(primary_key, ql::NOTHROW).has());
-                kv_location_set(&kv_location, *info.key, new_val, info.btree->timestamp,
+                kv_location_set(&kv_location, *info.key, new_val,
+                                info.btree->row_format, info.btree->timestamp,
                                 mod_info_out);
                 guarantee(mod_info_out->deleted.second.empty());
                 guarantee(!mod_info_out->added.second.empty());
@@ -273,6 +302,7 @@ batched_replace_response_t rdb_replace_and_return_superblock(
                     conflict = resp.add("replaced", make_counted<ql::datum_t>(1.0));
                     r_sanity_check(new_val->get(primary_key, ql::NOTHROW).has());
                     kv_location_set(&kv_location, *info.key, new_val,
+                                    info.btree->row_format,
                                     info.btree->timestamp,
                                     mod_info_out);
                     guarantee(!mod_info_out->deleted.second.empty());
@@ -313,29 +343,16 @@ private:
 
 void do_a_replace_from_batched_replace(
     auto_drainer_t::lock_t,
-    fifo_enforcer_sink_t *batched_replaces_fifo_sink,
-    const fifo_enforcer_write_token_t &batched_replaces_fifo_token,
     const btree_loc_info_t &info,
     const one_replace_t one_replace,
     promise_t<superblock_t *> *superblock_promise,
-    rdb_modification_report_cb_t *sindex_cb,
+    rdb_modification_report_t *mod_report_out,
     batched_replace_response_t *stats_out,
     profile::trace_t *trace)
 {
-    fifo_enforcer_sink_t::exit_write_t exiter(
-        batched_replaces_fifo_sink, batched_replaces_fifo_token);
-
-    rdb_modification_report_t mod_report(*info.key);
     counted_t<const ql::datum_t> res = rdb_replace_and_return_superblock(
-        info, &one_replace, superblock_promise, &mod_report.info, trace);
+        info, &one_replace, superblock_promise, &mod_report_out->info, trace);
     *stats_out = (*stats_out)->merge(res, ql::stats_merge);
-
-    // KSI: What is this for?  are we waiting to get in line to call on_mod_report?
-    // I guess so.
-
-    // JD: Looks like this is a do_a_replace_from_batched_replace specific thing.
-    exiter.wait();
-    sindex_cb->on_mod_report(mod_report);
 }
 
 batched_replace_response_t rdb_batched_replace(
@@ -346,11 +363,16 @@ batched_replace_response_t rdb_batched_replace(
     rdb_modification_report_cb_t *sindex_cb,
     profile::trace_t *trace) {
 
-    fifo_enforcer_source_t batched_replaces_fifo_source;
-    fifo_enforcer_sink_t batched_replaces_fifo_sink;
-
     counted_t<const ql::datum_t> stats(new ql::datum_t(ql::datum_t::R_OBJECT));
 
+    // Every replace fills in its own report, and the secondary indexes are
+    // updated for all of them at once below.
+    std::vector<rdb_modification_report_t> mod_reports;
+    mod_reports.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        mod_reports.push_back(rdb_modification_report_t(keys[i]));
+    }
+
     // We have to drain write operations before destructing everything above us,
     // because the coroutines being drained use them.
     {
@@ -365,25 +387,118 @@ batched_replace_response_t rdb_batched_replace(
                 std::bind(
                     &do_a_replace_from_batched_replace,
                     auto_drainer_t::lock_t(&drainer),
-                    &batched_replaces_fifo_sink,
-                    batched_replaces_fifo_source.enter_write(),
 
                     btree_loc_info_t(&info, current_superblock.release(), &keys[i]),
                     one_replace_t(replacer, i),
 
                     &superblock_promise,
-                    sindex_cb,
+                    &mod_reports[i],
                     &stats,
                     trace));
 
             current_superblock.init(superblock_promise.wait());
         }
     } // Make sure the drainer is destructed before the return statement.
+
+    sindex_cb->on_mod_reports(mod_reports);
     return stats;
 }
 
+bool rdb_bulk_insert(
+    const btree_info_t &info,
+    scoped_ptr_t<superblock_t> *superblock,
+    const std::vector<store_key_t> &keys,
+    const std::vector<counted_t<const ql::datum_t> > &inserts,
+    rdb_modification_report_cb_t *sindex_cb,
+    batched_replace_response_t *response_out) {
+    guarantee(keys.size() == inserts.size());
+    if ((*superblock)->get_root_block_id() != NULL_BLOCK_ID) {
+        return false;
+    }
+
+    std::vector<std::pair<store_key_t, size_t> > order;
+    order.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        order.push_back(std::make_pair(keys[i], i));
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 1; i < order.size(); ++i) {
+        if (order[i - 1].first == order[i].first) {
+            return false;
+        }
+    }
+
+    // Check the documents in their original order, so that the stats (and the
+    // first error in particular) come out the way `rdb_batched_replace()` would
+    // report them.
+    const std::string &primary_key = *info.primary_key;
+    counted_t<const ql::datum_t> stats(new ql::datum_t(ql::datum_t::R_OBJECT));
+    std::vector<bool> valid(inserts.size(), false);
+    for (size_t i = 0; i < inserts.size(); ++i) {
+        const counted_t<const ql::datum_t> &new_val = inserts[i];
+        ql::datum_ptr_t resp(ql::datum_t::R_OBJECT);
+        try {
+            if (new_val->get_type() != ql::datum_t::R_OBJECT) {
+                rfail_typed_target(
+                    new_val, "Inserted value must be an OBJECT (got %s):\n%s",
+                    new_val->get_type_name().c_str(), new_val->print().c_str());
+            }
+            new_val->rcheck_valid_replace(
+                make_counted<ql::datum_t>(ql::datum_t::R_NULL),
+                counted_t<const ql::datum_t>(), primary_key);
+            bool conflict = resp.add("inserted", make_counted<ql::datum_t>(1.0));
+            guarantee(!conflict);
+            valid[i] = true;
+        } catch (const ql::base_exc_t &e) {
+            resp.add_error(e.what());
+        }
+        stats = stats->merge(resp.to_counted(), ql::stats_merge);
+    }
+
+    std::vector<rdb_modification_report_t> mod_reports;
+    mod_reports.reserve(inserts.size());
+    {
+        // Like in `rdb_batched_replace()`, the superblock goes away before we touch
+        // the secondary indexes.
+        scoped_ptr_t<superblock_t> current_superblock(superblock->release());
+        value_sizer_t<rdb_value_t> sizer(current_superblock->cache()->get_block_size());
+        const block_size_t block_size = sizer.block_size();
+        btree_bulk_loader_t loader(&sizer, current_superblock.get(),
+                                   info.timestamp, &info.slice->stats);
+        for (auto it = order.begin(); it != order.end(); ++it) {
+            if (!valid[it->second]) {
+                continue;
+            }
+            const counted_t<const ql::datum_t> &new_val = inserts[it->second];
+
+            scoped_malloc_t<rdb_value_t> value(blob::btree_maxreflen);
+            memset(value.get(), 0, blob::btree_maxreflen);
+            {
+                blob_t blob(block_size, value->value_ref(), blob::btree_maxreflen);
+                write_message_t wm;
+                ql::serialize_row(&wm, new_val, info.row_format);
+                write_onto_blob(loader.expose_leaf(), &blob, wm);
+            }
+            loader.add(it->first.btree_key(), value.get());
+
+            mod_reports.push_back(rdb_modification_report_t(it->first));
+            rdb_modification_info_t *mod_info = &mod_reports.back().info;
+            mod_info->added.first = new_val;
+            mod_info->added.second.assign(
+                value->value_ref(),
+                value->value_ref() + value->inline_size(block_size));
+        }
+        loader.finish();
+    }
+
+    sindex_cb->on_mod_reports(mod_reports);
+    *response_out = stats;
+    return true;
+}
+
 void rdb_set(const store_key_t &key,
              counted_t<const ql::datum_t> data,
+             ql::row_format_t row_format,
              bool overwrite,
              btree_slice_t *slice,
              repli_timestamp_t timestamp,
@@ -406,7 +521,7 @@ void rdb_set(const store_key_t &key,
     mod_info->added.first = data;
 
     if (overwrite || !had_value) {
-        kv_location_set(&kv_location, key, data, timestamp, mod_info);
+        kv_location_set(&kv_location, key, data, row_format, timestamp, mod_info);
         guarantee(mod_info->deleted.second.empty() == !had_value &&
                   !mod_info->added.second.empty());
     }
@@ -536,6 +651,20 @@ private:
 };
 
 typedef btree_store_t<rdb_protocol_t>::sindex_access_t sindex_access_t;
+void rdb_modification_report_cb_t::on_mod_reports(
+        const std::vector<rdb_modification_report_t> &mod_reports) {
+    mutex_t::acq_t acq;
+    store_->lock_sindex_queue(sindex_block_, &acq);
+
+    for (auto it = mod_reports.begin(); it != mod_reports.end(); ++it) {
+        write_message_t wm;
+        wm << rdb_sindex_change_t(*it);
+        store_->sindex_queue_push(wm, &acq);
+    }
+
+    rdb_bulk_update_sindexes(sindexes_, &mod_reports, sindex_block_->txn());
+}
+
 typedef btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindex_access_vector_t;
 
 void sindex_erase_range(const key_range_t &key_range,
@@ -660,15 +789,22 @@ typedef rdb_protocol_details::terminal_variant_t terminal_variant_t;
 class sindex_data_t {
 public:
     sindex_data_t(const key_range_t &_pkey_range, const datum_range_t &_range,
-                  ql::map_wire_func_t wire_func, sindex_multi_bool_t _multi)
+                  ql::map_wire_func_t wire_func, sindex_multi_bool_t _multi,
+                  const sindex_covered_fields_t &_covered_fields,
+                  sorted_point_reader_t *_primary_reader)
         : pkey_range(_pkey_range), range(_range),
-          func(wire_func.compile_wire_func()), multi(_multi) { }
+          func(wire_func.compile_wire_func()), multi(_multi),
+          covered_fields(_covered_fields), primary_reader(_primary_reader) {
+        guarantee(!covered_fields == (primary_reader == NULL));
+    }
 private:
     friend class rget_cb_t;
     const key_range_t pkey_range;
     const datum_range_t range;
     const counted_t<ql::func_t> func;
     const sindex_multi_bool_t multi;
+    const sindex_covered_fields_t covered_fields;
+    sorted_point_reader_t *const primary_reader;
 };
 
 class job_data_t {
@@ -687,11 +823,48 @@ public:
             transformers.emplace_back(ql::make_op(env, _transforms[i]));
         }
         guarantee(transformers.size() == _transforms.size());
+        if (!_transforms.empty()) {
+            if (const ql::filter_wire_func_t *filter
+                    = boost::get<ql::filter_wire_func_t>(&_transforms[0])) {
+                counted_t<ql::func_t> func = filter->filter_func.compile_wire_func();
+                std::vector<ql::field_predicate_t> predicates;
+                if (func->get_field_predicates(&predicates)) {
+                    std::vector<std::string> fields;
+                    for (auto it = predicates.begin(); it != predicates.end(); ++it) {
+                        if (std::find(fields.begin(), fields.end(), it->get_field())
+                            == fields.end()) {
+                            fields.push_back(it->get_field());
+                        }
+                    }
+                    // A pseudotype's fields only make sense together.
+                    if (std::find(fields.begin(), fields.end(),
+                                  ql::datum_t::reql_type_string) == fields.end()) {
+                        prefilter.swap(predicates);
+                        prefilter_fields.swap(fields);
+                        prefilter_func = func;
+                    }
+                }
+            } else if (const ql::project_wire_func_t *project
+                           = boost::get<ql::project_wire_func_t>(&_transforms[0])) {
+                std::vector<std::string> fields;
+                if (project->get_kind() == ql::project_kind_t::PLUCK
+                    && project->get_top_level_fields(&fields)
+                    // A pseudotype's fields only make sense together.
+                    && std::find(fields.begin(), fields.end(),
+                                 ql::datum_t::reql_type_string) == fields.end()) {
+                    plucked_fields.swap(fields);
+                }
+            }
+        }
     }
     job_data_t(job_data_t &&jd)
         : env(jd.env),
           batcher(std::move(jd.batcher)),
           transformers(std::move(jd.transformers)),
+          prefilter(std::move(jd.prefilter)),
+          prefilter_fields(std::move(jd.prefilter_fields)),
+          prefilter_func(std::move(jd.prefilter_func)),
+          plucked_fields(std::move(jd.plucked_fields)),
           sorting(jd.sorting),
           accumulator(jd.accumulator.release()) {
     }
@@ -700,6 +873,15 @@ private:
     ql::env_t *const env;
     ql::batcher_t batcher;
     std::vector<scoped_ptr_t<ql::op_t> > transformers;
+    // If the first transformer is a filter that only tests a few fields of the
+    // row, these are its tests, so that rows it rejects don't have to be loaded.
+    std::vector<ql::field_predicate_t> prefilter;
+    // The fields `prefilter` tests, each once.
+    std::vector<std::string> prefilter_fields;
+    counted_t<ql::func_t> prefilter_func;
+    // If the first transformer plucks top-level fields, these are the fields, so
+    // that the rest of the row doesn't have to be loaded.
+    std::vector<std::string> plucked_fields;
     sorting_t sorting;
     scoped_ptr_t<ql::accumulator_t> accumulator;
 };
@@ -726,9 +908,23 @@ public:
     THROWS_ONLY(interrupted_exc_t);
     void finish() THROWS_ONLY(interrupted_exc_t);
 private:
+    // Returns true if the filter at the front of the job is sure to reject `row`.
+    bool prefilter_rejects(const lazy_json_t &row) const;
+    // Loads only the fields the first transformer plucks, or returns an empty
+    // pointer if the whole row has to be loaded after all.
+    counted_t<const ql::datum_t> load_plucked_fields(const lazy_json_t &row) const;
+    // Returns the row that an entry of a covering sindex is for, or an empty
+    // pointer if it's gone.  Only the covered fields are returned if those are all
+    // the job needs.  Sets `*sindex_val_out` if the entry holds the index value.
+    counted_t<const ql::datum_t> load_covered_row(
+        const counted_t<const ql::datum_t> &entry,
+        counted_t<const ql::datum_t> *sindex_val_out);
+
     const io_data_t io; // How do get data in/out.
     job_data_t job; // What to do next (stateful).
     const boost::optional<sindex_data_t> sindex; // Optional sindex information.
+    // True if the sindex is covering and the job only needs the covered fields.
+    bool covered_fields_suffice;
 
     // State for internal bookkeeping.
     bool bad_init;
@@ -743,7 +939,23 @@ rget_cb_t::rget_cb_t(io_data_t &&_io,
     : io(std::move(_io)),
       job(std::move(_job)),
       sindex(std::move(_sindex)),
+      covered_fields_suffice(false),
       bad_init(false) {
+    if (sindex && sindex->covered_fields) {
+        const std::vector<std::string> &covered = *sindex->covered_fields;
+        if (job.transformers.empty()) {
+            covered_fields_suffice = !job.accumulator->uses_val();
+        } else if (!job.plucked_fields.empty()) {
+            covered_fields_suffice = true;
+            for (auto it = job.plucked_fields.begin();
+                 it != job.plucked_fields.end();
+                 ++it) {
+                if (std::find(covered.begin(), covered.end(), *it) == covered.end()) {
+                    covered_fields_suffice = false;
+                }
+            }
+        }
+    }
     io.response->last_key = !reversed(job.sorting)
         ? range.left
         : (!range.right.unbounded ? range.right.key : store_key_t::max());
@@ -752,6 +964,63 @@ rget_cb_t::rget_cb_t(io_data_t &&_io,
                                         job.env->trace));
 }
 
+bool rget_cb_t::prefilter_rejects(const lazy_json_t &row) const {
+    if (job.prefilter.empty()) {
+        return false;
+    }
+    counted_t<const ql::datum_t> fields;
+    if (!row.get_fields(job.prefilter_fields, &fields)) {
+        // We'd have to load the whole row anyway.
+        return false;
+    }
+    for (auto it = job.prefilter.begin(); it != job.prefilter.end(); ++it) {
+        counted_t<const ql::datum_t> field = fields->get(it->get_field(), ql::NOTHROW);
+        if (!field.has()) {
+            // The filter is going to throw (and maybe use its default).
+            return false;
+        }
+        try {
+            if (!it->test(field, job.prefilter_func.get())) {
+                return true;
+            }
+        } catch (const ql::base_exc_t &) {
+            return false;
+        }
+    }
+    return false;
+}
+
+counted_t<const ql::datum_t>
+rget_cb_t::load_plucked_fields(const lazy_json_t &row) const {
+    if (job.plucked_fields.empty() || sindex) {
+        return counted_t<const ql::datum_t>();
+    }
+    counted_t<const ql::datum_t> fields;
+    if (!row.get_fields(job.plucked_fields, &fields)) {
+        return counted_t<const ql::datum_t>();
+    }
+    // The pluck still runs on the result, which doesn't change it.
+    return fields;
+}
+
+counted_t<const ql::datum_t> rget_cb_t::load_covered_row(
+        const counted_t<const ql::datum_t> &entry,
+        counted_t<const ql::datum_t> *sindex_val_out) {
+    // See `make_covering_value()`.
+    if (entry->size() == 3) {
+        *sindex_val_out = entry->get(1);
+        if (covered_fields_suffice) {
+            return entry->get(2);
+        }
+    }
+    store_key_t primary_key(entry->get(0)->as_str().to_std());
+    scoped_malloc_t<rdb_value_t> value(blob::btree_maxreflen);
+    if (!sindex->primary_reader->lookup(primary_key.btree_key(), value.get())) {
+        return counted_t<const ql::datum_t>();
+    }
+    return get_data(value.get(), sindex->primary_reader->expose_leaf());
+}
+
 void rget_cb_t::finish() THROWS_ONLY(interrupted_exc_t) {
     job.accumulator->finish(&io.response->result);
     if (job.accumulator->should_send_batch()) {
@@ -778,9 +1047,23 @@ THROWS_ONLY(interrupted_exc_t) {
     lazy_json_t row(static_cast<const rdb_value_t *>(keyvalue.value()),
                     keyvalue.expose_buf());
     counted_t<const ql::datum_t> val;
-    // We only load the value if we actually use it (`count` does not).
-    if (job.accumulator->uses_val() || job.transformers.size() != 0 || sindex) {
-        val = row.get();
+    // The entries of a covering sindex are small, so we always load them.  The row
+    // they're for is loaded below, once it's our turn to use `primary_reader`.
+    counted_t<const ql::datum_t> covering_entry;
+    const bool covering = sindex && sindex->covered_fields;
+    const bool rejected = !covering && prefilter_rejects(row);
+    if (covering) {
+        covering_entry = row.get();
+        row.reset();
+        io.slice->stats.pm_keys_read.record();
+    } else if (!rejected
+        && (job.accumulator->uses_val() || job.transformers.size() != 0 || sindex)) {
+        // We only load the value if we actually use it (`count` does not, and
+        // neither does a row the filter rejects).
+        val = load_plucked_fields(row);
+        if (!val.has()) {
+            val = row.get();
+        }
         io.slice->stats.pm_keys_read.record();
     } else {
         row.reset();
@@ -796,9 +1079,20 @@ THROWS_ONLY(interrupted_exc_t) {
             io.response->last_key = key;
         }
 
+        if (rejected) {
+            // The filter drops the row, so nothing after it would see it.
+            return done_traversing_t::NO;
+        }
+
         // Check whether we're out of sindex range.
         counted_t<const ql::datum_t> sindex_val; // NULL if no sindex.
-        if (sindex) {
+        if (covering_entry.has()) {
+            val = load_covered_row(covering_entry, &sindex_val);
+            if (!val.has()) {
+                return done_traversing_t::NO;
+            }
+        }
+        if (sindex && !sindex_val.has()) {
             sindex_val = sindex->func->call(job.env, val)->as_datum();
             if (sindex->multi == sindex_multi_bool_t::MULTI
                 && sindex_val->get_type() == ql::datum_t::R_ARRAY) {
@@ -807,9 +1101,9 @@ THROWS_ONLY(interrupted_exc_t) {
                 sindex_val = sindex_val->get(*tag, ql::NOTHROW);
                 guarantee(sindex_val);
             }
-            if (!sindex->range.contains(sindex_val)) {
-                return done_traversing_t::NO;
-            }
+        }
+        if (sindex && !sindex->range.contains(sindex_val)) {
+            return done_traversing_t::NO;
         }
 
         ql::groups_t data = {{counted_t<const ql::datum_t>(), ql::datums_t{val}}};
@@ -871,13 +1165,16 @@ void rdb_rget_secondary_slice(
     sorting_t sorting,
     const ql::map_wire_func_t &sindex_func,
     sindex_multi_bool_t sindex_multi,
+    const sindex_covered_fields_t &covered_fields,
+    sorted_point_reader_t *primary_reader,
     rget_read_response_t *response) {
     r_sanity_check(boost::get<ql::exc_t>(&response->result) == NULL);
     profile::starter_t starter("Do range scan on secondary index.", ql_env->trace);
     rget_cb_t callback(
         io_data_t(response, slice),
         job_data_t(ql_env, batchspec, transforms, terminal, sorting),
-        sindex_data_t(pk_range, sindex_range, sindex_func, sindex_multi),
+        sindex_data_t(pk_range, sindex_range, sindex_func, sindex_multi,
+                      covered_fields, primary_reader),
         sindex_region.inner);
     btree_concurrent_traversal(
         superblock, sindex_region.inner, &callback,
@@ -982,119 +1279,345 @@ void rdb_modification_report_cb_t::on_mod_report(
 
 typedef btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindex_access_vector_t;
 
+// Also sets `(*index_values_out)[i]` to the index value that `(*keys_out)[i]` was
+// made from.
 void compute_keys(const store_key_t &primary_key, counted_t<const ql::datum_t> doc,
                   ql::map_wire_func_t *mapping, sindex_multi_bool_t multi, ql::env_t *env,
-                  std::vector<store_key_t> *keys_out) {
-    guarantee(keys_out->empty());
+                  std::vector<store_key_t> *keys_out,
+                  std::vector<counted_t<const ql::datum_t> > *index_values_out) {
+    guarantee(keys_out->empty() && index_values_out->empty());
     counted_t<const ql::datum_t> index =
         mapping->compile_wire_func()->call(env, doc)->as_datum();
 
     if (multi == sindex_multi_bool_t::MULTI && index->get_type() == ql::datum_t::R_ARRAY) {
         for (uint64_t i = 0; i < index->size(); ++i) {
-            keys_out->push_back(
-                store_key_t(index->get(i, ql::THROW)->print_secondary(primary_key, i)));
+            counted_t<const ql::datum_t> element = index->get(i, ql::THROW);
+            keys_out->push_back(store_key_t(element->print_secondary(primary_key, i)));
+            index_values_out->push_back(element);
         }
     } else {
         keys_out->push_back(store_key_t(index->print_secondary(primary_key)));
+        index_values_out->push_back(index);
     }
 }
 
-/* Used below by rdb_update_sindexes. */
-void rdb_update_single_sindex(
-        const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
-        const rdb_modification_report_t *modification,
-        auto_drainer_t::lock_t) {
-    // Note if you get this error it's likely that you've passed in a default
-    // constructed mod_report. Don't do that.  Mod reports should always be passed
-    // to a function as an output parameter before they're passed to this
-    // function.
-    guarantee(modification->primary_key.size() != 0);
-
-    ql::map_wire_func_t mapping;
-    sindex_multi_bool_t multi = sindex_multi_bool_t::MULTI;
-    inplace_vector_read_stream_t read_stream(&sindex->sindex.opaque_definition);
-    archive_result_t success = deserialize(&read_stream, &mapping);
+void deserialize_sindex_definition(
+        const secondary_index_t::opaque_definition_t &opaque_definition,
+        ql::map_wire_func_t *mapping_out,
+        sindex_multi_bool_t *multi_out,
+        sindex_covered_fields_t *covered_fields_out) {
+    inplace_vector_read_stream_t read_stream(&opaque_definition);
+    archive_result_t success = deserialize(&read_stream, mapping_out);
     guarantee_deserialization(success, "sindex deserialize");
-    success = deserialize(&read_stream, &multi);
+    success = deserialize(&read_stream, multi_out);
     guarantee_deserialization(success, "sindex deserialize");
+    success = deserialize(&read_stream, covered_fields_out);
+    if (success == archive_result_t::SOCK_EOF) {
+        // The definition is older than covering sindexes.
+        covered_fields_out->reset();
+    } else {
+        guarantee_deserialization(success, "sindex deserialize");
+    }
+}
 
-    // TODO we just use a NULL environment here. People should not be able
-    // to do anything that requires an environment like gets from other
-    // tables etc. but we don't have a nice way to disallow those things so
-    // for now we pass null and it will segfault if an illegal sindex
-    // mapping is passed.
+struct rdb_compiled_sindex_t::instance_t {
+    explicit instance_t(const secondary_index_t::opaque_definition_t &definition)
+        : multi(sindex_multi_bool_t::MULTI),
+          // TODO we just use a NULL environment here. People should not be able
+          // to do anything that requires an environment like gets from other
+          // tables etc. but we don't have a nice way to disallow those things so
+          // for now we pass null and it will segfault if an illegal sindex
+          // mapping is passed.
+          env(NULL, &non_interruptor) {
+        deserialize_sindex_definition(definition, &mapping, &multi, &covered_fields);
+    }
+
+    ql::map_wire_func_t mapping;
+    sindex_multi_bool_t multi;
+    sindex_covered_fields_t covered_fields;
     cond_t non_interruptor;
-    ql::env_t env(NULL, &non_interruptor);
+    ql::env_t env;
+};
 
-    superblock_t *super_block = sindex->super_block.get();
+rdb_compiled_sindex_t::rdb_compiled_sindex_t(const secondary_index_t &sindex)
+    : opaque_definition_(sindex.opaque_definition) {
+    // Deserializing the definition right away catches a bad one early.
+    free_instances_.push_back(make_scoped<instance_t>(opaque_definition_));
+}
 
-    if (modification->info.deleted.first) {
-        guarantee(!modification->info.deleted.second.empty());
-        try {
-            counted_t<const ql::datum_t> deleted = modification->info.deleted.first;
+rdb_compiled_sindex_t::~rdb_compiled_sindex_t() { }
+
+rdb_compiled_sindex_t::func_acq_t::func_acq_t(
+        const counted_t<compiled_sindex_t> &compiled)
+    : compiled_(compiled),
+      sindex_(static_cast<rdb_compiled_sindex_t *>(compiled.get())) {
+    guarantee(sindex_ != NULL);
+    if (sindex_->free_instances_.empty()) {
+        instance_ = make_scoped<instance_t>(sindex_->opaque_definition_);
+    } else {
+        instance_ = std::move(sindex_->free_instances_.back());
+        sindex_->free_instances_.pop_back();
+    }
+}
 
-            std::vector<store_key_t> keys;
+rdb_compiled_sindex_t::func_acq_t::~func_acq_t() {
+    sindex_->free_instances_.push_back(std::move(instance_));
+}
 
-            compute_keys(modification->primary_key, deleted, &mapping, multi, &env, &keys);
+ql::map_wire_func_t *rdb_compiled_sindex_t::func_acq_t::mapping() {
+    return &instance_->mapping;
+}
 
-            for (auto it = keys.begin(); it != keys.end(); ++it) {
-                promise_t<superblock_t *> return_superblock_local;
-                {
-                    keyvalue_location_t<rdb_value_t> kv_location;
+sindex_multi_bool_t rdb_compiled_sindex_t::func_acq_t::multi() const {
+    return instance_->multi;
+}
 
-                    find_keyvalue_location_for_write(super_block,
-                                                     it->btree_key(),
-                                                     &kv_location,
-                                                     &sindex->btree->stats,
-                                                     env.trace.get_or_null(),
-                                                     &return_superblock_local);
+const sindex_covered_fields_t &
+rdb_compiled_sindex_t::func_acq_t::covered_fields() const {
+    return instance_->covered_fields;
+}
 
-                    if (kv_location.value.has()) {
-                        kv_location_delete(&kv_location, *it,
-                            repli_timestamp_t::distant_past, NULL);
-                    }
-                    // The keyvalue location gets destroyed here.
-                }
-                super_block = return_superblock_local.wait();
+ql::env_t *rdb_compiled_sindex_t::func_acq_t::env() {
+    return &instance_->env;
+}
+
+bool sindex_change_key_less(const sindex_change_t &a, const sindex_change_t &b) {
+    return a.key < b.key;
+}
+
+typedef std::pair<store_key_t, std::vector<char> > sindex_entry_t;
+
+bool sindex_entry_keys_equal(const sindex_entry_t &a, const sindex_entry_t &b) {
+    return a.first == b.first;
+}
+
+/* Serializes `datum` into a blob that fits into its ref, so that the value owns no
+blocks.  Returns false if it doesn't fit. */
+bool make_inline_value(buf_parent_t parent, const counted_t<const ql::datum_t> &datum,
+                       std::vector<char> *value_out) {
+    write_message_t wm;
+    wm << datum;
+    if (!blob::size_would_be_small(wm.size(), blob::btree_maxreflen)) {
+        return false;
+    }
+    scoped_malloc_t<rdb_value_t> value(blob::btree_maxreflen);
+    memset(value.get(), 0, blob::btree_maxreflen);
+    const block_size_t block_size = parent.cache()->get_block_size();
+    {
+        blob_t blob(block_size, value->value_ref(), blob::btree_maxreflen);
+        write_onto_blob(parent, &blob, wm);
+    }
+    value_out->assign(value->value_ref(),
+                      value->value_ref() + value->inline_size(block_size));
+    return true;
+}
+
+/* The value of an entry in a covering index is `[primary key, index value, covered
+fields]`, or just `[primary key]` if the whole thing doesn't fit into the value's
+blob ref.  Reads look the row up in the primary index in the latter case. */
+std::vector<char> make_covering_value(buf_parent_t parent,
+                                      const store_key_t &primary_key,
+                                      const counted_t<const ql::datum_t> &index_value,
+                                      const counted_t<const ql::datum_t> &covered_row) {
+    counted_t<const ql::datum_t> pkey
+        = make_counted<const ql::datum_t>(key_to_unescaped_str(primary_key));
+    std::vector<char> value;
+    if (make_inline_value(
+            parent,
+            make_counted<const ql::datum_t>(
+                std::vector<counted_t<const ql::datum_t> >{
+                    pkey, index_value, covered_row}),
+            &value)) {
+        return value;
+    }
+    // A primary key always fits.
+    guarantee(make_inline_value(
+        parent,
+        make_counted<const ql::datum_t>(
+            std::vector<counted_t<const ql::datum_t> >{pkey}),
+        &value));
+    return value;
+}
+
+/* Computes the entries of `doc` in the index, sorted by key and without duplicate
+keys.  `value_ref` is where `doc` is stored in the primary index.  A missing
+document, or one the mapping fails on, has no entries. */
+void compute_sindex_entries(buf_parent_t parent,
+                            const store_key_t &primary_key,
+                            const counted_t<const ql::datum_t> &doc,
+                            const std::vector<char> &value_ref,
+                            rdb_compiled_sindex_t::func_acq_t *func,
+                            std::vector<sindex_entry_t> *entries_out) {
+    if (!doc.has()) {
+        return;
+    }
+    std::vector<store_key_t> keys;
+    std::vector<counted_t<const ql::datum_t> > index_values;
+    try {
+        compute_keys(primary_key, doc, func->mapping(), func->multi(), func->env(),
+                     &keys, &index_values);
+    } catch (const ql::base_exc_t &) {
+        // Do nothing (the row isn't in the index).
+        return;
+    }
+
+    if (!func->covered_fields()) {
+        for (auto it = keys.begin(); it != keys.end(); ++it) {
+            entries_out->push_back(sindex_entry_t(*it, value_ref));
+        }
+    } else {
+        std::map<std::string, counted_t<const ql::datum_t> > fields;
+        for (auto it = func->covered_fields()->begin();
+             it != func->covered_fields()->end();
+             ++it) {
+            counted_t<const ql::datum_t> field = doc->get(*it, ql::NOTHROW);
+            if (field.has()) {
+                fields[*it] = field;
             }
-        } catch (const ql::base_exc_t &) {
-            // Do nothing (it wasn't actually in the index).
+        }
+        counted_t<const ql::datum_t> covered_row
+            = make_counted<const ql::datum_t>(std::move(fields));
+        for (size_t i = 0; i < keys.size(); ++i) {
+            entries_out->push_back(sindex_entry_t(
+                keys[i],
+                make_covering_value(parent, primary_key, index_values[i],
+                                    covered_row)));
         }
     }
 
-    if (modification->info.added.first) {
-        try {
-            counted_t<const ql::datum_t> added = modification->info.added.first;
+    std::sort(entries_out->begin(), entries_out->end());
+    // A multi index maps a row to the same key once per equal array element.
+    entries_out->erase(std::unique(entries_out->begin(), entries_out->end(),
+                                   &sindex_entry_keys_equal),
+                       entries_out->end());
+}
 
-            std::vector<store_key_t> keys;
+void compute_sindex_changes(buf_parent_t parent,
+                            const rdb_modification_report_t &modification,
+                            rdb_compiled_sindex_t::func_acq_t *func,
+                            std::vector<sindex_change_t> *changes_out) {
+    // Note if you get this error it's likely that you've passed in a default
+    // constructed mod_report. Don't do that.  Mod reports should always be passed
+    // to a function as an output parameter before they're passed to this
+    // function.
+    guarantee(modification.primary_key.size() != 0);
+
+    std::vector<sindex_entry_t> old_entries;
+    compute_sindex_entries(parent, modification.primary_key,
+                           modification.info.deleted.first,
+                           modification.info.deleted.second, func, &old_entries);
+    std::vector<sindex_entry_t> new_entries;
+    compute_sindex_entries(parent, modification.primary_key,
+                           modification.info.added.first,
+                           modification.info.added.second, func, &new_entries);
+
+    auto old_it = old_entries.begin();
+    auto new_it = new_entries.begin();
+    while (old_it != old_entries.end() || new_it != new_entries.end()) {
+        if (new_it == new_entries.end()
+            || (old_it != old_entries.end() && old_it->first < new_it->first)) {
+            changes_out->push_back(sindex_change_t(old_it->first, std::vector<char>()));
+            ++old_it;
+        } else if (old_it == old_entries.end() || new_it->first < old_it->first) {
+            changes_out->push_back(sindex_change_t(new_it->first, new_it->second));
+            ++new_it;
+        } else {
+            if (old_it->second != new_it->second) {
+                changes_out->push_back(sindex_change_t(new_it->first, new_it->second));
+            }
+            ++old_it;
+            ++new_it;
+        }
+    }
+}
 
-            compute_keys(modification->primary_key, added, &mapping, multi, &env, &keys);
+/* Applies `changes` in key order, so that consecutive descents go down the same
+path through the tree.  When several changes are for the same key, the last one
+wins, and the key is only visited once. */
+void apply_sindex_changes(const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
+                          std::vector<sindex_change_t> *changes,
+                          profile::trace_t *trace) {
+    std::stable_sort(changes->begin(), changes->end(), &sindex_change_key_less);
 
-            for (auto it = keys.begin(); it != keys.end(); ++it) {
-                promise_t<superblock_t *> return_superblock_local;
-                {
-                    keyvalue_location_t<rdb_value_t> kv_location;
+    superblock_t *super_block = sindex->super_block.get();
 
-                    find_keyvalue_location_for_write(super_block,
-                                                     it->btree_key(),
-                                                     &kv_location,
-                                                     &sindex->btree->stats,
-                                                     env.trace.get_or_null(),
-                                                     &return_superblock_local);
+    if (super_block->get_root_block_id() == NULL_BLOCK_ID) {
+        // There is nothing to erase from an empty index, so we can build it
+        // bottom-up.
+        value_sizer_t<rdb_value_t> sizer(super_block->cache()->get_block_size());
+        btree_bulk_loader_t loader(&sizer, super_block,
+                                   repli_timestamp_t::distant_past,
+                                   &sindex->btree->stats);
+        for (auto it = changes->begin(); it != changes->end(); ++it) {
+            if ((it + 1 != changes->end() && (it + 1)->key == it->key)
+                || it->value.empty()) {
+                continue;
+            }
+            scoped_malloc_t<rdb_value_t> value(
+                it->value.data(), it->value.data() + it->value.size());
+            loader.add(it->key.btree_key(), value.get());
+        }
+        loader.finish();
+        return;
+    }
 
-                    kv_location_set(&kv_location, *it,
-                                    modification->info.added.second,
-                                    repli_timestamp_t::distant_past);
-                    // The keyvalue location gets destroyed here.
-                }
-                super_block = return_superblock_local.wait();
+    for (auto it = changes->begin(); it != changes->end(); ++it) {
+        if (it + 1 != changes->end() && (it + 1)->key == it->key) {
+            continue;
+        }
+        promise_t<superblock_t *> return_superblock_local;
+        {
+            keyvalue_location_t<rdb_value_t> kv_location;
+
+            find_keyvalue_location_for_write(super_block,
+                                             it->key.btree_key(),
+                                             &kv_location,
+                                             &sindex->btree->stats,
+                                             trace,
+                                             &return_superblock_local);
+
+            if (!it->value.empty()) {
+                kv_location_set(&kv_location, it->key, it->value,
+                                repli_timestamp_t::distant_past);
+            } else if (kv_location.value.has()) {
+                kv_location_delete(&kv_location, it->key,
+                                   repli_timestamp_t::distant_past, NULL);
             }
-        } catch (const ql::base_exc_t &) {
-            // Do nothing (we just drop the row from the index).
+            // The keyvalue location gets destroyed here.
         }
+        super_block = return_superblock_local.wait();
+    }
+}
+
+/* Once no index refers to it anymore, deletes the blob that the old version of
+the row was stored in. */
+void delete_replaced_value(const rdb_modification_report_t &modification,
+                           txn_t *txn) {
+    if (modification.info.deleted.first) {
+        // Deleting the value unfortunately updates the ref in-place as it operates, so
+        // we need to make a copy of the blob reference that is extended to the
+        // appropriate width.
+        std::vector<char> ref_cpy(modification.info.deleted.second);
+        ref_cpy.insert(ref_cpy.end(), blob::btree_maxreflen - ref_cpy.size(), 0);
+        guarantee(ref_cpy.size() == static_cast<size_t>(blob::btree_maxreflen));
+
+        actually_delete_rdb_value(buf_parent_t(txn), ref_cpy.data());
     }
 }
 
+/* Used below by rdb_update_sindexes. */
+void rdb_update_single_sindex(
+        const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
+        const rdb_modification_report_t *modification,
+        auto_drainer_t::lock_t) {
+    rdb_compiled_sindex_t::func_acq_t func(sindex->compiled);
+
+    std::vector<sindex_change_t> changes;
+    compute_sindex_changes(sindex->super_block->expose_buf(), *modification, &func,
+                           &changes);
+    apply_sindex_changes(sindex, &changes, func.env()->trace.get_or_null());
+}
+
 void rdb_update_sindexes(const sindex_access_vector_t &sindexes,
                          const rdb_modification_report_t *modification,
                          txn_t *txn) {
@@ -1112,15 +1635,44 @@ void rdb_update_sindexes(const sindex_access_vector_t &sindexes,
 
     /* All of the sindex have been updated now it's time to actually clear the
      * deleted blob if it exists. */
-    if (modification->info.deleted.first) {
-        // Deleting the value unfortunately updates the ref in-place as it operates, so
-        // we need to make a copy of the blob reference that is extended to the
-        // appropriate width.
-        std::vector<char> ref_cpy(modification->info.deleted.second);
-        ref_cpy.insert(ref_cpy.end(), blob::btree_maxreflen - ref_cpy.size(), 0);
-        guarantee(ref_cpy.size() == static_cast<size_t>(blob::btree_maxreflen));
+    delete_replaced_value(*modification, txn);
+}
 
-        actually_delete_rdb_value(buf_parent_t(txn), ref_cpy.data());
+/* Used below by rdb_bulk_update_sindexes. */
+void rdb_bulk_update_single_sindex(
+        const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
+        const std::vector<rdb_modification_report_t> *modifications,
+        auto_drainer_t::lock_t) {
+    rdb_compiled_sindex_t::func_acq_t func(sindex->compiled);
+
+    // Collect the index changes of all the rows into one run, in the order of the
+    // modifications, so that a later change to a key wins over an earlier one.
+    std::vector<sindex_change_t> changes;
+    for (auto it = modifications->begin(); it != modifications->end(); ++it) {
+        compute_sindex_changes(sindex->super_block->expose_buf(), *it, &func,
+                               &changes);
+    }
+    apply_sindex_changes(sindex, &changes, func.env()->trace.get_or_null());
+}
+
+void rdb_bulk_update_sindexes(
+        const sindex_access_vector_t &sindexes,
+        const std::vector<rdb_modification_report_t> *modifications,
+        txn_t *txn) {
+    {
+        auto_drainer_t drainer;
+
+        for (sindex_access_vector_t::const_iterator it = sindexes.begin();
+                                                    it != sindexes.end();
+                                                    ++it) {
+            coro_t::spawn_sometime(std::bind(
+                        &rdb_bulk_update_single_sindex, &*it,
+                        modifications, auto_drainer_t::lock_t(&drainer)));
+        }
+    }
+
+    for (auto it = modifications->begin(); it != modifications->end(); ++it) {
+        delete_replaced_value(*it, txn);
     }
 }
 
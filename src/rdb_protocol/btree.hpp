@@ -14,6 +14,7 @@
 #include "rdb_protocol/protocol.hpp"
 
 class key_tester_t;
+class sorted_point_reader_t;
 class parallel_traversal_progress_t;
 template <class> class promise_t;
 struct rdb_value_t;
@@ -24,6 +25,9 @@ typedef rdb_protocol_t::read_response_t read_response_t;
 typedef rdb_protocol_t::point_read_t point_read_t;
 typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
+typedef rdb_protocol_t::batched_point_read_t batched_point_read_t;
+typedef rdb_protocol_t::batched_point_read_response_t batched_point_read_response_t;
+
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
 
@@ -85,6 +89,15 @@ void rdb_get(
     point_read_response_t *response,
     profile::trace_t *trace);
 
+// Looks up all of `keys` with a `sorted_point_reader_t`, and fills in the rows that
+// exist.
+void rdb_get_batch(
+    const std::vector<store_key_t> &keys,
+    btree_slice_t *slice,
+    superblock_t *superblock,
+    batched_point_read_response_t *response,
+    profile::trace_t *trace);
+
 enum return_vals_t {
     NO_RETURN_VALS = 0,
     RETURN_VALS = 1
@@ -93,15 +106,18 @@ enum return_vals_t {
 struct btree_info_t {
     btree_info_t(btree_slice_t *_slice,
                  repli_timestamp_t _timestamp,
-                 const std::string *_primary_key)
+                 const std::string *_primary_key,
+                 ql::row_format_t _row_format)
         : slice(_slice), timestamp(_timestamp),
-          primary_key(_primary_key) {
+          primary_key(_primary_key), row_format(_row_format) {
         guarantee(slice != NULL);
         guarantee(primary_key != NULL);
     }
     btree_slice_t *const slice;
     const repli_timestamp_t timestamp;
     const std::string *primary_key;
+    // How to write the rows.
+    const ql::row_format_t row_format;
 };
 
 struct btree_loc_info_t {
@@ -139,7 +155,21 @@ batched_replace_response_t rdb_batched_replace(
     rdb_modification_report_cb_t *sindex_cb,
     profile::trace_t *trace);
 
+/* Inserts `inserts`, whose primary keys are `keys`, into an empty btree by
+building it bottom-up with `btree_bulk_loader_t`, then updates the secondary
+indexes with one sorted run each. Returns false, without touching anything, if the btree isn't empty or two of the
+documents share a primary key; the caller should fall back to
+`rdb_batched_replace()` then. */
+bool rdb_bulk_insert(
+    const btree_info_t &info,
+    scoped_ptr_t<superblock_t> *superblock,
+    const std::vector<store_key_t> &keys,
+    const std::vector<counted_t<const ql::datum_t> > &inserts,
+    rdb_modification_report_cb_t *sindex_cb,
+    batched_replace_response_t *response_out);
+
 void rdb_set(const store_key_t &key, counted_t<const ql::datum_t> data,
+             ql::row_format_t row_format,
              bool overwrite,
              btree_slice_t *slice, repli_timestamp_t timestamp,
              superblock_t *superblock,
@@ -222,6 +252,9 @@ void rdb_rget_secondary_slice(
     sorting_t sorting,
     const ql::map_wire_func_t &sindex_func,
     sindex_multi_bool_t sindex_multi,
+    const sindex_covered_fields_t &covered_fields,
+    // Looks rows up in the primary index, if the sindex is covering. NULL otherwise.
+    sorted_point_reader_t *primary_reader,
     rget_read_response_t *response);
 
 void rdb_distribution_get(int max_depth,
@@ -275,6 +308,9 @@ public:
             auto_drainer_t::lock_t lock);
 
     void on_mod_report(const rdb_modification_report_t &mod_report);
+    // Like calling `on_mod_report()` for each report in turn, but updates each
+    // secondary index in one pass in key order.
+    void on_mod_reports(const std::vector<rdb_modification_report_t> &mod_reports);
 
     ~rdb_modification_report_cb_t();
 
@@ -288,12 +324,82 @@ private:
     btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindexes_;
 };
 
+/* The mapping function of an rdb sindex, deserialized from its opaque definition
+once per store.  Evaluating a function isn't reentrant, and it may yield, so each
+coroutine that updates the sindex checks out a copy of its own, together with an
+env_t to evaluate it in.  Returned copies are kept for the next write. */
+class rdb_compiled_sindex_t : public compiled_sindex_t {
+private:
+    struct instance_t;
+
+public:
+    explicit rdb_compiled_sindex_t(const secondary_index_t &sindex);
+    ~rdb_compiled_sindex_t();
+
+    class func_acq_t {
+    public:
+        // `compiled` must come from `rdb_protocol_t::store_t`.
+        explicit func_acq_t(const counted_t<compiled_sindex_t> &compiled);
+        ~func_acq_t();
+        ql::map_wire_func_t *mapping();
+        sindex_multi_bool_t multi() const;
+        const sindex_covered_fields_t &covered_fields() const;
+        ql::env_t *env();
+    private:
+        counted_t<compiled_sindex_t> compiled_;
+        rdb_compiled_sindex_t *sindex_;
+        scoped_ptr_t<instance_t> instance_;
+
+        DISABLE_COPYING(func_acq_t);
+    };
+
+private:
+    const secondary_index_t::opaque_definition_t opaque_definition_;
+    std::vector<scoped_ptr_t<instance_t> > free_instances_;
+
+    DISABLE_COPYING(rdb_compiled_sindex_t);
+};
+
+// Reads an sindex's definition, as `sindex_create_t` serializes it.
+void deserialize_sindex_definition(
+        const secondary_index_t::opaque_definition_t &opaque_definition,
+        ql::map_wire_func_t *mapping_out,
+        sindex_multi_bool_t *multi_out,
+        sindex_covered_fields_t *covered_fields_out);
+
+/* A change to a secondary index: afterwards `key` maps to `value`, or isn't in the
+index at all if `value` is empty. */
+struct sindex_change_t {
+    sindex_change_t(const store_key_t &_key, const std::vector<char> &_value)
+        : key(_key), value(_value) { }
+
+    store_key_t key;
+    std::vector<char> value;
+};
+
+/* Diffs the index entries of the old and the new version of the row and appends
+the changes that turn one into the other to `changes_out`.  A key that both
+versions have is only changed if its value differs.  It always does in an index
+that refers to the rows, since a replaced row moves to a new blob, but not in a
+covering index if none of the covered fields changed. */
+void compute_sindex_changes(buf_parent_t parent,
+                            const rdb_modification_report_t &modification,
+                            rdb_compiled_sindex_t::func_acq_t *func,
+                            std::vector<sindex_change_t> *changes_out);
+
 void rdb_update_sindexes(
         const btree_store_t<rdb_protocol_t>::sindex_access_vector_t &sindexes,
         const rdb_modification_report_t *modification,
         txn_t *txn);
 
 
+// Has the same effect as calling `rdb_update_sindexes()` for each modification in
+// turn, but only visits each changed index key once.
+void rdb_bulk_update_sindexes(
+        const btree_store_t<rdb_protocol_t>::sindex_access_vector_t &sindexes,
+        const std::vector<rdb_modification_report_t> *modifications,
+        txn_t *txn);
+
 void rdb_erase_range_sindexes(
         const btree_store_t<rdb_protocol_t>::sindex_access_vector_t &sindexes,
         const rdb_erase_range_report_t *erase_range,
@@ -7,10 +7,13 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <limits>
+#include <unordered_map>
 
 #include "errors.hpp"
 #include <boost/detail/endian.hpp>
 
+#include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/stl_types.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
@@ -18,6 +21,7 @@
 #include "rdb_protocol/pseudo_time.hpp"
 #include "rdb_protocol/shards.hpp"
 #include "stl_utils.hpp"
+#include "thread_local.hpp"
 
 namespace ql {
 
@@ -59,15 +63,22 @@ datum_t::datum_t(std::vector<counted_t<const datum_t> > &&_array)
 
 datum_t::datum_t(std::map<std::string, counted_t<const datum_t> > &&_object)
     : type(R_OBJECT),
-      r_object(new std::map<std::string, counted_t<const datum_t> >(
-                   std::move(_object))) {
+      r_object(new datum_object_t(std::move(_object))) {
+    maybe_sanitize_ptype();
+}
+
+datum_t::datum_t(datum_object_t &&_object)
+    : type(R_OBJECT),
+      r_object(new datum_object_t(std::move(_object))) {
     maybe_sanitize_ptype();
 }
 
 datum_t::datum_t(grouped_data_t &&gd)
     : type(R_OBJECT),
-      r_object(new std::map<std::string, counted_t<const datum_t> >()) {
-    (*r_object)[reql_type_string] = make_counted<const datum_t>("GROUPED_DATA");
+      r_object(new datum_object_t()) {
+    UNUSED bool b = r_object->set(reql_type_string,
+                                  make_counted<const datum_t>("GROUPED_DATA"),
+                                  CLOBBER);
     std::vector<counted_t<const datum_t> > v;
     v.reserve(gd.size());
     for (auto kv = gd.begin(); kv != gd.end(); ++kv) {
@@ -75,7 +86,7 @@ datum_t::datum_t(grouped_data_t &&gd)
                         std::vector<counted_t<const datum_t> >{
                             std::move(kv->first), std::move(kv->second)}));
     }
-    (*r_object)["data"] = make_counted<const datum_t>(std::move(v));
+    b = r_object->set("data", make_counted<const datum_t>(std::move(v)), CLOBBER);
     // We don't sanitize the ptype because this is a fake ptype that should only
     // be used for serialization.
 }
@@ -93,7 +104,7 @@ datum_t::datum_t(datum_t::type_t _type) : type(_type) {
         r_array = new std::vector<counted_t<const datum_t> >();
     } break;
     case R_OBJECT: {
-        r_object = new std::map<std::string, counted_t<const datum_t> >();
+        r_object = new datum_object_t();
     } break;
     case UNINITIALIZED: // fallthru
     default: unreachable();
@@ -134,7 +145,7 @@ void datum_t::init_array() {
 
 void datum_t::init_object() {
     type = R_OBJECT;
-    r_object = new std::map<std::string, counted_t<const datum_t> >();
+    r_object = new datum_object_t();
 }
 
 void datum_t::init_json(cJSON *json) {
@@ -215,7 +226,7 @@ datum_t::datum_t(const scoped_cJSON_t &json) {
 datum_t::type_t datum_t::get_type() const { return type; }
 
 bool datum_t::is_ptype() const {
-    return type == R_OBJECT && std_contains(*r_object, reql_type_string);
+    return type == R_OBJECT && r_object->count(reql_type_string) > 0;
 }
 
 bool datum_t::is_ptype(const std::string &reql_type) const {
@@ -743,9 +754,9 @@ counted_t<const datum_t> datum_t::get(size_t index, throw_bool_t throw_bool) con
 
 counted_t<const datum_t> datum_t::get(const std::string &key,
                                       throw_bool_t throw_bool) const {
-    std::map<std::string, counted_t<const datum_t> >::const_iterator it
-        = as_object().find(key);
-    if (it != as_object().end()) return it->second;
+    const datum_object_t &obj = as_object();
+    datum_object_t::const_iterator it = obj.find(key);
+    if (it != obj.end()) return it->second;
     if (throw_bool == THROW) {
         rfail(base_exc_t::NON_EXISTENCE,
               "No attribute `%s` in object:\n%s", key.c_str(), print().c_str());
@@ -753,11 +764,90 @@ counted_t<const datum_t> datum_t::get(const std::string &key,
     return counted_t<const datum_t>();
 }
 
-const std::map<std::string, counted_t<const datum_t> > &datum_t::as_object() const {
+const datum_object_t &datum_t::as_object() const {
     check_type(R_OBJECT);
     return *r_object;
 }
 
+// Names longer than this are rarely shared between rows (and are not worth
+// hashing), so they don't go into the intern table.
+static const size_t MAX_INTERNED_FIELD_NAME_SIZE = 64;
+// The intern tables are never shrunk, so they are capped to keep a workload with
+// arbitrary keys (e.g. objects used as maps) from growing them without bound.
+static const size_t MAX_INTERNED_FIELD_NAMES = 16384;
+
+typedef std::unordered_map<std::string, datum_field_name_t> field_name_table_t;
+
+TLS_with_init(field_name_table_t *, field_name_table, NULL);
+
+datum_field_name_t::datum_field_name_t(const std::string &name) {
+    if (name.size() > MAX_INTERNED_FIELD_NAME_SIZE) {
+        rep = make_counted<rep_t>(name);
+        return;
+    }
+    field_name_table_t *table = TLS_get_field_name_table();
+    if (table == NULL) {
+        // Like the thread itself, this lives until the process exits.
+        table = new field_name_table_t();
+        TLS_set_field_name_table(table);
+    }
+    auto it = table->find(name);
+    if (it != table->end()) {
+        rep = it->second.rep;
+    } else {
+        rep = make_counted<rep_t>(name);
+        if (table->size() < MAX_INTERNED_FIELD_NAMES) {
+            table->insert(std::make_pair(name, *this));
+        }
+    }
+}
+
+datum_object_t::datum_object_t(std::map<std::string, counted_t<const datum_t> > &&map) {
+    // The map is already sorted, so the fields can just be appended.
+    fields.reserve(map.size());
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        fields.push_back(field_t(datum_field_name_t(it->first), std::move(it->second)));
+    }
+}
+
+static bool field_less(const datum_object_t::field_t &field, const std::string &key) {
+    return field.first.compare(key) < 0;
+}
+
+datum_object_t::const_iterator datum_object_t::find(const std::string &key) const {
+    auto it = std::lower_bound(fields.begin(), fields.end(), key, &field_less);
+    return (it != fields.end() && it->first == key) ? it : fields.end();
+}
+
+bool datum_object_t::set(const std::string &key, counted_t<const datum_t> &&val,
+                         clobber_bool_t clobber_bool) {
+    // Objects are mostly built in key order (from a `std::map`, from the
+    // serialization format, or by copying another object), so check the end
+    // first.
+    if (fields.empty() || fields.back().first.compare(key) < 0) {
+        fields.push_back(field_t(datum_field_name_t(key), std::move(val)));
+        return false;
+    }
+    auto it = std::lower_bound(fields.begin(), fields.end(), key, &field_less);
+    if (it != fields.end() && it->first == key) {
+        if (clobber_bool == CLOBBER) {
+            it->second = std::move(val);
+        }
+        return true;
+    }
+    fields.insert(it, field_t(datum_field_name_t(key), std::move(val)));
+    return false;
+}
+
+bool datum_object_t::erase(const std::string &key) {
+    auto it = std::lower_bound(fields.begin(), fields.end(), key, &field_less);
+    if (it != fields.end() && it->first == key) {
+        fields.erase(it);
+        return true;
+    }
+    return false;
+}
+
 cJSON *datum_t::as_json_raw() const {
     switch (get_type()) {
     case R_NULL: return cJSON_CreateNull();
@@ -773,8 +863,7 @@ cJSON *datum_t::as_json_raw() const {
     } break;
     case R_OBJECT: {
         scoped_cJSON_t obj(cJSON_CreateObject());
-        for (std::map<std::string, counted_t<const datum_t> >::const_iterator
-                 it = r_object->begin(); it != r_object->end(); ++it) {
+        for (auto it = r_object->begin(); it != r_object->end(); ++it) {
             obj.AddItemToObject(it->first.c_str(), it->second->as_json_raw());
         }
         return obj.release();
@@ -821,9 +910,7 @@ MUST_USE bool datum_t::add(const std::string &key, counted_t<const datum_t> val,
     check_type(R_OBJECT);
     check_str_validity(key);
     r_sanity_check(val.has());
-    bool key_in_obj = r_object->count(key) > 0;
-    if (!key_in_obj || (clobber_bool == CLOBBER)) (*r_object)[key] = val;
-    return key_in_obj;
+    return r_object->set(key, std::move(val), clobber_bool);
 }
 
 MUST_USE bool datum_t::delete_field(const std::string &key) {
@@ -834,7 +921,7 @@ counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs) const {
     if (get_type() != R_OBJECT || rhs->get_type() != R_OBJECT) { return rhs; }
 
     datum_ptr_t d(as_object());
-    const std::map<std::string, counted_t<const datum_t> > &rhs_obj = rhs->as_object();
+    const datum_object_t &rhs_obj = rhs->as_object();
     for (auto it = rhs_obj.begin(); it != rhs_obj.end(); ++it) {
         counted_t<const datum_t> sub_lhs = d->get(it->first, NOTHROW);
         bool is_literal = it->second->is_ptype(pseudo::literal_string);
@@ -860,7 +947,7 @@ counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs) const {
 counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs,
                                         merge_resoluter_t f) const {
     datum_ptr_t d(as_object());
-    const std::map<std::string, counted_t<const datum_t> > &rhs_obj = rhs->as_object();
+    const datum_object_t &rhs_obj = rhs->as_object();
     for (auto it = rhs_obj.begin(); it != rhs_obj.end(); ++it) {
         if (counted_t<const datum_t> left = get(it->first, NOTHROW)) {
             bool b = d.add(it->first, f(it->first, left, it->second), CLOBBER);
@@ -915,9 +1002,8 @@ int datum_t::cmp(const datum_t &rhs) const {
             }
             return pseudo_cmp(rhs);
         } else {
-            const std::map<std::string, counted_t<const datum_t> > &obj = as_object();
-            const std::map<std::string, counted_t<const datum_t> > &rhs_obj
-                = rhs.as_object();
+            const datum_object_t &obj = as_object();
+            const datum_object_t &rhs_obj = rhs.as_object();
             auto it = obj.begin();
             auto it2 = rhs_obj.begin();
             while (it != obj.end() && it2 != rhs_obj.end()) {
@@ -996,14 +1082,16 @@ void datum_t::init_from_pb(const Datum *d) {
     } break;
     case Datum::R_OBJECT: {
         init_object();
+        r_object->reserve(d->r_object_size());
         for (int i = 0; i < d->r_object_size(); ++i) {
             const Datum_AssocPair *ap = &d->r_object(i);
             const std::string &key = ap->key();
             check_str_validity(key);
-            rcheck(r_object->count(key) == 0,
+            bool conflict = r_object->set(key, make_counted<const datum_t>(&ap->val()),
+                                          NOCLOBBER);
+            rcheck(!conflict,
                    base_exc_t::GENERIC,
                    strprintf("Duplicate key %s in object.", key.c_str()));
-            (*r_object)[key] = make_counted<datum_t>(&ap->val());
         }
         std::set<std::string> allowed_ptypes = { pseudo::literal_string };
         maybe_sanitize_ptype(allowed_ptypes);
@@ -1065,7 +1153,7 @@ void datum_t::write_to_protobuf(Datum *d, use_json_t use_json) const {
             // We use rbegin and rend so that things print the way we expect.
             for (auto it = r_object->rbegin(); it != r_object->rend(); ++it) {
                 Datum_AssocPair *ap = d->add_r_object();
-                ap->set_key(it->first);
+                ap->set_key(it->first.str());
                 it->second->write_to_protobuf(ap->mutable_val(), use_json);
             }
         } break;
@@ -1090,11 +1178,12 @@ enum class datum_serialized_type_t {
     R_STR = 6,
     INT_NEGATIVE = 7,
     INT_POSITIVE = 8,
+    R_OBJECT_INDEXED = 9,
 };
 
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(datum_serialized_type_t, int8_t,
                                       datum_serialized_type_t::R_ARRAY,
-                                      datum_serialized_type_t::INT_POSITIVE);
+                                      datum_serialized_type_t::R_OBJECT_INDEXED);
 
 // This must be kept in sync with operator<<(write_message_t &, const counted_t<const
 // datum_T> &).
@@ -1119,7 +1208,12 @@ size_t serialized_size(const counted_t<const datum_t> &datum) {
         }
     } break;
     case datum_t::R_OBJECT: {
-        sz += serialized_size(datum->as_object());
+        const datum_object_t &obj = datum->as_object();
+        sz += varint_uint64_serialized_size(obj.size());
+        for (auto it = obj.begin(); it != obj.end(); ++it) {
+            sz += serialized_size(it->first.str());
+            sz += serialized_size(it->second);
+        }
     } break;
     case datum_t::R_STR: {
         sz += serialized_size(datum->as_str());
@@ -1170,7 +1264,13 @@ write_message_t &operator<<(write_message_t &wm,
     } break;
     case datum_t::R_OBJECT: {
         wm << datum_serialized_type_t::R_OBJECT;
-        wm << datum->as_object();
+        // The same format as a `std::map<std::string, counted_t<const datum_t> >`.
+        const datum_object_t &obj = datum->as_object();
+        serialize_varint_uint64(&wm, obj.size());
+        for (auto it = obj.begin(); it != obj.end(); ++it) {
+            wm << it->first.str();
+            wm << it->second;
+        }
     } break;
     case datum_t::R_STR: {
         wm << datum_serialized_type_t::R_STR;
@@ -1255,12 +1355,42 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
             return archive_result_t::RANGE_ERROR;
         }
     } break;
-    case datum_serialized_type_t::R_OBJECT: {
-        std::map<std::string, counted_t<const datum_t> > value;
-        res = deserialize(s, &value);
+    case datum_serialized_type_t::R_OBJECT:  // fall through
+    case datum_serialized_type_t::R_OBJECT_INDEXED: {
+        uint64_t sz;
+        res = deserialize_varint_uint64(s, &sz);
         if (bad(res)) {
             return res;
         }
+        if (sz > std::numeric_limits<size_t>::max()) {
+            return archive_result_t::RANGE_ERROR;
+        }
+        if (type == datum_serialized_type_t::R_OBJECT_INDEXED) {
+            // We don't need the field offsets to read the whole object.
+            for (uint64_t i = 0; i < sz; ++i) {
+                uint32_t offset;
+                res = deserialize(s, &offset);
+                if (bad(res)) {
+                    return res;
+                }
+            }
+        }
+        datum_object_t value;
+        for (uint64_t i = 0; i < sz; ++i) {
+            std::string key;
+            res = deserialize(s, &key);
+            if (bad(res)) {
+                return res;
+            }
+            counted_t<const datum_t> val;
+            res = deserialize(s, &val);
+            if (bad(res)) {
+                return res;
+            }
+            // Like the `std::map` we used to deserialize into, keep the first of
+            // duplicate keys.
+            UNUSED bool b = value.set(key, std::move(val), NOCLOBBER);
+        }
         try {
             datum->reset(new datum_t(std::move(value)));
         } catch (const base_exc_t &) {
@@ -1287,6 +1417,112 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
     return archive_result_t::SUCCESS;
 }
 
+void serialize_with_field_index(write_message_t *wm,
+                                const counted_t<const datum_t> &datum) {
+    r_sanity_check(datum.has());
+    if (datum->get_type() != datum_t::R_OBJECT) {
+        *wm << datum;
+        return;
+    }
+
+    // The fields are laid out as for `R_OBJECT`, preceded by the offset of every
+    // field from the first one.  The offsets have a fixed size, so that they can be
+    // binary searched.
+    const datum_object_t &obj = datum->as_object();
+    std::vector<uint64_t> offsets;
+    offsets.reserve(obj.size());
+    uint64_t offset = 0;
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        offsets.push_back(offset);
+        offset += serialized_size(it->first.str()) + serialized_size(it->second);
+    }
+    if (offset > std::numeric_limits<uint32_t>::max()) {
+        *wm << datum;
+        return;
+    }
+
+    *wm << datum_serialized_type_t::R_OBJECT_INDEXED;
+    serialize_varint_uint64(wm, obj.size());
+    for (auto it = offsets.begin(); it != offsets.end(); ++it) {
+        *wm << static_cast<uint32_t>(*it);
+    }
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        *wm << it->first.str();
+        *wm << it->second;
+    }
+}
+
+void serialize_row(write_message_t *wm, const counted_t<const datum_t> &datum,
+                   row_format_t format) {
+    switch (format) {
+    case row_format_t::PLAIN:
+        *wm << datum;
+        break;
+    case row_format_t::FIELD_INDEXED:
+        serialize_with_field_index(wm, datum);
+        break;
+    default:
+        unreachable();
+    }
+}
+
+archive_result_t deserialize_field(buffer_group_read_stream_t *s,
+                                   const std::string &key,
+                                   bool *has_index_out,
+                                   counted_t<const datum_t> *field_out) {
+    *has_index_out = false;
+    field_out->reset();
+
+    s->seek(0);
+    datum_serialized_type_t type;
+    archive_result_t res = deserialize(s, &type);
+    if (bad(res)) {
+        return res;
+    }
+    if (type != datum_serialized_type_t::R_OBJECT_INDEXED) {
+        return archive_result_t::SUCCESS;
+    }
+    *has_index_out = true;
+
+    uint64_t sz;
+    res = deserialize_varint_uint64(s, &sz);
+    if (bad(res)) {
+        return res;
+    }
+    if (sz > std::numeric_limits<uint32_t>::max()) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    const int64_t offsets_start = serialized_size_t<int8_t>::value
+        + varint_uint64_serialized_size(sz);
+    const int64_t fields_start = offsets_start + sz * sizeof(uint32_t);
+
+    uint64_t lo = 0, hi = sz;
+    while (lo < hi) {
+        const uint64_t mid = lo + (hi - lo) / 2;
+        s->seek(offsets_start + mid * sizeof(uint32_t));
+        uint32_t offset;
+        res = deserialize(s, &offset);
+        if (bad(res)) {
+            return res;
+        }
+        s->seek(fields_start + offset);
+        std::string mid_key;
+        res = deserialize(s, &mid_key);
+        if (bad(res)) {
+            return res;
+        }
+        const int cmp = mid_key.compare(key);
+        if (cmp == 0) {
+            return deserialize(s, field_out);
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return archive_result_t::SUCCESS;
+}
+
 write_message_t &operator<<(write_message_t &wm,
                             const empty_ok_t<const counted_t<const datum_t> > &datum) {
     const counted_t<const datum_t> *pointer = datum.get();
@@ -21,6 +21,7 @@
 #include "rdb_protocol/error.hpp"
 
 class Datum;
+class buffer_group_read_stream_t;
 
 RDB_DECLARE_SERIALIZABLE(Datum);
 
@@ -50,6 +51,7 @@ enum clobber_bool_t { NOCLOBBER = 0, CLOBBER = 1};
 enum class use_json_t { NO = 0, YES = 1 };
 
 class grouped_data_t;
+class datum_object_t;
 
 // A `datum_t` is basically a JSON value, although we may extend it later.
 class datum_t : public slow_atomic_countable_t<datum_t> {
@@ -76,6 +78,7 @@ public:
     explicit datum_t(const char *cstr);
     explicit datum_t(std::vector<counted_t<const datum_t> > &&_array);
     explicit datum_t(std::map<std::string, counted_t<const datum_t> > &&object);
+    explicit datum_t(datum_object_t &&object);
 
     // This should only be used to send responses to the client.
     explicit datum_t(grouped_data_t &&gd);
@@ -126,7 +129,7 @@ public:
     // Access an element of an array.
     counted_t<const datum_t> get(size_t index, throw_bool_t throw_bool = THROW) const;
     // Use of `get` is preferred to `as_object` when possible.
-    const std::map<std::string, counted_t<const datum_t> > &as_object() const;
+    const datum_object_t &as_object() const;
 
     // Access an element of an object.
     counted_t<const datum_t> get(const std::string &key,
@@ -216,7 +219,7 @@ private:
         double r_num;
         wire_string_t *r_str;
         std::vector<counted_t<const datum_t> > *r_array;
-        std::map<std::string, counted_t<const datum_t> > *r_object;
+        datum_object_t *r_object;
     };
 
 public:
@@ -226,6 +229,89 @@ private:
     DISABLE_COPYING(datum_t);
 };
 
+// The name of a field of an object.  Field names are interned in a per-thread
+// table, so that the rows of a table, which mostly have the same handful of
+// fields, share one copy of each name instead of allocating their own.  Names
+// that are too long, or that show up once the table is full, get a copy of
+// their own; either way, comparing two names that share a copy is free.
+class datum_field_name_t {
+public:
+    explicit datum_field_name_t(const std::string &name);
+
+    const std::string &str() const { return rep->str; }
+    operator const std::string &() const { return rep->str; }
+    const char *c_str() const { return rep->str.c_str(); }
+    size_t size() const { return rep->str.size(); }
+
+    int compare(const std::string &other) const { return rep->str.compare(other); }
+    int compare(const datum_field_name_t &other) const {
+        return rep == other.rep ? 0 : rep->str.compare(other.rep->str);
+    }
+
+    bool operator==(const datum_field_name_t &other) const {
+        return compare(other) == 0;
+    }
+    bool operator==(const std::string &other) const { return rep->str == other; }
+    bool operator==(const char *other) const { return rep->str == other; }
+    bool operator!=(const datum_field_name_t &other) const { return !(*this == other); }
+    bool operator!=(const std::string &other) const { return !(*this == other); }
+    bool operator!=(const char *other) const { return !(*this == other); }
+
+private:
+    class rep_t : public slow_atomic_countable_t<rep_t> {
+    public:
+        explicit rep_t(const std::string &_str) : str(_str) { }
+        const std::string str;
+    };
+
+    counted_t<const rep_t> rep;
+};
+
+// The fields of an object, sorted by name.  The fields live in one flat array
+// rather than in a `std::map`, so an object costs a single allocation instead of
+// a tree node and a key string per field, and `get` is a binary search over
+// contiguous memory.  It offers the read-only part of the `std::map` interface
+// (iterators point at something with `first` and `second`), which is all that
+// code iterating over `as_object()` needs; changes go through `datum_ptr_t`.
+class datum_object_t {
+public:
+    struct field_t {
+        field_t(datum_field_name_t &&_first, counted_t<const datum_t> &&_second)
+            : first(std::move(_first)), second(std::move(_second)) { }
+        datum_field_name_t first;
+        counted_t<const datum_t> second;
+    };
+
+    typedef std::vector<field_t>::const_iterator const_iterator;
+    typedef std::vector<field_t>::const_reverse_iterator const_reverse_iterator;
+
+    datum_object_t() { }
+    explicit datum_object_t(std::map<std::string, counted_t<const datum_t> > &&map);
+
+    const_iterator begin() const { return fields.begin(); }
+    const_iterator end() const { return fields.end(); }
+    const_reverse_iterator rbegin() const { return fields.rbegin(); }
+    const_reverse_iterator rend() const { return fields.rend(); }
+    size_t size() const { return fields.size(); }
+    bool empty() const { return fields.empty(); }
+
+    const_iterator find(const std::string &key) const;
+    size_t count(const std::string &key) const { return find(key) == end() ? 0 : 1; }
+
+private:
+    friend class datum_t;
+    friend archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum);
+
+    void reserve(size_t n) { fields.reserve(n); }
+    // Returns true if `key` was already in the object.
+    bool set(const std::string &key, counted_t<const datum_t> &&val,
+             clobber_bool_t clobber_bool);
+    // Returns true if `key` was in the object.
+    bool erase(const std::string &key);
+
+    std::vector<field_t> fields;
+};
+
 size_t serialized_size(const counted_t<const datum_t> &datum);
 
 write_message_t &operator<<(write_message_t &wm, const counted_t<const datum_t> &datum);
@@ -234,6 +320,33 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum);
 write_message_t &operator<<(write_message_t &wm, const empty_ok_t<const counted_t<const datum_t> > &datum);
 archive_result_t deserialize(read_stream_t *s, empty_ok_ref_t<counted_t<const datum_t> > datum);
 
+// Serializes a row with a field index.  This is the same as `operator<<`, except
+// that an object at the top level also gets a table of the offsets of its fields
+// (4 bytes per field), so that `deserialize_field` can read one field without
+// deserializing the others.  `deserialize` reads both.
+void serialize_with_field_index(write_message_t *wm,
+                                const counted_t<const datum_t> &datum);
+
+// How rows get written to tables.  Rows are only written with a field index if the
+// server was started with `--field-indexed-rows`: servers from before field indexes
+// existed can't read them, so writing them is a one-way change to the data files.
+// Rows with an index are read the same way whatever the format is.
+enum class row_format_t { PLAIN = 0, FIELD_INDEXED = 1 };
+
+// Serializes a row the way it gets stored in a table: with a field index if
+// `format` is `FIELD_INDEXED`, and like `operator<<` otherwise.
+void serialize_row(write_message_t *wm, const counted_t<const datum_t> &datum,
+                   row_format_t format);
+
+// Reads the field `key` of a row written by `serialize_with_field_index`,
+// leaving `*field_out` empty if the row doesn't have it.  Sets `*has_index_out` to
+// false (and reads nothing) if the row doesn't have a field index, because it
+// isn't an object or was written before rows had one.
+MUST_USE archive_result_t deserialize_field(buffer_group_read_stream_t *s,
+                                            const std::string &key,
+                                            bool *has_index_out,
+                                            counted_t<const datum_t> *field_out);
+
 // Converts a double to int, but returns false if it's not an integer or out of range.
 bool number_as_integer(double d, int64_t *i_out);
 
@@ -1,9 +1,11 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/datum_stream.hpp"
 
+#include <iterator>
 #include <map>
 
 #include "clustering/administration/metadata.hpp"
+#include "containers/disk_backed_queue.hpp"
 #include "rdb_protocol/batching.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
@@ -764,6 +766,296 @@ indexed_sort_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batch
     return ret;
 }
 
+// ORDERBY_DATUM_STREAM_T
+
+// How many rows of a spilled run get serialized together.
+static const size_t ORDERBY_SPILL_CHUNK_ROWS = 256;
+
+// How many runs get merged at once.  A merge pass needs this many input tapes and
+// this many output tapes, each with its own temporary file.
+static const size_t ORDERBY_MERGE_FAN_IN = 8;
+
+/* A `tape_t` holds a sequence of sorted runs in a temporary file.  Runs are
+appended with `push_run()` and read back in the same order: `start_run()` moves on
+to the next run, and `peek()` and `pop()` read it.  A chunk never holds rows from
+two runs. */
+class orderby_datum_stream_t::tape_t {
+public:
+    tape_t(io_backender_t *io_backender, const base_path_t &base_path,
+           perfmon_collection_t *stats)
+        : queue(io_backender,
+                serializer_filepath_t(base_path,
+                                      "orderby-run-" + uuid_to_str(generate_uuid())),
+                stats),
+          rows_left_in_run(0),
+          index(0) { }
+
+    void begin_run() {
+        r_sanity_check(out_chunk.empty());
+        run_sizes.push_back(0);
+    }
+
+    void push(counted_t<const datum_t> &&row) {
+        out_chunk.push_back(std::move(row));
+        ++run_sizes.back();
+        if (out_chunk.size() >= ORDERBY_SPILL_CHUNK_ROWS) {
+            flush();
+        }
+    }
+
+    void end_run() {
+        flush();
+    }
+
+    void push_run(std::vector<counted_t<const datum_t> > *rows) {
+        begin_run();
+        for (auto it = rows->begin(); it != rows->end(); ++it) {
+            push(std::move(*it));
+        }
+        end_run();
+    }
+
+    // Returns false if there are no more runs.
+    bool start_run() {
+        r_sanity_check(rows_left_in_run == 0);
+        if (run_sizes.empty()) {
+            return false;
+        }
+        rows_left_in_run = run_sizes.front();
+        run_sizes.pop_front();
+        return true;
+    }
+
+    // Returns NULL once the current run is over.
+    const counted_t<const datum_t> &peek() {
+        if (rows_left_in_run == 0) {
+            return empty;
+        }
+        if (index >= in_chunk.size()) {
+            in_chunk.clear();
+            queue.pop(&in_chunk);
+            index = 0;
+            r_sanity_check(in_chunk.size() != 0);
+        }
+        return in_chunk[index];
+    }
+
+    counted_t<const datum_t> pop() {
+        r_sanity_check(rows_left_in_run != 0 && index < in_chunk.size());
+        --rows_left_in_run;
+        return std::move(in_chunk[index++]);
+    }
+
+private:
+    void flush() {
+        if (!out_chunk.empty()) {
+            queue.push(out_chunk);
+            out_chunk.clear();
+        }
+    }
+
+    disk_backed_queue_t<datums_t> queue;
+    // The number of rows in each run that hasn't been started yet.
+    std::deque<uint64_t> run_sizes;
+    datums_t out_chunk;
+
+    uint64_t rows_left_in_run;
+    datums_t in_chunk;
+    size_t index;
+    const counted_t<const datum_t> empty;
+
+    DISABLE_COPYING(tape_t);
+};
+
+orderby_datum_stream_t::orderby_datum_stream_t(
+    counted_t<datum_stream_t> stream,
+    const std::vector<std::pair<order_direction_t, counted_t<func_t> > > &comps,
+    size_t _run_size)
+    : wrapper_datum_stream_t(stream),
+      comparisons(comps),
+      lt_cmp(comps),
+      run_size(_run_size),
+      sorted(false),
+      index(0),
+      input_tapes_offset(0),
+      num_runs(0),
+      spilled_rows_left(0) {
+    r_sanity_check(run_size > 0);
+}
+
+orderby_datum_stream_t::~orderby_datum_stream_t() { }
+
+counted_t<datum_stream_t> orderby_datum_stream_t::slice(size_t l, size_t r) {
+    if (!sorted && !ops_to_do() && !is_grouped() && !source->is_grouped()
+        && r <= array_size_limit()) {
+        limit = limit ? std::min<uint64_t>(*limit, r) : r;
+    }
+    return datum_stream_t::slice(l, r);
+}
+
+bool orderby_datum_stream_t::is_exhausted() const {
+    return sorted && index >= data.size() && spilled_rows_left == 0
+        && batch_cache_exhausted();
+}
+
+bool orderby_datum_stream_t::is_array() {
+    return !is_grouped() && !source->is_grouped();
+}
+
+counted_t<const datum_t> orderby_datum_stream_t::as_array(env_t *env) {
+    return is_array()
+        ? eager_datum_stream_t::as_array(env)
+        : counted_t<const datum_t>();
+}
+
+void orderby_datum_stream_t::sort_source(env_t *env) {
+    if (limit) {
+        counted_t<val_t> top_k = source->run_terminal(
+            env, top_k_wire_func_t(comparisons, *limit, backtrace()));
+        data = top_k->as_datum()->as_array();
+        return;
+    }
+
+    batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env);
+    for (;;) {
+        std::vector<counted_t<const datum_t> > batch = source->next_batch(env, batchspec);
+        if (batch.size() == 0) {
+            break;
+        }
+        std::move(batch.begin(), batch.end(), std::back_inserter(data));
+        if (data.size() > run_size) {
+            rcheck(env->temp_files.is_set(), base_exc_t::GENERIC,
+                   strprintf("Array over size limit %zu.", data.size()).c_str());
+            spill_data(env);
+        }
+    }
+
+    if (num_runs == 0) {
+        sort_rows(env, &data);
+    } else {
+        if (data.size() != 0) {
+            spill_data(env);
+        }
+        merge_runs(env);
+    }
+}
+
+void orderby_datum_stream_t::sort_rows(env_t *env,
+                                       std::vector<counted_t<const datum_t> > *rows) {
+    profile::sampler_t sampler("Sorting in-memory.", env->trace);
+    std::sort(rows->begin(), rows->end(),
+              std::bind(lt_cmp, env, &sampler, ph::_1, ph::_2));
+}
+
+orderby_datum_stream_t::tape_t *orderby_datum_stream_t::get_tape(env_t *env,
+                                                                 size_t i) {
+    if (tapes.empty()) {
+        tapes.resize(2 * ORDERBY_MERGE_FAN_IN);
+    }
+    if (!tapes[i].has()) {
+        tapes[i].init(new tape_t(env->temp_files.io_backender,
+                                 *env->temp_files.base_path, &spill_stats));
+    }
+    return tapes[i].get();
+}
+
+void orderby_datum_stream_t::spill_data(env_t *env) {
+    // A batch from the source may have pushed us well past `run_size`.
+    for (size_t i = 0; i < data.size(); i += run_size) {
+        std::vector<counted_t<const datum_t> > run(
+            std::make_move_iterator(data.begin() + i),
+            std::make_move_iterator(data.begin() + std::min(data.size(), i + run_size)));
+        sort_rows(env, &run);
+        profile::sampler_t sampler("Spilling sorted rows to disk.", env->trace);
+        get_tape(env, input_tapes_offset + num_runs % ORDERBY_MERGE_FAN_IN)->push_run(&run);
+        ++num_runs;
+        spilled_rows_left += run.size();
+    }
+    std::vector<counted_t<const datum_t> > tmp;
+    tmp.swap(data);
+}
+
+void orderby_datum_stream_t::merge_runs(env_t *env) {
+    profile::sampler_t sampler("Merging sorted runs on disk.", env->trace);
+    while (num_runs > ORDERBY_MERGE_FAN_IN) {
+        /* Run `i` is on input tape `i % ORDERBY_MERGE_FAN_IN`, so each group of
+        `ORDERBY_MERGE_FAN_IN` consecutive runs is the next run on every input
+        tape. Output runs are spread over the output tapes the same way. */
+        const size_t output_tapes_offset = ORDERBY_MERGE_FAN_IN - input_tapes_offset;
+        size_t num_output_runs = 0;
+        for (size_t done = 0; done < num_runs; done += ORDERBY_MERGE_FAN_IN) {
+            std::vector<tape_t *> inputs;
+            for (size_t i = 0; i < ORDERBY_MERGE_FAN_IN; ++i) {
+                tape_t *tape = get_tape(env, input_tapes_offset + i);
+                if (tape->start_run()) {
+                    inputs.push_back(tape);
+                }
+            }
+            tape_t *output = get_tape(
+                env, output_tapes_offset + num_output_runs % ORDERBY_MERGE_FAN_IN);
+            output->begin_run();
+            while (counted_t<const datum_t> row = pop_smallest(env, &sampler, inputs)) {
+                output->push(std::move(row));
+            }
+            output->end_run();
+            ++num_output_runs;
+        }
+        input_tapes_offset = output_tapes_offset;
+        num_runs = num_output_runs;
+    }
+
+    for (size_t i = 0; i < ORDERBY_MERGE_FAN_IN; ++i) {
+        tape_t *tape = get_tape(env, input_tapes_offset + i);
+        if (tape->start_run()) {
+            merge_inputs.push_back(tape);
+        }
+    }
+}
+
+counted_t<const datum_t> orderby_datum_stream_t::pop_smallest(
+    env_t *env, profile::sampler_t *sampler, const std::vector<tape_t *> &inputs) {
+    tape_t *best = NULL;
+    for (auto it = inputs.begin(); it != inputs.end(); ++it) {
+        const counted_t<const datum_t> &head = (*it)->peek();
+        if (head.has() && (best == NULL || lt_cmp(env, sampler, head, best->peek()))) {
+            best = *it;
+        }
+    }
+    if (best == NULL) {
+        return counted_t<const datum_t>();
+    }
+    return best->pop();
+}
+
+std::vector<counted_t<const datum_t> >
+orderby_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batchspec) {
+    if (!sorted) {
+        sort_source(env);
+        sorted = true;
+    }
+
+    std::vector<counted_t<const datum_t> > ret;
+    batcher_t batcher = batchspec.to_batcher();
+    if (merge_inputs.empty()) {
+        for (; index < data.size() && !batcher.should_send_batch(); ++index) {
+            batcher.note_el(data[index]);
+            ret.push_back(std::move(data[index]));
+        }
+    } else {
+        profile::sampler_t sampler("Merging sorted runs.", env->trace);
+        while (!batcher.should_send_batch()) {
+            counted_t<const datum_t> d = pop_smallest(env, &sampler, merge_inputs);
+            if (!d.has()) {
+                break;
+            }
+            --spilled_rows_left;
+            batcher.note_el(d);
+            ret.push_back(std::move(d));
+        }
+    }
+    return ret;
+}
+
 // INDEXES_OF_DATUM_STREAM_T
 indexes_of_datum_stream_t::indexes_of_datum_stream_t(counted_t<func_t> _f,
                                                      counted_t<datum_stream_t> _source)
@@ -94,7 +94,7 @@ public:
     counted_t<val_t> to_array(env_t *env);
 
     // stream -> stream (always eager)
-    counted_t<datum_stream_t> slice(size_t l, size_t r);
+    virtual counted_t<datum_stream_t> slice(size_t l, size_t r);
     counted_t<datum_stream_t> zip();
     counted_t<datum_stream_t> indexes_of(counted_t<func_t> f);
 
@@ -248,6 +248,69 @@ size_t index;
 std::vector<counted_t<const datum_t> > data;
 };
 
+// An unindexed `orderBy`.  The source is read and sorted in runs of at most
+// `run_size` rows; if there's more than one run, the runs are spilled to a fixed
+// set of temporary files and merged, `ORDERBY_MERGE_FAN_IN` runs at a time, until
+// few enough are left to merge as the stream is read.  (Without a place for
+// temporary files, a source that big is an error instead.)  If the stream gets
+// sliced before it's read, only the rows that can make it through the slice are
+// kept, and tables work out their share of those on the shards.  Like the sorted
+// array it replaces, the stream counts as an array.
+class orderby_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    orderby_datum_stream_t(
+        counted_t<datum_stream_t> stream,
+        const std::vector<std::pair<order_direction_t, counted_t<func_t> > > &comps,
+        size_t run_size = array_size_limit());
+    ~orderby_datum_stream_t();
+
+    virtual counted_t<datum_stream_t> slice(size_t l, size_t r);
+
+private:
+    class tape_t;
+
+    virtual bool is_exhausted() const;
+    virtual bool is_array();
+    virtual counted_t<const datum_t> as_array(env_t *env);
+    virtual std::vector<counted_t<const datum_t> >
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    void sort_source(env_t *env);
+    void sort_rows(env_t *env, std::vector<counted_t<const datum_t> > *rows);
+    // Sorts `data` in runs of at most `run_size` rows, and spills them.
+    void spill_data(env_t *env);
+    tape_t *get_tape(env_t *env, size_t i);
+    // Merges runs until there are at most `ORDERBY_MERGE_FAN_IN` left, then starts
+    // reading the remaining ones.
+    void merge_runs(env_t *env);
+    // Returns the smallest row left in the current run of any of `inputs`, or NULL
+    // once they're all at the end of their runs.
+    counted_t<const datum_t> pop_smallest(env_t *env, profile::sampler_t *sampler,
+                                          const std::vector<tape_t *> &inputs);
+
+    const std::vector<std::pair<order_direction_t, counted_t<func_t> > > comparisons;
+    const orderby_lt_cmp_t lt_cmp;
+    const size_t run_size;
+
+    // Set by `slice`: only the first `*limit` rows will ever be read.
+    boost::optional<uint64_t> limit;
+    bool sorted;
+
+    // The sorted rows, if they all fit in memory.
+    std::vector<counted_t<const datum_t> > data;
+    size_t index;
+
+    perfmon_collection_t spill_stats;
+    // `2 * ORDERBY_MERGE_FAN_IN` tapes, created as they're needed.  Runs are
+    // spread round-robin over the `ORDERBY_MERGE_FAN_IN` input tapes starting at
+    // `input_tapes_offset`, and every merge pass writes to the other half.
+    std::vector<scoped_ptr_t<tape_t> > tapes;
+    size_t input_tapes_offset;
+    size_t num_runs;
+    std::vector<tape_t *> merge_inputs;
+    uint64_t spilled_rows_left;
+};
+
 class union_datum_stream_t : public datum_stream_t {
 public:
     union_datum_stream_t(std::vector<counted_t<datum_stream_t> > &&_streams,
@@ -177,6 +177,7 @@ env_t::env_t(rdb_protocol_t::context_t *ctx, signal_t *_interruptor)
           NULL,
           ctx ? ctx->machine_id : uuid_u()),
       interruptor(_interruptor),
+      temp_files(ctx ? ctx->temp_files : temp_file_location_t()),
       eval_callback(NULL) { }
 
 env_t::env_t(
@@ -191,6 +192,7 @@ env_t::env_t(
     directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
     signal_t *_interruptor,
     uuid_u _this_machine,
+    const temp_file_location_t &_temp_files,
     protob_t<Query> query)
   : evals_since_yield(0),
     global_optargs(query),
@@ -202,6 +204,7 @@ env_t::env_t(
                    _directory_read_manager,
                    _this_machine),
     interruptor(_interruptor),
+    temp_files(_temp_files),
     eval_callback(NULL)
 {
     if (query.has()) {
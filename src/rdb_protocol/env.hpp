@@ -98,6 +98,7 @@ public:
         directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
         signal_t *_interruptor,
         uuid_u _this_machine,
+        const temp_file_location_t &_temp_files,
         protob_t<Query> query);
 
     env_t(
@@ -159,6 +160,10 @@ public:
 
     scoped_ptr_t<profile::trace_t> trace;
 
+    // Where to spill intermediate results that are too big to keep in memory.  If
+    // it isn't set, they're subject to the array size limit instead.
+    temp_file_location_t temp_files;
+
     profile_bool_t profile();
 
 private:
@@ -73,6 +73,11 @@ counted_t<val_t> reql_func_t::call(
     }
 }
 
+bool func_t::get_field_predicates(
+        UNUSED std::vector<field_predicate_t> *predicates_out) const {
+    return false;
+}
+
 bool reql_func_t::is_deterministic() const {
     return body->is_deterministic();
 }
@@ -223,8 +228,7 @@ bool filter_match(counted_t<const datum_t> predicate, counted_t<const datum_t> v
     if (predicate->is_ptype(pseudo::literal_string)) {
         return *predicate->get(pseudo::value_key) == *value;
     } else {
-        const std::map<std::string, counted_t<const datum_t> > &obj
-            = predicate->as_object();
+        const datum_object_t &obj = predicate->as_object();
         for (auto it = obj.begin(); it != obj.end(); ++it) {
             r_sanity_check(it->second.has());
             counted_t<const datum_t> elt = value->get(it->first, NOTHROW);
@@ -253,6 +257,182 @@ bool reql_func_t::filter_helper(env_t *env, counted_t<const datum_t> arg) const
     }
 }
 
+field_predicate_t::field_predicate_t(const std::string &_field, type_t _type,
+                                     counted_t<const datum_t> _value)
+    : field(_field), type(_type), value(_value) { }
+
+bool field_predicate_t::test(const counted_t<const datum_t> &field_value,
+                             const rcheckable_t *parent) const {
+    switch (type) {
+    case type_t::MATCH:
+        // This is one step of `filter_match`.
+        if (value->get_type() == datum_t::R_OBJECT
+            && field_value->get_type() == datum_t::R_OBJECT) {
+            return filter_match(value, field_value, parent);
+        }
+        return *field_value == *value;
+    case type_t::EQ: return *field_value == *value;
+    case type_t::NE: return *field_value != *value;
+    case type_t::LT: return *field_value < *value;
+    case type_t::LE: return *field_value <= *value;
+    case type_t::GT: return *field_value > *value;
+    case type_t::GE: return *field_value >= *value;
+    default: unreachable();
+    }
+}
+
+bool reql_func_t::is_arg(const Term &t) const {
+    if (arg_names.size() != 1) {
+        return false;
+    }
+    if (t.type() == Term::IMPLICIT_VAR) {
+        return function_emits_implicit_variable(arg_names);
+    }
+    return t.type() == Term::VAR
+        && t.args_size() == 1
+        && t.args(0).type() == Term::DATUM
+        && t.args(0).datum().type() == Datum::R_NUM
+        && t.args(0).datum().r_num() == static_cast<double>(arg_names[0].value);
+}
+
+// Returns the constant `t` evaluates to, or an empty pointer if it isn't a
+// plain constant.
+static counted_t<const datum_t> term_constant(const Term &t) {
+    if (t.type() != Term::DATUM) {
+        return counted_t<const datum_t>();
+    }
+    try {
+        counted_t<const datum_t> d = make_counted<const datum_t>(&t.datum());
+        // Literals mean something else inside of `filter_match`.
+        if (d->is_ptype(pseudo::literal_string)) {
+            return counted_t<const datum_t>();
+        }
+        return d;
+    } catch (const base_exc_t &) {
+        return counted_t<const datum_t>();
+    }
+}
+
+// Sets `*field_out` if `t` gets a field of the function's argument.
+bool reql_func_t::is_arg_field(const Term &t, std::string *field_out) const {
+    if (t.type() != Term::GET_FIELD || t.args_size() != 2 || t.optargs_size() != 0
+        || !is_arg(t.args(0))) {
+        return false;
+    }
+    const Term &key = t.args(1);
+    if (key.type() != Term::DATUM || key.datum().type() != Datum::R_STR) {
+        return false;
+    }
+    *field_out = key.datum().r_str();
+    return true;
+}
+
+bool reql_func_t::get_comparison_predicates(
+        const Term &t, std::vector<field_predicate_t> *predicates_out) const {
+    if (t.optargs_size() != 0) {
+        return false;
+    }
+    if (t.type() == Term::ALL) {
+        // `ALL` stops at the first argument that's false, so the tests of its
+        // arguments are made in order.
+        for (int i = 0; i < t.args_size(); ++i) {
+            if (!get_comparison_predicates(t.args(i), predicates_out)) {
+                return false;
+            }
+        }
+        return t.args_size() != 0;
+    }
+
+    // The type of the test if the field is on the left, and if it's on the right.
+    field_predicate_t::type_t left_type, right_type;
+    switch (t.type()) {
+    case Term::EQ: {
+        left_type = right_type = field_predicate_t::type_t::EQ;
+    } break;
+    case Term::NE: {
+        left_type = right_type = field_predicate_t::type_t::NE;
+    } break;
+    case Term::LT: {
+        left_type = field_predicate_t::type_t::LT;
+        right_type = field_predicate_t::type_t::GT;
+    } break;
+    case Term::LE: {
+        left_type = field_predicate_t::type_t::LE;
+        right_type = field_predicate_t::type_t::GE;
+    } break;
+    case Term::GT: {
+        left_type = field_predicate_t::type_t::GT;
+        right_type = field_predicate_t::type_t::LT;
+    } break;
+    case Term::GE: {
+        left_type = field_predicate_t::type_t::GE;
+        right_type = field_predicate_t::type_t::LE;
+    } break;
+    default:
+        return false;
+    }
+    if (t.args_size() != 2) {
+        return false;
+    }
+
+    std::string field;
+    counted_t<const datum_t> value;
+    if (is_arg_field(t.args(0), &field) && (value = term_constant(t.args(1)))) {
+        predicates_out->push_back(field_predicate_t(field, left_type, value));
+        return true;
+    }
+    if (is_arg_field(t.args(1), &field) && (value = term_constant(t.args(0)))) {
+        predicates_out->push_back(field_predicate_t(field, right_type, value));
+        return true;
+    }
+    return false;
+}
+
+bool reql_func_t::get_field_predicates(
+        std::vector<field_predicate_t> *predicates_out) const {
+    const Term &t = *body->get_src();
+    std::vector<field_predicate_t> predicates;
+
+    // Objects are matched against the row, see `filter_helper`.
+    counted_t<const datum_t> obj;
+    if (t.type() == Term::DATUM) {
+        obj = term_constant(t);
+    } else if (t.type() == Term::MAKE_OBJ && t.args_size() == 0) {
+        std::map<std::string, counted_t<const datum_t> > fields;
+        for (int i = 0; i < t.optargs_size(); ++i) {
+            counted_t<const datum_t> val = term_constant(t.optargs(i).val());
+            if (!val.has() || !fields.insert(std::make_pair(t.optargs(i).key(),
+                                                            val)).second) {
+                return false;
+            }
+        }
+        try {
+            obj = make_counted<const datum_t>(std::move(fields));
+        } catch (const base_exc_t &) {
+            return false;
+        }
+    } else {
+        if (!get_comparison_predicates(t, &predicates)) {
+            return false;
+        }
+    }
+
+    if (obj.has()) {
+        if (obj->get_type() != datum_t::R_OBJECT || obj->is_ptype()) {
+            return false;
+        }
+        // `filter_match` goes through the fields in this order, too.
+        const datum_object_t &fields = obj->as_object();
+        for (auto it = fields.begin(); it != fields.end(); ++it) {
+            predicates.push_back(field_predicate_t(
+                it->first, field_predicate_t::type_t::MATCH, it->second));
+        }
+    }
+
+    predicates_out->swap(predicates);
+    return !predicates_out->empty();
+}
+
 std::string reql_func_t::print_source() const {
     std::string ret = "function (captures = " + captured_scope.print() + ") (args = [";
     for (size_t i = 0; i < arg_names.size(); ++i) {
@@ -24,6 +24,30 @@ namespace ql {
 
 class func_visitor_t;
 
+// A test of one top-level field of a row against a constant.  A filter that
+// does nothing but make such tests (see `func_t::get_field_predicates`) can
+// reject a row by looking at a few of its fields, without loading the rest.
+class field_predicate_t {
+public:
+    // `MATCH` is the test that `filter({field: value})` makes.
+    enum class type_t { MATCH, EQ, NE, LT, LE, GT, GE };
+
+    field_predicate_t(const std::string &_field, type_t _type,
+                      counted_t<const datum_t> _value);
+
+    const std::string &get_field() const { return field; }
+
+    // Returns whether `field_value` passes the test.  Throws wherever evaluating
+    // the filter would have thrown.
+    bool test(const counted_t<const datum_t> &field_value,
+              const rcheckable_t *parent) const;
+
+private:
+    std::string field;
+    type_t type;
+    counted_t<const datum_t> value;
+};
+
 class func_t : public slow_atomic_countable_t<func_t>, public pb_rcheckable_t {
 public:
     virtual ~func_t();
@@ -42,6 +66,15 @@ public:
 
     void assert_deterministic(const char *extra_msg) const;
 
+    // Returns true if this function, used as a filter, does nothing but test
+    // top-level fields of its argument against constants, and fills
+    // `predicates_out` with those tests in the order it makes them.  A row is
+    // rejected by the filter if it fails one of them, provided that it has all of
+    // the fields that the ones before it test (otherwise the filter's default
+    // gets involved).
+    virtual bool get_field_predicates(
+        std::vector<field_predicate_t> *predicates_out) const;
+
     bool filter_call(env_t *env,
                      counted_t<const datum_t> arg,
                      counted_t<func_t> default_filter_val) const;
@@ -79,6 +112,8 @@ public:
         eval_flags_t eval_flags) const;
     bool is_deterministic() const;
 
+    bool get_field_predicates(std::vector<field_predicate_t> *predicates_out) const;
+
     std::string print_source() const;
 
     void visit(func_visitor_t *visitor) const;
@@ -87,6 +122,11 @@ private:
     friend class wire_func_serialization_visitor_t;
     bool filter_helper(env_t *env, counted_t<const datum_t> arg) const;
 
+    bool is_arg(const Term &t) const;
+    bool is_arg_field(const Term &t, std::string *field_out) const;
+    bool get_comparison_predicates(
+        const Term &t, std::vector<field_predicate_t> *predicates_out) const;
+
     // Only contains the parts of the scope that `body` uses.
     var_scope_t captured_scope;
 
@@ -1,6 +1,10 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/lazy_json.hpp"
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "containers/archive/buffer_group_stream.hpp"
 #include "rdb_protocol/blob_wrapper.hpp"
 
@@ -31,6 +35,49 @@ const counted_t<const ql::datum_t> &lazy_json_t::get() const {
     return pointee->ptr;
 }
 
+bool lazy_json_t::get_fields(const std::vector<std::string> &keys,
+                             counted_t<const ql::datum_t> *fields_out) const {
+    guarantee(pointee.has());
+    std::map<std::string, counted_t<const ql::datum_t> > fields;
+    if (pointee->ptr.has()) {
+        if (pointee->ptr->get_type() != ql::datum_t::R_OBJECT) {
+            return false;
+        }
+        for (auto it = keys.begin(); it != keys.end(); ++it) {
+            counted_t<const ql::datum_t> field = pointee->ptr->get(*it, ql::NOTHROW);
+            if (field.has()) {
+                fields[*it] = std::move(field);
+            }
+        }
+        *fields_out = make_counted<const ql::datum_t>(std::move(fields));
+        return true;
+    }
+
+    // All the fields are read from one exposure of the blob.
+    rdb_blob_wrapper_t blob(pointee->parent.cache()->get_block_size(),
+                            const_cast<rdb_value_t *>(pointee->rdb_value)->value_ref(),
+                            blob::btree_maxreflen);
+    blob_acq_t acq_group;
+    buffer_group_t buffer_group;
+    blob.expose_all(pointee->parent, access_t::read, &buffer_group, &acq_group);
+    buffer_group_read_stream_t read_stream(const_view(&buffer_group));
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        bool has_index;
+        counted_t<const ql::datum_t> field;
+        archive_result_t res = ql::deserialize_field(&read_stream, *it,
+                                                     &has_index, &field);
+        guarantee_deserialization(res, "rdb value field");
+        if (!has_index) {
+            return false;
+        }
+        if (field.has()) {
+            fields[*it] = std::move(field);
+        }
+    }
+    *fields_out = make_counted<const ql::datum_t>(std::move(fields));
+    return true;
+}
+
 bool lazy_json_t::references_parent() const {
     return pointee.has() && !pointee->parent.empty();
 }
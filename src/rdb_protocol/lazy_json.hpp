@@ -2,6 +2,9 @@
 #ifndef RDB_PROTOCOL_LAZY_JSON_HPP_
 #define RDB_PROTOCOL_LAZY_JSON_HPP_
 
+#include <string>
+#include <vector>
+
 #include "buffer_cache/alt/alt.hpp"
 #include "buffer_cache/alt/blob.hpp"
 #include "rdb_protocol/datum.hpp"
@@ -63,6 +66,13 @@ public:
         : pointee(new lazy_json_pointee_t(rdb_value, parent)) { }
 
     const counted_t<const ql::datum_t> &get() const;
+    // Reads the top-level fields `keys` of the row into an object, without loading
+    // the rest of it if it was stored with a field index (see
+    // `serialize_with_field_index`).  The object leaves out the fields the row
+    // doesn't have.  Returns false if the row can't be read that way, in which case
+    // `get` has to be used instead.
+    MUST_USE bool get_fields(const std::vector<std::string> &keys,
+                             counted_t<const ql::datum_t> *fields_out) const;
     bool references_parent() const;
     void reset();
 
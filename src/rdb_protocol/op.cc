@@ -114,6 +114,10 @@ private:
 };
 
 size_t op_term_t::num_args() const { return args.size(); }
+bool op_term_t::arg_is_deterministic(size_t i) const {
+    r_sanity_check(i < args.size());
+    return args[i]->is_deterministic();
+}
 counted_t<val_t> op_term_t::arg(scope_env_t *env, size_t i, eval_flags_t flags) {
     if (i == 0) {
         if (!arg0.has()) arg0 = arg_verifier->consume(0)->eval(env, flags);
@@ -60,6 +60,8 @@ protected:
     virtual ~op_term_t();
 
     size_t num_args() const; // number of arguments
+    // Whether argument `i` always evaluates to the same thing.
+    bool arg_is_deterministic(size_t i) const;
     // Returns argument `i`.
     counted_t<val_t> arg(scope_env_t *env, size_t i, eval_flags_t flags = NO_FLAGS);
     // Tries to get an optional argument, returns `counted_t<val_t>()` if not found.
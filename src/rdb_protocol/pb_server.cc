@@ -2,6 +2,7 @@
 #include "rdb_protocol/pb_server.hpp"
 
 #include "concurrency/cross_thread_watchable.hpp"
+#include "concurrency/interruptor.hpp"
 #include "concurrency/watchable.hpp"
 #include "rdb_protocol/counted_term.hpp"
 #include "rdb_protocol/env.hpp"
@@ -24,7 +25,8 @@ query2_server_t::query2_server_t(const std::set<ip_address_t> &local_addresses,
            boost::bind(&query2_server_t::handle, this, _1, _2, _3),
            &on_unparsable_query2,
            _ctx->auth_metadata,
-           INLINE),
+           CORO_UNORDERED,
+           MAX_CONCURRENT_RDB_QUERIES_PER_CONNECTION),
     ctx(_ctx), parser_id(generate_uuid()), thread_counters(0)
 { }
 
@@ -59,6 +61,32 @@ private:
     DISABLE_COPYING(scoped_ops_running_stat_t);
 };
 
+class token_lock_acq_t {
+public:
+    token_lock_acq_t(query2_server_t::context_t *_ctx, int64_t _token)
+        : ctx(_ctx), token(_token) {
+        auto it = ctx->token_locks.find(token);
+        if (it == ctx->token_locks.end()) {
+            it = ctx->token_locks.insert(token, new query2_server_t::token_lock_t).first;
+        }
+        lock = it->second;
+        ++lock->users;
+        acq.reset(&lock->mutex);
+    }
+    ~token_lock_acq_t() {
+        acq.reset();
+        if (--lock->users == 0) {
+            ctx->token_locks.erase(token);
+        }
+    }
+private:
+    query2_server_t::context_t *ctx;
+    int64_t token;
+    query2_server_t::token_lock_t *lock;
+    mutex_t::acq_t acq;
+    DISABLE_COPYING(token_lock_acq_t);
+};
+
 bool query2_server_t::handle(ql::protob_t<Query> q,
                              Response *response_out,
                              context_t *query2_context) {
@@ -71,8 +99,22 @@ bool query2_server_t::handle(ql::protob_t<Query> q,
     bool response_needed = !(noreply.has() &&
          noreply->get_type() == ql::datum_t::type_t::R_BOOL &&
          noreply->as_bool());
+
+    // `protob_server_t` calls us in the order the queries arrived, so we have to get
+    // in line before we block for the first time.
+    const bool is_noreply_wait = q->type() == Query::NOREPLY_WAIT;
+    rwlock_in_line_t noreply_wait_in_line(&query2_context->noreply_wait_lock,
+                                          is_noreply_wait
+                                              ? access_t::write
+                                              : access_t::read);
+    token_lock_acq_t token_acq(query2_context, q->token());
     try {
+        wait_interruptible(is_noreply_wait
+                               ? noreply_wait_in_line.write_signal()
+                               : noreply_wait_in_line.read_signal(),
+                           interruptor);
         scoped_ops_running_stat_t stat(&ctx->ql_ops_running);
+        block_pm_histogram latency(&ctx->ql_query_latency);
         guarantee(ctx->directory_read_manager);
         // `ql::run` will set the status code
         ql::run(q, ctx, interruptor, response_out, stream_cache2);
@@ -6,6 +6,11 @@
 #include <set>
 #include <string>
 
+#include "errors.hpp"
+#include <boost/ptr_container/ptr_map.hpp>
+
+#include "concurrency/mutex.hpp"
+#include "concurrency/rwlock.hpp"
 #include "protob/protob.hpp"
 #include "protocol_api.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -26,12 +31,25 @@ public:
 
     int get_port() const;
 
+    struct token_lock_t {
+        token_lock_t() : users(0) { }
+        mutex_t mutex;
+        int users;
+    };
+
     struct context_t {
         context_t() : interruptor(0) { }
         static const int32_t no_auth_magic_number = VersionDummy::V0_1;
         static const int32_t auth_magic_number = VersionDummy::V0_2;
         ql::stream_cache2_t stream_cache2;
         signal_t *interruptor;
+
+        // The queries on a connection run concurrently.  A NOREPLY_WAIT takes this
+        // for writing, and every other query for reading, so that it waits for
+        // every query that arrived before it.
+        rwlock_t noreply_wait_lock;
+        // The queries for one token run one at a time, in the order they arrived.
+        boost::ptr_map<int64_t, token_lock_t> token_locks;
     };
 private:
     MUST_USE bool handle(ql::protob_t<Query> q,
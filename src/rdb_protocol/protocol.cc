@@ -5,7 +5,10 @@
 #include <functional>
 
 #include "arch/io/disk.hpp"
+#include "btree/backfill.hpp"
 #include "btree/erase_range.hpp"
+#include "btree/get_distribution.hpp"
+#include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
 #include "btree/superblock.hpp"
@@ -44,6 +47,9 @@ typedef rdb_protocol_t::read_response_t read_response_t;
 typedef rdb_protocol_t::point_read_t point_read_t;
 typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
+typedef rdb_protocol_t::batched_point_read_t batched_point_read_t;
+typedef rdb_protocol_t::batched_point_read_response_t batched_point_read_response_t;
+
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
 
@@ -383,8 +389,11 @@ rdb_protocol_t::context_t::context_t()
     cross_thread_database_watchables(get_num_threads()),
     directory_read_manager(NULL),
     signals(get_num_threads()),
+    row_format(ql::row_format_t::PLAIN),
     ql_stats_membership(&get_global_perfmon_collection(), &ql_stats_collection, "query_language"),
-    ql_ops_running_membership(&ql_stats_collection, &ql_ops_running, "ops_running")
+    ql_ops_running_membership(&ql_stats_collection, &ql_ops_running, "ops_running"),
+    ql_query_latency(secs_to_ticks(1)),
+    ql_query_latency_membership(&ql_stats_collection, &ql_query_latency, "query_latency")
 { }
 
 rdb_protocol_t::context_t::context_t(
@@ -406,8 +415,11 @@ rdb_protocol_t::context_t::context_t(
       directory_read_manager(_directory_read_manager),
       signals(get_num_threads()),
       machine_id(_machine_id),
+      row_format(ql::row_format_t::PLAIN),
       ql_stats_membership(global_stats, &ql_stats_collection, "query_language"),
-      ql_ops_running_membership(&ql_stats_collection, &ql_ops_running, "ops_running")
+      ql_ops_running_membership(&ql_stats_collection, &ql_ops_running, "ops_running"),
+      ql_query_latency(secs_to_ticks(1)),
+      ql_query_latency_membership(&ql_stats_collection, &ql_query_latency, "query_latency")
 {
     for (int thread = 0; thread < get_num_threads(); ++thread) {
         cross_thread_namespace_watchables[thread].init(new cross_thread_watchable_variable_t<cow_ptr_t<namespaces_semilattice_metadata_t<rdb_protocol_t> > >(
@@ -458,6 +470,9 @@ store_key_t sindex_list_region_key() {
     return store_key_t();
 }
 
+// Defined below, with `write_t::get_region()`.
+region_t region_from_keys(const std::vector<store_key_t> &keys);
+
 /* read_t::get_region implementation */
 struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const point_read_t &pr) const {
@@ -479,6 +494,10 @@ struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const sindex_status_t &ss) const {
         return ss.region;
     }
+
+    region_t operator()(const batched_point_read_t &bpr) const {
+        return region_from_keys(bpr.keys);
+    }
 };
 
 region_t read_t::get_region() const THROWS_NOTHING {
@@ -540,6 +559,21 @@ struct rdb_r_shard_visitor_t : public boost::static_visitor<bool> {
         return rangey_read(ss);
     }
 
+    bool operator()(const batched_point_read_t &bpr) const {
+        std::vector<store_key_t> shard_keys;
+        for (auto it = bpr.keys.begin(); it != bpr.keys.end(); ++it) {
+            if (region_contains_key(*region, *it)) {
+                shard_keys.push_back(*it);
+            }
+        }
+        if (!shard_keys.empty()) {
+            *read_out = read_t(batched_point_read_t(std::move(shard_keys)), profile);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     const hash_region_t<key_range_t> *region;
     profile_bool_t profile;
     read_t *read_out;
@@ -597,6 +631,7 @@ public:
     void operator()(const distribution_read_t &rg);
     void operator()(const sindex_list_t &rg);
     void operator()(const sindex_status_t &rg);
+    void operator()(const batched_point_read_t &bpr);
 
 private:
     read_response_t *responses; // Cannibalized for efficiency.
@@ -734,6 +769,17 @@ void rdb_r_unshard_visitor_t::operator()(UNUSED const sindex_status_t &ss) {
     }
 }
 
+void rdb_r_unshard_visitor_t::operator()(UNUSED const batched_point_read_t &bpr) {
+    *response_out = read_response_t(batched_point_read_response_t());
+    auto out = boost::get<batched_point_read_response_t>(&response_out->response);
+    for (size_t i = 0; i < count; ++i) {
+        auto resp = boost::get<batched_point_read_response_t>(&responses[i].response);
+        guarantee(resp != NULL);
+        // Every key belongs to exactly one shard.
+        out->data.insert(resp->data.begin(), resp->data.end());
+    }
+}
+
 void read_t::unshard(read_response_t *responses, size_t count,
                      read_response_t *response_out, context_t *ctx,
                      signal_t *interruptor) const
@@ -1035,13 +1081,16 @@ void write_t::unshard(write_response_t *responses, size_t count,
 store_t::store_t(serializer_t *serializer,
                  const std::string &perfmon_name,
                  int64_t cache_target,
+                 const page_cache_config_t &cache_config,
+                 cache_balancer_t *balancer,
                  bool create,
                  perfmon_collection_t *parent_perfmon_collection,
                  context_t *_ctx,
                  io_backender_t *io,
                  const base_path_t &base_path) :
     btree_store_t<rdb_protocol_t>(serializer, perfmon_name, cache_target,
-            create, parent_perfmon_collection, _ctx, io, base_path),
+            cache_config, balancer, create, parent_perfmon_collection, _ctx, io,
+            base_path),
     ctx(_ctx)
 {
     // Make sure to continue bringing sindexes up-to-date if it was interrupted earlier
@@ -1093,6 +1142,13 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         rdb_get(get.key, btree, superblock, res, ql_env.trace.get_or_null());
     }
 
+    void operator()(const batched_point_read_t &bpr) {
+        response->response = batched_point_read_response_t();
+        batched_point_read_response_t *res =
+            boost::get<batched_point_read_response_t>(&response->response);
+        rdb_get_batch(bpr.keys, btree, superblock, res, ql_env.trace.get_or_null());
+    }
+
     void operator()(const rget_read_t &rget) {
         if (rget.transforms.size() != 0 || rget.terminal) {
             rassert(rget.optargs.size() != 0);
@@ -1112,8 +1168,10 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             std::vector<char> sindex_mapping_data;
 
             try {
+                // We release the superblock below, unless the sindex is covering.
                 bool found = store->acquire_sindex_superblock_for_read(
-                    rget.sindex->id, superblock, &sindex_sb, &sindex_mapping_data);
+                    rget.sindex->id, superblock, &sindex_sb, &sindex_mapping_data,
+                    false);
                 if (!found) {
                     res->result = ql::exc_t(
                         ql::base_exc_t::GENERIC,
@@ -1137,18 +1195,28 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             //  between sindex_start_value and sindex_end_value.
             ql::map_wire_func_t sindex_mapping;
             sindex_multi_bool_t multi_bool = sindex_multi_bool_t::MULTI;
-            inplace_vector_read_stream_t read_stream(&sindex_mapping_data);
-            archive_result_t success = deserialize(&read_stream, &sindex_mapping);
-            guarantee_deserialization(success, "sindex description");
-            success = deserialize(&read_stream, &multi_bool);
-            guarantee_deserialization(success, "sindex description");
+            sindex_covered_fields_t covered_fields;
+            deserialize_sindex_definition(sindex_mapping_data, &sindex_mapping,
+                                          &multi_bool, &covered_fields);
+
+            // A covering sindex looks rows up in the primary index, so it keeps the
+            // primary index's root instead.
+            value_sizer_t<rdb_value_t> sizer(btree->cache()->get_block_size());
+            scoped_ptr_t<sorted_point_reader_t> primary_reader;
+            if (covered_fields) {
+                primary_reader.init(
+                    new sorted_point_reader_t(&sizer, superblock, &btree->stats));
+            } else {
+                superblock->release();
+            }
 
             rdb_rget_secondary_slice(
                 store->get_sindex_slice(rget.sindex->id),
                 rget.sindex->original_range, rget.sindex->region,
                 sindex_sb.get(), &ql_env, rget.batchspec, rget.transforms,
                 rget.terminal, rget.region.inner, rget.sorting,
-                sindex_mapping, multi_bool, res);
+                sindex_mapping, multi_bool, covered_fields, primary_reader.get(),
+                res);
         }
     }
 
@@ -1348,7 +1416,7 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         response->response =
             rdb_batched_replace(
                 btree_info_t(btree, timestamp,
-                             &br.pkey),
+                             &br.pkey, row_format),
                 superblock, br.keys, &replacer, &sindex_cb,
                 ql_env.trace.get_or_null());
     }
@@ -1364,10 +1432,22 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         for (auto it = bi.inserts.begin(); it != bi.inserts.end(); ++it) {
             keys.emplace_back((*it)->get(bi.pkey)->print_primary());
         }
+        // A batch that goes into an empty table doesn't have to be inserted row
+        // by row.  We can't return values from the bulk path, but then again
+        // `return_vals` is only allowed for single-row inserts anyway.
+        if (!bi.return_vals) {
+            batched_replace_response_t bulk_response;
+            if (rdb_bulk_insert(btree_info_t(btree, timestamp, &bi.pkey, row_format),
+                                superblock, keys, bi.inserts, &sindex_cb,
+                                &bulk_response)) {
+                response->response = bulk_response;
+                return;
+            }
+        }
         response->response =
             rdb_batched_replace(
                 btree_info_t(btree, timestamp,
-                             &bi.pkey),
+                             &bi.pkey, row_format),
                 superblock, keys, &replacer, &sindex_cb,
                 ql_env.trace.get_or_null());
     }
@@ -1378,7 +1458,8 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
             boost::get<point_write_response_t>(&response->response);
 
         rdb_modification_report_t mod_report(w.key);
-        rdb_set(w.key, w.data, w.overwrite, btree, timestamp, superblock->get(),
+        rdb_set(w.key, w.data, row_format, w.overwrite, btree, timestamp,
+                superblock->get(),
                 res, &mod_report.info, ql_env.trace.get_or_null());
 
         update_sindexes(&mod_report);
@@ -1402,6 +1483,7 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         write_message_t wm;
         wm << c.mapping;
         wm << c.multi;
+        wm << c.covered_fields;
 
         vector_stream_t stream;
         stream.reserve(wm.size());
@@ -1462,6 +1544,7 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         response(_response),
         superblock(_superblock),
         timestamp(_timestamp),
+        row_format(ctx->row_format),
         interruptor(_interruptor, ctx->signals[get_thread_id().threadnum].get()),
         ql_env(ctx->extproc_pool,
                ctx->ns_repo,
@@ -1471,6 +1554,7 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
                NULL,
                &interruptor,
                ctx->machine_id,
+               ctx->temp_files,
                ql::protob_t<Query>()) {
         sindex_block =
             store->acquire_sindex_block_for_write((*superblock)->expose_buf(),
@@ -1510,6 +1594,7 @@ private:
     write_response_t *response;
     scoped_ptr_t<superblock_t> *superblock;
     repli_timestamp_t timestamp;
+    ql::row_format_t row_format;
     wait_any_t interruptor;
     ql::env_t ql_env;
     buf_lock_t sindex_block;
@@ -1640,8 +1725,38 @@ void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_ti
                                      THROWS_ONLY(interrupted_exc_t) {
     with_priority_t p(CORO_PRIORITY_BACKFILL_SENDER);
     rdb_backfill_callback_impl_t callback(chunk_fun_cb);
-    std::vector<std::pair<region_t, state_timestamp_t> > regions(start_point.begin(), start_point.end());
-    refcount_superblock_t refcount_wrapper(superblock, regions.size());
+
+    /* The superblock is first used to find out how the keys are distributed,
+    and then for backfilling. */
+    refcount_superblock_t distribution_wrapper(superblock, 2);
+
+    /* Rather than walking each region in one traversal, we split it into
+    sub-ranges with about as many keys each and walk those concurrently. They
+    all see the same snapshot, so they still add up to a backfill as of a single
+    point in time. */
+    std::vector<store_key_t> split_keys;
+    {
+        int64_t key_count;
+        get_btree_key_distribution(&distribution_wrapper, BACKFILL_SPLIT_DEPTH,
+                                   &key_count, &split_keys);
+        std::sort(split_keys.begin(), split_keys.end());
+    }
+
+    std::vector<std::pair<region_t, state_timestamp_t> > regions;
+    for (region_map_t<rdb_protocol_t, state_timestamp_t>::const_iterator it = start_point.begin();
+         it != start_point.end();
+         ++it) {
+        std::vector<key_range_t> parts;
+        divide_key_range(it->first.inner, split_keys, BACKFILL_MAX_PARALLEL_RANGES,
+                         &parts);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            region_t part = it->first;
+            part.inner = parts[i];
+            regions.push_back(std::make_pair(part, it->second));
+        }
+    }
+
+    refcount_superblock_t refcount_wrapper(&distribution_wrapper, regions.size());
     pmap(regions.size(), std::bind(&call_rdb_backfill, ph::_1,
                                    btree, regions, &callback,
                                    &refcount_wrapper, sindex_block, progress,
@@ -1655,13 +1770,14 @@ void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_ti
 }
 
 void backfill_chunk_single_rdb_set(const rdb_backfill_atom_t &bf_atom,
+                                   ql::row_format_t row_format,
                                    btree_slice_t *btree, superblock_t *superblock,
                                    UNUSED auto_drainer_t::lock_t drainer_acq,
                                    rdb_modification_report_t *mod_report_out,
                                    promise_t<superblock_t *> *superblock_promise_out) {
     mod_report_out->primary_key = bf_atom.key;
     point_write_response_t response;
-    rdb_set(bf_atom.key, bf_atom.value, true,
+    rdb_set(bf_atom.key, bf_atom.value, row_format, true,
             btree, bf_atom.recency,
             superblock, &response,
             &mod_report_out->info, static_cast<profile::trace_t *>(NULL),
@@ -1673,9 +1789,10 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
                                    btree_slice_t *_btree,
                                    txn_t *_txn,
                                    scoped_ptr_t<superblock_t> &&_superblock,
+                                   ql::row_format_t _row_format,
                                    signal_t *_interruptor) :
         store(_store), btree(_btree), txn(_txn), superblock(std::move(_superblock)),
-        interruptor(_interruptor) {
+        row_format(_row_format), interruptor(_interruptor) {
         sindex_block =
             store->acquire_sindex_block_for_write(superblock->expose_buf(),
                                                   superblock->get_sindex_block_id());
@@ -1709,7 +1826,8 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
                 // `spawn_now_dangerously` so that we don't have to wait for the
                 // superblock if it's immediately available.
                 coro_t::spawn_now_dangerously(std::bind(&backfill_chunk_single_rdb_set,
-                                                        kv.backfill_atoms[i], btree,
+                                                        kv.backfill_atoms[i],
+                                                        row_format, btree,
                                                         superblock.release(),
                                                         auto_drainer_t::lock_t(&drainer),
                                                         &mod_reports[i],
@@ -1752,15 +1870,16 @@ private:
             write_message_t wm;
             wm << rdb_sindex_change_t(mod_reports[i]);
             store->sindex_queue_push(wm, &acq);
-
-            rdb_update_sindexes(sindexes, &mod_reports[i], txn);
         }
+
+        rdb_bulk_update_sindexes(sindexes, &mod_reports, txn);
     }
 
     btree_store_t<rdb_protocol_t> *store;
     btree_slice_t *btree;
     txn_t *txn;
     scoped_ptr_t<superblock_t> superblock;
+    const ql::row_format_t row_format;
     signal_t *interruptor;
     buf_lock_t sindex_block;
 
@@ -1776,6 +1895,8 @@ void store_t::protocol_receive_backfill(btree_slice_t *btree,
     rdb_receive_backfill_visitor_t v(this, btree,
                                      superblock->expose_buf().txn(),
                                      std::move(superblock),
+                                     ctx != NULL ? ctx->row_format
+                                                 : ql::row_format_t::PLAIN,
                                      interruptor);
     boost::apply_visitor(v, chunk.val);
 }
@@ -1797,6 +1918,11 @@ void store_t::protocol_reset_data(const region_t& subregion,
                     interruptor);
 }
 
+counted_t<compiled_sindex_t> store_t::protocol_compile_sindex(
+        const secondary_index_t &sindex) {
+    return make_counted<rdb_compiled_sindex_t>(sindex);
+}
+
 region_t rdb_protocol_t::cpu_sharding_subspace(int subregion_number,
                                                int num_cpu_shards) {
     guarantee(subregion_number >= 0);
@@ -1824,6 +1950,7 @@ RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::sindex_list_response_t, sindexes);
 RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::read_response_t,
                            response, event_log, n_shards);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::sindex_status_response_t, statuses);
+RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::batched_point_read_response_t, data);
 
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_read_t, key);
 RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::sindex_rangespec_t,
@@ -1842,6 +1969,7 @@ RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::distribution_read_t,
                            max_depth, result_limit, region);
 RDB_IMPL_ME_SERIALIZABLE_0(rdb_protocol_t::sindex_list_t);
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::sindex_status_t, sindexes, region);
+RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::batched_point_read_t, keys);
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::read_t, read, profile);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_write_response_t, result);
 
@@ -1860,7 +1988,8 @@ RDB_IMPL_ME_SERIALIZABLE_4(rdb_protocol_t::batched_insert_t,
 RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::point_write_t, key, data, overwrite);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_delete_t, key);
 
-RDB_IMPL_ME_SERIALIZABLE_4(rdb_protocol_t::sindex_create_t, id, mapping, region, multi);
+RDB_IMPL_ME_SERIALIZABLE_5(rdb_protocol_t::sindex_create_t, id, mapping, region, multi,
+                           covered_fields);
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::sindex_drop_t, id, region);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::sync_t, region);
 
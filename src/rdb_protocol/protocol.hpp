@@ -176,8 +176,30 @@ enum class sindex_multi_bool_t { SINGLE = 0, MULTI = 1};
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(sindex_multi_bool_t, int8_t,
         sindex_multi_bool_t::SINGLE, sindex_multi_bool_t::MULTI);
 
+/* The top-level fields that a covering sindex stores in its entries, along with
+the primary key, or none if the sindex's entries refer to the rows in the primary
+index.  Reads that need fields a covering sindex doesn't store look the rows up in
+the primary index. */
+typedef boost::optional<std::vector<std::string> > sindex_covered_fields_t;
+
 class cluster_semilattice_metadata_t;
 class auth_semilattice_metadata_t;
+class io_backender_t;
+
+/* Where a query may put temporary files, such as the sorted runs of an `orderBy`
+that doesn't fit in memory.  It isn't set on proxies, which have no data
+directory. */
+class temp_file_location_t {
+public:
+    temp_file_location_t() : io_backender(NULL) { }
+    temp_file_location_t(io_backender_t *_io_backender, const base_path_t &_base_path)
+        : io_backender(_io_backender), base_path(_base_path) { }
+
+    bool is_set() const { return io_backender != NULL && static_cast<bool>(base_path); }
+
+    io_backender_t *io_backender;
+    boost::optional<base_path_t> base_path;
+};
 
 struct rdb_protocol_t {
     static const size_t MAX_PRIMARY_KEY_SIZE = 128;
@@ -228,10 +250,19 @@ struct rdb_protocol_t {
         scoped_array_t<scoped_ptr_t<cross_thread_signal_t> > signals;
         uuid_u machine_id;
 
+        // Set after construction (on servers only), like `ns_repo`.
+        temp_file_location_t temp_files;
+        // How the stores write rows.  `PLAIN` unless set after construction.
+        ql::row_format_t row_format;
+
         perfmon_collection_t ql_stats_collection;
         perfmon_membership_t ql_stats_membership;
         perfmon_counter_t ql_ops_running;
         perfmon_membership_t ql_ops_running_membership;
+        // How long queries take from when they start running until their
+        // response is ready.
+        perfmon_histogram_t ql_query_latency;
+        perfmon_membership_t ql_query_latency_membership;
     };
 
     struct point_read_response_t {
@@ -242,6 +273,12 @@ struct rdb_protocol_t {
         RDB_DECLARE_ME_SERIALIZABLE;
     };
 
+    struct batched_point_read_response_t {
+        // Only the keys that exist in the table are in here.
+        std::map<store_key_t, counted_t<const ql::datum_t> > data;
+        RDB_DECLARE_ME_SERIALIZABLE;
+    };
+
     struct rget_read_response_t {
 
         class empty_t { RDB_MAKE_ME_SERIALIZABLE_0() };
@@ -294,7 +331,8 @@ struct rdb_protocol_t {
                                rget_read_response_t,
                                distribution_read_response_t,
                                sindex_list_response_t,
-                               sindex_status_response_t> variant_t;
+                               sindex_status_response_t,
+                               batched_point_read_response_t> variant_t;
         variant_t response;
         profile::event_log_t event_log;
         size_t n_shards;
@@ -316,6 +354,19 @@ struct rdb_protocol_t {
         RDB_DECLARE_ME_SERIALIZABLE;
     };
 
+    // Looks up many primary keys at once.  Each shard gets a single read with the
+    // keys that belong to it.
+    class batched_point_read_t {
+    public:
+        batched_point_read_t() { }
+        explicit batched_point_read_t(std::vector<store_key_t> &&_keys)
+            : keys(std::move(_keys)) { }
+
+        std::vector<store_key_t> keys;
+
+        RDB_DECLARE_ME_SERIALIZABLE;
+    };
+
     struct sindex_rangespec_t {
         sindex_rangespec_t() { }
         sindex_rangespec_t(const std::string &_id,
@@ -409,7 +460,8 @@ struct rdb_protocol_t {
                                rget_read_t,
                                distribution_read_t,
                                sindex_list_t,
-                               sindex_status_t> variant_t;
+                               sindex_status_t,
+                               batched_point_read_t> variant_t;
         variant_t read;
         profile_bool_t profile;
 
@@ -428,8 +480,13 @@ struct rdb_protocol_t {
         read_t(const variant_t &r, profile_bool_t _profile)
             : read(r), profile(_profile) { }
 
-        // Only use snapshotting if we're doing a range get.
-        bool use_snapshot() const THROWS_NOTHING { return boost::get<rget_read_t>(&read); }
+        // Only use snapshotting if we're doing a range get or looking up a batch of
+        // keys, so that we don't hold up writes while we hold on to a path through
+        // the tree.
+        bool use_snapshot() const THROWS_NOTHING {
+            return boost::get<rget_read_t>(&read)
+                || boost::get<batched_point_read_t>(&read);
+        }
 
         // Returns true if this read should be sent to every replica.
         bool all_read() const THROWS_NOTHING { return boost::get<sindex_status_t>(&read); }
@@ -581,14 +638,17 @@ struct rdb_protocol_t {
     public:
         sindex_create_t() { }
         sindex_create_t(const std::string &_id, const ql::map_wire_func_t &_mapping,
-                        sindex_multi_bool_t _multi)
-            : id(_id), mapping(_mapping), region(region_t::universe()), multi(_multi)
+                        sindex_multi_bool_t _multi,
+                        const sindex_covered_fields_t &_covered_fields)
+            : id(_id), mapping(_mapping), region(region_t::universe()), multi(_multi),
+              covered_fields(_covered_fields)
         { }
 
         std::string id;
         ql::map_wire_func_t mapping;
         region_t region;
         sindex_multi_bool_t multi;
+        sindex_covered_fields_t covered_fields;
 
         RDB_DECLARE_ME_SERIALIZABLE;
     };
@@ -758,6 +818,8 @@ struct rdb_protocol_t {
         store_t(serializer_t *serializer,
                 const std::string &perfmon_name,
                 int64_t cache_target,
+                const page_cache_config_t &cache_config,
+                cache_balancer_t *balancer,
                 bool create,
                 perfmon_collection_t *parent_perfmon_collection,
                 context_t *ctx,
@@ -799,6 +861,9 @@ struct rdb_protocol_t {
                                  btree_slice_t *btree,
                                  superblock_t *superblock,
                                  signal_t *interruptor);
+
+        counted_t<compiled_sindex_t> protocol_compile_sindex(
+                const secondary_index_t &sindex);
         context_t *ctx;
     };
 
@@ -1,10 +1,13 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/shards.hpp"
 
+#include <algorithm>
+
 #include "errors.hpp"
 #include <boost/variant.hpp>
 
 #include "rdb_protocol/func.hpp"
+#include "rdb_protocol/pathspec.hpp"
 #include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/protocol.hpp"
 
@@ -431,6 +434,58 @@ private:
     counted_t<func_t> f;
 };
 
+// Keeps the `k` smallest rows as a max-heap (so the row to throw out next is
+// always at the front), and only sorts them once at the end.
+class top_k_terminal_t : public terminal_t<datums_t> {
+public:
+    top_k_terminal_t(env_t *_env, const top_k_wire_func_t &f)
+        : terminal_t<datums_t>(datums_t()),
+          env(_env),
+          k(f.get_k()),
+          lt_cmp(f.compile_comparisons()),
+          bt(f.get_bt()) { }
+private:
+    virtual void accumulate(const counted_t<const datum_t> &el, datums_t *out) {
+        if (k == 0) {
+            return;
+        }
+        try {
+            auto cmp = std::bind(lt_cmp, env, static_cast<profile::sampler_t *>(NULL),
+                                 ph::_1, ph::_2);
+            if (out->size() < k) {
+                out->push_back(el);
+                std::push_heap(out->begin(), out->end(), cmp);
+            } else if (cmp(el, out->front())) {
+                std::pop_heap(out->begin(), out->end(), cmp);
+                out->back() = el;
+                std::push_heap(out->begin(), out->end(), cmp);
+            }
+        } catch (const datum_exc_t &e) {
+            throw exc_t(e, bt.get());
+        }
+    }
+    virtual counted_t<const datum_t> unpack(datums_t *heap) {
+        profile::sampler_t sampler("Sorting in-memory.", env->trace);
+        try {
+            std::sort_heap(heap->begin(), heap->end(),
+                           std::bind(lt_cmp, env, &sampler, ph::_1, ph::_2));
+        } catch (const datum_exc_t &e) {
+            throw exc_t(e, bt.get());
+        }
+        return make_counted<const datum_t>(std::move(*heap));
+    }
+    virtual void unshard_impl(datums_t *out, datums_t *el) {
+        for (auto it = el->begin(); it != el->end(); ++it) {
+            accumulate(*it, out);
+        }
+    }
+
+    env_t *env;
+    const uint64_t k;
+    const orderby_lt_cmp_t lt_cmp;
+    protob_t<const Backtrace> bt;
+};
+
 template<class T>
 class terminal_visitor_t : public boost::static_visitor<T *> {
 public:
@@ -453,6 +508,9 @@ public:
     T *operator()(const reduce_wire_func_t &f) const {
         return new reduce_terminal_t(env, f);
     }
+    T *operator()(const top_k_wire_func_t &f) const {
+        return new top_k_terminal_t(env, f);
+    }
     env_t *env;
 };
 
@@ -464,6 +522,56 @@ eager_acc_t *make_eager_terminal(env_t *env, const terminal_variant_t &t) {
     return boost::apply_visitor(terminal_visitor_t<eager_acc_t>(env), t);
 }
 
+orderby_lt_cmp_t::orderby_lt_cmp_t(
+    std::vector<std::pair<order_direction_t, counted_t<func_t> > > _comparisons)
+    : comparisons(std::move(_comparisons)) { }
+
+bool orderby_lt_cmp_t::operator()(env_t *env,
+                                  profile::sampler_t *sampler,
+                                  const counted_t<const datum_t> &l,
+                                  const counted_t<const datum_t> &r) const {
+    if (sampler != NULL) {
+        sampler->new_sample();
+    }
+    for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
+        counted_t<const datum_t> lval;
+        counted_t<const datum_t> rval;
+        try {
+            lval = it->second->call(env, l)->as_datum();
+        } catch (const base_exc_t &e) {
+            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                throw;
+            }
+        }
+
+        try {
+            rval = it->second->call(env, r)->as_datum();
+        } catch (const base_exc_t &e) {
+            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                throw;
+            }
+        }
+
+        const bool desc = it->first == order_direction_t::DESC;
+        if (!lval.has() && !rval.has()) {
+            continue;
+        }
+        if (!lval.has()) {
+            return true != desc;
+        }
+        if (!rval.has()) {
+            return false != desc;
+        }
+        // TODO: use datum_t::cmp instead to be faster
+        if (*lval == *rval) {
+            continue;
+        }
+        return (*lval < *rval) != desc;
+    }
+
+    return false;
+}
+
 class ungrouped_op_t : public op_t {
 protected:
 private:
@@ -608,6 +716,41 @@ private:
     counted_t<func_t> f;
 };
 
+class project_trans_t : public ungrouped_op_t {
+public:
+    explicit project_trans_t(const project_wire_func_t &_f)
+        : kind(_f.get_kind()),
+          // The paths were checked when the query was compiled, so nothing will
+          // need to blame a term for them.
+          pathspec(_f.get_paths(), NULL),
+          bt(_f.get_bt()) { }
+private:
+    virtual void lst_transform(datums_t *lst) {
+        const char *name = kind == project_kind_t::PLUCK ? "pluck" : "without";
+        try {
+            for (auto it = lst->begin(); it != lst->end(); ++it) {
+                if ((*it)->get_type() != datum_t::R_OBJECT) {
+                    rcheck_datum((*it)->get_type() != datum_t::R_ARRAY,
+                                 base_exc_t::GENERIC,
+                                 strprintf("Cannot perform %s on a sequence of "
+                                           "sequences.", name));
+                    rfail_datum(exc_type(*it),
+                                "Cannot perform %s on a non-object non-sequence `%s`.",
+                                name, (*it)->trunc_print().c_str());
+                }
+                *it = kind == project_kind_t::PLUCK
+                    ? project(*it, pathspec, DONT_RECURSE)
+                    : unproject(*it, pathspec, DONT_RECURSE);
+            }
+        } catch (const datum_exc_t &e) {
+            throw exc_t(e, bt.get());
+        }
+    }
+    project_kind_t kind;
+    pathspec_t pathspec;
+    protob_t<const Backtrace> bt;
+};
+
 class filter_trans_t : public ungrouped_op_t {
 public:
     filter_trans_t(env_t *_env, const filter_wire_func_t &_f)
@@ -680,6 +823,9 @@ public:
     op_t *operator()(const concatmap_wire_func_t &f) const {
         return new concatmap_trans_t(env, f);
     }
+    op_t *operator()(const project_wire_func_t &f) const {
+        return new project_trans_t(f);
+    }
 private:
     env_t *env;
 };
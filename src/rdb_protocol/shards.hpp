@@ -169,13 +169,15 @@ typedef boost::variant<
     grouped_t<std::pair<double, uint64_t> >, // Avg.
     grouped_t<counted_t<const ql::datum_t> >, // Reduce (may be NULL), min, max.
     grouped_t<stream_t>, // No terminal.,
+    grouped_t<datums_t>, // Top K.
     exc_t // Don't re-order (we don't want this to initialize to an error.)
     > result_t;
 
 typedef boost::variant<map_wire_func_t,
                        group_wire_func_t,
                        filter_wire_func_t,
-                       concatmap_wire_func_t
+                       concatmap_wire_func_t,
+                       project_wire_func_t
                        > transform_variant_t;
 
 typedef boost::variant<count_wire_func_t,
@@ -183,9 +185,29 @@ typedef boost::variant<count_wire_func_t,
                        avg_wire_func_t,
                        min_wire_func_t,
                        max_wire_func_t,
-                       reduce_wire_func_t
+                       reduce_wire_func_t,
+                       top_k_wire_func_t
                        > terminal_variant_t;
 
+// The ordering used by an unindexed `orderBy`.  Rows for which a comparison
+// function fails with a NON_EXISTENCE error sort before every other row (or after
+// them, for descending comparisons).
+class orderby_lt_cmp_t {
+public:
+    typedef bool result_type;
+    explicit orderby_lt_cmp_t(
+        std::vector<std::pair<order_direction_t, counted_t<func_t> > > _comparisons);
+
+    // `sampler` may be NULL.
+    bool operator()(env_t *env,
+                    profile::sampler_t *sampler,
+                    const counted_t<const datum_t> &l,
+                    const counted_t<const datum_t> &r) const;
+
+private:
+    std::vector<std::pair<order_direction_t, counted_t<func_t> > > comparisons;
+};
+
 class op_t {
 public:
     op_t() { }
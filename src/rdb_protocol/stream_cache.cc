@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/stream_cache.hpp"
 
+#include "arch/runtime/coroutines.hpp"
+#include "concurrency/interruptor.hpp"
 #include "rdb_protocol/env.hpp"
 
 namespace ql {
@@ -29,22 +31,35 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
     if (it == streams.end()) return false;
     entry_t *entry = it->second;
     entry->last_activity = time(0);
+    std::vector<counted_t<const datum_t> > ds;
+    size_t batch_size;
     try {
+        // The prefetch uses the env_t until it's done.
+        const bool was_prefetched = entry->has_prefetch();
+        if (was_prefetched) {
+            ds = entry->wait_for_prefetch(interruptor);
+        }
+
         // Reset the env_t's interruptor to a good one before we use it.  This may be a
         // hack.  (I'd rather not have env_t be mutable this way -- could we construct
         // a new env_t instead?  Why do we keep env_t's around anymore?)
         entry->env->interruptor = interruptor;
 
-        batch_type_t batch_type = entry->has_sent_batch
-                                      ? batch_type_t::NORMAL
-                                      : batch_type_t::NORMAL_FIRST;
-        std::vector<counted_t<const datum_t> > ds
-            = entry->stream->next_batch(
+        if (!was_prefetched) {
+            batch_type_t batch_type = entry->has_sent_batch
+                                          ? batch_type_t::NORMAL
+                                          : batch_type_t::NORMAL_FIRST;
+            ds = entry->stream->next_batch(
                 entry->env.get(),
-                batchspec_t::user(batch_type, entry->env.get()));
+                entry->tuner.adapt(batchspec_t::user(batch_type, entry->env.get())));
+        }
         entry->has_sent_batch = true;
+        // Measured the way the batcher measures rows, which is what the tuner's
+        // element size gets compared against.
+        batch_size = 0;
         for (auto d = ds.begin(); d != ds.end(); ++d) {
             (*d)->write_to_protobuf(res->add_response(), entry->use_json);
+            batch_size += serialized_size(*d);
         }
         if (entry->env->trace.has()) {
             entry->env->trace->as_datum()->write_to_protobuf(
@@ -59,6 +74,8 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
         res->set_type(Response::SUCCESS_SEQUENCE);
     } else {
         res->set_type(Response::SUCCESS_PARTIAL);
+        entry->tuner.note_batch(ds.size(), batch_size);
+        entry->start_prefetch();
     }
 
     return true;
@@ -81,5 +98,43 @@ stream_cache2_t::entry_t::entry_t(time_t _last_activity,
 
 stream_cache2_t::entry_t::~entry_t() { }
 
+void stream_cache2_t::entry_t::start_prefetch() {
+    guarantee(!prefetch_done.has());
+    prefetch_done.init(new cond_t);
+    coro_t::spawn_sometime(std::bind(&entry_t::prefetch, this,
+                                     auto_drainer_t::lock_t(&drainer)));
+}
+
+std::vector<counted_t<const datum_t> >
+stream_cache2_t::entry_t::wait_for_prefetch(signal_t *interruptor) {
+    guarantee(prefetch_done.has());
+    tuner.note_batch_ready(prefetch_done->is_pulsed());
+    wait_interruptible(prefetch_done.get(), interruptor);
+    prefetch_done.reset();
+    if (prefetch_exception != std::exception_ptr()) {
+        std::exception_ptr exception = prefetch_exception;
+        prefetch_exception = std::exception_ptr();
+        std::rethrow_exception(exception);
+    }
+    std::vector<counted_t<const datum_t> > ret;
+    ret.swap(prefetched);
+    return ret;
+}
+
+void stream_cache2_t::entry_t::prefetch(auto_drainer_t::lock_t keepalive) {
+    // Nobody else uses the env until `prefetch_done` is pulsed, and the entry
+    // can't go away before the prefetch is done, so the drain signal is all that
+    // can interrupt us.
+    env->interruptor = keepalive.get_drain_signal();
+    try {
+        prefetched = stream->next_batch(
+            env.get(),
+            tuner.adapt(batchspec_t::user(batch_type_t::NORMAL, env.get())));
+    } catch (const std::exception &) {
+        prefetch_exception = std::current_exception();
+    }
+    prefetch_done->pulse();
+}
+
 
 } // namespace ql
@@ -4,11 +4,15 @@
 
 #include <time.h>
 
+#include <exception>
 #include <map>
+#include <vector>
 
 #include "errors.hpp"
 #include <boost/ptr_container/ptr_map.hpp>
 
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/cond_var.hpp"
 #include "concurrency/signal.hpp"
 #include "containers/scoped.hpp"
 #include "rdb_protocol/datum_stream.hpp"
@@ -20,6 +24,10 @@ class env_t;
 
 namespace ql {
 
+/* Once a cursor has sent a partial batch, the stream cache fetches the next batch
+in the background while the client is busy with the last one, so that the
+client's next CONTINUE can be answered right away.  The size of the batches
+adapts as described for `batch_tuner_t`. */
 class stream_cache2_t {
 public:
     stream_cache2_t() { }
@@ -46,7 +54,25 @@ private:
         counted_t<datum_stream_t> stream;
         time_t max_age;
         bool has_sent_batch;
+        batch_tuner_t tuner;
+
+        // Starts fetching the next batch in the background.
+        void start_prefetch();
+        // Waits for the batch that `start_prefetch()` fetched, and rethrows
+        // anything that was thrown fetching it.
+        std::vector<counted_t<const datum_t> > wait_for_prefetch(signal_t *interruptor);
+        // Whether the next batch is being fetched or ready.
+        bool has_prefetch() const { return prefetch_done.has(); }
     private:
+        void prefetch(auto_drainer_t::lock_t keepalive);
+
+        scoped_ptr_t<cond_t> prefetch_done;
+        std::vector<counted_t<const datum_t> > prefetched;
+        std::exception_ptr prefetch_exception;
+
+        // Destroyed first, so that the prefetch stops before the stream goes away.
+        auto_drainer_t drainer;
+
         DISABLE_COPYING(entry_t);
     };
 
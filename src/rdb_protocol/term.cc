@@ -195,7 +195,7 @@ void run(protob_t<Query> q,
                 ctx->cross_thread_namespace_watchables[th.threadnum]->get_watchable(),
                 ctx->cross_thread_database_watchables[th.threadnum]->get_watchable(),
                 ctx->cluster_metadata, ctx->directory_read_manager,
-                interruptor, ctx->machine_id, q));
+                interruptor, ctx->machine_id, ctx->temp_files, q));
 
         counted_t<term_t> root_term;
         try {
@@ -307,9 +307,9 @@ void run(protob_t<Query> q,
         }
 
         // NOREPLY_WAIT is just a no-op.
-        // This works because we only evaluate one Query at a time
-        // on the connection level. Once we get to the NOREPLY_WAIT Query
-        // we know that all previous Queries have completed processing.
+        // This works because `query2_server_t` doesn't let a NOREPLY_WAIT Query
+        // run until all previous Queries on the connection have completed
+        // processing.
 
         // Send back a WAIT_COMPLETE response.
         res->set_type(Response_ResponseType_WAIT_COMPLETE);
@@ -52,9 +52,42 @@ public:
 
         prop_bt(func.get());
     }
+protected:
+    // The arguments after the first one, as an array.
+    counted_t<const datum_t> paths_arg(scope_env_t *env) {
+        const size_t n = num_args();
+        std::vector<counted_t<const datum_t> > paths;
+        paths.reserve(n - 1);
+        for (size_t i = 1; i < n; ++i) {
+            paths.push_back(arg(env, i)->as_datum());
+        }
+        return make_counted<const datum_t>(std::move(paths));
+    }
+
+    // Evaluates the path arguments once for the whole sequence, unless they might
+    // evaluate differently for each row.
+    boost::optional<project_wire_func_t> make_project_func(scope_env_t *env,
+                                                           project_kind_t kind) {
+        for (size_t i = 1; i < num_args(); ++i) {
+            if (!arg_is_deterministic(i)) {
+                return boost::none;
+            }
+        }
+        counted_t<const datum_t> paths = paths_arg(env);
+        // The shards can't blame a term for bad paths, so we check them here.
+        pathspec_t pathspec(paths, this);
+        return project_wire_func_t(kind, paths, backtrace());
+    }
+
 private:
     virtual counted_t<val_t> obj_eval(scope_env_t *env, counted_t<val_t> v0) = 0;
 
+    // Terms that project every row of a sequence may return a transformation that
+    // does so without evaluating `func` for each row.
+    virtual boost::optional<project_wire_func_t> seq_projection(scope_env_t *) {
+        return boost::none;
+    }
+
     virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
         counted_t<val_t> v0 = arg(env, 0);
         counted_t<const datum_t> d;
@@ -76,6 +109,15 @@ private:
                                  name()));
             }
 
+            if (poly_type == MAP) {
+                boost::optional<project_wire_func_t> project_func
+                    = seq_projection(env);
+                if (project_func) {
+                    return new_val(env->env, v0->as_seq(env->env)->add_transformation(
+                        env->env, *project_func, backtrace()));
+                }
+            }
+
             compile_env_t compile_env(env->scope.compute_visibility());
             counted_t<func_term_t> func_term
                 = make_counted<func_term_t>(&compile_env, func);
@@ -113,15 +155,12 @@ private:
         counted_t<const datum_t> obj = v0->as_datum();
         r_sanity_check(obj->get_type() == datum_t::R_OBJECT);
 
-        const size_t n = num_args();
-        std::vector<counted_t<const datum_t> > paths;
-        paths.reserve(n - 1);
-        for (size_t i = 1; i < n; ++i) {
-            paths.push_back(arg(env, i)->as_datum());
-        }
-        pathspec_t pathspec(make_counted<const datum_t>(std::move(paths)), this);
+        pathspec_t pathspec(paths_arg(env), this);
         return new_val(project(obj, pathspec, DONT_RECURSE));
     }
+    virtual boost::optional<project_wire_func_t> seq_projection(scope_env_t *env) {
+        return make_project_func(env, project_kind_t::PLUCK);
+    }
     virtual const char *name() const { return "pluck"; }
 };
 
@@ -134,15 +173,12 @@ private:
         counted_t<const datum_t> obj = v0->as_datum();
         r_sanity_check(obj->get_type() == datum_t::R_OBJECT);
 
-        std::vector<counted_t<const datum_t> > paths;
-        const size_t n = num_args();
-        paths.reserve(n - 1);
-        for (size_t i = 1; i < n; ++i) {
-            paths.push_back(arg(env, i)->as_datum());
-        }
-        pathspec_t pathspec(make_counted<const datum_t>(std::move(paths)), this);
+        pathspec_t pathspec(paths_arg(env), this);
         return new_val(unproject(obj, pathspec, DONT_RECURSE));
     }
+    virtual boost::optional<project_wire_func_t> seq_projection(scope_env_t *env) {
+        return make_project_func(env, project_kind_t::WITHOUT);
+    }
     virtual const char *name() const { return "without"; }
 };
 
@@ -16,7 +16,7 @@ namespace ql {
 class sindex_create_term_t : public op_term_t {
 public:
     sindex_create_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : op_term_t(env, term, argspec_t(2, 3), optargspec_t({"multi"})) { }
+        : op_term_t(env, term, argspec_t(2, 3), optargspec_t({"multi", "covering"})) { }
 
     virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
         counted_t<table_t> table = arg(env, 0)->as_table();
@@ -50,7 +50,19 @@ public:
              ? sindex_multi_bool_t::MULTI
              : sindex_multi_bool_t::SINGLE);
 
-        bool success = table->sindex_create(env->env, name, index_func, multi);
+        /* A covering index stores the listed fields instead of referring to the
+           row. */
+        sindex_covered_fields_t covered_fields;
+        if (counted_t<val_t> covering_val = optarg(env, "covering")) {
+            counted_t<const datum_t> fields = covering_val->as_datum();
+            covered_fields = std::vector<std::string>();
+            for (size_t i = 0; i < fields->size(); ++i) {
+                covered_fields->push_back(fields->get(i)->as_str().to_std());
+            }
+        }
+
+        bool success = table->sindex_create(env->env, name, index_func, multi,
+                                            covered_fields);
         if (success) {
             datum_ptr_t res(datum_t::R_OBJECT);
             UNUSED bool b = res.add("created", make_counted<datum_t>(1.0));
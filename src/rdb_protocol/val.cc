@@ -174,11 +174,13 @@ counted_t<const datum_t> table_t::batched_insert(
 MUST_USE bool table_t::sindex_create(env_t *env,
                                      const std::string &id,
                                      counted_t<func_t> index_func,
-                                     sindex_multi_bool_t multi) {
+                                     sindex_multi_bool_t multi,
+                                     const sindex_covered_fields_t &covered_fields) {
     index_func->assert_deterministic("Index functions must be deterministic.");
     map_wire_func_t wire_func(index_func);
     rdb_protocol_t::write_t write(
-            rdb_protocol_t::sindex_create_t(id, wire_func, multi), env->profile());
+            rdb_protocol_t::sindex_create_t(id, wire_func, multi, covered_fields),
+            env->profile());
 
     rdb_protocol_t::write_response_t res;
     access->get_namespace_if().write(
@@ -306,6 +308,41 @@ counted_t<const datum_t> table_t::get_row(env_t *env, counted_t<const datum_t> p
     return p_res->data;
 }
 
+std::vector<counted_t<const datum_t> > table_t::get_rows(
+        env_t *env, const std::vector<counted_t<const datum_t> > &pvals) {
+    std::vector<store_key_t> keys;
+    keys.reserve(pvals.size());
+    for (auto it = pvals.begin(); it != pvals.end(); ++it) {
+        keys.push_back(store_key_t((*it)->print_primary()));
+    }
+    std::vector<counted_t<const datum_t> > rows(pvals.size());
+    if (keys.empty()) {
+        return rows;
+    }
+
+    rdb_protocol_t::read_t read(
+            rdb_protocol_t::batched_point_read_t(std::vector<store_key_t>(keys)),
+            env->profile());
+    rdb_protocol_t::read_response_t res;
+    if (use_outdated) {
+        access->get_namespace_if().read_outdated(read, &res, env->interruptor);
+    } else {
+        access->get_namespace_if().read(
+            read, &res, order_token_t::ignore, env->interruptor);
+    }
+    rdb_protocol_t::batched_point_read_response_t *p_res =
+        boost::get<rdb_protocol_t::batched_point_read_response_t>(&res.response);
+    r_sanity_check(p_res);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto row = p_res->data.find(keys[i]);
+        rows[i] = (row != p_res->data.end())
+            ? row->second
+            : make_counted<datum_t>(datum_t::R_NULL);
+    }
+    return rows;
+}
+
 counted_t<datum_stream_t> table_t::get_all(
         env_t *env,
         counted_t<const datum_t> value,
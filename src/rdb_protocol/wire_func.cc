@@ -170,7 +170,74 @@ RDB_IMPL_ME_SERIALIZABLE_0(count_wire_func_t);
 RDB_IMPL_ME_SERIALIZABLE_0(min_wire_func_t);
 RDB_IMPL_ME_SERIALIZABLE_0(max_wire_func_t);
 
+top_k_wire_func_t::top_k_wire_func_t(
+    const std::vector<std::pair<order_direction_t, counted_t<func_t> > > &_comps,
+    uint64_t _k,
+    const protob_t<const Backtrace> &_bt)
+    : k(_k), bt(_bt) {
+    comparisons.reserve(_comps.size());
+    for (auto it = _comps.begin(); it != _comps.end(); ++it) {
+        comparisons.push_back(std::make_pair(it->first, wire_func_t(it->second)));
+    }
+}
+
+std::vector<std::pair<order_direction_t, counted_t<func_t> > >
+top_k_wire_func_t::compile_comparisons() const {
+    std::vector<std::pair<order_direction_t, counted_t<func_t> > > ret;
+    ret.reserve(comparisons.size());
+    for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
+        ret.push_back(std::make_pair(it->first, it->second.compile_wire_func()));
+    }
+    return ret;
+}
+
+uint64_t top_k_wire_func_t::get_k() const {
+    return k;
+}
+
+protob_t<const Backtrace> top_k_wire_func_t::get_bt() const {
+    return bt.get_bt();
+}
+
+RDB_IMPL_ME_SERIALIZABLE_3(top_k_wire_func_t, comparisons, k, bt);
+
+
+
+project_wire_func_t::project_wire_func_t(project_kind_t _kind,
+                                         counted_t<const datum_t> _paths,
+                                         const protob_t<const Backtrace> &_bt)
+    : kind(_kind), paths(std::move(_paths)), bt(_bt) {
+    r_sanity_check(paths->get_type() == datum_t::R_ARRAY);
+}
+
+project_kind_t project_wire_func_t::get_kind() const {
+    return kind;
+}
+
+counted_t<const datum_t> project_wire_func_t::get_paths() const {
+    return paths;
+}
+
+bool project_wire_func_t::get_top_level_fields(
+        std::vector<std::string> *fields_out) const {
+    std::vector<std::string> fields;
+    fields.reserve(paths->size());
+    for (size_t i = 0; i < paths->size(); ++i) {
+        counted_t<const datum_t> path = paths->get(i);
+        if (path->get_type() != datum_t::R_STR) {
+            return false;
+        }
+        fields.push_back(path->as_str().to_std());
+    }
+    fields_out->swap(fields);
+    return true;
+}
+
+protob_t<const Backtrace> project_wire_func_t::get_bt() const {
+    return bt.get_bt();
+}
 
+RDB_IMPL_ME_SERIALIZABLE_3(project_wire_func_t, kind, paths, bt);
 
 map_wire_func_t map_wire_func_t::make_safely(
     pb::dummy_var_t dummy_var,
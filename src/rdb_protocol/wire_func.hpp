@@ -5,10 +5,13 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "containers/archive/archive.hpp"
 #include "containers/uuid.hpp"
 #include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/sym.hpp"
 #include "rdb_protocol/var_types.hpp"
@@ -104,6 +107,33 @@ private:
     protob_t<const Backtrace> bt;
 };
 
+enum class project_kind_t { PLUCK, WITHOUT };
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(project_kind_t, int8_t,
+                                      project_kind_t::PLUCK, project_kind_t::WITHOUT);
+
+// `pluck` or `without` applied to every row of a sequence.  The shards run these
+// directly instead of evaluating a function, and a `pluck` of top-level fields
+// can read just those fields out of a serialized row.
+class project_wire_func_t {
+public:
+    project_wire_func_t() : kind(project_kind_t::PLUCK) { }
+    project_wire_func_t(project_kind_t _kind,
+                        counted_t<const datum_t> _paths,
+                        const protob_t<const Backtrace> &_bt);
+    project_kind_t get_kind() const;
+    // The arguments to `pluck` or `without`, as an array.
+    counted_t<const datum_t> get_paths() const;
+    // Returns true and fills in `fields_out` if every path is a single top-level
+    // field name.
+    bool get_top_level_fields(std::vector<std::string> *fields_out) const;
+    protob_t<const Backtrace> get_bt() const;
+    RDB_DECLARE_ME_SERIALIZABLE;
+private:
+    project_kind_t kind;
+    counted_t<const datum_t> paths;
+    bt_wire_func_t bt;
+};
+
 class group_wire_func_t {
 public:
     group_wire_func_t() : bt(make_counted_backtrace()) { }
@@ -142,6 +172,31 @@ struct max_wire_func_t {
     RDB_DECLARE_ME_SERIALIZABLE;
 };
 
+enum class order_direction_t { ASC, DESC };
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(order_direction_t, int8_t,
+                                      order_direction_t::ASC, order_direction_t::DESC);
+
+// The terminal for an unindexed `orderBy` followed by a `limit`: only the first `k`
+// rows in the order given by the comparisons are kept, so that every shard sends
+// back at most `k` rows.
+class top_k_wire_func_t {
+public:
+    top_k_wire_func_t() : k(0) { }
+    top_k_wire_func_t(
+        const std::vector<std::pair<order_direction_t, counted_t<func_t> > > &_comps,
+        uint64_t _k,
+        const protob_t<const Backtrace> &_bt);
+    std::vector<std::pair<order_direction_t, counted_t<func_t> > >
+    compile_comparisons() const;
+    uint64_t get_k() const;
+    protob_t<const Backtrace> get_bt() const;
+    RDB_DECLARE_ME_SERIALIZABLE;
+private:
+    std::vector<std::pair<order_direction_t, wire_func_t> > comparisons;
+    uint64_t k;
+    bt_wire_func_t bt;
+};
+
 }  // namespace ql
 
 #endif  // RDB_PROTOCOL_WIRE_FUNC_HPP_
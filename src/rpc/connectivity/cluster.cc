@@ -10,10 +10,12 @@
 
 #include "arch/io/network.hpp"
 #include "arch/timing.hpp"
+#include "config/args.hpp"
 
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/pmap.hpp"
 #include "concurrency/semaphore.hpp"
+#include "concurrency/wait_any.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "containers/object_buffer.hpp"
 #include "containers/uuid.hpp"
@@ -113,7 +115,8 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
     `connection_map` on each thread and notifying any listeners that we're now
     connected to ourself. The destructor will remove us from the
     `connection_map` and again notify any listeners. */
-    connection_to_ourself(this, parent->me, NULL, routing_table[parent->me]),
+    connection_to_ourself(this, parent->me, std::vector<tcp_conn_stream_t *>(),
+                          routing_table[parent->me]),
 
     listener(new tcp_listener_t(cluster_listener_socket.get(),
                                 std::bind(&connectivity_cluster_t::run_t::on_new_connection,
@@ -145,11 +148,22 @@ void connectivity_cluster_t::run_t::join(const peer_address_t &address) THROWS_N
         auto_drainer_t::lock_t(&drainer)));
 }
 
+scoped_array_t<connectivity_cluster_t::run_t::connection_entry_t::lane_t>
+connectivity_cluster_t::run_t::connection_entry_t::make_lanes(
+        const std::vector<tcp_conn_stream_t *> &lane_conns) {
+    scoped_array_t<lane_t> lanes(lane_conns.size());
+    for (size_t i = 0; i < lane_conns.size(); ++i) {
+        guarantee(lane_conns[i] != NULL);
+        lanes[i].conn = lane_conns[i];
+    }
+    return lanes;
+}
+
 connectivity_cluster_t::run_t::connection_entry_t::connection_entry_t(run_t *p,
                                                                       peer_id_t id,
-                                                                      tcp_conn_stream_t *c,
+                                                                      const std::vector<tcp_conn_stream_t *> &lane_conns,
                                                                       const peer_address_t &a) THROWS_NOTHING :
-    conn(c), address(a), session_id(generate_uuid()),
+    lanes(make_lanes(lane_conns)), address(a), session_id(generate_uuid()),
     pm_collection(),
     pm_bytes_sent(secs_to_ticks(1), true),
     pm_collection_membership(&p->parent->connectivity_collection, &pm_collection, uuid_to_str(id.get_uuid())),
@@ -170,8 +184,25 @@ connectivity_cluster_t::run_t::connection_entry_t::~connection_entry_t() THROWS_
     entries.reset();
 
     /* `~entry_installation_t` destroys the `auto_drainer_t`'s in entries,
-    so nothing can be holding the `send_mutex`. */
-    guarantee(!send_mutex.is_locked());
+    so nothing can be holding the `send_mutex`es. */
+    for (size_t i = 0; i < lanes.size(); ++i) {
+        guarantee(!lanes[i].send_mutex.is_locked());
+    }
+}
+
+connectivity_cluster_t::run_t::connection_entry_t::lane_t *
+connectivity_cluster_t::run_t::connection_entry_t::get_lane_for_current_thread() {
+    if (lanes.size() == 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < lanes.size(); ++i) {
+        if (lanes[i].conn->home_thread() == get_thread_id()) {
+            return &lanes[i];
+        }
+    }
+    // Messages from the same thread always take the same lane, so they stay in
+    // order.
+    return &lanes[get_thread_id().threadnum % lanes.size()];
 }
 
 static void ping_connection_watcher(peer_id_t peer, peers_list_callback_t *connect_disconnect_cb) THROWS_NOTHING {
@@ -221,7 +252,7 @@ void connectivity_cluster_t::run_t::on_new_connection(const scoped_ptr_t<tcp_con
     nconn->make_overcomplicated(&conn);
     keepalive_tcp_conn_stream_t conn_stream(conn);
 
-    handle(&conn_stream, boost::none, boost::none, lock, NULL);
+    handle(&conn_stream, boost::none, boost::none, boost::none, lock, NULL);
 }
 
 void connectivity_cluster_t::run_t::connect_to_peer(const peer_address_t *address,
@@ -256,7 +287,9 @@ void connectivity_cluster_t::run_t::connect_to_peer(const peer_address_t *addres
             keepalive_tcp_conn_stream_t conn(selected_addr->ip(), selected_addr->port().value(),
                                              drainer_lock.get_drain_signal(), cluster_client_port);
             if (!*successful_join) {
-                handle(&conn, expected_id, boost::optional<peer_address_t>(*address), drainer_lock, successful_join);
+                handle(&conn, expected_id, boost::optional<peer_address_t>(*address),
+                       boost::optional<ip_and_port_t>(*selected_addr), drainer_lock,
+                       successful_join);
             }
         } catch (const tcp_conn_t::connect_failed_exc_t &) {
             /* Ignore */
@@ -526,6 +559,144 @@ bool connectivity_cluster_t::run_t::get_routing_table_to_send_and_add_peer(
     return true;
 }
 
+/* A `lane_set_t` belongs to the `handle()` instance for the first lane of a
+connection with more than one lane. The `handle()` instances for the other lanes
+add their connections to it, and then wait for it to be released before they
+close them. Only accessed on the `run_t`'s home thread. */
+class connectivity_cluster_t::run_t::lane_set_t {
+public:
+    lane_set_t(peer_id_t _peer, uuid_u _id, int num_lanes) :
+        peer(_peer), id(_id), conns(num_lanes, NULL), num_unsettled(num_lanes - 1),
+        accepting(true) {
+        guarantee(num_lanes > 1);
+    }
+
+    ~lane_set_t() {
+        released.pulse();
+        /* `drainer`'s destructor waits for the lanes to stop waiting on
+        `released`. */
+    }
+
+    int num_lanes() const { return conns.size(); }
+
+    bool has_lane(int index) const { return conns[index] != NULL; }
+
+    /* Returns false if it's too late to add the lane; the caller should close
+    it then. Otherwise, the caller must keep `conn` open until `released` is
+    pulsed. */
+    MUST_USE bool add_lane(int index, keepalive_tcp_conn_stream_t *conn) {
+        guarantee(index > 0 && index < num_lanes());
+        if (!accepting || conns[index] != NULL) {
+            return false;
+        }
+        conns[index] = conn;
+        on_lane_settled();
+        return true;
+    }
+
+    void lane_failed(int index) {
+        guarantee(index > 0 && index < num_lanes());
+        guarantee(conns[index] == NULL);
+        on_lane_settled();
+    }
+
+    /* Called by the first lane when it's done waiting for the others. */
+    void stop_accepting() {
+        accepting = false;
+    }
+
+    const peer_id_t peer;
+    const uuid_u id;
+
+    /* `conns[0]` is unused; the first lane is not part of the set. */
+    std::vector<keepalive_tcp_conn_stream_t *> conns;
+
+    /* Pulsed once every lane has been added or has failed. */
+    cond_t settled;
+
+    cond_t released;
+
+    auto_drainer_t drainer;
+
+private:
+    void on_lane_settled() {
+        guarantee(num_unsettled > 0);
+        --num_unsettled;
+        if (num_unsettled == 0) {
+            settled.pulse();
+        }
+    }
+
+    int num_unsettled;
+    bool accepting;
+
+    DISABLE_COPYING(lane_set_t);
+};
+
+/* Once a connection is set up, each of its lanes is served by a `serve_lane()`
+coroutine on the lane's own thread. The `lane_serving_t` lives on the `run_t`'s
+home thread, and keeps those coroutines in step: The `connection_entry_t` may
+only be created once every lane is on its thread, no lane may read a message
+before the `connection_entry_t` exists or after it is gone, and the lanes may
+only leave their threads once the `connection_entry_t` is gone. When one lane
+goes down, all of them go down. */
+class connectivity_cluster_t::run_t::lane_serving_t {
+public:
+    lane_serving_t(peer_id_t _peer, const peer_address_t &_address,
+                   signal_t *drain_signal) :
+        peer(_peer), address(_address), home_thread(get_thread_id()),
+        close(drain_signal, &closing), num_unregistered(0), num_reading(0) { }
+
+    void add_lane(keepalive_tcp_conn_stream_t *conn, threadnum_t thread) {
+        conns.push_back(conn);
+        threads.push_back(thread);
+        ++num_unregistered;
+        ++num_reading;
+    }
+
+    void on_lane_registered() {
+        guarantee(get_thread_id() == home_thread);
+        guarantee(num_unregistered > 0);
+        --num_unregistered;
+        if (num_unregistered == 0) {
+            registered.pulse();
+        }
+    }
+
+    void on_lane_stopped_reading() {
+        guarantee(get_thread_id() == home_thread);
+        guarantee(num_reading > 0);
+        --num_reading;
+        if (num_reading == 0) {
+            stopped_reading.pulse();
+        }
+    }
+
+    const peer_id_t peer;
+    const peer_address_t address;
+    const threadnum_t home_thread;
+    std::vector<keepalive_tcp_conn_stream_t *> conns;
+    std::vector<threadnum_t> threads;
+
+    /* Pulsed when any lane stops reading. */
+    cond_t closing;
+    /* Pulsed when the lanes should shut down. */
+    wait_any_t close;
+    /* Pulsed once every lane is on its thread. */
+    cond_t registered;
+    /* Pulsed once the `connection_entry_t` exists; no lane reads before that. */
+    cond_t entry_created;
+    /* Pulsed once every lane has left its message-handling loop. */
+    cond_t stopped_reading;
+    cond_t entry_destroyed;
+
+private:
+    size_t num_unregistered;
+    size_t num_reading;
+
+    DISABLE_COPYING(lane_serving_t);
+};
+
 // We log error conditions as follows:
 // - silent: network error; conflict between parallel connections
 // - warning: invalid header
@@ -537,10 +708,14 @@ void connectivity_cluster_t::run_t::handle(
         keepalive_tcp_conn_stream_t *conn,
         boost::optional<peer_id_t> expected_id,
         boost::optional<peer_address_t> expected_address,
+        boost::optional<ip_and_port_t> lane_address,
         auto_drainer_t::lock_t drainer_lock,
-        bool *successful_join) THROWS_NOTHING
+        bool *successful_join,
+        lane_set_t *outgoing_lanes,
+        int outgoing_lane_index) THROWS_NOTHING
 {
     parent->assert_thread();
+    rassert((outgoing_lanes == NULL) == (outgoing_lane_index == 0));
 
     // Get the name of our peer, for error reporting.
     ip_address_t peer_addr;
@@ -554,6 +729,26 @@ void connectivity_cluster_t::run_t::handle(
     cluster_conn_closing_subscription_t conn_closer_1(conn);
     conn_closer_1.reset(drainer_lock.get_drain_signal());
 
+    /* The side that connects decides how many lanes the connection gets. It
+    can't open more than one if all of its connections have to come from the
+    same port. The ID ties the extra lanes to the first one. */
+    uuid_u lanes_id = nil_uuid();
+    int32_t our_lane_index = 0;
+    int32_t num_lanes = 1;
+    cluster_conn_closing_subscription_t conn_closer_lanes(conn);
+    if (outgoing_lanes != NULL) {
+        lanes_id = outgoing_lanes->id;
+        our_lane_index = outgoing_lane_index;
+        num_lanes = outgoing_lanes->num_lanes();
+        // Give up on the lane if the connection is done waiting for it.
+        conn_closer_lanes.reset(&outgoing_lanes->released);
+    } else if (lane_address && cluster_client_port == 0) {
+        num_lanes = std::min(get_num_threads(), CLUSTER_CONNECTION_MAX_LANES);
+        if (num_lanes > 1) {
+            lanes_id = generate_uuid();
+        }
+    }
+
     // Each side sends a header followed by its own ID and address, then receives and checks the
     // other side's.
     {
@@ -565,6 +760,9 @@ void connectivity_cluster_t::run_t::handle(
         msg.append(cluster_arch_bitsize.data(), cluster_arch_bitsize.length());
         msg << static_cast<uint64_t>(cluster_build_mode.length());
         msg.append(cluster_build_mode.data(), cluster_build_mode.length());
+        msg << lanes_id;
+        msg << our_lane_index;
+        msg << num_lanes;
         msg << parent->me;
         msg << routing_table[parent->me].hosts();
         if (send_write_message(conn, &msg))
@@ -638,6 +836,22 @@ void connectivity_cluster_t::run_t::handle(
         }
     }
 
+    // Receive the lane information. It's only meaningful from the side that
+    // connected.
+    uuid_u remote_lanes_id;
+    int32_t remote_lane_index;
+    int32_t remote_num_lanes;
+    if (deserialize_and_check(conn, &remote_lanes_id, peername) ||
+        deserialize_and_check(conn, &remote_lane_index, peername) ||
+        deserialize_and_check(conn, &remote_num_lanes, peername))
+        return;
+    if (remote_num_lanes < 1 || remote_num_lanes > CLUSTER_CONNECTION_MAX_LANES ||
+        remote_lane_index < 0 || remote_lane_index >= remote_num_lanes ||
+        (remote_num_lanes > 1 && remote_lanes_id.is_nil())) {
+        logERR("received invalid lane information from %s, closing connection", peername);
+        return;
+    }
+
     // Receive id, host/ports.
     peer_id_t other_id;
     std::set<host_and_port_t> other_peer_addr_hosts;
@@ -676,6 +890,53 @@ void connectivity_cluster_t::run_t::handle(
         return;
     }
 
+    /* If this is an extra lane of a connection, hand it to the `handle()`
+    instance for the connection's first lane, which takes care of everything
+    from here on. */
+    if (outgoing_lanes != NULL || remote_lane_index != 0) {
+        lane_set_t *lanes;
+        int lane_index;
+        auto_drainer_t::lock_t lanes_lock;
+        if (outgoing_lanes != NULL) {
+            // `connect_lane()` holds a lock on `outgoing_lanes` for us.
+            lanes = outgoing_lanes;
+            lane_index = outgoing_lane_index;
+        } else {
+            auto it = incoming_lanes.find(remote_lanes_id);
+            if (it == incoming_lanes.end() || it->second->peer != other_id ||
+                it->second->num_lanes() != remote_num_lanes) {
+                // The first lane went away, or gave up waiting for us.
+                return;
+            }
+            lanes = it->second;
+            lane_index = remote_lane_index;
+            lanes_lock = auto_drainer_t::lock_t(&lanes->drainer);
+        }
+
+        /* From now on, closing the connection is up to the first lane. */
+        conn_closer_1.reset();
+        conn_closer_lanes.reset();
+        if (lanes->add_lane(lane_index, conn)) {
+            lanes->released.wait_lazily_unordered();
+        }
+        return;
+    }
+
+    /* If the connection has extra lanes, get ready to receive them. The side
+    that connected opens them once we're done with the handshake below. */
+    object_buffer_t<lane_set_t> lanes;
+    map_insertion_sentry_t<uuid_u, lane_set_t *> incoming_lanes_entry;
+    if (num_lanes > 1) {
+        lanes.create(other_id, lanes_id, num_lanes);
+    } else if (remote_num_lanes > 1) {
+        if (incoming_lanes.find(remote_lanes_id) != incoming_lanes.end()) {
+            logERR("received duplicate lane ID from %s, closing connection", peername);
+            return;
+        }
+        lanes.create(other_id, remote_lanes_id, remote_num_lanes);
+        incoming_lanes_entry.reset(&incoming_lanes, remote_lanes_id, lanes.get());
+    }
+
     // Just saying that we're still on the rpc listener thread.
     parent->assert_thread();
 
@@ -779,64 +1040,171 @@ void connectivity_cluster_t::run_t::handle(
         }
     }
 
+    /* Wait for the extra lanes (opening them first if it's up to us). If some
+    of them don't make it, we go ahead without them. */
+    lane_serving_t serving(other_id, other_peer_addr, drainer_lock.get_drain_signal());
+    if (lanes.has()) {
+        if (num_lanes > 1) {
+            for (int i = 1; i < num_lanes; ++i) {
+                coro_t::spawn_sometime(std::bind(
+                    &connectivity_cluster_t::run_t::connect_lane, this,
+                    *lane_address, i, lanes.get(),
+                    auto_drainer_t::lock_t(&lanes->drainer), drainer_lock));
+            }
+        }
+
+        signal_timer_t timeout;
+        timeout.start(CLUSTER_CONNECTION_LANE_TIMEOUT_MS);
+        wait_any_t waiter(&lanes->settled, &timeout, drainer_lock.get_drain_signal());
+        waiter.wait_lazily_unordered();
+        incoming_lanes_entry.reset();
+        lanes->stop_accepting();
+
+        /* Lane `i` goes on thread `i`, on both sides. That way a message that
+        is sent from some thread gets received on the same thread, as long as
+        both nodes have enough threads. */
+        serving.add_lane(conn, threadnum_t(0));
+        for (int i = 1; i < lanes->num_lanes(); ++i) {
+            if (lanes->has_lane(i)) {
+                serving.add_lane(lanes->conns[i], threadnum_t(i % get_num_threads()));
+            }
+        }
+    } else {
+        // We could pick a better way to pick a better thread, our choice
+        // now is hopefully a performance non-problem.
+        serving.add_lane(conn, threadnum_t(rng.randint(get_num_threads())));
+    }
+
     /* Now that we're about to switch threads, it's not safe to try to close
-    the connection from this thread anymore. This is safe because we won't do
-    anything that permanently blocks before setting up `conn_closer_2`. */
+    the connections from this thread anymore. This is safe because we won't do
+    anything that permanently blocks before `serve_lane()` sets up its own
+    closing subscription. */
     conn_closer_1.reset();
 
-    // We could pick a better way to pick a better thread, our choice
-    // now is hopefully a performance non-problem.
-    threadnum_t chosen_thread = threadnum_t(rng.randint(get_num_threads()));
+    pmap(serving.conns.size(), std::bind(&connectivity_cluster_t::run_t::serve_lane,
+                                         this, ph::_1, &serving));
 
-    cross_thread_signal_t connection_thread_drain_signal(drainer_lock.get_drain_signal(), chosen_thread);
+    /* The destructor of `lanes` releases the extra lanes, so that their
+    `handle()` instances can close them. */
+}
+
+void connectivity_cluster_t::run_t::connect_lane(
+        ip_and_port_t address,
+        int lane_index,
+        lane_set_t *lanes,
+        UNUSED auto_drainer_t::lock_t lanes_lock,
+        auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING {
+    parent->assert_thread();
+    wait_any_t interruptor(&lanes->released, drainer_lock.get_drain_signal());
+    try {
+        keepalive_tcp_conn_stream_t conn(address.ip(), address.port().value(),
+                                         &interruptor);
+        handle(&conn, boost::optional<peer_id_t>(lanes->peer), boost::none,
+               boost::none, drainer_lock, NULL, lanes, lane_index);
+    } catch (const tcp_conn_t::connect_failed_exc_t &) {
+        /* Ignore */
+    } catch (const interrupted_exc_t &) {
+        /* Ignore */
+    }
+
+    if (!lanes->has_lane(lane_index)) {
+        lanes->lane_failed(lane_index);
+    }
+}
+
+void connectivity_cluster_t::run_t::serve_lane(int index,
+                                               lane_serving_t *serving) THROWS_NOTHING {
+    parent->assert_thread();
+    keepalive_tcp_conn_stream_t *conn = serving->conns[index];
+    const threadnum_t lane_thread = serving->threads[index];
+
+    cross_thread_signal_t close_signal(&serving->close, lane_thread);
+    cross_thread_signal_t registered_signal(&serving->registered, lane_thread);
+    cross_thread_signal_t entry_created_signal(&serving->entry_created, lane_thread);
+    cross_thread_signal_t stopped_reading_signal(&serving->stopped_reading, lane_thread);
+    cross_thread_signal_t entry_destroyed_signal(&serving->entry_destroyed, lane_thread);
 
     rethread_tcp_conn_stream_t unregister_conn(conn, INVALID_THREAD);
-    on_thread_t conn_threader(chosen_thread);
+    on_thread_t conn_threader(lane_thread);
     rethread_tcp_conn_stream_t reregister_conn(conn, get_thread_id());
 
-    // Make sure that if we're ordered to shut down, any pending read
-    // or write gets interrupted.
+    // Make sure that if we're ordered to shut down, or another lane goes down,
+    // any pending read or write gets interrupted.
     cluster_conn_closing_subscription_t conn_closer_2(conn);
-    conn_closer_2.reset(&connection_thread_drain_signal);
+    conn_closer_2.reset(&close_signal);
 
     {
-        /* `connection_entry_t` is the public interface of this coroutine. Its
-        constructor registers it in the `connectivity_cluster_t`'s connection
-        map and notifies any connect listeners. */
-        connection_entry_t conn_structure(this, other_id, conn, other_peer_addr);
-        object_buffer_t<heartbeat_keepalive_t> keepalive;
+        on_thread_t threader(serving->home_thread);
+        serving->on_lane_registered();
+    }
 
+    /* `connection_entry_t` is the public interface of the connection. Its
+    constructor registers it in the `connectivity_cluster_t`'s connection map
+    and notifies any connect listeners. The first lane owns it. */
+    object_buffer_t<connection_entry_t> conn_structure;
+    object_buffer_t<heartbeat_keepalive_t> keepalive;
+    if (index == 0) {
+        registered_signal.wait_lazily_unordered();
+        conn_structure.create(this, serving->peer,
+                              std::vector<tcp_conn_stream_t *>(serving->conns.begin(),
+                                                               serving->conns.end()),
+                              serving->address);
         if (heartbeat_manager != NULL) {
-            keepalive.create(conn, heartbeat_manager, other_id);
+            keepalive.create(conn, heartbeat_manager, serving->peer);
         }
+        on_thread_t threader(serving->home_thread);
+        serving->entry_created.pulse();
+    } else {
+        /* The message handlers expect the peer to be in the connection map, so
+        we mustn't read anything before the first lane has created the entry. */
+        entry_created_signal.wait_lazily_unordered();
+    }
 
-        /* Main message-handling loop: read messages off the connection until
-        it's closed, which may be due to network events, or the other end
-        shutting down, or us shutting down. */
-        try {
-            int messages_handled_since_yield = 0;
-            while (true) {
-                message_handler->on_message(other_id, conn); // might raise fake_archive_exc_t
-
-                ++messages_handled_since_yield;
-                if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
-                    coro_t::yield();
-                    messages_handled_since_yield = 0;
-                }
+    /* Main message-handling loop: read messages off the connection until
+    it's closed, which may be due to network events, or the other end
+    shutting down, or us shutting down. */
+    try {
+        int messages_handled_since_yield = 0;
+        while (true) {
+            message_handler->on_message(serving->peer, conn); // might raise fake_archive_exc_t
+
+            ++messages_handled_since_yield;
+            if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
+                coro_t::yield();
+                messages_handled_since_yield = 0;
             }
-        } catch (const fake_archive_exc_t &) {
-            /* The exception broke us out of the loop, and that's what we
-            wanted. This could either be because we lost contact with the peer
-            or because the cluster is shutting down and `close_conn()` got
-            called. */
         }
+    } catch (const fake_archive_exc_t &) {
+        /* The exception broke us out of the loop, and that's what we
+        wanted. This could either be because we lost contact with the peer
+        or because the cluster is shutting down and `close_conn()` got
+        called. */
+    }
 
-        if(conn->is_read_open()) {
-            logWRN("Received invalid data on a cluster connection. Disconnecting.");
-        }
+    if(conn->is_read_open()) {
+        logWRN("Received invalid data on a cluster connection. Disconnecting.");
+    }
 
+    // Take the other lanes down with us.
+    {
+        on_thread_t threader(serving->home_thread);
+        serving->closing.pulse_if_not_already_pulsed();
+        serving->on_lane_stopped_reading();
+    }
+
+    if (index == 0) {
+        /* The other lanes may still be handling a message, and the handlers
+        expect the peer to be in the connection map. */
+        stopped_reading_signal.wait_lazily_unordered();
         /* The `conn_structure` destructor removes us from the connection map
         and notifies any disconnect listeners. */
+        keepalive.reset();
+        conn_structure.reset();
+        on_thread_t threader(serving->home_thread);
+        serving->entry_destroyed.pulse();
+    } else {
+        // Somebody might still be sending a message on this lane.
+        entry_destroyed_signal.wait_lazily_unordered();
     }
 }
 
@@ -885,21 +1253,28 @@ connectivity_service_t *connectivity_cluster_t::get_connectivity_service() THROW
     return this;
 }
 
+static std::vector<char> write_message_to_vector(write_message_t *msg) {
+    std::vector<char> data;
+    data.reserve(msg->size());
+    intrusive_list_t<write_buffer_t> *buffers = msg->unsafe_expose_buffers();
+    for (write_buffer_t *b = buffers->head(); b != NULL; b = buffers->next(b)) {
+        data.insert(data.end(), b->data, b->data + b->size);
+    }
+    return data;
+}
+
 void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_callback_t *callback) THROWS_NOTHING {
     // We could be on _any_ thread.
 
     guarantee(!dest.is_nil());
 
-    /* We currently write the message to a vector_stream_t, then
-       serialize that as a string. It's horribly inefficient, of course. */
-    // TODO: If we don't do it this way, we (or the caller) will need
-    // to worry about having the writer run on the connection thread.
-    vector_stream_t buffer;
-    // Reserve some space to reduce overhead (especially for small messages)
-    buffer.reserve(1024);
+    /* The message gets serialized on the calling thread, because the writer
+    might not be safe to run on the connection's thread. The buffers of `msg`
+    then go out over the connection as they are. */
+    write_message_t msg;
     {
         ASSERT_FINITE_CORO_WAITING;
-        callback->write(&buffer);
+        callback->write(&msg);
     }
 
 #ifdef CLUSTER_MESSAGE_DEBUGGING
@@ -910,7 +1285,8 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
         buf.appendf(" to ");
         debug_print(&buf, dest);
         buf.appendf("\n");
-        print_hd(buffer.vector().data(), 0, buffer.vector().size());
+        std::vector<char> data = write_message_to_vector(&msg);
+        print_hd(data.data(), 0, data.size());
     }
 #endif
 
@@ -940,36 +1316,45 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
         conn_structure_lock = it->second.second;
     }
 
-    size_t bytes_sent = buffer.vector().size();
+    size_t bytes_sent = msg.size();
+
+    run_t::connection_entry_t::lane_t *lane = conn_structure->get_lane_for_current_thread();
 
-    if (conn_structure->conn == NULL) {
+    if (lane == NULL) {
         // We're sending a message to ourself
         guarantee(dest == me);
         // We could be on any thread here! Oh no!
-        std::vector<char> buffer_data;
-        buffer.swap(&buffer_data);
-        vector_read_stream_t read_stream(std::move(buffer_data));
+        vector_read_stream_t read_stream(write_message_to_vector(&msg));
         current_run->message_handler->on_message(me, &read_stream);
     } else {
         guarantee(dest != me);
-        on_thread_t threader(conn_structure->conn->home_thread());
+
+        std::vector<struct iovec> iov;
+        intrusive_list_t<write_buffer_t> *buffers = msg.unsafe_expose_buffers();
+        for (write_buffer_t *b = buffers->head(); b != NULL; b = buffers->next(b)) {
+            struct iovec v;
+            v.iov_base = b->data;
+            v.iov_len = b->size;
+            iov.push_back(v);
+        }
+
+        on_thread_t threader(lane->conn->home_thread());
 
         /* Acquire the send-mutex so we don't collide with other things trying
-        to send on the same connection. */
-        mutex_t::acq_t acq(&conn_structure->send_mutex);
+        to send on the same lane. */
+        mutex_t::acq_t acq(&lane->send_mutex);
 
         {
-            int64_t res = conn_structure->conn->write(buffer.vector().data(),
-                                                      buffer.vector().size());
+            int64_t res = lane->conn->writev(iov.data(), iov.size());
             if (res == -1) {
-                /* Close the other half of the connection to make sure that
-                   `connectivity_cluster_t::run_t::handle()` notices that something is
-                   up */
-                if (conn_structure->conn->is_read_open()) {
-                    conn_structure->conn->shutdown_read();
+                /* Close the other half of the lane to make sure that
+                   `connectivity_cluster_t::run_t::serve_lane()` notices that
+                   something is up */
+                if (lane->conn->is_read_open()) {
+                    lane->conn->shutdown_read();
                 }
             } else {
-                guarantee(res == static_cast<int64_t>(buffer.vector().size()));
+                guarantee(res == static_cast<int64_t>(bytes_sent));
             }
         }
     }
@@ -984,9 +1369,15 @@ void connectivity_cluster_t::kill_connection(peer_id_t peer) THROWS_NOTHING {
         connection_map->find(peer);
 
     if (it != connection_map->end()) {
-        tcp_conn_stream_t *conn = it->second.first->conn;
-        guarantee(conn != NULL, "Attempted to kill connection to myself.");
-        guarantee(get_thread_id() == conn->home_thread());
+        run_t::connection_entry_t *entry = it->second.first;
+        guarantee(entry->lanes.size() != 0, "Attempted to kill connection to myself.");
+        /* Shutting down the first lane takes the others down with it. We may have
+        been called from another lane's thread (e.g. by the mailbox manager after an
+        invalid message), so go to the first lane's thread to do it. The drainer
+        lock keeps `entry` alive while we switch. */
+        auto_drainer_t::lock_t connection_keepalive = it->second.second;
+        tcp_conn_stream_t *conn = entry->lanes[0].conn;
+        on_thread_t threader(conn->home_thread());
 
         if (conn->is_read_open()) {
             conn->shutdown_read();
@@ -14,6 +14,7 @@
 #include "concurrency/semaphore.hpp"
 #include "containers/archive/tcp_conn_stream.hpp"
 #include "containers/map_sentries.hpp"
+#include "containers/scoped.hpp"
 #include "containers/uuid.hpp"
 #include "perfmon/perfmon.hpp"
 #include "rpc/connectivity/connectivity.hpp"
@@ -93,22 +94,40 @@ public:
         class connection_entry_t : public home_thread_mixin_debug_only_t {
         public:
             /* The constructor registers us in every thread's `connection_map`;
-            the destructor deregisters us. Both also notify all subscribers. */
-            connection_entry_t(run_t *, peer_id_t, tcp_conn_stream_t *,
+            the destructor deregisters us. Both also notify all subscribers.
+            It must be constructed on the home thread of the first lane. */
+            connection_entry_t(run_t *, peer_id_t,
+                               const std::vector<tcp_conn_stream_t *> &lane_conns,
                                const peer_address_t &peer) THROWS_NOTHING;
             ~connection_entry_t() THROWS_NOTHING;
 
-            /* NULL for our "connection" to ourself */
-            tcp_conn_stream_t *conn;
+            /* A connection to a peer is made up of one or more TCP connections,
+            called "lanes", each of which lives on its own thread. */
+            class lane_t {
+            public:
+                lane_t() : conn(NULL) { }
+                tcp_conn_stream_t *conn;
+                mutex_t send_mutex;
+            private:
+                DISABLE_COPYING(lane_t);
+            };
+
+            /* Returns the lane that messages sent from the current thread go
+            over. That's the lane living on the current thread if there is one,
+            so that sending doesn't need a thread switch. Returns NULL for our
+            "connection" to ourself. */
+            lane_t *get_lane_for_current_thread();
+
+            /* Empty for our "connection" to ourself. The heartbeat runs on the
+            first lane's thread, and killing the connection shuts that lane
+            down, which takes the other lanes down with it. */
+            scoped_array_t<lane_t> lanes;
 
             /* `connection_t` contains the addresses so that we can call
             `get_peers_list()` on any thread. Otherwise, we would have to go
             cross-thread to access the routing table. */
             peer_address_t address;
 
-            /* Unused for our connection to ourself */
-            mutex_t send_mutex;
-
             uuid_u session_id;
 
             perfmon_collection_t pm_collection;
@@ -116,6 +135,9 @@ public:
             perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
 
         private:
+            static scoped_array_t<lane_t> make_lanes(
+                const std::vector<tcp_conn_stream_t *> &lane_conns);
+
             /* We only hold this information so we can deregister ourself */
             run_t *parent;
             peer_id_t peer;
@@ -156,6 +178,14 @@ public:
             DISABLE_COPYING(variable_setter_t);
         };
 
+        /* Collects the extra lanes of a connection while it's being set up;
+        see `handle()`. */
+        class lane_set_t;
+
+        /* Shared between the coroutines that serve the lanes of a connection;
+        see `serve_lane()`. */
+        class lane_serving_t;
+
         void on_new_connection(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn, auto_drainer_t::lock_t lock) THROWS_NOTHING;
 
         /* `connectivity_cluster_t::connect_to_peer` is spawned for each known
@@ -188,12 +218,33 @@ public:
         It handles the handshake, exchanging node maps, sending out the
         connect-notification, receiving messages from the peer until it
         disconnects or we are shut down, and sending out the
-        disconnect-notification. */
+        disconnect-notification.
+
+        The side that connects (the one that knows `lane_address`) also opens
+        extra lanes to the same address, by calling `connect_lane()`. The
+        `handle()` instances for the extra lanes (on both sides) only do the
+        handshake; then they hand their connection to the `handle()` instance
+        for the first lane, and wait for it to finish with the connection.
+        `outgoing_lanes` and `outgoing_lane_index` are only set for the extra
+        lanes on the connecting side. */
         void handle(keepalive_tcp_conn_stream_t *c,
             boost::optional<peer_id_t> expected_id,
             boost::optional<peer_address_t> expected_address,
+            boost::optional<ip_and_port_t> lane_address,
             auto_drainer_t::lock_t,
-            bool *successful_join) THROWS_NOTHING;
+            bool *successful_join,
+            lane_set_t *outgoing_lanes = NULL,
+            int outgoing_lane_index = 0) THROWS_NOTHING;
+
+        void connect_lane(ip_and_port_t address,
+                          int lane_index,
+                          lane_set_t *lanes,
+                          auto_drainer_t::lock_t lanes_lock,
+                          auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING;
+
+        /* Reads messages off of one lane of an established connection. The
+        coroutine for the first lane also owns the `connection_entry_t`. */
+        void serve_lane(int index, lane_serving_t *serving) THROWS_NOTHING;
 
         connectivity_cluster_t *parent;
 
@@ -220,6 +271,11 @@ public:
         redundant connections to the same peer. */
         mutex_t new_connection_mutex;
 
+        /* The connections that are waiting for their peer to open their extra
+        lanes, by the ID the peer sent with the first lane. Only accessed on
+        the home thread. */
+        std::map<uuid_u, lane_set_t *> incoming_lanes;
+
         scoped_ptr_t<tcp_bound_socket_t> cluster_listener_socket;
         int cluster_listener_port;
         int cluster_client_port;
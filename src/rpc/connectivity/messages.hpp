@@ -4,7 +4,7 @@
 
 class connectivity_service_t;
 class peer_id_t;
-class write_stream_t;
+class write_message_t;
 
 #include "containers/archive/string_stream.hpp"
 
@@ -46,10 +46,12 @@ no further messages are delivered. This gives a natural way to make sure that no
 messages are still being delivered at the time that the `application_t`
 destructor is called. */
 
+/* `write()` serializes the message into `msg`. The message service then sends
+the buffers of `msg` as they are, so nothing gets copied after serialization. */
 class send_message_write_callback_t {
 public:
     virtual ~send_message_write_callback_t() { }
-    virtual void write(write_stream_t *stream) = 0;
+    virtual void write(write_message_t *msg) = 0;
 };
 
 class message_service_t  {
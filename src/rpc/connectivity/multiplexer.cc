@@ -1,13 +1,20 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "rpc/connectivity/multiplexer.hpp"
 
+#include <string.h>
+
+#include <limits>
+#include <vector>
+
 #include "errors.hpp"
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 
+#include "arch/runtime/coroutines.hpp"
+#include "config/args.hpp"
+#include "containers/archive/vector_stream.hpp"
 #include "rpc/connectivity/connectivity.hpp"
 
-
 message_multiplexer_t::run_t::run_t(message_multiplexer_t *p) : parent(p) {
     guarantee(parent->run == NULL);
     parent->run = this;
@@ -29,6 +36,39 @@ void message_multiplexer_t::run_t::on_message(peer_id_t source, read_stream_t *s
     tag_t tag;
     archive_result_t res = deserialize(stream, &tag);
     if (bad(res)) { throw fake_archive_exc_t(); }
+    if (tag != batch_tag) {
+        dispatch(source, tag, stream);
+        return;
+    }
+
+    /* A batch is a count, followed by that many messages that each start with
+    their length. Every message gets its own stream, so that a handler can't read
+    into the next one. */
+    uint32_t num_messages;
+    res = deserialize(stream, &num_messages);
+    if (bad(res)) { throw fake_archive_exc_t(); }
+    for (uint32_t i = 0; i < num_messages; ++i) {
+        uint64_t length;
+        res = deserialize(stream, &length);
+        if (bad(res)
+            || length > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            throw fake_archive_exc_t();
+        }
+        std::vector<char> data(length);
+        int64_t bytes_read = force_read(stream, data.data(), length);
+        if (bytes_read != static_cast<int64_t>(length)) {
+            throw fake_archive_exc_t();
+        }
+        vector_read_stream_t message_stream(std::move(data));
+        tag_t message_tag;
+        res = deserialize(&message_stream, &message_tag);
+        if (bad(res) || message_tag == batch_tag) { throw fake_archive_exc_t(); }
+        dispatch(source, message_tag, &message_stream);
+    }
+}
+
+void message_multiplexer_t::run_t::dispatch(peer_id_t source, tag_t tag,
+                                            read_stream_t *stream) {
     client_t *client = parent->clients[tag];
     guarantee(client != NULL, "Got a message for an unfamiliar tag. Apparently "
         "we aren't compatible with the cluster on the other end.");
@@ -57,6 +97,8 @@ message_multiplexer_t::client_t::client_t(message_multiplexer_t *p,
     run(NULL),
     outstanding_writes_semaphores(max_outstanding)
 {
+    guarantee(tag != batch_tag, "Tag %d is reserved for coalesced messages.",
+              static_cast<int>(batch_tag));
     guarantee(parent->run == NULL);
     guarantee(parent->clients[tag] == NULL);
     parent->clients[tag] = this;
@@ -78,12 +120,9 @@ public:
         tag(_tag), subwriter(_subwriter) { }
     virtual ~tagged_message_writer_t() { }
 
-    void write(write_stream_t *os) {
-        write_message_t msg;
-        msg << tag;
-        int res = send_write_message(os, &msg);
-        if (res) { throw fake_archive_exc_t(); }
-        subwriter->write(os);
+    void write(write_message_t *msg) {
+        *msg << tag;
+        subwriter->write(msg);
     }
 
 private:
@@ -91,25 +130,48 @@ private:
     send_message_write_callback_t *subwriter;
 };
 
+class batch_message_writer_t : public send_message_write_callback_t {
+public:
+    batch_message_writer_t(uint32_t _num_messages, write_message_t *_messages) :
+        num_messages(_num_messages), messages(_messages) { }
+    virtual ~batch_message_writer_t() { }
+
+    void write(write_message_t *msg) {
+        *msg << message_multiplexer_t::batch_tag;
+        *msg << num_messages;
+        msg->append_message(messages);
+    }
+
+private:
+    uint32_t num_messages;
+    write_message_t *messages;
+};
+
 void message_multiplexer_t::client_t::send_message(peer_id_t dest, send_message_write_callback_t *callback) {
-    tagged_message_writer_t writer(tag, callback);
-    {
-        semaphore_acq_t outstanding_write_acq (outstanding_writes_semaphores.get());
+    semaphore_acq_t outstanding_write_acq (outstanding_writes_semaphores.get());
+    if (parent->coalesce && dest != get_connectivity_service()->get_me()) {
+        parent->coalesce_message(dest, tag, callback);
+    } else {
+        tagged_message_writer_t writer(tag, callback);
         parent->message_service->send_message(dest, &writer);
-        // Release outstanding_writes_semaphore
     }
+    // Release outstanding_writes_semaphore
 }
 
 void message_multiplexer_t::client_t::kill_connection(peer_id_t peer) {
     parent->message_service->kill_connection(peer);
 }
 
-message_multiplexer_t::message_multiplexer_t(message_service_t *super_ms) :
-    message_service(super_ms), run(NULL)
+message_multiplexer_t::message_multiplexer_t(message_service_t *super_ms,
+                                             bool _coalesce) :
+    message_service(super_ms), run(NULL), coalesce(_coalesce)
 {
     for (int i = 0; i < max_tag; i++) {
         clients[i] = NULL;
     }
+    if (coalesce) {
+        coalesced.init(new one_per_thread_t<batches_t>());
+    }
 }
 
 message_multiplexer_t::~message_multiplexer_t() {
@@ -118,3 +180,66 @@ message_multiplexer_t::~message_multiplexer_t() {
         guarantee(clients[i] == NULL);
     }
 }
+
+message_multiplexer_t::batch_t::batch_t() :
+    messages(new write_message_t), num_messages(0), num_users(0) { }
+
+void message_multiplexer_t::coalesce_message(peer_id_t dest, tag_t tag,
+                                             send_message_write_callback_t *callback) {
+    scoped_ptr_t<batch_t> *batch_ptr = &(*coalesced->get())[dest];
+    if (!batch_ptr->has()) {
+        batch_ptr->init(new batch_t);
+    }
+    batch_t *batch = batch_ptr->get();
+
+    {
+        ASSERT_FINITE_CORO_WAITING;
+        /* Each message is preceded by its length, which we only know once the
+        callback has written it. */
+        write_message_t *messages = batch->messages.get();
+        const size_t size_before = messages->size();
+        char *length_slot = messages->reserve(sizeof(uint64_t));
+        *messages << tag;
+        callback->write(messages);
+        uint64_t length = messages->size() - size_before - sizeof(uint64_t);
+        memcpy(length_slot, &length, sizeof(length));
+        ++batch->num_messages;
+        ++batch->num_users;
+    }
+
+    if (batch->messages->size() < MULTIPLEXER_MAX_COALESCED_BYTES) {
+        // Give the other coroutines on this thread a chance to join the batch.
+        coro_t::yield();
+    }
+    /* Either this sends our message, or it waits for the flush that took it to
+    finish writing it. */
+    flush_batch(dest, batch);
+    release_batch(dest, batch);
+}
+
+void message_multiplexer_t::flush_batch(peer_id_t dest, batch_t *batch) {
+    mutex_t::acq_t acq(&batch->flush_mutex);
+    if (batch->num_messages == 0) {
+        // Somebody else already sent everything while we waited for the mutex.
+        return;
+    }
+    scoped_ptr_t<write_message_t> messages(new write_message_t);
+    messages.swap(batch->messages);
+    const uint32_t num_messages = batch->num_messages;
+    batch->num_messages = 0;
+
+    batch_message_writer_t writer(num_messages, messages.get());
+    message_service->send_message(dest, &writer);
+}
+
+void message_multiplexer_t::release_batch(peer_id_t dest, batch_t *batch) {
+    guarantee(batch->num_users > 0);
+    --batch->num_users;
+    if (batch->num_users == 0 && batch->num_messages == 0) {
+        // Nobody's going to flush it, so nothing else has a pointer to it.
+        batches_t *thread_batches = coalesced->get();
+        auto it = thread_batches->find(dest);
+        guarantee(it != thread_batches->end() && it->second.get() == batch);
+        thread_batches->erase(it);
+    }
+}
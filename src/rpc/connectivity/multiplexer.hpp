@@ -2,13 +2,21 @@
 #ifndef RPC_CONNECTIVITY_MULTIPLEXER_HPP_
 #define RPC_CONNECTIVITY_MULTIPLEXER_HPP_
 
+#include <map>
+
 #include "rpc/connectivity/messages.hpp"
 #include "rpc/connectivity/heartbeat.hpp"
+#include "concurrency/mutex.hpp"
 #include "concurrency/semaphore.hpp"
 #include "concurrency/one_per_thread.hpp"
+#include "containers/scoped.hpp"
 
 #define DEFAULT_MAX_OUTSTANDING_WRITES_PER_THREAD 4
 
+// When coalescing, a batch gets flushed synchronously by the sender that makes it
+// this big.
+#define MULTIPLEXER_MAX_COALESCED_BYTES (64 * KILOBYTE)
+
 /* `message_multiplexer_t` is used when you want multiple components to share a
 `message_service_t`. Here's an example of how one might use it:
 
@@ -30,18 +38,34 @@
 
     // destructors take care of shutting everything down
 
+If `coalesce` is set, messages that the clients send to another peer don't go out
+one by one. Instead, each thread collects the messages it sends to a given peer
+into a batch, which goes out as a single message of the underlying service. A
+sender yields once after adding its message, so that other coroutines on the
+thread can add theirs, and then flushes the batch; a batch that grows to
+`MULTIPLEXER_MAX_COALESCED_BYTES` is flushed right away. Either way,
+`send_message()` doesn't return until the message has been written, just like
+without coalescing. Since all messages from one thread to one peer go through
+the same batch, their order is preserved. Messages to ourself are never
+coalesced. Both ends of a connection can read batches regardless of their own
+setting.
+
 */
 
 class message_multiplexer_t {
 public:
     typedef unsigned char tag_t;
     static const int max_tag = 256;
+    // The tag of a message that carries a batch of coalesced messages. Clients
+    // can't use it.
+    static const tag_t batch_tag = 0;
     class run_t : public message_handler_t {
     public:
         explicit run_t(message_multiplexer_t *);
         ~run_t();
     private:
         void on_message(peer_id_t, read_stream_t *);
+        void dispatch(peer_id_t, tag_t, read_stream_t *);
         message_multiplexer_t *const parent;
     };
     class client_t : public message_service_t {
@@ -68,16 +92,47 @@ public:
         run_t *run;
         one_per_thread_t<static_semaphore_t> outstanding_writes_semaphores;
     };
-    explicit message_multiplexer_t(message_service_t *super_ms);
+    explicit message_multiplexer_t(message_service_t *super_ms, bool coalesce = false);
     ~message_multiplexer_t();
 private:
     friend class run_t;
     friend class client_t;
     friend class client_t::run_t;
 
+    /* The messages that one thread has coalesced for one peer, but not sent yet. */
+    class batch_t {
+    public:
+        batch_t();
+        scoped_ptr_t<write_message_t> messages;
+        uint32_t num_messages;
+        // The number of senders that have added a message and haven't returned yet.
+        // Once there are none and the batch is empty, it gets erased, so that
+        // peers we no longer send to don't keep a batch around.
+        int num_users;
+        // Held while a flush writes the batch's messages. Keeps flushes from
+        // overtaking each other, and lets a sender whose message was taken by
+        // somebody else's flush wait until it has been written.
+        mutex_t flush_mutex;
+    private:
+        DISABLE_COPYING(batch_t);
+    };
+
+    typedef std::map<peer_id_t, scoped_ptr_t<batch_t> > batches_t;
+
+    // Adds the message to the batch for `dest` and returns once it's been written.
+    void coalesce_message(peer_id_t dest, tag_t tag,
+                          send_message_write_callback_t *callback);
+    void flush_batch(peer_id_t dest, batch_t *batch);
+    // Called by a user of the batch when it's done with it.
+    void release_batch(peer_id_t dest, batch_t *batch);
+
     message_service_t *const message_service;
     client_t *clients[max_tag];
     run_t *run;
+
+    const bool coalesce;
+    // Only allocated if `coalesce` is set.
+    scoped_ptr_t<one_per_thread_t<batches_t> > coalesced;
 };
 
 #endif /* RPC_CONNECTIVITY_MULTIPLEXER_HPP_ */
@@ -63,16 +63,11 @@ public:
         initial_value(_initial_value), metadata_fifo_state(_metadata_fifo_state) { }
     ~initialization_writer_t() { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = 'I';
-        msg << code;
-        msg << initial_value;
-        msg << metadata_fifo_state;
-        int res = send_write_message(stream, &msg);
-        if (res) {
-            throw fake_archive_exc_t();
-        }
+        *msg << code;
+        *msg << initial_value;
+        *msg << metadata_fifo_state;
     }
 private:
     const metadata_t &initial_value;
@@ -86,16 +81,11 @@ public:
         new_value(_new_value), metadata_fifo_token(_metadata_fifo_token) { }
     ~update_writer_t() { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = 'U';
-        msg << code;
-        msg << new_value;
-        msg << metadata_fifo_token;
-        int res = send_write_message(stream, &msg);
-        if (res) {
-            throw fake_archive_exc_t();
-        }
+        *msg << code;
+        *msg << new_value;
+        *msg << metadata_fifo_token;
     }
 private:
     const metadata_t &new_value;
@@ -2,6 +2,7 @@
 #include "rpc/mailbox/mailbox.hpp"
 
 #include <stdint.h>
+#include <string.h>
 
 #include <functional>
 
@@ -59,24 +60,19 @@ public:
         dest_thread(_dest_thread), dest_mailbox_id(_dest_mailbox_id), subwriter(_subwriter) { }
     virtual ~raw_mailbox_writer_t() { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
-        msg << dest_thread;
-        msg << dest_mailbox_id;
-        uint64_t prefix_length = static_cast<uint64_t>(msg.size());
+    void write(write_message_t *msg) {
+        // The message starts with its length, which we only know once the
+        // subwriter is done. Leave room for it and fill it in afterwards.
+        char *length_slot = msg->reserve(sizeof(uint64_t));
+        *msg << dest_thread;
+        *msg << dest_mailbox_id;
+        uint64_t prefix_length = static_cast<uint64_t>(msg->size());
 
-        subwriter->write(&msg);
+        subwriter->write(msg);
 
-        // Prepend the message length
-        // TODO: It would be more efficient if we could make this part of `msg`.
-        //  e.g. with a `prepend()` method on write_message_t.
-        write_message_t length_msg;
-        length_msg << (static_cast<uint64_t>(msg.size()) - prefix_length);
-
-        int res = send_write_message(stream, &length_msg);
-        if (res) { throw fake_archive_exc_t(); }
-        res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        // This is the same encoding `operator<<` uses for `uint64_t`.
+        uint64_t data_length = static_cast<uint64_t>(msg->size()) - prefix_length;
+        memcpy(length_slot, &data_length, sizeof(data_length));
     }
 private:
     int32_t dest_thread;
@@ -137,11 +137,6 @@ private:
     raw_mailbox_t::id_t register_mailbox(raw_mailbox_t *mb);
     void unregister_mailbox(raw_mailbox_t::id_t id);
 
-    static void write_mailbox_message(write_stream_t *stream,
-                                      threadnum_t dest_thread,
-                                      raw_mailbox_t::id_t dest_mailbox_id,
-                                      mailbox_write_callback_t *callback);
-
     void on_message(peer_id_t source_peer, read_stream_t *stream);
 
     void mailbox_read_coroutine(peer_id_t source_peer, threadnum_t dest_thread,
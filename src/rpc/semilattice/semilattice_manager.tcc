@@ -90,14 +90,11 @@ public:
     metadata_writer_t(const metadata_t &_md, metadata_version_t _mdv) :
         md(_md), mdv(_mdv) { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = message_code_metadata;
-        msg << code;
-        msg << md;
-        msg << mdv;
-        int res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        *msg << code;
+        *msg << md;
+        *msg << mdv;
     }
 private:
     const metadata_t &md;
@@ -110,13 +107,10 @@ public:
     explicit sync_from_query_writer_t(sync_from_query_id_t _query_id) :
         query_id(_query_id) { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = message_code_sync_from_query;
-        msg << code;
-        msg << query_id;
-        int res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        *msg << code;
+        *msg << query_id;
     }
 private:
     sync_from_query_id_t query_id;
@@ -128,14 +122,11 @@ public:
     sync_from_reply_writer_t(sync_from_query_id_t _query_id, metadata_version_t _version) :
         query_id(_query_id), version(_version) { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = message_code_sync_from_reply;
-        msg << code;
-        msg << query_id;
-        msg << version;
-        int res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        *msg << code;
+        *msg << query_id;
+        *msg << version;
     }
 private:
     sync_from_query_id_t query_id;
@@ -148,14 +139,11 @@ public:
     sync_to_query_writer_t(sync_to_query_id_t _query_id, metadata_version_t _version) :
         query_id(_query_id), version(_version) { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = message_code_sync_to_query;
-        msg << code;
-        msg << query_id;
-        msg << version;
-        int res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        *msg << code;
+        *msg << query_id;
+        *msg << version;
     }
 private:
     sync_to_query_id_t query_id;
@@ -168,13 +156,10 @@ public:
     explicit sync_to_reply_writer_t(sync_to_query_id_t _query_id) :
         query_id(_query_id) { }
 
-    void write(write_stream_t *stream) {
-        write_message_t msg;
+    void write(write_message_t *msg) {
         uint8_t code = message_code_sync_to_reply;
-        msg << code;
-        msg << query_id;
-        int res = send_write_message(stream, &msg);
-        if (res) { throw fake_archive_exc_t(); }
+        *msg << code;
+        *msg << query_id;
     }
 private:
     sync_to_query_id_t query_id;
@@ -0,0 +1,91 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include "serializer/log/block_compression.hpp"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "config/args.hpp"
+#include "math.hpp"
+#include "utils.hpp"
+
+static const size_t COMPRESSED_BLOCK_PREFIX_SIZE
+    = sizeof(ls_buf_data_t) + sizeof(ls_compressed_block_header_t);
+
+bool compress_block(block_codec_t codec,
+                    const ser_buffer_t *buf,
+                    block_size_t block_size,
+                    scoped_malloc_t<ser_buffer_t> *disk_buf_out,
+                    block_size_t *disk_block_size_out) {
+    guarantee(codec == block_codec_t::zlib);
+
+    // Compression only saves us anything if it frees up at least one device block.
+    const size_t aligned_size = ceil_aligned(block_size.ser_value(), DEVICE_BLOCK_SIZE);
+    if (aligned_size <= DEVICE_BLOCK_SIZE + COMPRESSED_BLOCK_PREFIX_SIZE) {
+        return false;
+    }
+    const size_t max_compressed_size
+        = aligned_size - DEVICE_BLOCK_SIZE - COMPRESSED_BLOCK_PREFIX_SIZE;
+
+    scoped_malloc_t<ser_buffer_t> disk_buf(malloc_aligned(aligned_size,
+                                                          DEVICE_BLOCK_SIZE));
+    char *const compressed_data = disk_buf->cache_data
+        + sizeof(ls_compressed_block_header_t);
+
+    uLongf compressed_size = max_compressed_size;
+    const int res = compress2(reinterpret_cast<Bytef *>(compressed_data),
+                              &compressed_size,
+                              reinterpret_cast<const Bytef *>(buf->cache_data),
+                              block_size.value(),
+                              Z_BEST_SPEED);
+    if (res == Z_BUF_ERROR) {
+        // It didn't fit in max_compressed_size bytes.
+        return false;
+    }
+    guarantee(res == Z_OK, "compress2 failed (%d)", res);
+
+    disk_buf->ser_header = buf->ser_header;
+    ls_compressed_block_header_t header;
+    header.codec = static_cast<int8_t>(codec);
+    header.compressed_size = compressed_size;
+    memcpy(disk_buf->cache_data, &header, sizeof(header));
+
+    // Zero the tail of the last device block, so that we don't write out
+    // uninitialized memory.
+    const size_t disk_block_size = COMPRESSED_BLOCK_PREFIX_SIZE + compressed_size;
+    char *const raw_disk_buf = reinterpret_cast<char *>(disk_buf.get());
+    memset(raw_disk_buf + disk_block_size, 0,
+           ceil_aligned(disk_block_size, DEVICE_BLOCK_SIZE) - disk_block_size);
+
+    *disk_buf_out = std::move(disk_buf);
+    *disk_block_size_out = block_size_t::unsafe_make(disk_block_size);
+    return true;
+}
+
+void decompress_block(const ser_buffer_t *disk_buf,
+                      block_size_t disk_block_size,
+                      block_size_t block_size,
+                      ser_buffer_t *buf_out) {
+    guarantee(disk_block_size.ser_value() > COMPRESSED_BLOCK_PREFIX_SIZE);
+
+    ls_compressed_block_header_t header;
+    memcpy(&header, disk_buf->cache_data, sizeof(header));
+    guarantee(header.codec == static_cast<int8_t>(block_codec_t::zlib),
+              "Compressed block %" PR_BLOCK_ID " has unknown codec %d.",
+              disk_buf->ser_header.block_id, static_cast<int>(header.codec));
+    guarantee(COMPRESSED_BLOCK_PREFIX_SIZE + header.compressed_size
+              == disk_block_size.ser_value(),
+              "Compressed block %" PR_BLOCK_ID " is corrupted.",
+              disk_buf->ser_header.block_id);
+
+    uLongf size = block_size.value();
+    const int res = uncompress(
+        reinterpret_cast<Bytef *>(buf_out->cache_data),
+        &size,
+        reinterpret_cast<const Bytef *>(disk_buf->cache_data + sizeof(header)),
+        header.compressed_size);
+    guarantee(res == Z_OK && size == block_size.value(),
+              "Compressed block %" PR_BLOCK_ID " is corrupted (%d).",
+              disk_buf->ser_header.block_id, res);
+
+    buf_out->ser_header = disk_buf->ser_header;
+}
@@ -0,0 +1,53 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
+#define SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
+
+#include <stdint.h>
+
+#include "containers/archive/archive.hpp"
+#include "containers/scoped.hpp"
+#include "serializer/types.hpp"
+
+/* The serializer can store data blocks compressed.  A compressed block starts with
+the usual `ls_buf_data_t` (so that the GC and read-ahead can tell which block it is
+without decompressing it), followed by an `ls_compressed_block_header_t`, followed by
+the compressed `cache_data`.  The LBA records both the block's size and the (smaller)
+number of bytes it takes up on disk; the two differ exactly when the block is stored
+compressed. */
+
+enum class block_codec_t : int8_t {
+    // Blocks are stored verbatim.
+    none = 0,
+    // Blocks are deflated with zlib, at its fastest compression level.
+    zlib = 1
+};
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(block_codec_t, int8_t,
+                                      block_codec_t::none, block_codec_t::zlib);
+
+struct ls_compressed_block_header_t {
+    // A block_codec_t, never block_codec_t::none.
+    int8_t codec;
+    // The number of bytes of compressed data following this header.
+    uint32_t compressed_size;
+} __attribute__((__packed__));
+
+// Compresses the block in `buf`, whose size is `block_size`.  Returns false if the
+// compressed block wouldn't take up fewer device blocks on disk than the original.
+// Otherwise, sets `*disk_buf_out` to the block in its on-disk form (which is
+// allocated suitably for writing it with direct I/O) and `*disk_block_size_out` to
+// the number of bytes of it that matter.
+MUST_USE bool compress_block(block_codec_t codec,
+                             const ser_buffer_t *buf,
+                             block_size_t block_size,
+                             scoped_malloc_t<ser_buffer_t> *disk_buf_out,
+                             block_size_t *disk_block_size_out);
+
+// Restores a block that was written by compress_block into `buf_out`, which must have
+// room for `block_size` bytes.
+void decompress_block(const ser_buffer_t *disk_buf,
+                      block_size_t disk_block_size,
+                      block_size_t block_size,
+                      ser_buffer_t *buf_out);
+
+#endif  // SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
@@ -6,6 +6,7 @@
 
 #include "config/args.hpp"
 #include "containers/archive/archive.hpp"
+#include "serializer/log/block_compression.hpp"
 #include "serializer/types.hpp"
 #include "rpc/serialize_macros.hpp"
 
@@ -17,6 +18,7 @@ struct log_serializer_dynamic_config_t {
         gc_high_ratio = DEFAULT_GC_HIGH_RATIO;
         read_ahead = true;
         io_batch_factor = DEFAULT_IO_BATCH_FACTOR;
+        block_codec = block_codec_t::none;
     }
 
     /* When the proportion of garbage blocks hits gc_high_ratio, then the serializer will collect
@@ -31,7 +33,14 @@ struct log_serializer_dynamic_config_t {
     /* Enable reading more data than requested to let the cache warmup more quickly esp. on rotational drives */
     bool read_ahead;
 
-    RDB_MAKE_ME_SERIALIZABLE_4(gc_low_ratio, gc_high_ratio, io_batch_factor, read_ahead);
+    /* How newly written data blocks get compressed.  Blocks that are already on disk
+    keep the form they were written in, so this can be changed between runs.  Set
+    from `--block-compression` for table files; see `lba_entry_t` for why it
+    defaults to off. */
+    block_codec_t block_codec;
+
+    RDB_MAKE_ME_SERIALIZABLE_5(gc_low_ratio, gc_high_ratio, io_batch_factor, read_ahead,
+                               block_codec);
 };
 
 /* This is equivalent to log_serializer_static_config_t below, but is an on-disk
@@ -11,6 +11,7 @@
 #include "arch/runtime/coroutines.hpp"
 #include "concurrency/mutex.hpp"
 #include "perfmon/perfmon.hpp"
+#include "serializer/log/block_compression.hpp"
 #include "serializer/log/log_serializer.hpp"
 #include "stl_utils.hpp"
 
@@ -25,6 +26,9 @@ private:
     struct block_info_t {
         uint32_t relative_offset;
         block_size_t block_size;
+        // The space the block takes up in the extent.  Less than block_size if the
+        // block is stored compressed.
+        block_size_t disk_block_size;
         bool token_referenced;
         bool index_referenced;
     };
@@ -90,17 +94,24 @@ public:
         return block_infos.empty()
             ? 0
             : block_infos.back().relative_offset
-            + aligned_value(block_infos.back().block_size);
+            + aligned_value(block_infos.back().disk_block_size);
     }
 
-    // Returns the ostensible size of the block_index'th block.  Note that
-    // block_boundaries[i] + block_size(i) <= block_boundaries[i + 1].
+    // Returns the ostensible size of the block_index'th block.
     block_size_t block_size(unsigned int block_index) const {
         guarantee(state != state_reconstructing);
         guarantee(block_index < block_infos.size());
         return block_infos[block_index].block_size;
     }
 
+    // Returns the size of the block_index'th block on disk.  Note that
+    // block_boundaries[i] + disk_block_size(i) <= block_boundaries[i + 1].
+    block_size_t disk_block_size(unsigned int block_index) const {
+        guarantee(state != state_reconstructing);
+        guarantee(block_index < block_infos.size());
+        return block_infos[block_index].disk_block_size;
+    }
+
     // Returns block_boundaries()[block_index].
     uint32_t relative_offset(unsigned int block_index) const {
         guarantee(state != state_reconstructing);
@@ -120,22 +131,24 @@ public:
     }
 
     bool new_offset(block_size_t block_size,
+                    block_size_t disk_block_size,
                     uint32_t *relative_offset_out,
                     unsigned int *block_index_out) {
         // Returns true if there's enough room at the end of the extent for the new
         // block.
         guarantee(state == state_active);
-        guarantee(block_size.ser_value() <= parent->static_config->extent_size());
+        guarantee(disk_block_size.ser_value() <= parent->static_config->extent_size());
 
         uint32_t offset = back_relative_offset();
         guarantee(offset <= parent->static_config->extent_size());
 
-        if (offset > parent->static_config->extent_size() - block_size.ser_value()) {
+        if (offset > parent->static_config->extent_size() - disk_block_size.ser_value()) {
             return false;
         } else {
             *relative_offset_out = offset;
             *block_index_out = block_infos.size();
-            block_infos.push_back(block_info_t{offset, block_size, false, false});
+            block_infos.push_back(block_info_t{offset, block_size, disk_block_size,
+                                               false, false});
             update_stats(NULL, &block_infos.back());
             return true;
         }
@@ -188,7 +201,7 @@ public:
         uint32_t b = 0;
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
             if (it->token_referenced) {
-                b += aligned_value(it->block_size);
+                b += aligned_value(it->disk_block_size);
             }
         }
         return b;
@@ -202,22 +215,26 @@ public:
         return std::lower_bound(block_infos.begin(), block_infos.end(), relative_offset, &gc_entry_t::info_less);
     }
 
-    void mark_live_indexwise_with_offset(int64_t offset, block_size_t block_size) {
+    void mark_live_indexwise_with_offset(int64_t offset, block_size_t block_size,
+                                         block_size_t disk_block_size) {
         guarantee(offset >= extent_ref.offset() && offset < extent_ref.offset() + UINT32_MAX);
 
         uint32_t relative_offset = offset - extent_ref.offset();
 
         auto it = find_lower_bound_iter(relative_offset);
         if (it == block_infos.end()) {
-            block_infos.push_back(block_info_t{relative_offset, block_size, false, true});
+            block_infos.push_back(block_info_t{relative_offset, block_size,
+                                               disk_block_size, false, true});
             update_stats(NULL, &block_infos.back());
         } else if (it->relative_offset > relative_offset) {
-            guarantee(it->relative_offset >= relative_offset + aligned_value(block_size));
-            auto new_block = block_infos.insert(it, block_info_t{relative_offset, block_size, false, true});
+            guarantee(it->relative_offset >= relative_offset + aligned_value(disk_block_size));
+            auto new_block = block_infos.insert(it, block_info_t{relative_offset, block_size,
+                                                                 disk_block_size, false, true});
             update_stats(NULL, &*new_block);
         } else {
             guarantee(it->relative_offset == relative_offset);
             guarantee(it->block_size == block_size);
+            guarantee(it->disk_block_size == disk_block_size);
             const block_info_t old_info = *it;
             it->index_referenced = true;
             update_stats(&old_info, &*it);
@@ -241,7 +258,7 @@ public:
         uint32_t b = 0;
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
             if (it->index_referenced) {
-                b += aligned_value(it->block_size);
+                b += aligned_value(it->disk_block_size);
             }
         }
         return b;
@@ -258,7 +275,7 @@ public:
         for (auto it = block_infos.begin(); it != block_infos.end(); ++it) {
             ret += strprintf("%s[%" PRIi64 "..+%" PRIu32 ") %c%c",
                              it == block_infos.begin() ? "" : separator,
-                             offset + it->relative_offset, it->block_size.ser_value(),
+                             offset + it->relative_offset, it->disk_block_size.ser_value(),
                              it->token_referenced ? 'T' : ' ',
                              it->index_referenced ? 'I' : ' ');
         }
@@ -277,7 +294,7 @@ private:
         uint32_t b = parent->static_config->extent_size();
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
             if (it->token_referenced || it->index_referenced) {
-                b -= aligned_value(it->block_size);
+                b -= aligned_value(it->disk_block_size);
             }
         }
         return b;
@@ -301,14 +318,14 @@ private:
             if (old_block->token_referenced || old_block->index_referenced) {
                 // Block is live
                 num_live_blocks_stat -= 1;
-                garbage_bytes_stat += aligned_value(old_block->block_size);
+                garbage_bytes_stat += aligned_value(old_block->disk_block_size);
             }
         }
         // Apply new_block
         if (new_block->token_referenced || new_block->index_referenced) {
             // Block is live
             num_live_blocks_stat += 1;
-            garbage_bytes_stat -= aligned_value(new_block->block_size);
+            garbage_bytes_stat -= aligned_value(new_block->disk_block_size);
         }
     }
     
@@ -407,7 +424,8 @@ void data_block_manager_t::start_reconstruct() {
 // gc_entry_t in the entries table.  (This is used when we start up, when
 // everything is presumed to be garbage, until we mark it as
 // non-garbage.)
-void data_block_manager_t::mark_live(int64_t offset, block_size_t ser_block_size) {
+void data_block_manager_t::mark_live(int64_t offset, block_size_t ser_block_size,
+                                     block_size_t disk_block_size) {
     uint64_t extent_id = static_config->extent_index(offset);
 
     if (entries.get(extent_id) == NULL) {
@@ -418,7 +436,7 @@ void data_block_manager_t::mark_live(int64_t offset, block_size_t ser_block_size
     }
 
     gc_entry_t *entry = entries.get(extent_id);
-    entry->mark_live_indexwise_with_offset(offset, ser_block_size);
+    entry->mark_live_indexwise_with_offset(offset, ser_block_size, disk_block_size);
 }
 
 void data_block_manager_t::end_reconstruct() {
@@ -564,6 +582,19 @@ void read_ahead_offset_and_size(int64_t off_in,
     *size_out = end_offset - offset;
 }
 
+// Copies a block that was read from disk into buf_out, decompressing it if it's
+// stored compressed.
+void unpack_disk_block(const void *disk_buf, block_size_t block_size,
+                       block_size_t disk_block_size, void *buf_out) {
+    if (disk_block_size == block_size) {
+        memcpy(buf_out, disk_buf, block_size.ser_value());
+    } else {
+        decompress_block(static_cast<const ser_buffer_t *>(disk_buf),
+                         disk_block_size, block_size,
+                         static_cast<ser_buffer_t *>(buf_out));
+    }
+}
+
 class dbm_read_ahead_t {
 public:
     static std::vector<uint32_t> get_boundaries(data_block_manager_t *parent,
@@ -577,7 +608,8 @@ public:
 
     static void perform_read_ahead(data_block_manager_t *const parent,
                                    const int64_t off_in,
-                                   const uint32_t ser_block_size_in,
+                                   const block_size_t block_size_in,
+                                   const block_size_t disk_block_size_in,
                                    void *const buf_out,
                                    file_account_t *const io_account) {
         const std::vector<uint32_t> boundaries = get_boundaries(parent, off_in);
@@ -587,7 +619,7 @@ public:
 
         // Finish initialization.
         read_ahead_offset_and_size(off_in,
-                                   ser_block_size_in,
+                                   disk_block_size_in.ser_value(),
                                    parent->static_config->extent_size(),
                                    boundaries,
                                    &read_ahead_offset,
@@ -623,7 +655,8 @@ public:
             if (current_offset == off_in) {
                 guarantee(!handled_required_block);
 
-                memcpy(buf_out, current_buf, ser_block_size_in);
+                unpack_disk_block(current_buf, block_size_in, disk_block_size_in,
+                                  buf_out);
                 handled_required_block = true;
             } else {
                 const block_id_t block_id
@@ -639,13 +672,19 @@ public:
                     continue;
                 }
 
+                const block_size_t block_size
+                    = block_size_t::unsafe_make(info.ser_block_size);
+                const block_size_t disk_block_size
+                    = block_size_t::unsafe_make(info.disk_block_size);
+                guarantee(info.disk_block_size <= *(lower_it + 1) - *lower_it);
+
                 scoped_malloc_t<ser_buffer_t> data = parent->serializer->malloc();
-                memcpy(data.get(), current_buf, info.ser_block_size);
-                guarantee(info.ser_block_size <= *(lower_it + 1) - *lower_it);
+                unpack_disk_block(current_buf, block_size, disk_block_size, data.get());
 
                 counted_t<ls_block_token_pointee_t> ls_token
                     = parent->serializer->generate_block_token(current_offset,
-                                                               block_size_t::unsafe_make(info.ser_block_size));
+                                                               block_size,
+                                                               disk_block_size);
 
                 counted_t<standard_block_token_t> token
                     = to_standard_block_token(block_id, ls_token);
@@ -673,27 +712,31 @@ bool data_block_manager_t::should_perform_read_ahead(int64_t offset) {
     return !entry->was_written && serializer->should_perform_read_ahead();
 }
 
-void data_block_manager_t::read(int64_t off_in, uint32_t ser_block_size_in,
+void data_block_manager_t::read(int64_t off_in, block_size_t block_size,
+                                block_size_t disk_block_size,
                                 void *buf_out, file_account_t *io_account) {
     guarantee(state == state_ready);
     if (should_perform_read_ahead(off_in)) {
-        dbm_read_ahead_t::perform_read_ahead(this, off_in, ser_block_size_in,
+        dbm_read_ahead_t::perform_read_ahead(this, off_in, block_size, disk_block_size,
                                              buf_out, io_account);
     } else {
-        if (divides(DEVICE_BLOCK_SIZE, reinterpret_cast<intptr_t>(buf_out)) &&
+        const uint32_t disk_size = disk_block_size.ser_value();
+        if (disk_block_size == block_size &&
+            divides(DEVICE_BLOCK_SIZE, reinterpret_cast<intptr_t>(buf_out)) &&
             divides(DEVICE_BLOCK_SIZE, off_in) &&
-            divides(DEVICE_BLOCK_SIZE, ser_block_size_in)) {
-            co_read(dbfile, off_in, ser_block_size_in, buf_out, io_account);
+            divides(DEVICE_BLOCK_SIZE, disk_size)) {
+            co_read(dbfile, off_in, disk_size, buf_out, io_account);
         } else {
             int64_t floor_off_in = floor_aligned(off_in, DEVICE_BLOCK_SIZE);
-            int64_t ceil_off_end = ceil_aligned(off_in + ser_block_size_in,
+            int64_t ceil_off_end = ceil_aligned(off_in + disk_size,
                                                 DEVICE_BLOCK_SIZE);
             scoped_malloc_t<char> buf(malloc_aligned(ceil_off_end - floor_off_in,
                                                      DEVICE_BLOCK_SIZE));
             co_read(dbfile, floor_off_in, ceil_off_end - floor_off_in,
                     buf.get(), io_account);
 
-            memcpy(buf_out, buf.get() + (off_in - floor_off_in), ser_block_size_in);
+            unpack_disk_block(buf.get() + (off_in - floor_off_in),
+                              block_size, disk_block_size, buf_out);
         }
     }
 }
@@ -702,6 +745,36 @@ std::vector<counted_t<ls_block_token_pointee_t> >
 data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
                                   file_account_t *io_account,
                                   iocallback_t *cb) {
+    std::vector<disk_write_t> disk_writes;
+    disk_writes.reserve(writes.size());
+    std::vector<scoped_malloc_t<ser_buffer_t> > compressed_bufs;
+
+    for (auto it = writes.begin(); it != writes.end(); ++it) {
+        it->buf->ser_header.block_id = it->block_id;
+
+        scoped_malloc_t<ser_buffer_t> compressed_buf;
+        block_size_t compressed_size = block_size_t::undefined();
+        if (dynamic_config->block_codec != block_codec_t::none
+            && compress_block(dynamic_config->block_codec, it->buf, it->block_size,
+                              &compressed_buf, &compressed_size)) {
+            disk_writes.push_back(disk_write_t(compressed_buf.get(), it->block_size,
+                                               compressed_size));
+            compressed_bufs.push_back(std::move(compressed_buf));
+        } else {
+            disk_writes.push_back(disk_write_t(it->buf, it->block_size,
+                                               it->block_size));
+        }
+    }
+
+    return many_disk_writes(disk_writes, std::move(compressed_bufs), io_account, cb);
+}
+
+std::vector<counted_t<ls_block_token_pointee_t> >
+data_block_manager_t::many_disk_writes(
+        const std::vector<disk_write_t> &writes,
+        std::vector<scoped_malloc_t<ser_buffer_t> > &&bufs_to_free,
+        file_account_t *io_account,
+        iocallback_t *cb) {
     // Either we're ready to write, or we're shutting down and just finished reading
     // blocks for gc and called do_write.
     guarantee(state == state_ready ||
@@ -712,10 +785,6 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
     std::vector<std::vector<counted_t<ls_block_token_pointee_t> > > token_groups
         = gimme_some_new_offsets(writes);
 
-    for (auto it = writes.begin(); it != writes.end(); ++it) {
-        it->buf->ser_header.block_id = it->block_id;
-    }
-
     struct intermediate_cb_t : public iocallback_t {
         virtual void on_io_complete() {
             --ops_remaining;
@@ -728,9 +797,11 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         size_t ops_remaining;
         iocallback_t *cb;
+        std::vector<scoped_malloc_t<ser_buffer_t> > bufs_to_free;
     };
 
     intermediate_cb_t *const intermediate_cb = new intermediate_cb_t;
+    intermediate_cb->bufs_to_free = std::move(bufs_to_free);
     // We add 1 for degenerate case where token_groups is empty -- we call
     // intermediate_cb->on_io_complete later.
     intermediate_cb->ops_remaining = token_groups.size() + 1;
@@ -741,7 +812,7 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         const int64_t front_offset = token_groups[i].front()->offset();
         const int64_t back_offset = token_groups[i].back()->offset()
-            + gc_entry_t::aligned_value(token_groups[i].back()->block_size());
+            + gc_entry_t::aligned_value(token_groups[i].back()->disk_block_size());
 
         guarantee(divides(DEVICE_BLOCK_SIZE, front_offset));
 
@@ -753,13 +824,13 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         for (size_t j = 0; j < token_groups[i].size(); ++j) {
             const int64_t j_offset = token_groups[i][j]->offset();
-            const block_size_t j_block_size = token_groups[i][j]->block_size();
+            const block_size_t j_disk_block_size = token_groups[i][j]->disk_block_size();
             guarantee(j_offset == last_written_offset);
-            const size_t j_aligned_size = gc_entry_t::aligned_value(j_block_size);
+            const size_t j_aligned_size = gc_entry_t::aligned_value(j_disk_block_size);
 
             // The behavior of gimme_some_new_offsets is supposed to retain order, so
             // we expect writes[write_number] to have the currently-relevant write.
-            guarantee(writes[write_number].block_size == j_block_size);
+            guarantee(writes[write_number].disk_block_size == j_disk_block_size);
 
             iovecs[j].iov_base = writes[write_number].buf;
             iovecs[j].iov_len = j_aligned_size;
@@ -869,7 +940,7 @@ void data_block_manager_t::mark_garbage(int64_t offset, extent_transaction_t *tx
     // Add to old garbage count if necessary (works because of the
     // !entry->block_is_garbage(block_index) assertion above).
     if (entry->state == gc_entry_t::state_old && entry->block_is_garbage(block_index)) {
-        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->block_size(block_index));
+        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->disk_block_size(block_index));
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -899,7 +970,7 @@ void data_block_manager_t::mark_garbage_tokenwise_with_offset(int64_t offset) {
     // Add to old garbage count if necessary (works because of the
     // !entry->block_is_garbage(block_index) assertion above).
     if (entry->state == gc_entry_t::state_old && entry->block_is_garbage(block_index)) {
-        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->block_size(block_index));
+        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->disk_block_size(block_index));
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -943,20 +1014,25 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t *writes, size_t num
             // Step 1: Write buffers to disk and assemble index operations
             ASSERT_NO_CORO_WAITING;
 
-            std::vector<buf_write_info_t> the_writes;
+            // The blocks get moved in their on-disk form, so that compressed
+            // blocks don't get decompressed and compressed again.
+            std::vector<disk_write_t> the_writes;
             the_writes.reserve(num_writes);
             for (size_t i = 0; i < num_writes; ++i) {
                 old_block_tokens.push_back(parent->serializer->generate_block_token(writes[i].old_offset,
-                                                                                    writes[i].block_size));
+                                                                                    writes[i].block_size,
+                                                                                    writes[i].disk_block_size));
 
-                the_writes.push_back(buf_write_info_t(writes[i].buf,
-                                                      writes[i].block_size,
-                                                      writes[i].buf->ser_header.block_id));
+                the_writes.push_back(disk_write_t(writes[i].buf,
+                                                  writes[i].block_size,
+                                                  writes[i].disk_block_size));
             }
 
             new_block_tokens
-                = parent->many_writes(the_writes, parent->choose_gc_io_account(),
-                                      &block_write_cond);
+                = parent->many_disk_writes(the_writes,
+                                           std::vector<scoped_malloc_t<ser_buffer_t> >(),
+                                           parent->choose_gc_io_account(),
+                                           &block_write_cond);
 
             guarantee(new_block_tokens.size() == num_writes);
         }
@@ -1103,7 +1179,7 @@ void data_block_manager_t::run_gc() {
 
                         const uint32_t end
                             = gc_state.current_entry->relative_offset(i)
-                            + gc_entry_t::aligned_value(gc_state.current_entry->block_size(i));
+                            + gc_entry_t::aligned_value(gc_state.current_entry->disk_block_size(i));
 
                         if (beg <= current_interval_end) {
                             current_interval_end = end;
@@ -1174,7 +1250,8 @@ void data_block_manager_t::run_gc() {
                         + gc_state.current_entry->relative_offset(i);
 
                     gc_writes.push_back(gc_write_t(block, block_offset,
-                                                   gc_state.current_entry->block_size(i)));
+                                                   gc_state.current_entry->block_size(i),
+                                                   gc_state.current_entry->disk_block_size(i)));
                 }
 
                 guarantee(gc_writes.size() == num_writes);
@@ -1286,7 +1363,7 @@ void data_block_manager_t::actually_shutdown() {
 }
 
 std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes) {
+data_block_manager_t::gimme_some_new_offsets(const std::vector<disk_write_t> &writes) {
     ASSERT_NO_CORO_WAITING;
 
     // Start a new extent if necessary.
@@ -1304,7 +1381,7 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
     for (auto it = writes.begin(); it != writes.end(); ++it) {
         uint32_t relative_offset = valgrind_undefined<uint32_t>(UINT32_MAX);
         unsigned int block_index = valgrind_undefined<unsigned int>(UINT_MAX);
-        if (!active_extent->new_offset(it->block_size,
+        if (!active_extent->new_offset(it->block_size, it->disk_block_size,
                                        &relative_offset, &block_index)) {
             // Move the active_extent gc_entry_t to the young extent queue (if it's
             // not already empty), and make a new gc_entry_t.
@@ -1321,6 +1398,7 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
 
             ++stats->pm_serializer_data_extents_allocated;
             const bool succeeded = active_extent->new_offset(it->block_size,
+                                                             it->disk_block_size,
                                                              &relative_offset,
                                                              &block_index);
             guarantee(succeeded);
@@ -1336,7 +1414,8 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
         active_extent->was_written = true;
         active_extent->mark_live_tokenwise(block_index);
 
-        tokens.push_back(serializer->generate_block_token(offset, it->block_size));
+        tokens.push_back(serializer->generate_block_token(offset, it->block_size,
+                                                          it->disk_block_size));
     }
 
     if (!tokens.empty()) {
@@ -37,10 +37,23 @@ private:
         ser_buffer_t *buf;
         int64_t old_offset;
         block_size_t block_size;
+        block_size_t disk_block_size;
         gc_write_t(ser_buffer_t *b, int64_t _old_offset,
-                   block_size_t _block_size)
+                   block_size_t _block_size, block_size_t _disk_block_size)
             : buf(b), old_offset(_old_offset),
-              block_size(_block_size) { }
+              block_size(_block_size), disk_block_size(_disk_block_size) { }
+    };
+
+    // A block in the form it gets written to disk: `buf` holds `disk_block_size`
+    // bytes, which is less than `block_size` if the block is compressed.
+    struct disk_write_t {
+        ser_buffer_t *buf;
+        block_size_t block_size;
+        block_size_t disk_block_size;
+        disk_write_t(ser_buffer_t *b, block_size_t _block_size,
+                     block_size_t _disk_block_size)
+            : buf(b), block_size(_block_size),
+              disk_block_size(_disk_block_size) { }
     };
 
     struct gc_writer_t {
@@ -64,7 +77,9 @@ public:
     static void prepare_initial_metablock(data_block_manager::metablock_mixin_t *mb);
     void start_existing(file_t *dbfile, data_block_manager::metablock_mixin_t *last_metablock);
 
-    void read(int64_t off_in, uint32_t ser_block_size,
+    // Reads the block at off_in into buf_out, decompressing it if disk_block_size
+    // says it's stored compressed.
+    void read(int64_t off_in, block_size_t block_size, block_size_t disk_block_size,
               void *buf_out, file_account_t *io_account);
 
     /* exposed gc api */
@@ -73,7 +88,8 @@ public:
 
     /* r{start,end}_reconstruct functions for safety */
     void start_reconstruct();
-    void mark_live(int64_t offset, block_size_t block_size);
+    void mark_live(int64_t offset, block_size_t block_size,
+                   block_size_t disk_block_size);
     void end_reconstruct();
 
     /* We must make sure that blocks which have tokens pointing to them don't
@@ -97,16 +113,24 @@ public:
     // ratio of garbage to blocks in the system
     double garbage_ratio() const;
 
+    // Compresses the blocks if dynamic_config->block_codec says so.
     std::vector<counted_t<ls_block_token_pointee_t> >
     many_writes(const std::vector<buf_write_info_t> &writes,
                 file_account_t *io_account,
                 iocallback_t *cb);
 
-    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-    gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes);
+private:
+    // Writes blocks that are already in their on-disk form.  The buffers in
+    // `bufs_to_free` get freed once the writes are complete.
+    std::vector<counted_t<ls_block_token_pointee_t> >
+    many_disk_writes(const std::vector<disk_write_t> &writes,
+                     std::vector<scoped_malloc_t<ser_buffer_t> > &&bufs_to_free,
+                     file_account_t *io_account,
+                     iocallback_t *cb);
 
+    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
+    gimme_some_new_offsets(const std::vector<disk_write_t> &writes);
 
-private:
     void actually_shutdown();
 
     file_account_t *choose_gc_io_account();
@@ -64,35 +64,49 @@ struct lba_entry_t {
 
     uint32_t ser_block_size;
 
-    // TODO: Remove the need for these fields (or this zero field).  Remove the
-    // requirement that lba_entry_t be a divisor of DEVICE_BLOCK_SIZE.  When doing
-    // so, be sure to make lba entries backwards compatiblizable for now.  (We could
-    // in the future use this value being non-zero to mean the lba entry is a
-    // new-style entry.)
-    uint32_t zero2;
+    // The number of bytes the block takes up on disk, if it's stored compressed (see
+    // block_compression.hpp), or zero if it's stored verbatim.  This used to be an
+    // always-zero padding field, so old entries read as uncompressed blocks and
+    // the file format version didn't change.  The catch is that versions from
+    // before block compression ignore the field: they would read a compressed
+    // block as if it were verbatim.  That's why compression is off unless the
+    // server is started with `--block-compression`.  Turning it on is one-way for
+    // a file: the GC moves blocks in their on-disk form, so blocks that were
+    // written compressed stay compressed, and the file can't go back to an older
+    // version.
+    uint32_t compressed_ser_block_size;
 
     repli_timestamp_t recency;
     // An offset into the file, with is_delete set appropriately.
     flagged_off64_t offset;
 
     static lba_entry_t make(block_id_t block_id, repli_timestamp_t recency,
-                            flagged_off64_t offset, uint32_t ser_block_size) {
+                            flagged_off64_t offset, uint32_t ser_block_size,
+                            uint32_t disk_block_size) {
         guarantee(ser_block_size != 0 || !offset.has_value());
+        guarantee(disk_block_size <= ser_block_size);
         lba_entry_t entry;
         entry.block_id = block_id;
         entry.ser_block_size = ser_block_size;
-        entry.zero2 = 0;
+        entry.compressed_ser_block_size
+            = disk_block_size == ser_block_size ? 0 : disk_block_size;
         entry.recency = recency;
         entry.offset = offset;
         return entry;
     }
 
+    uint32_t disk_block_size() const {
+        return compressed_ser_block_size == 0
+            ? ser_block_size
+            : compressed_ser_block_size;
+    }
+
     static bool is_padding(const lba_entry_t* entry) {
         return entry->block_id == PADDING_BLOCK_ID  && entry->offset.is_padding();
     }
 
     static lba_entry_t make_padding_entry() {
-        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0);
+        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0, 0);
     }
 } __attribute__((__packed__));
 
@@ -0,0 +1,112 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <fcntl.h>
+#include <string.h>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/io/disk/aio.hpp"
+#include "arch/io/io_utils.hpp"
+#include "arch/runtime/thread_pool.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/queue/unlimited_fifo.hpp"
+#include "containers/scoped.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+/* Runs actions through an `aio_diskmgr_t` one at a time. */
+class aio_test_driver_t {
+public:
+    typedef aio_diskmgr_t::action_t action_t;
+
+    explicit aio_test_driver_t(kernel_io_interface_t interface) : current(NULL) {
+        diskmgr.init(aio_diskmgr_t::create_with_interface(
+            &linux_thread_pool_t::get_thread()->queue, &queue, 8, interface));
+        if (diskmgr.has()) {
+            diskmgr->done_fun = boost::bind(&aio_test_driver_t::on_done, this, _1);
+        }
+    }
+
+    bool is_available() const { return diskmgr.has(); }
+
+    void run(action_t *action) {
+        cond_t done;
+        current = &done;
+        queue.push(action);
+        done.wait_lazily_unordered();
+        current = NULL;
+    }
+
+private:
+    void on_done(action_t *) {
+        guarantee(current != NULL);
+        current->pulse();
+    }
+
+    unlimited_fifo_queue_t<action_t *> queue;
+    scoped_ptr_t<aio_diskmgr_t> diskmgr;
+    cond_t *current;
+};
+
+void run_aio_diskmgr_test(kernel_io_interface_t interface) {
+    aio_test_driver_t driver(interface);
+    if (!driver.is_available()) {
+        // The kernel or a seccomp filter doesn't allow this interface.
+        return;
+    }
+
+    temp_file_t temp_file;
+    scoped_fd_t fd(::open(temp_file.name().permanent_path().c_str(),
+                          O_RDWR | O_CREAT, 0644));
+    guarantee_err(fd.get() != INVALID_FD, "Couldn't open the test file");
+#ifdef __linux__
+    // Native AIO is only asynchronous with direct I/O.  Some filesystems (like
+    // tmpfs) don't support it, in which case we test with buffered I/O.
+    UNUSED int fcntl_res = fcntl(fd.get(), F_SETFL, O_DIRECT);
+#endif
+
+    const size_t block_size = 4 * DEVICE_BLOCK_SIZE;
+    scoped_malloc_t<char> first(malloc_aligned(block_size, DEVICE_BLOCK_SIZE));
+    scoped_malloc_t<char> second(malloc_aligned(block_size, DEVICE_BLOCK_SIZE));
+    scoped_malloc_t<char> read_back(malloc_aligned(block_size, DEVICE_BLOCK_SIZE));
+    memset(first.get(), 'a', block_size);
+    memset(second.get(), 'b', block_size);
+
+    // A write wrapped in datasyncs, then a plain one.
+    aio_test_driver_t::action_t write1;
+    write1.make_write(fd.get(), first.get(), block_size, 0, true);
+    driver.run(&write1);
+    EXPECT_TRUE(write1.get_succeeded());
+
+    aio_test_driver_t::action_t write2;
+    write2.make_write(fd.get(), second.get(), block_size, block_size, false);
+    driver.run(&write2);
+    EXPECT_TRUE(write2.get_succeeded());
+
+    aio_test_driver_t::action_t read1;
+    read1.make_read(fd.get(), read_back.get(), block_size, 0);
+    driver.run(&read1);
+    EXPECT_TRUE(read1.get_succeeded());
+    EXPECT_EQ(0, memcmp(first.get(), read_back.get(), block_size));
+
+    aio_test_driver_t::action_t read2;
+    read2.make_read(fd.get(), read_back.get(), block_size, block_size);
+    driver.run(&read2);
+    EXPECT_TRUE(read2.get_succeeded());
+    EXPECT_EQ(0, memcmp(second.get(), read_back.get(), block_size));
+}
+
+TEST(AioDiskmgr, IoUring) {
+    run_in_thread_pool(boost::bind(&run_aio_diskmgr_test,
+                                   kernel_io_interface_t::io_uring));
+}
+
+TEST(AioDiskmgr, NativeAio) {
+    run_in_thread_pool(boost::bind(&run_aio_diskmgr_test,
+                                   kernel_io_interface_t::native_aio));
+}
+
+}  // namespace unittest
@@ -407,6 +407,7 @@ void run_blob_test() {
 
     cache_t cache(&log_serializer,
                   alt_cache_config_t(),
+                  NULL,
                   &get_global_perfmon_collection());
 
     run_tests(&cache);
@@ -0,0 +1,156 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <functional>
+#include <vector>
+
+#include "unittest/gtest.hpp"
+
+#include "arch/io/disk.hpp"
+#include "btree/bulk_load.hpp"
+#include "btree/operations.hpp"
+#include "btree/slice.hpp"
+#include "buffer_cache/alt/alt.hpp"
+#include "buffer_cache/alt/alt_serialize_onto_blob.hpp"
+#include "buffer_cache/alt/blob.hpp"
+#include "rdb_protocol/btree.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/lazy_json.hpp"
+#include "serializer/config.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+store_key_t bulk_load_test_key(int i) {
+    return store_key_t(strprintf("%08d", i));
+}
+
+int64_t get_population(txn_t *txn, superblock_t *superblock) {
+    buf_lock_t stat_block(buf_parent_t(txn), superblock->get_stat_block_id(),
+                          access_t::read);
+    buf_read_t read(&stat_block);
+    return static_cast<const btree_statblock_t *>(read.get_data_read())->population;
+}
+
+void run_bulk_load_test(int num_keys) {
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    cache_t cache(&serializer, alt_cache_config_t(), NULL,
+                  &get_global_perfmon_collection());
+    cache_conn_t cache_conn(&cache);
+    btree_slice_t slice(&cache, &get_global_perfmon_collection(), "bulk_load");
+
+    {
+        txn_t txn(&cache_conn, write_durability_t::HARD, repli_timestamp_t::invalid, 1);
+        buf_lock_t superblock(&txn, SUPERBLOCK_ID, alt_create_t::create);
+        buf_write_t sb_write(&superblock);
+        btree_slice_t::init_superblock(&superblock,
+                                       std::vector<char>(), std::vector<char>());
+    }
+
+    {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn(&cache_conn, write_access_t::write, 1,
+                                     repli_timestamp_t::distant_past,
+                                     write_durability_t::SOFT,
+                                     &superblock, &txn);
+
+        value_sizer_t<rdb_value_t> sizer(cache.get_block_size());
+        btree_bulk_loader_t loader(&sizer, superblock.get(),
+                                   repli_timestamp_t::distant_past, &slice.stats);
+        for (int i = 0; i < num_keys; ++i) {
+            scoped_malloc_t<rdb_value_t> value(blob::btree_maxreflen);
+            memset(value.get(), 0, blob::btree_maxreflen);
+            {
+                blob_t blob(cache.get_block_size(), value->value_ref(),
+                            blob::btree_maxreflen);
+                write_message_t wm;
+                ql::serialize_with_field_index(
+                    &wm, make_counted<ql::datum_t>(static_cast<double>(i)));
+                write_onto_blob(loader.expose_leaf(), &blob, wm);
+            }
+            loader.add(bulk_load_test_key(i).btree_key(), value.get());
+        }
+        loader.finish();
+        ASSERT_EQ(num_keys, loader.num_pairs());
+        ASSERT_EQ(num_keys == 0,
+                  superblock->get_root_block_id() == NULL_BLOCK_ID);
+    }
+
+    if (num_keys == 0) {
+        return;
+    }
+
+    // The loaded tree must take regular writes, too.
+    {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn(&cache_conn, write_access_t::write, 1,
+                                     repli_timestamp_t::distant_past,
+                                     write_durability_t::SOFT,
+                                     &superblock, &txn);
+        point_write_response_t response;
+        rdb_modification_info_t mod_info;
+        rdb_set(store_key_t(strprintf("%08da", num_keys / 2)),
+                make_counted<ql::datum_t>(-1.0), ql::row_format_t::PLAIN, false,
+                &slice,
+                repli_timestamp_t::distant_past, superblock.get(), &response,
+                &mod_info, NULL);
+        ASSERT_EQ(point_write_result_t::STORED, response.result);
+    }
+
+    {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn_for_reading(&cache_conn, CACHE_SNAPSHOTTED_NO,
+                                                 &superblock, &txn);
+        ASSERT_EQ(num_keys + 1, get_population(txn.get(), superblock.get()));
+    }
+
+    // Look every key up, along with one that's missing, in one sorted batch.
+    std::vector<store_key_t> keys;
+    for (int i = 0; i < num_keys; ++i) {
+        keys.push_back(bulk_load_test_key(i));
+    }
+    keys.push_back(store_key_t(strprintf("%08da", num_keys / 2)));
+    keys.push_back(store_key_t(strprintf("%08db", num_keys / 2)));
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_reading(&cache_conn, CACHE_SNAPSHOTTED_NO,
+                                             &superblock, &txn);
+    batched_point_read_response_t response;
+    rdb_get_batch(keys, &slice, superblock.get(), &response, NULL);
+    ASSERT_EQ(static_cast<size_t>(num_keys + 1), response.data.size());
+    for (int i = 0; i < num_keys; ++i) {
+        ASSERT_EQ(i, response.data[bulk_load_test_key(i)]->as_num());
+    }
+    ASSERT_EQ(-1,
+              response.data[store_key_t(strprintf("%08da", num_keys / 2))]->as_num());
+}
+
+TEST(BTreeBulkLoad, Empty) {
+    run_in_thread_pool(std::bind(&run_bulk_load_test, 0));
+}
+
+TEST(BTreeBulkLoad, SingleLeaf) {
+    run_in_thread_pool(std::bind(&run_bulk_load_test, 10));
+}
+
+TEST(BTreeBulkLoad, ManyLevels) {
+    // Enough keys for more than one full internal node above the leaves.
+    run_in_thread_pool(std::bind(&run_bulk_load_test, 100000));
+}
+
+}  // namespace unittest
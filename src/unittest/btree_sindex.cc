@@ -6,6 +6,7 @@
 #include "btree/operations.hpp"
 #include "buffer_cache/alt/alt.hpp"
 #include "buffer_cache/alt/blob.hpp"
+#include "buffer_cache/alt/config.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -28,7 +29,7 @@ void run_sindex_low_level_operations_test() {
         &file_opener,
         &get_global_perfmon_collection());
 
-    cache_t cache(&serializer, alt_cache_config_t(),
+    cache_t cache(&serializer, alt_cache_config_t(), NULL,
                   &get_global_perfmon_collection());
     cache_conn_t cache_conn(&cache);
 
@@ -124,6 +125,8 @@ void run_sindex_btree_store_api_test() {
             &serializer,
             "unit_test_store",
             GIGABYTE,
+            page_cache_config_t(),
+            NULL,
             true,
             &get_global_perfmon_collection(),
             NULL,
@@ -201,7 +204,8 @@ void run_sindex_btree_store_api_test() {
             rdb_modification_info_t mod_info;
 
             store_key_t key("foo");
-            rdb_set(key, data, true, store.get_sindex_slice(id),
+            rdb_set(key, data, ql::row_format_t::PLAIN, true,
+                    store.get_sindex_slice(id),
                     repli_timestamp_t::invalid,
                     sindex_super_block.get(), &response,
                     &mod_info, static_cast<profile::trace_t *>(NULL));
@@ -0,0 +1,124 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "buffer_cache/alt/alt.hpp"
+#include "concurrency/pmap.hpp"
+#include "containers/scoped.hpp"
+#include "perfmon/perfmon.hpp"
+#include "serializer/config.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/mock_file.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+static const int child_recency_test_children = 10;
+
+repli_timestamp_t make_test_timestamp(uint64_t longtime) {
+    repli_timestamp_t ret;
+    ret.longtime = longtime;
+    return ret;
+}
+
+void visit_cache_stats_on_thread(perfmon_t *perfmon, void *data, int thread) {
+    on_thread_t th((threadnum_t(thread)));
+    perfmon->visit_stats(data);
+}
+
+// How many pages the cache registered in `stats` has loaded from the serializer.
+int64_t cache_misses(perfmon_collection_t *stats) {
+    void *data = stats->begin_stats();
+    pmap(get_num_threads(), std::bind(&visit_cache_stats_on_thread,
+                                      stats, data, std::placeholders::_1));
+    scoped_ptr_t<perfmon_result_t> result = stats->end_stats(data);
+    const perfmon_result_t *cache_result
+        = static_cast<const perfmon_result_t *>(result.get())->get_map()->at("cache");
+    const std::string *misses = cache_result->get_map()->at("misses")->get_string();
+    return strtoll(misses->c_str(), NULL, 10);
+}
+
+void write_test_block(buf_lock_t *lock, char fill) {
+    buf_write_t write(lock);
+    memset(write.get_data_write(), fill, lock->cache()->max_block_size().value());
+}
+
+/* `GetChildRecency` checks that `buf_lock_t::get_child_recency` gives each child
+the recency it was last written with, without loading any of them, even though the
+parent is snapshotted (which is how backfills traverse the tree). */
+
+void run_get_child_recency_test() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(
+            &file_opener,
+            standard_serializer_t::static_config_t());
+    // Read-ahead would load the children along with the parent.
+    standard_serializer_t::dynamic_config_t serializer_config;
+    serializer_config.read_ahead = false;
+    standard_serializer_t serializer(
+            serializer_config,
+            &file_opener,
+            &get_global_perfmon_collection());
+
+    block_id_t parent_id;
+    std::vector<block_id_t> child_ids;
+    {
+        perfmon_collection_t stats;
+        cache_t cache(&serializer, alt_cache_config_t(), NULL, &stats);
+        cache_conn_t cache_conn(&cache);
+        {
+            txn_t txn(&cache_conn, write_durability_t::HARD, make_test_timestamp(5),
+                      child_recency_test_children + 1);
+            buf_lock_t parent(buf_parent_t(&txn), alt_create_t::create);
+            write_test_block(&parent, 'p');
+            parent_id = parent.block_id();
+            for (int i = 0; i < child_recency_test_children; ++i) {
+                buf_lock_t child(&parent, alt_create_t::create);
+                write_test_block(&child, 'c');
+                child_ids.push_back(child.block_id());
+            }
+        }
+        {
+            // Only the first child changes after timestamp 5.
+            txn_t txn(&cache_conn, write_durability_t::HARD, make_test_timestamp(10),
+                      1);
+            buf_lock_t parent(buf_parent_t(&txn), parent_id, access_t::write);
+            buf_lock_t child(&parent, child_ids[0], access_t::write);
+            write_test_block(&child, 'd');
+        }
+        // The cache flushes everything to the serializer as it goes away.
+    }
+
+    // A new cache, so that none of the blocks are loaded.
+    perfmon_collection_t stats;
+    cache_t cache(&serializer, alt_cache_config_t(), NULL, &stats);
+    cache_conn_t cache_conn(&cache);
+    txn_t txn(&cache_conn, read_access_t::read);
+    buf_lock_t parent(buf_parent_t(&txn), parent_id, access_t::read);
+    parent.snapshot_subdag();
+    const int64_t misses_before = cache_misses(&stats);
+
+    for (int i = 0; i < child_recency_test_children; ++i) {
+        EXPECT_EQ(make_test_timestamp(i == 0 ? 10 : 5),
+                  buf_lock_t::get_child_recency(buf_parent_t(&parent), child_ids[i]));
+    }
+    EXPECT_EQ(misses_before, cache_misses(&stats));
+
+    // Reading a child does load it, so the counter above would have noticed.
+    {
+        buf_lock_t child(&parent, child_ids[1], access_t::read);
+        buf_read_t read(&child);
+        read.get_data_read();
+    }
+    EXPECT_EQ(misses_before + 1, cache_misses(&stats));
+}
+
+TEST(BufLockTest, GetChildRecency) {
+    unittest::run_in_thread_pool(run_get_child_recency_test);
+}
+
+}  // namespace unittest
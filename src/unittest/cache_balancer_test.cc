@@ -0,0 +1,118 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "buffer_cache/alt/cache_balancer.hpp"
+#include "unittest/gtest.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+class cache_balancer_tester_t {
+public:
+    cache_balancer_tester_t() : infos(2) { }
+
+    // Adds an evicter's stats to the given thread's list, and returns its index
+    // there.
+    size_t add(int thread, uint64_t configured_limit, uint64_t in_memory_size,
+               uint64_t bytes_loaded) {
+        cache_balancer_t::evicter_info_t info;
+        info.evicter = NULL;
+        info.configured_limit = configured_limit;
+        info.in_memory_size = in_memory_size;
+        info.bytes_loaded = bytes_loaded;
+        // collect_from_thread() starts every evicter off at its configured limit.
+        info.new_limit = configured_limit;
+        infos[thread].push_back(info);
+        return infos[thread].size() - 1;
+    }
+
+    void compute_new_limits() {
+        cache_balancer_t::compute_new_limits(&infos);
+    }
+
+    uint64_t new_limit(int thread, size_t index) const {
+        return infos[thread][index].new_limit;
+    }
+
+    uint64_t total_new_limit() const {
+        uint64_t total = 0;
+        for (auto t = infos.begin(); t != infos.end(); ++t) {
+            for (auto it = t->begin(); it != t->end(); ++it) {
+                total += it->new_limit;
+            }
+        }
+        return total;
+    }
+
+private:
+    std::vector<std::vector<cache_balancer_t::evicter_info_t> > infos;
+};
+
+// Every evicter keeps 1/16th of its configured limit.
+static const uint64_t configured_limit = 16 * MEGABYTE;
+static const uint64_t floor_limit = configured_limit / 16;
+
+TEST(CacheBalancer, IdleCachesKeepConfiguredLimits) {
+    cache_balancer_tester_t tester;
+    tester.add(0, configured_limit, 0, 0);
+    tester.add(0, configured_limit, 0, 0);
+    tester.add(1, configured_limit, 0, 0);
+    tester.compute_new_limits();
+
+    EXPECT_EQ(configured_limit, tester.new_limit(0, 0));
+    EXPECT_EQ(configured_limit, tester.new_limit(0, 1));
+    EXPECT_EQ(configured_limit, tester.new_limit(1, 0));
+}
+
+TEST(CacheBalancer, HotCacheGetsIdleCachesMemory) {
+    cache_balancer_tester_t tester;
+    tester.add(0, configured_limit, 0, 0);
+    tester.add(0, configured_limit, 0, 0);
+    tester.add(1, configured_limit, 0, 0);
+    // This one is full and keeps loading blocks from disk.
+    const size_t hot = tester.add(1, configured_limit, configured_limit, 8 * MEGABYTE);
+    tester.compute_new_limits();
+
+    // The idle caches shrink to their floor, and the hot one gets everything else.
+    EXPECT_EQ(floor_limit, tester.new_limit(0, 0));
+    EXPECT_EQ(floor_limit, tester.new_limit(0, 1));
+    EXPECT_EQ(floor_limit, tester.new_limit(1, 0));
+    const uint64_t budget = 4 * configured_limit;
+    EXPECT_LE(tester.total_new_limit(), budget);
+    // Give or take rounding.
+    EXPECT_GE(tester.new_limit(1, hot), budget - 3 * floor_limit - 1);
+}
+
+TEST(CacheBalancer, DemandProportionalShares) {
+    cache_balancer_tester_t tester;
+    // Both want more than the budget; the second wants twice as much above the
+    // floor as the first.
+    const size_t a = tester.add(0, configured_limit, configured_limit,
+                                configured_limit - floor_limit);
+    const size_t b = tester.add(1, configured_limit, configured_limit,
+                                3 * configured_limit - 3 * floor_limit);
+    tester.compute_new_limits();
+
+    EXPECT_LE(tester.total_new_limit(), 2 * configured_limit);
+    const uint64_t a_above_floor = tester.new_limit(0, a) - floor_limit;
+    const uint64_t b_above_floor = tester.new_limit(1, b) - floor_limit;
+    EXPECT_NEAR(2.0 * a_above_floor, b_above_floor, 2.0);
+}
+
+TEST(CacheBalancer, LimitsNeverGoBelowFloor) {
+    cache_balancer_tester_t tester;
+    // Holds a little, but less than its floor.
+    const size_t small = tester.add(0, configured_limit, floor_limit / 4, 0);
+    const size_t idle = tester.add(0, configured_limit, 0, 0);
+    // Wants far more memory than the whole budget.
+    const size_t huge = tester.add(1, configured_limit, configured_limit,
+                                   100 * configured_limit);
+    tester.compute_new_limits();
+
+    EXPECT_EQ(floor_limit, tester.new_limit(0, small));
+    EXPECT_EQ(floor_limit, tester.new_limit(0, idle));
+    EXPECT_GE(tester.new_limit(1, huge), floor_limit);
+    EXPECT_LE(tester.total_new_limit(), 3 * configured_limit);
+}
+
+}  // namespace unittest
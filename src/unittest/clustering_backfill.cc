@@ -2,6 +2,7 @@
 #include "unittest/gtest.hpp"
 #include "clustering/immediate_consistency/branch/backfiller.hpp"
 #include "clustering/immediate_consistency/branch/backfillee.hpp"
+#include "concurrency/pmap.hpp"
 #include "containers/uuid.hpp"
 #include "rpc/semilattice/view/field.hpp"
 #include "unittest/branch_history_manager.hpp"
@@ -166,4 +167,133 @@ TEST(ClusteringBackfill, BackfillTest) {
     unittest::run_in_thread_pool(&run_backfill_test);
 }
 
+/* `BackfillFrame` checks that chunks survive being packed into a frame, whether
+or not the frame gets compressed. */
+
+void check_backfill_frame_round_trip(int num_chunks, const std::string &value,
+                                     backfill_codec_t expected_codec) {
+    backfill_frame_builder_t<dummy_protocol_t> builder;
+    std::vector<dummy_protocol_t::backfill_chunk_t> chunks;
+    for (int i = 0; i < num_chunks; ++i) {
+        dummy_protocol_t::backfill_chunk_t chunk;
+        chunk.key = strprintf("key%d", i);
+        chunk.value = value;
+        chunk.timestamp = state_timestamp_t::zero();
+        chunks.push_back(chunk);
+        builder.add_chunk(chunk);
+    }
+    ASSERT_FALSE(builder.is_full());
+    ASSERT_EQ(num_chunks, builder.get_num_chunks());
+
+    backfill_frame_t<dummy_protocol_t> frame;
+    builder.finish(&frame);
+    EXPECT_TRUE(builder.is_empty());
+    EXPECT_EQ(expected_codec, frame.codec);
+    if (expected_codec == backfill_codec_t::zlib) {
+        EXPECT_LT(frame.data.size(), frame.uncompressed_size);
+    }
+
+    std::vector<dummy_protocol_t::backfill_chunk_t> read_chunks;
+    read_backfill_frame(&frame, &read_chunks);
+    ASSERT_EQ(chunks.size(), read_chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        EXPECT_EQ(chunks[i].key, read_chunks[i].key);
+        EXPECT_EQ(chunks[i].value, read_chunks[i].value);
+        EXPECT_TRUE(chunks[i].timestamp == read_chunks[i].timestamp);
+    }
+}
+
+TEST(ClusteringBackfill, BackfillFrame) {
+    check_backfill_frame_round_trip(5, std::string(1000, 'x'), backfill_codec_t::zlib);
+
+    // Random bytes don't compress, so they get sent as they are.
+    std::string random_value;
+    for (int i = 0; i < 1000; ++i) {
+        random_value.push_back(static_cast<char>(randint(256)));
+    }
+    check_backfill_frame_round_trip(1, random_value, backfill_codec_t::none);
+}
+
+/* `BackfillFrameSender` has many coroutines send chunks at once through a
+semaphore that only has room for a single frame, the way `send_backfill()` does
+when it traverses several sub-ranges in parallel. Every frame must fit into the
+semaphore, or the sender would wait for allocations forever. */
+
+class backfill_frame_receiver_t {
+public:
+    explicit backfill_frame_receiver_t(semaphore_t *_chunk_semaphore)
+        : chunk_semaphore(_chunk_semaphore), num_frames(0), max_frame_chunks(0) { }
+
+    void on_frame(const backfill_frame_t<dummy_protocol_t> &frame) {
+        backfill_frame_t<dummy_protocol_t> copy = frame;
+        std::vector<dummy_protocol_t::backfill_chunk_t> chunks;
+        read_backfill_frame(&copy, &chunks);
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            keys.push_back(chunks[i].key);
+        }
+        ++num_frames;
+        max_frame_chunks = std::max(max_frame_chunks, frame.num_chunks);
+        /* Hand the allocations back later, like the backfillee does once it
+        has applied the chunks. */
+        coro_t::spawn_sometime(boost::bind(&semaphore_t::unlock, chunk_semaphore,
+                                           static_cast<int64_t>(frame.num_chunks)));
+    }
+
+    semaphore_t *chunk_semaphore;
+    std::vector<std::string> keys;
+    int num_frames;
+    int32_t max_frame_chunks;
+};
+
+static const int num_frame_producers = 20;
+static const int chunks_per_frame_producer = 50;
+
+void produce_backfill_chunks(backfill_frame_sender_t<dummy_protocol_t> *sender,
+                             signal_t *interruptor, int producer) {
+    for (int i = 0; i < chunks_per_frame_producer; ++i) {
+        dummy_protocol_t::backfill_chunk_t chunk;
+        chunk.key = strprintf("%d-%d", producer, i);
+        chunk.value = "value";
+        chunk.timestamp = state_timestamp_t::zero();
+        sender->send_chunk(chunk, interruptor);
+        if (i % 7 == 0) {
+            coro_t::yield();
+        }
+    }
+}
+
+void run_backfill_frame_sender_test() {
+    static_semaphore_t chunk_semaphore(BACKFILL_MAX_CHUNKS_PER_FRAME);
+    backfill_frame_receiver_t receiver(&chunk_semaphore);
+    backfill_frame_sender_t<dummy_protocol_t> sender(
+        &chunk_semaphore,
+        boost::bind(&backfill_frame_receiver_t::on_frame, &receiver, _1));
+
+    cond_t non_interruptor;
+    pmap(num_frame_producers,
+         boost::bind(&produce_backfill_chunks, &sender, &non_interruptor, _1));
+    sender.send_frame(&non_interruptor);
+
+    EXPECT_LE(receiver.max_frame_chunks, BACKFILL_MAX_CHUNKS_PER_FRAME);
+    EXPECT_GE(receiver.num_frames,
+              num_frame_producers * chunks_per_frame_producer / BACKFILL_MAX_CHUNKS_PER_FRAME);
+
+    // Every chunk arrives exactly once, and each producer's chunks arrive in
+    // the order it sent them.
+    ASSERT_EQ(static_cast<size_t>(num_frame_producers * chunks_per_frame_producer),
+              receiver.keys.size());
+    std::vector<int> next_chunk(num_frame_producers, 0);
+    for (size_t i = 0; i < receiver.keys.size(); ++i) {
+        int producer, chunk;
+        ASSERT_EQ(2, sscanf(receiver.keys[i].c_str(), "%d-%d", &producer, &chunk));
+        ASSERT_LT(producer, num_frame_producers);
+        EXPECT_EQ(next_chunk[producer], chunk);
+        next_chunk[producer] = chunk + 1;
+    }
+}
+
+TEST(ClusteringBackfill, BackfillFrameSender) {
+    unittest::run_in_thread_pool(&run_backfill_frame_sender_test);
+}
+
 }   /* namespace unittest */
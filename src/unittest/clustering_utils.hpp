@@ -8,6 +8,7 @@
 
 #include "arch/io/disk.hpp"
 #include "arch/timing.hpp"
+#include "buffer_cache/alt/config.hpp"
 #include "clustering/immediate_consistency/branch/metadata.hpp"
 #include "clustering/immediate_consistency/query/master.hpp"
 #include "clustering/immediate_consistency/query/master_access.hpp"
@@ -51,7 +52,7 @@ public:
     test_store_t(io_backender_t *io_backender, order_source_t *order_source, typename protocol_t::context_t *ctx) :
             serializer(create_and_construct_serializer(&temp_file, io_backender)),
             store(serializer.get(), temp_file.name().permanent_path(), GIGABYTE,
-                    true, &get_global_perfmon_collection(), ctx, io_backender, base_path_t(".")) {
+                    page_cache_config_t(), NULL, true, &get_global_perfmon_collection(), ctx, io_backender, base_path_t(".")) {
         /* Initialize store metadata */
         cond_t non_interruptor;
         object_buffer_t<fifo_enforcer_sink_t::exit_write_t> token;
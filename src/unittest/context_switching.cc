@@ -5,6 +5,7 @@
 
 #include "containers/scoped.hpp"
 #include "unittest/gtest.hpp"
+#include "utils.hpp"
 
 namespace unittest {
 
@@ -89,6 +90,37 @@ TEST(ContextSwitchingTest, SwitchBetweenContexts) {
     original_context = NULL;
 }
 
+#ifndef THREADED_COROUTINES
+static const size_t deep_stack_size = 64 * 1024;
+
+static NOINLINE void touch_deep_stack() {
+    volatile char buffer[deep_stack_size];
+    for (size_t i = 0; i < deep_stack_size; i += 512) {
+        buffer[i] = 1;
+    }
+}
+
+static void use_deep_stack(void) {
+    touch_deep_stack();
+    context_switch(artificial_stack_1_context, original_context);
+}
+
+TEST(ContextSwitchingTest, ReleaseUnusedStackPages) {
+    scoped_ptr_t<coro_context_ref_t> orig_context_local(new coro_context_ref_t);
+    original_context = orig_context_local.get();
+    {
+        coro_stack_t a(&use_deep_stack, 1024*1024);
+        artificial_stack_1_context = &a.context;
+        context_switch(original_context, artificial_stack_1_context);
+
+        // The stack went deep once, but only its top is still in use.
+        EXPECT_GE(a.release_unused_pages(), deep_stack_size);
+        EXPECT_LT(a.release_unused_pages(), deep_stack_size);
+    }
+    original_context = NULL;
+}
+#endif  // THREADED_COROUTINES
+
 __attribute__((noreturn)) static void throw_an_exception() {
     throw std::runtime_error("This is a test exception");
 }
@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 
+#include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/string_stream.hpp"
+#include "containers/buffer_group.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "unittest/gtest.hpp"
 
@@ -62,6 +64,133 @@ TEST(DatumTest, NumericSerialization) {
     test_datum_serialization(make_counted<ql::datum_t>(std::move(vec)));
 }
 
+TEST(DatumTest, ObjectFields) {
+    ql::datum_ptr_t obj(ql::datum_t::R_OBJECT);
+    const char *keys[] = { "b", "d", "a", "c" };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+        ASSERT_FALSE(obj.add(keys[i], make_counted<const ql::datum_t>(
+                                 static_cast<double>(i))));
+    }
+    ASSERT_TRUE(obj.add("a", make_counted<const ql::datum_t>(10.0), ql::NOCLOBBER));
+    ASSERT_EQ(2.0, obj->get("a")->as_num());
+    ASSERT_TRUE(obj.add("a", make_counted<const ql::datum_t>(10.0), ql::CLOBBER));
+    ASSERT_TRUE(obj.delete_field("d"));
+    ASSERT_FALSE(obj.delete_field("d"));
+    counted_t<const ql::datum_t> datum = obj.to_counted();
+
+    // Fields come out sorted by name, like they did from a `std::map`.
+    const ql::datum_object_t &fields = datum->as_object();
+    ASSERT_EQ(3u, fields.size());
+    std::string names;
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        names += it->first.str();
+    }
+    ASSERT_EQ("abc", names);
+    ASSERT_EQ(10.0, datum->get("a")->as_num());
+    ASSERT_EQ(0.0, datum->get("b")->as_num());
+    ASSERT_FALSE(datum->get("d", ql::NOTHROW).has());
+    test_datum_serialization(datum);
+
+    // Objects with the same fields share the copies of the field names.
+    std::map<std::string, counted_t<const ql::datum_t> > map;
+    map["a"] = make_counted<const ql::datum_t>(1.0);
+    counted_t<const ql::datum_t> other
+        = make_counted<const ql::datum_t>(std::move(map));
+    ASSERT_EQ(fields.begin()->first.c_str(),
+              other->as_object().begin()->first.c_str());
+}
+
+
+TEST(DatumTest, FieldIndex) {
+    std::map<std::string, counted_t<const ql::datum_t> > map;
+    for (int i = 0; i < 100; ++i) {
+        map[strprintf("field%d", i)]
+            = make_counted<const ql::datum_t>(std::string(i, 'x'));
+    }
+    counted_t<const ql::datum_t> datum
+        = make_counted<const ql::datum_t>(std::move(map));
+
+    string_stream_t write_stream;
+    write_message_t wm;
+    ql::serialize_with_field_index(&wm, datum);
+    ASSERT_EQ(0, send_write_message(&write_stream, &wm));
+    const std::string serialized = write_stream.str();
+
+    // Split the serialization in two, like a blob that spans several blocks.
+    const_buffer_group_t group;
+    group.add_buffer(serialized.size() / 2, serialized.data());
+    group.add_buffer(serialized.size() - serialized.size() / 2,
+                     serialized.data() + serialized.size() / 2);
+
+    for (int i = 0; i < 100; ++i) {
+        buffer_group_read_stream_t stream(&group);
+        bool has_index;
+        counted_t<const ql::datum_t> field;
+        ASSERT_EQ(archive_result_t::SUCCESS,
+                  ql::deserialize_field(&stream, strprintf("field%d", i),
+                                        &has_index, &field));
+        ASSERT_TRUE(has_index);
+        ASSERT_TRUE(field.has());
+        ASSERT_EQ(std::string(i, 'x'), field->as_str().to_std());
+    }
 
+    {
+        buffer_group_read_stream_t stream(&group);
+        bool has_index;
+        counted_t<const ql::datum_t> field;
+        ASSERT_EQ(archive_result_t::SUCCESS,
+                  ql::deserialize_field(&stream, "field", &has_index, &field));
+        ASSERT_TRUE(has_index);
+        ASSERT_FALSE(field.has());
+    }
+
+    // The whole row still deserializes the regular way.
+    buffer_group_read_stream_t stream(&group);
+    counted_t<const ql::datum_t> deserialized;
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize(&stream, &deserialized));
+    ASSERT_TRUE(stream.entire_stream_consumed());
+    ASSERT_EQ(*datum, *deserialized);
+}
+
+/* `FieldIndexSize` pins down what the field index costs: 4 bytes per field and
+nothing else.  Offsets narrower than that would cap rows at 64KB, and the cost
+only matters for rows with many tiny fields, like the one below. */
+
+size_t serialized_row_size(const counted_t<const ql::datum_t> &datum,
+                           ql::row_format_t format) {
+    write_message_t wm;
+    ql::serialize_row(&wm, datum, format);
+    return wm.size();
+}
+
+TEST(DatumTest, FieldIndexSize) {
+    std::map<std::string, counted_t<const ql::datum_t> > map;
+    const size_t num_fields = 10;
+    for (size_t i = 0; i < num_fields; ++i) {
+        map[strprintf("f%zu", i)] = make_counted<const ql::datum_t>(static_cast<double>(i));
+    }
+    counted_t<const ql::datum_t> datum
+        = make_counted<const ql::datum_t>(std::move(map));
+
+    write_message_t plain;
+    plain << datum;
+    write_message_t indexed;
+    ql::serialize_with_field_index(&indexed, datum);
+    ASSERT_EQ(plain.size() + num_fields * sizeof(uint32_t), indexed.size());
+    ASSERT_EQ(ql::serialized_size(datum), plain.size());
+
+    // Rows are written without the index unless the format asks for it.
+    ASSERT_EQ(plain.size(), serialized_row_size(datum, ql::row_format_t::PLAIN));
+    ASSERT_EQ(indexed.size(),
+              serialized_row_size(datum, ql::row_format_t::FIELD_INDEXED));
+
+    // Values that aren't objects never get an index.
+    counted_t<const ql::datum_t> number = make_counted<const ql::datum_t>(1.0);
+    write_message_t plain_number;
+    plain_number << number;
+    write_message_t indexed_number;
+    ql::serialize_with_field_index(&indexed_number, number);
+    ASSERT_EQ(plain_number.size(), indexed_number.size());
+}
 
 }  // namespace unittest
@@ -66,11 +66,17 @@ TEST(DiskFormatTest, LbaEntryT) {
     ASSERT_TRUE(lba_entry_t::is_padding(&ent));
     flagged_off64_t real = flagged_off64_t::unused();
     real = flagged_off64_t::make(1);
-    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, 1234);
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, 1234, 1234);
     ASSERT_FALSE(lba_entry_t::is_padding(&ent));
+    // Uncompressed blocks are written the way they were before compression existed.
+    EXPECT_EQ(0u, ent.compressed_ser_block_size);
+    EXPECT_EQ(1234u, ent.disk_block_size());
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, 1234, 567);
+    EXPECT_EQ(1234u, ent.ser_block_size);
+    EXPECT_EQ(567u, ent.disk_block_size());
     flagged_off64_t deleteblock = flagged_off64_t::unused();
     deleteblock = flagged_off64_t::make(1);
-    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, deleteblock, 1234);
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, deleteblock, 1234, 1234);
     ASSERT_FALSE(lba_entry_t::is_padding(&ent));
 }
 
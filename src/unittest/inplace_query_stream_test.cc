@@ -0,0 +1,156 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <string.h>
+
+#include <set>
+#include <string>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/io/network.hpp"
+#include "concurrency/cond_var.hpp"
+#include "containers/scoped.hpp"
+#include "protob/inplace_query_stream.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* A connected pair of `tcp_conn_t`s over the loopback interface. */
+class tcp_conn_pair_t {
+public:
+    tcp_conn_pair_t() : loopback("127.0.0.1") {
+        std::set<ip_address_t> addresses;
+        addresses.insert(loopback);
+        tcp_listener_t listener(addresses, 0,
+                                boost::bind(&tcp_conn_pair_t::on_connect, this, _1));
+        client.init(new tcp_conn_t(loopback, listener.get_port(), &non_interruptor));
+        server_connected.wait_lazily_unordered();
+    }
+
+    tcp_conn_t *get_client() { return client.get(); }
+    tcp_conn_t *get_server() { return server.get(); }
+    signal_t *get_non_interruptor() { return &non_interruptor; }
+
+private:
+    void on_connect(scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {  // NOLINT(runtime/references)
+        nconn->make_overcomplicated(&server);
+        server_connected.pulse();
+    }
+
+    ip_address_t loopback;
+    cond_t non_interruptor;
+    cond_t server_connected;
+    scoped_ptr_t<tcp_conn_t> client;
+    scoped_ptr_t<tcp_conn_t> server;
+
+    DISABLE_COPYING(tcp_conn_pair_t);
+};
+
+void write_frame(tcp_conn_t *conn, const std::string &data, signal_t *closer) {
+    int32_t size = data.size();
+    conn->write(&size, sizeof(size), closer);
+    conn->write(data.data(), data.size(), closer);
+}
+
+bool read_frame_in_place(tcp_conn_t *conn, Query *query_out, signal_t *closer) {
+    int32_t size;
+    const_charslice header = conn->peek(sizeof(int32_t), closer);
+    memcpy(&size, header.beg, sizeof(int32_t));
+    return parse_protob_in_place(conn, size, query_out, closer);
+}
+
+void run_parse_in_place_test() {
+    tcp_conn_pair_t conns;
+    signal_t *closer = conns.get_non_interruptor();
+
+    Query start;
+    start.set_type(Query::START);
+    start.set_token(1);
+    // Big enough that the frame arrives in several pieces.
+    Term *term = start.mutable_query();
+    term->set_type(Term::DATUM);
+    term->mutable_datum()->set_type(Datum::R_STR);
+    term->mutable_datum()->set_r_str(std::string(40 * KILOBYTE, 'a'));
+    Query cont;
+    cont.set_type(Query::CONTINUE);
+    cont.set_token(2);
+
+    write_frame(conns.get_client(), start.SerializeAsString(), closer);
+    write_frame(conns.get_client(), std::string(3, '\xff'), closer);
+    write_frame(conns.get_client(), cont.SerializeAsString(), closer);
+
+    Query parsed;
+    ASSERT_TRUE(read_frame_in_place(conns.get_server(), &parsed, closer));
+    EXPECT_EQ(start.SerializeAsString(), parsed.SerializeAsString());
+
+    // A frame that can't be parsed still gets popped...
+    parsed.Clear();
+    EXPECT_FALSE(read_frame_in_place(conns.get_server(), &parsed, closer));
+
+    // ... so the next one can be.
+    parsed.Clear();
+    ASSERT_TRUE(read_frame_in_place(conns.get_server(), &parsed, closer));
+    EXPECT_EQ(Query::CONTINUE, parsed.type());
+    EXPECT_EQ(2, parsed.token());
+}
+
+TEST(InplaceQueryStream, Parse) {
+    run_in_thread_pool(&run_parse_in_place_test);
+}
+
+void run_serialize_in_place_test() {
+    tcp_conn_pair_t conns;
+    signal_t *closer = conns.get_non_interruptor();
+
+    // Spans several of the connection's write buffers.
+    Response response;
+    response.set_type(Response::SUCCESS_SEQUENCE);
+    response.set_token(17);
+    for (int i = 0; i < 30; ++i) {
+        Datum *datum = response.add_response();
+        datum->set_type(Datum::R_STR);
+        datum->set_r_str(std::string(1000 + i, 'a' + i % 26));
+    }
+    Response small_response;
+    small_response.set_type(Response::SUCCESS_ATOM);
+    small_response.set_token(18);
+
+    serialize_protob_in_place(response, conns.get_server(), closer);
+    serialize_protob_in_place(small_response, conns.get_server(), closer);
+
+    const Response *expected[] = { &response, &small_response };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        int32_t size;
+        conns.get_client()->read(&size, sizeof(size), closer);
+        ASSERT_EQ(expected[i]->ByteSize(), size);
+        scoped_array_t<char> data(size);
+        conns.get_client()->read(data.data(), size, closer);
+        Response parsed;
+        ASSERT_TRUE(parsed.ParseFromArray(data.data(), size));
+        EXPECT_EQ(expected[i]->SerializeAsString(), parsed.SerializeAsString());
+    }
+}
+
+TEST(InplaceQueryStream, Serialize) {
+    run_in_thread_pool(&run_serialize_in_place_test);
+}
+
+void run_serialize_to_closed_conn_test() {
+    tcp_conn_pair_t conns;
+    signal_t *closer = conns.get_non_interruptor();
+
+    Response response;
+    response.set_type(Response::SUCCESS_ATOM);
+    response.set_token(1);
+    conns.get_server()->shutdown_write();
+    EXPECT_THROW(serialize_protob_in_place(response, conns.get_server(), closer),
+                 tcp_conn_write_closed_exc_t);
+}
+
+TEST(InplaceQueryStream, SerializeToClosedConnection) {
+    run_in_thread_pool(&run_serialize_to_closed_conn_test);
+}
+
+}  // namespace unittest
@@ -2,6 +2,7 @@
 #include "errors.hpp"
 #include <boost/make_shared.hpp>
 
+#include "buffer_cache/alt/config.hpp"
 #include "memcached/protocol.hpp"
 #include "serializer/config.hpp"
 #include "serializer/translator.hpp"
@@ -50,7 +51,7 @@ void run_with_namespace_interface(boost::function<void(namespace_interface_t<mem
         underlying_stores.push_back(
                 new memcached_protocol_t::store_t(multiplexer->proxies[i],
                     temp_file.name().permanent_path() + strprintf("_%zd", i),
-                    GIGABYTE, true, &get_global_perfmon_collection(), NULL,
+                    GIGABYTE, page_cache_config_t(), NULL, true, &get_global_perfmon_collection(), NULL,
                     &io_backender, base_path_t(".")));
     }
 
@@ -1,4 +1,10 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
 #include "arch/runtime/coroutines.hpp"
 #include "arch/timing.hpp"
 #include "buffer_cache/alt/page_cache.hpp"
@@ -8,6 +14,7 @@
 #include "concurrency/pmap.hpp"
 #include "containers/scoped.hpp"
 #include "serializer/config.hpp"
+#include "time.hpp"
 #include "unittest/gtest.hpp"
 #include "unittest/mock_file.hpp"
 #include "unittest/unittest_utils.hpp"
@@ -26,11 +33,13 @@ struct mock_ser_t {
     scoped_ptr_t<standard_serializer_t> ser;
     scoped_ptr_t<alt_memory_tracker_t> tracker;
 
-    mock_ser_t()
+    explicit mock_ser_t(bool read_ahead = true)
         : opener() {
         standard_serializer_t::create(&opener,
                                       standard_serializer_t::static_config_t());
-        ser = make_scoped<standard_serializer_t>(log_serializer_t::dynamic_config_t(),
+        log_serializer_t::dynamic_config_t dynamic_config;
+        dynamic_config.read_ahead = read_ahead;
+        ser = make_scoped<standard_serializer_t>(dynamic_config,
                                                  &opener,
                                                  &get_global_perfmon_collection());
         tracker = make_scoped<alt_memory_tracker_t>();
@@ -43,20 +52,34 @@ void reset_tracker_acq(alt::tracker_acq_t *acq) {
 
 class test_txn_t;
 
-class test_cache_t : public page_cache_t {
+// A base class of test_cache_t, so that the collection gets constructed before the
+// page cache registers its perfmons in it.
+struct test_cache_stats_t {
+    perfmon_collection_t stats_collection;
+};
+
+class test_cache_t : private test_cache_stats_t, public page_cache_t {
 public:
     test_cache_t(serializer_t *serializer, alt_memory_tracker_t *tracker)
-        : page_cache_t(serializer, page_cache_config_t(), tracker),
+        : page_cache_t(serializer, page_cache_config_t(), tracker, NULL,
+                       &stats_collection),
           tracker_(tracker) { }
     test_cache_t(serializer_t *serializer, alt_memory_tracker_t *tracker,
-                 uint64_t memory_limit)
-        : page_cache_t(serializer, make_config(memory_limit), tracker),
+                 uint64_t memory_limit,
+                 cache_eviction_policy_t eviction_policy
+                 = cache_eviction_policy_t::sampled_lru,
+                 int64_t flush_group_window_ms = 0)
+        : page_cache_t(serializer, make_config(memory_limit, eviction_policy,
+                                               flush_group_window_ms),
+                       tracker, NULL, &stats_collection),
           tracker_(tracker) { }
 
     void flush(scoped_ptr_t<test_txn_t> txn) {
         flush_and_destroy_txn(std::move(txn), &reset_tracker_acq);
     }
 
+    perfmon_collection_t *stats() { return &stats_collection; }
+
     alt::tracker_acq_t make_tracker_acq() {
         // KSI: We could make these tests better by varying the expected change
         // count.
@@ -64,9 +87,13 @@ public:
     }
 
 private:
-    static page_cache_config_t make_config(uint64_t memory_limit) {
+    static page_cache_config_t make_config(uint64_t memory_limit,
+                                           cache_eviction_policy_t eviction_policy,
+                                           int64_t flush_group_window_ms) {
         page_cache_config_t ret;
         ret.memory_limit = memory_limit;
+        ret.eviction_policy = eviction_policy;
+        ret.flush_group_window_ms = flush_group_window_ms;
         return ret;
     }
 
@@ -352,8 +379,13 @@ TEST(PageTest, WriteWaitForFlush) {
 
 class bigger_test_t {
 public:
-    explicit bigger_test_t(uint64_t _memory_limit)
-        : memory_limit(_memory_limit), mock(), c(NULL),
+    explicit bigger_test_t(uint64_t _memory_limit,
+                           cache_eviction_policy_t _eviction_policy
+                           = cache_eviction_policy_t::sampled_lru,
+                           int64_t _flush_group_window_ms = 0)
+        : memory_limit(_memory_limit), eviction_policy(_eviction_policy),
+          flush_group_window_ms(_flush_group_window_ms),
+          mock(), c(NULL),
           txn1_ptr(NULL), txn2_ptr(NULL) {
         for (size_t i = 0; i < b_len; ++i) {
             b[i] = NULL_BLOCK_ID;
@@ -362,7 +394,8 @@ public:
 
     void run() {
         {
-            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit);
+            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit,
+                               eviction_policy, flush_group_window_ms);
             auto_drainer_t drain;
             c = &cache;
 
@@ -407,7 +440,8 @@ public:
         c = NULL;
 
         {
-            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit);
+            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit,
+                               eviction_policy, flush_group_window_ms);
             auto_drainer_t drain;
             c = &cache;
             coro_t::spawn_ordered(std::bind(&bigger_test_t::run_txn14,
@@ -418,7 +452,8 @@ public:
         c = NULL;
 
         {
-            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit);
+            test_cache_t cache(mock.ser.get(), mock.tracker.get(), memory_limit,
+                               eviction_policy, flush_group_window_ms);
             c = &cache;
             auto txn = make_scoped<test_txn_t>(c);
 
@@ -1166,6 +1201,8 @@ private:
     }
 
     const uint64_t memory_limit;
+    const cache_eviction_policy_t eviction_policy;
+    const int64_t flush_group_window_ms;
 
     mock_ser_t mock;
     test_cache_t *c;
@@ -1232,4 +1269,235 @@ TEST(PageTest, BiggerTestNoMemory) {
     run_in_thread_pool(run_BiggerTestNoMemory, 4);
 }
 
+void run_BiggerTestTightMemoryTwoQueue() {
+    bigger_test_t test(8192, cache_eviction_policy_t::two_queue);
+    test.run();
+}
+
+TEST(PageTest, BiggerTestTightMemoryTwoQueue) {
+    run_in_thread_pool(run_BiggerTestTightMemoryTwoQueue, 4);
+}
+
+void run_BiggerTestNoMemoryTwoQueue() {
+    bigger_test_t test(0, cache_eviction_policy_t::two_queue);
+    test.run();
+}
+
+TEST(PageTest, BiggerTestNoMemoryTwoQueue) {
+    run_in_thread_pool(run_BiggerTestNoMemoryTwoQueue, 4);
+}
+
+void run_BiggerTestTightMemoryFlushGroupWindow() {
+    bigger_test_t test(8192, cache_eviction_policy_t::sampled_lru, 5);
+    test.run();
+}
+
+TEST(PageTest, BiggerTestTightMemoryFlushGroupWindow) {
+    run_in_thread_pool(run_BiggerTestTightMemoryFlushGroupWindow, 4);
+}
+
+/* A hot set of blocks is read over and over, interleaved with a few blocks that
+are only read once, and then a long sequential scan goes through the cache.  The
+two_queue policy promotes the hot blocks (they get reloaded right after being
+evicted, which counts as a ghost hit), so the scan only churns the probationary
+queue; with sampled_lru the scan pushes the hot set out. */
+
+static const int scan_test_cache_blocks = 16;
+static const int scan_test_hot_blocks = 12;
+static const int scan_test_rounds = 10;
+static const int scan_test_cold_blocks_per_round = 8;
+static const int scan_test_scan_blocks = 200;
+
+void create_scan_test_blocks(test_cache_t *cache, int count,
+                             std::vector<block_id_t> *ids_out) {
+    auto txn = make_scoped<test_txn_t>(cache);
+    for (int i = 0; i < count; ++i) {
+        current_test_acq_t acq(txn.get(), alt_create_t::create);
+        ids_out->push_back(acq.block_id());
+        test_acq_t page_acq;
+        page_acq.init(acq.current_page_for_write(), cache);
+        memset(page_acq.get_buf_write(), i % 256, page_acq.get_buf_size());
+    }
+    cache->flush(std::move(txn));
+}
+
+void read_scan_test_block(test_cache_t *cache, block_id_t block_id) {
+    auto txn = make_scoped<test_txn_t>(cache);
+    {
+        current_test_acq_t acq(txn.get(), block_id, access_t::read);
+        test_acq_t page_acq;
+        page_acq.init(acq.current_page_for_read(), cache);
+        page_acq.buf_ready_signal()->wait();
+    }
+    cache->flush(std::move(txn));
+}
+
+void visit_stats_on_thread(perfmon_t *perfmon, void *data, int thread) {
+    on_thread_t th((threadnum_t(thread)));
+    perfmon->visit_stats(data);
+}
+
+// Reads one of the counters the cache keeps in its stats collection.
+int64_t cache_stat(test_cache_t *cache, const std::string &name) {
+    perfmon_t *const perfmon = cache->stats();
+    void *data = perfmon->begin_stats();
+    pmap(get_num_threads(), std::bind(&visit_stats_on_thread, perfmon, data, ph::_1));
+    scoped_ptr_t<perfmon_result_t> result = perfmon->end_stats(data);
+    const perfmon_result_t::internal_map_t *map
+        = static_cast<const perfmon_result_t *>(result.get())->get_map();
+    auto it = map->find(name);
+    guarantee(it != map->end());
+    return strtoll(it->second->get_string()->c_str(), NULL, 10);
+}
+
+void run_ScanResistance(cache_eviction_policy_t eviction_policy) {
+    // Read-ahead would load scan blocks nobody asked for.
+    mock_ser_t mock(false);
+
+    std::vector<block_id_t> hot, cold, scan;
+    {
+        test_cache_t cache(mock.ser.get(), mock.tracker.get());
+        create_scan_test_blocks(&cache, scan_test_hot_blocks, &hot);
+        create_scan_test_blocks(&cache,
+                                scan_test_rounds * scan_test_cold_blocks_per_round,
+                                &cold);
+        create_scan_test_blocks(&cache, scan_test_scan_blocks, &scan);
+    }
+
+    test_cache_t cache(mock.ser.get(), mock.tracker.get(),
+                       scan_test_cache_blocks * mock.ser->max_block_size().ser_value(),
+                       eviction_policy);
+
+    size_t next_cold = 0;
+    for (int round = 0; round < scan_test_rounds; ++round) {
+        for (auto it = hot.begin(); it != hot.end(); ++it) {
+            read_scan_test_block(&cache, *it);
+        }
+        for (int i = 0; i < scan_test_cold_blocks_per_round; ++i) {
+            read_scan_test_block(&cache, cold[next_cold++]);
+        }
+    }
+
+    const int64_t ghost_hits_before_scan = cache_stat(&cache, "ghost_hits");
+    if (eviction_policy == cache_eviction_policy_t::two_queue) {
+        EXPECT_GT(ghost_hits_before_scan, 0);
+    } else {
+        EXPECT_EQ(0, ghost_hits_before_scan);
+    }
+
+    for (auto it = scan.begin(); it != scan.end(); ++it) {
+        read_scan_test_block(&cache, *it);
+    }
+    // Every scanned block was read once, so none of them was a ghost.
+    EXPECT_EQ(ghost_hits_before_scan, cache_stat(&cache, "ghost_hits"));
+
+    const int64_t misses_before = cache_stat(&cache, "misses");
+    for (auto it = hot.begin(); it != hot.end(); ++it) {
+        read_scan_test_block(&cache, *it);
+    }
+    const int64_t hot_misses = cache_stat(&cache, "misses") - misses_before;
+    if (eviction_policy == cache_eviction_policy_t::two_queue) {
+        // The scan can cost the protected queue a block or two while the
+        // probationary queue is at its share, but no more.
+        EXPECT_LE(hot_misses, scan_test_hot_blocks / 4);
+    } else {
+        EXPECT_GE(hot_misses, scan_test_hot_blocks - scan_test_hot_blocks / 4);
+    }
+}
+
+TEST(PageTest, ScanResistanceTwoQueue) {
+    run_in_thread_pool(std::bind(&run_ScanResistance,
+                                 cache_eviction_policy_t::two_queue), 4);
+}
+
+TEST(PageTest, ScanResistanceSampledLru) {
+    run_in_thread_pool(std::bind(&run_ScanResistance,
+                                 cache_eviction_policy_t::sampled_lru), 4);
+}
+
+void count_flush_completion(int *completed, int total, cond_t *all_done,
+                            alt::tracker_acq_t *acq) {
+    reset_tracker_acq(acq);
+    ++*completed;
+    if (*completed == total) {
+        all_done->pulse();
+    }
+}
+
+// Flushes num_txns independent txns at once and returns how many flush groups it
+// took.
+int64_t flush_independent_txns(test_cache_t *cache, int num_txns) {
+    const int64_t groups_before = cache_stat(cache, "flush_groups");
+
+    std::vector<scoped_ptr_t<test_txn_t> > txns;
+    for (int i = 0; i < num_txns; ++i) {
+        txns.push_back(make_scoped<test_txn_t>(cache));
+        current_test_acq_t acq(txns.back().get(), alt_create_t::create);
+        test_acq_t page_acq;
+        page_acq.init(acq.current_page_for_write(), cache);
+        memset(page_acq.get_buf_write(), i % 256, page_acq.get_buf_size());
+    }
+
+    int completed = 0;
+    cond_t all_done;
+    for (auto it = txns.begin(); it != txns.end(); ++it) {
+        cache->flush_and_destroy_txn(std::move(*it),
+                                     std::bind(&count_flush_completion, &completed,
+                                               num_txns, &all_done, ph::_1));
+    }
+    all_done.wait();
+
+    return cache_stat(cache, "flush_groups") - groups_before;
+}
+
+void run_FlushGroups(int64_t flush_group_window_ms) {
+    mock_ser_t mock;
+    test_cache_t cache(mock.ser.get(), mock.tracker.get(), GIGABYTE,
+                       cache_eviction_policy_t::sampled_lru, flush_group_window_ms);
+    if (flush_group_window_ms == 0) {
+        // The first txn gets flushed right away, and the rest wait for that flush
+        // and then go in one group.
+        EXPECT_EQ(2, flush_independent_txns(&cache, 10));
+    } else {
+        // They all join the group during the window.
+        EXPECT_EQ(1, flush_independent_txns(&cache, 10));
+    }
+}
+
+TEST(PageTest, FlushGroupsNoWindow) {
+    run_in_thread_pool(std::bind(&run_FlushGroups, 0), 4);
+}
+
+TEST(PageTest, FlushGroupsWindow) {
+    run_in_thread_pool(std::bind(&run_FlushGroups, 50), 4);
+}
+
+void run_FlushGroupWindowCutShortByShutdown() {
+    mock_ser_t mock;
+    const ticks_t start = get_ticks();
+    int completed = 0;
+    cond_t done;
+    {
+        test_cache_t cache(mock.ser.get(), mock.tracker.get(), GIGABYTE,
+                           cache_eviction_policy_t::sampled_lru, 60 * 1000);
+        auto txn = make_scoped<test_txn_t>(&cache);
+        {
+            current_test_acq_t acq(txn.get(), alt_create_t::create);
+            test_acq_t page_acq;
+            page_acq.init(acq.current_page_for_write(), &cache);
+            page_acq.get_buf_write();
+        }
+        cache.flush_and_destroy_txn(std::move(txn),
+                                    std::bind(&count_flush_completion, &completed,
+                                              1, &done, ph::_1));
+        // Destroying the cache has to interrupt the window and flush the txn.
+    }
+    EXPECT_TRUE(done.is_pulsed());
+    EXPECT_LT(ticks_to_secs(get_ticks() - start), 30.0);
+}
+
+TEST(PageTest, FlushGroupWindowCutShortByShutdown) {
+    run_in_thread_pool(run_FlushGroupWindowCutShortByShutdown, 4);
+}
+
 }  // namespace unittest
@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include <cmath>  // for std::isnan -- read the comment below.
+#include <limits>
 
 #include "perfmon/perfmon.hpp"
 #include "unittest/gtest.hpp"
@@ -57,4 +58,63 @@ TEST(PerfmonTest, StddevComputation) {
     }
 }
 
+TEST(PerfmonTest, HistogramBuckets) {
+    using namespace perfmon_histogram;  // NOLINT(build/namespaces)
+
+    // Every value falls into a bucket whose bounds enclose it, and the buckets are
+    // contiguous.
+    int last_bucket = 0;
+    for (uint64_t value = 0; value < 100000; ++value) {
+        int bucket = bucket_for_value(value);
+        ASSERT_TRUE(bucket == last_bucket || bucket == last_bucket + 1);
+        ASSERT_LE(value, bucket_upper_bound(bucket));
+        if (bucket > 0) {
+            ASSERT_LT(bucket_upper_bound(bucket - 1), value);
+        }
+        last_bucket = bucket;
+    }
+
+    // Small values are exact, larger ones are within 1/32 of the bucket's bound.
+    for (uint64_t value = 0; value < 64; ++value) {
+        EXPECT_EQ(value, bucket_upper_bound(bucket_for_value(value)));
+    }
+    for (uint64_t value = 64; value < (1ull << max_value_bits); value = value * 3 + 1) {
+        uint64_t bound = bucket_upper_bound(bucket_for_value(value));
+        EXPECT_LE(value, bound);
+        EXPECT_LE(bound - value, value / 32);
+    }
+
+    EXPECT_EQ(num_buckets - 1, bucket_for_value((1ull << max_value_bits) - 1));
+    EXPECT_EQ(num_buckets - 1, bucket_for_value(1ull << max_value_bits));
+    EXPECT_EQ(num_buckets - 1, bucket_for_value(std::numeric_limits<uint64_t>::max()));
+}
+
+TEST(PerfmonTest, HistogramPercentiles) {
+    perfmon_histogram::stats_t first, second;
+    for (uint64_t i = 1; i <= 500; ++i) {
+        first.record(i);
+        second.record(i + 500);
+    }
+
+    perfmon_histogram::stats_t stats;
+    stats.aggregate(first);
+    stats.aggregate(perfmon_histogram::stats_t());
+    stats.aggregate(second);
+    EXPECT_EQ(1000u, stats.count);
+    EXPECT_EQ(1u, stats.min);
+    EXPECT_EQ(1000u, stats.max);
+
+    EXPECT_EQ(1u, stats.value_at_percentile(0));
+    EXPECT_EQ(63u, stats.value_at_percentile(6.3));
+    EXPECT_NEAR(500.0, stats.value_at_percentile(50), 500.0 / 32);
+    EXPECT_NEAR(990.0, stats.value_at_percentile(99), 990.0 / 32);
+    EXPECT_EQ(1000u, stats.value_at_percentile(99.9));
+    EXPECT_EQ(1000u, stats.value_at_percentile(100));
+
+    // Percentiles never leave the range of the recorded values.
+    perfmon_histogram::stats_t single;
+    single.record(1000001);
+    EXPECT_EQ(1000001u, single.value_at_percentile(50));
+}
+
 }  // namespace unittest
@@ -1,6 +1,8 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "unittest/gtest.hpp"
 
+#include "btree/backfill.hpp"
+#include "btree/get_distribution.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "clustering/immediate_consistency/branch/broadcaster.hpp"
 #include "clustering/immediate_consistency/branch/listener.hpp"
@@ -18,6 +20,7 @@
 #include "unittest/branch_history_manager.hpp"
 #include "unittest/clustering_utils.hpp"
 #include "unittest/dummy_metadata_controller.hpp"
+#include "unittest/dummy_namespace_interface.hpp"
 #include "unittest/unittest_utils.hpp"
 
 namespace unittest {
@@ -264,7 +267,8 @@ void run_sindex_backfill_test(std::pair<io_backender_t *, simple_mailbox_cluster
         ql::map_wire_func_t m(mapping, make_vector(one), get_backtrace(mapping));
 
         rdb_protocol_t::write_t write(
-            rdb_protocol_t::sindex_create_t(id, m, sindex_multi_bool_t::SINGLE),
+            rdb_protocol_t::sindex_create_t(id, m, sindex_multi_bool_t::SINGLE,
+                                            sindex_covered_fields_t()),
             profile_bool_t::PROFILE);
 
         fake_fifo_enforcement_t enforce;
@@ -350,6 +354,127 @@ void run_sindex_backfill_test(std::pair<io_backender_t *, simple_mailbox_cluster
 TEST(RDBProtocolBackfill, SindexBackfill) {
      run_in_thread_pool_with_broadcaster(&run_sindex_backfill_test);
 }
+/* `ParallelBackfill` fills the store with enough data that its B-tree has split
+points, so that the backfill traverses several sub-ranges at once and their
+chunks compete for the same allocations. The new mirror must end up with every
+document. */
+
+void run_parallel_backfill_test(std::pair<io_backender_t *, simple_mailbox_cluster_t *> io_backender_and_cluster,
+                                branch_history_manager_t<rdb_protocol_t> *branch_history_manager,
+                                clone_ptr_t<watchable_t<boost::optional<boost::optional<broadcaster_business_card_t<rdb_protocol_t> > > > > broadcaster_metadata_view,
+                                scoped_ptr_t<broadcaster_t<rdb_protocol_t> > *broadcaster,
+                                test_store_t<rdb_protocol_t> *initial_store,
+                                scoped_ptr_t<listener_t<rdb_protocol_t> > *initial_listener,
+                                rdb_protocol_t::context_t *ctx,
+                                order_source_t *order_source) {
+    io_backender_t *const io_backender = io_backender_and_cluster.first;
+    simple_mailbox_cluster_t *const cluster = io_backender_and_cluster.second;
+    const size_t value_padding_length = 300;
+    const int num_docs = 3000;
+
+    recreate_temporary_directory(base_path_t("."));
+    replier_t<rdb_protocol_t> replier(initial_listener->get(), cluster->get_mailbox_manager(), branch_history_manager);
+
+    watchable_variable_t<boost::optional<boost::optional<replier_business_card_t<rdb_protocol_t> > > >
+        replier_business_card_variable(boost::optional<boost::optional<replier_business_card_t<rdb_protocol_t> > >(boost::optional<replier_business_card_t<rdb_protocol_t> >(replier.get_business_card())));
+
+    for (int i = 0; i < num_docs; ++i) {
+        write_to_broadcaster(value_padding_length, broadcaster->get(),
+                             strprintf("key%06d", i), strprintf("%d", i),
+                             order_source->check_in("unittest::(rdb)run_parallel_backfill_test"),
+                             NULL);
+    }
+
+    cond_t interruptor;
+
+    /* Make sure the data is big enough to be split into several sub-ranges. */
+    {
+        dummy_performer_t<rdb_protocol_t> performer(&initial_store->store);
+        rdb_protocol_t::read_t read(
+            rdb_protocol_t::distribution_read_t(BACKFILL_SPLIT_DEPTH, num_docs),
+            profile_bool_t::DONT_PROFILE);
+        rdb_protocol_t::read_response_t response;
+        performer.read_outdated(read, &response, &interruptor);
+        rdb_protocol_t::distribution_read_response_t distribution =
+            boost::get<rdb_protocol_t::distribution_read_response_t>(response.response);
+        ASSERT_LT(1u, distribution.key_counts.size());
+    }
+
+    /* The second mirror backfills all of it while it's being constructed. */
+    test_store_t<rdb_protocol_t> store2(io_backender, order_source, ctx);
+    listener_t<rdb_protocol_t> listener2(
+        base_path_t("."),
+        io_backender,
+        cluster->get_mailbox_manager(),
+        broadcaster_metadata_view,
+        branch_history_manager,
+        &store2.store,
+        replier_business_card_variable.get_watchable(),
+        generate_uuid(),
+        &get_global_perfmon_collection(),
+        &interruptor,
+        order_source);
+    EXPECT_FALSE(listener2.get_broadcaster_lost_signal()->is_pulsed());
+
+    dummy_performer_t<rdb_protocol_t> performer2(&store2.store);
+    for (int i = 0; i < num_docs; ++i) {
+        rdb_protocol_t::read_t read(
+            rdb_protocol_t::point_read_t(store_key_t(strprintf("key%06d", i))),
+            profile_bool_t::DONT_PROFILE);
+        rdb_protocol_t::read_response_t response;
+        performer2.read_outdated(read, &response, &interruptor);
+        rdb_protocol_t::point_read_response_t get_result =
+            boost::get<rdb_protocol_t::point_read_response_t>(response.response);
+        ASSERT_TRUE(get_result.data.get() != NULL);
+        EXPECT_EQ(*generate_document(value_padding_length, strprintf("%d", i)),
+                  *get_result.data);
+    }
+}
+
+TEST(RDBProtocolBackfill, ParallelBackfill) {
+     run_in_thread_pool_with_broadcaster(&run_parallel_backfill_test);
+}
+
+/* `DivideKeyRange` checks how backfills split their key ranges into sub-ranges
+to traverse in parallel. */
+
+TEST(RDBProtocolBackfill, DivideKeyRange) {
+    std::vector<store_key_t> split_keys;
+    for (int i = 0; i < 100; ++i) {
+        split_keys.push_back(store_key_t(strprintf("%03d", i)));
+    }
+
+    const key_range_t range(key_range_t::closed, store_key_t("010"),
+                            key_range_t::open, store_key_t("090"));
+    std::vector<key_range_t> parts;
+    divide_key_range(range, split_keys, 4, &parts);
+
+    /* The parts have to cover the range exactly, in order. */
+    ASSERT_EQ(4u, parts.size());
+    EXPECT_EQ(range.left, parts.front().left);
+    EXPECT_FALSE(parts.back().right.unbounded);
+    EXPECT_EQ(range.right.key, parts.back().right.key);
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        ASSERT_FALSE(parts[i].right.unbounded);
+        EXPECT_EQ(parts[i].right.key, parts[i + 1].left);
+        EXPECT_FALSE(parts[i].is_empty());
+        /* Each part gets about a quarter of the 80 split keys in the range. */
+        int num_keys = 0;
+        for (size_t j = 0; j < split_keys.size(); ++j) {
+            num_keys += parts[i].contains_key(split_keys[j]) ? 1 : 0;
+        }
+        EXPECT_LE(19, num_keys);
+        EXPECT_GE(21, num_keys);
+    }
+
+    /* With no split keys inside the range, it stays in one piece. */
+    parts.clear();
+    divide_key_range(key_range_t(key_range_t::closed, store_key_t("a"),
+                                 key_range_t::none, store_key_t()),
+                     split_keys, 4, &parts);
+    ASSERT_EQ(1u, parts.size());
+    EXPECT_TRUE(parts[0].right.unbounded);
+}
 
 }   /* namespace unittest */
 
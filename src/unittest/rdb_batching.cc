@@ -0,0 +1,221 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <map>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/timing.hpp"
+#include "rdb_protocol/batching.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/pb_utils.hpp"
+#include "rdb_protocol/stream_cache.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/rdb_env.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* How many copies of `el` a batch built from `batchspec` takes before it's sent. */
+int64_t batch_length(const ql::batchspec_t &batchspec,
+                     const counted_t<const ql::datum_t> &el) {
+    ql::batcher_t batcher = batchspec.to_batcher();
+    for (int64_t i = 1; i < 1000; ++i) {
+        if (batcher.note_el(el)) {
+            return i;
+        }
+    }
+    return 1000;
+}
+
+/* A batch_conf that fits `size_in_els` elements of `el_size` bytes, but no less than
+`min_els` elements, into a batch. */
+counted_t<const ql::datum_t> make_batch_conf(int64_t size_in_els, int64_t el_size,
+                                              int64_t min_els) {
+    std::map<std::string, counted_t<const ql::datum_t> > conf;
+    conf["max_size"] = make_counted<const ql::datum_t>(
+        static_cast<double>(size_in_els * el_size));
+    conf["min_els"] = make_counted<const ql::datum_t>(static_cast<double>(min_els));
+    // Long enough that the latency cap doesn't end any batches.
+    conf["max_dur"] = make_counted<const ql::datum_t>(60.0 * 1000 * 1000);
+    return make_counted<const ql::datum_t>(std::move(conf));
+}
+
+TEST(RDBBatching, TunerGrowsAndShrinks) {
+    counted_t<const ql::datum_t> el = make_counted<const ql::datum_t>(std::string(100, 'a'));
+    const int64_t el_size = serialized_size(el);
+    ql::batchspec_t batchspec = ql::batchspec_t::user(
+        ql::batch_type_t::NORMAL, make_batch_conf(10, el_size, 1));
+
+    ql::batch_tuner_t tuner;
+    EXPECT_EQ(10, batch_length(tuner.adapt(batchspec), el));
+
+    // The batches double while they're ready before the client asks for them...
+    tuner.note_batch_ready(true);
+    EXPECT_EQ(20, batch_length(tuner.adapt(batchspec), el));
+    tuner.note_batch_ready(true);
+    EXPECT_EQ(40, batch_length(tuner.adapt(batchspec), el));
+
+    // ... and halve once the client has to wait.
+    tuner.note_batch_ready(false);
+    EXPECT_EQ(20, batch_length(tuner.adapt(batchspec), el));
+    tuner.note_batch_ready(false);
+    EXPECT_EQ(10, batch_length(tuner.adapt(batchspec), el));
+}
+
+TEST(RDBBatching, TunerClampsSizeFactor) {
+    counted_t<const ql::datum_t> el = make_counted<const ql::datum_t>(std::string(100, 'a'));
+    const int64_t el_size = serialized_size(el);
+    ql::batchspec_t batchspec = ql::batchspec_t::user(
+        ql::batch_type_t::NORMAL, make_batch_conf(10, el_size, 1));
+
+    ql::batch_tuner_t tuner;
+    for (int i = 0; i < 10; ++i) {
+        tuner.note_batch_ready(true);
+    }
+    // At most 8 times what batch_conf asks for.
+    EXPECT_EQ(80, batch_length(tuner.adapt(batchspec), el));
+
+    for (int i = 0; i < 10; ++i) {
+        tuner.note_batch_ready(false);
+    }
+    // And never less than what it asks for.
+    EXPECT_EQ(10, batch_length(tuner.adapt(batchspec), el));
+}
+
+TEST(RDBBatching, TunerLowersMinElsForLargeElements) {
+    counted_t<const ql::datum_t> el = make_counted<const ql::datum_t>(std::string(100, 'a'));
+    const int64_t el_size = serialized_size(el);
+    // Only 2 elements fit into the size limit, but batch_conf asks for at least 8.
+    ql::batchspec_t batchspec = ql::batchspec_t::user(
+        ql::batch_type_t::NORMAL, make_batch_conf(2, el_size, 8));
+
+    ql::batch_tuner_t tuner;
+    EXPECT_EQ(8, batch_length(tuner.adapt(batchspec), el));
+
+    // Empty batches don't tell us anything about the element size.
+    tuner.note_batch(0, 0);
+    EXPECT_EQ(8, batch_length(tuner.adapt(batchspec), el));
+
+    tuner.note_batch(4, 4 * el_size);
+    EXPECT_EQ(2, batch_length(tuner.adapt(batchspec), el));
+}
+
+TEST(RDBBatching, TunerLeavesFirstBatchAlone) {
+    counted_t<const ql::datum_t> el = make_counted<const ql::datum_t>(std::string(100, 'a'));
+    const int64_t el_size = serialized_size(el);
+    counted_t<const ql::datum_t> conf = make_batch_conf(40, el_size, 1);
+
+    ql::batch_tuner_t tuner;
+    const int64_t first_length = batch_length(
+        tuner.adapt(ql::batchspec_t::user(ql::batch_type_t::NORMAL_FIRST, conf)), el);
+    tuner.note_batch_ready(true);
+    EXPECT_EQ(first_length, batch_length(
+        tuner.adapt(ql::batchspec_t::user(ql::batch_type_t::NORMAL_FIRST, conf)), el));
+}
+
+/* `stream_cache2_t` tests.  The rows are big enough that a cursor over them takes
+several batches. */
+
+static const int num_cursor_rows = 300;
+
+std::vector<counted_t<const ql::datum_t> > make_cursor_rows() {
+    std::vector<counted_t<const ql::datum_t> > rows;
+    for (int i = 0; i < num_cursor_rows; ++i) {
+        std::map<std::string, counted_t<const ql::datum_t> > row;
+        row["id"] = make_counted<const ql::datum_t>(static_cast<double>(i));
+        row["pad"] = make_counted<const ql::datum_t>(std::string(10 * KILOBYTE, 'a'));
+        rows.push_back(make_counted<const ql::datum_t>(std::move(row)));
+    }
+    return rows;
+}
+
+void insert_cursor(test_rdb_env_t::instance_t *env_instance,
+                   ql::stream_cache2_t *stream_cache,
+                   int64_t token,
+                   std::vector<counted_t<const ql::datum_t> > rows) {
+    scoped_ptr_t<ql::env_t> env;
+    env_instance->make_extra_env(&env);
+    counted_t<ql::datum_stream_t> stream = make_counted<ql::array_datum_stream_t>(
+        make_counted<const ql::datum_t>(std::move(rows)),
+        ql::make_counted_backtrace());
+    stream_cache->insert(token, ql::use_json_t::NO, std::move(env), stream);
+}
+
+void run_prefetched_batches_in_order_test(test_rdb_env_t *test_env) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    cond_t non_interruptor;
+
+    ql::stream_cache2_t stream_cache;
+    insert_cursor(env_instance.get(), &stream_cache, 1, make_cursor_rows());
+
+    int num_batches = 0;
+    int num_read = 0;
+    for (;;) {
+        Response res;
+        ASSERT_TRUE(stream_cache.serve(1, &res, &non_interruptor));
+        ++num_batches;
+        for (int i = 0; i < res.response_size(); ++i, ++num_read) {
+            counted_t<const ql::datum_t> row
+                = make_counted<const ql::datum_t>(&res.response(i));
+            ASSERT_EQ(num_read, row->get("id")->as_int());
+        }
+        if (res.type() == Response::SUCCESS_SEQUENCE) {
+            break;
+        }
+        ASSERT_EQ(Response::SUCCESS_PARTIAL, res.type());
+        // Give the next batch time to be prefetched, like a client would.
+        nap(10);
+    }
+    EXPECT_EQ(num_cursor_rows, num_read);
+    EXPECT_LT(2, num_batches);
+    EXPECT_FALSE(stream_cache.contains(1));
+}
+
+TEST(RDBBatching, PrefetchedBatchesInOrder) {
+    test_rdb_env_t test_env;
+    run_in_thread_pool(boost::bind(&run_prefetched_batches_in_order_test, &test_env));
+}
+
+void run_prefetch_dropped_on_close_test(test_rdb_env_t *test_env, bool wait_for_prefetch) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    cond_t non_interruptor;
+
+    // We keep references to the rows, so that we can tell when the cursor has let
+    // go of them.
+    std::vector<counted_t<const ql::datum_t> > rows = make_cursor_rows();
+    ql::stream_cache2_t stream_cache;
+    insert_cursor(env_instance.get(), &stream_cache, 1, rows);
+
+    Response res;
+    ASSERT_TRUE(stream_cache.serve(1, &res, &non_interruptor));
+    ASSERT_EQ(Response::SUCCESS_PARTIAL, res.type());
+    if (wait_for_prefetch) {
+        nap(10);
+    }
+
+    // Closing the cursor waits for the prefetch, then drops its batch along with
+    // the stream.
+    stream_cache.erase(1);
+    EXPECT_FALSE(stream_cache.contains(1));
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        ASSERT_TRUE(it->unique());
+    }
+}
+
+TEST(RDBBatching, PrefetchDroppedOnClose) {
+    test_rdb_env_t test_env;
+    run_in_thread_pool(boost::bind(&run_prefetch_dropped_on_close_test, &test_env, true));
+}
+
+TEST(RDBBatching, PrefetchDroppedOnCloseWhileRunning) {
+    test_rdb_env_t test_env;
+    run_in_thread_pool(boost::bind(&run_prefetch_dropped_on_close_test, &test_env, false));
+}
+
+}  // namespace unittest
@@ -6,6 +6,8 @@
 #include "arch/timing.hpp"
 #include "btree/btree_store.hpp"
 #include "btree/operations.hpp"
+#include "buffer_cache/alt/blob.hpp"
+#include "buffer_cache/alt/config.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "rdb_protocol/btree.hpp"
@@ -44,7 +46,8 @@ void insert_rows(int start, int finish, btree_store_t<rdb_protocol_t> *store) {
         rdb_modification_report_t mod_report(pk);
         rdb_set(pk,
                 make_counted<ql::datum_t>(scoped_cJSON_t(cJSON_Parse(data.c_str()))),
-                false, store->btree.get(), repli_timestamp_t::invalid,
+                ql::row_format_t::PLAIN, false, store->btree.get(),
+                repli_timestamp_t::invalid,
                 superblock.get(), &response, &mod_report.info,
                 static_cast<profile::trace_t *>(NULL));
 
@@ -75,41 +78,48 @@ void insert_rows_and_pulse_when_done(int start, int finish,
     pulse_when_done->pulse();
 }
 
-std::string create_sindex(btree_store_t<rdb_protocol_t> *store) {
-    cond_t dummy_interruptor;
-    std::string sindex_id = uuid_to_str(generate_uuid());
-    write_token_pair_t token_pair;
-    store->new_write_token_pair(&token_pair);
-
-    scoped_ptr_t<txn_t> txn;
-    scoped_ptr_t<real_superblock_t> super_block;
-
-    store->acquire_superblock_for_write(repli_timestamp_t::invalid,
-                                        1, write_durability_t::SOFT,
-                                        &token_pair, &txn, &super_block,
-                                        &dummy_interruptor);
-
+// The definition of a sindex on the "sid" field.
+secondary_index_t::opaque_definition_t make_sindex_definition(
+        sindex_multi_bool_t multi_bool = sindex_multi_bool_t::SINGLE,
+        const sindex_covered_fields_t &covered_fields = sindex_covered_fields_t()) {
     ql::sym_t one(1);
     ql::protob_t<const Term> mapping = ql::r::var(one)["sid"].release_counted();
     ql::map_wire_func_t m(mapping, make_vector(one), get_backtrace(mapping));
 
-    sindex_multi_bool_t multi_bool = sindex_multi_bool_t::SINGLE;
-
     write_message_t wm;
     wm << m;
     wm << multi_bool;
+    wm << covered_fields;
 
     vector_stream_t stream;
     stream.reserve(wm.size());
     int res = send_write_message(&stream, &wm);
     guarantee(res == 0);
+    return stream.vector();
+}
+
+std::string create_sindex(btree_store_t<rdb_protocol_t> *store,
+                          std::string sindex_id = uuid_to_str(generate_uuid()),
+                          const secondary_index_t::opaque_definition_t &definition
+                              = make_sindex_definition()) {
+    cond_t dummy_interruptor;
+    write_token_pair_t token_pair;
+    store->new_write_token_pair(&token_pair);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+
+    store->acquire_superblock_for_write(repli_timestamp_t::invalid,
+                                        1, write_durability_t::SOFT,
+                                        &token_pair, &txn, &super_block,
+                                        &dummy_interruptor);
 
     buf_lock_t sindex_block
         = store->acquire_sindex_block_for_write(super_block->expose_buf(),
                                                 super_block->get_sindex_block_id());
     UNUSED bool b = store->add_sindex(
             sindex_id,
-            stream.vector(),
+            definition,
             &sindex_block);
     return sindex_id;
 }
@@ -141,6 +151,56 @@ void drop_sindex(btree_store_t<rdb_protocol_t> *store,
             &dummy_interruptor);
 }
 
+void set_sindexes(btree_store_t<rdb_protocol_t> *store,
+                  const std::map<std::string, secondary_index_t> &sindexes) {
+    cond_t dummy_interruptor;
+    write_token_pair_t token_pair;
+    store->new_write_token_pair(&token_pair);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+
+    store->acquire_superblock_for_write(repli_timestamp_t::invalid,
+                                        1, write_durability_t::SOFT, &token_pair,
+                                        &txn, &super_block, &dummy_interruptor);
+
+    value_sizer_t<rdb_value_t> sizer(store->cache->get_block_size());
+    rdb_value_deleter_t deleter;
+
+    buf_lock_t sindex_block
+        = store->acquire_sindex_block_for_write(super_block->expose_buf(),
+                                                super_block->get_sindex_block_id());
+    std::set<std::string> created_sindexes;
+    store->set_sindexes(sindexes, &sindex_block, &sizer, &deleter,
+                        &created_sindexes, &dummy_interruptor);
+}
+
+// Returns what the store has compiled the sindex `sindex_id` to.
+counted_t<compiled_sindex_t> get_compiled_sindex(btree_store_t<rdb_protocol_t> *store,
+                                                 const std::string &sindex_id) {
+    cond_t dummy_interruptor;
+    write_token_pair_t token_pair;
+    store->new_write_token_pair(&token_pair);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+
+    store->acquire_superblock_for_write(repli_timestamp_t::invalid,
+                                        1, write_durability_t::SOFT, &token_pair,
+                                        &txn, &super_block, &dummy_interruptor);
+
+    buf_lock_t sindex_block
+        = store->acquire_sindex_block_for_write(super_block->expose_buf(),
+                                                super_block->get_sindex_block_id());
+    std::set<std::string> sindex_ids;
+    sindex_ids.insert(sindex_id);
+    btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindexes;
+    bool got_all = store->acquire_sindex_superblocks_for_write(
+            sindex_ids, &sindex_block, &sindexes);
+    guarantee(got_all);
+    return sindexes[0].compiled;
+}
+
 void bring_sindexes_up_to_date(
         btree_store_t<rdb_protocol_t> *store, std::string sindex_id) {
     cond_t dummy_interruptor;
@@ -346,6 +406,8 @@ void run_sindex_post_construction() {
             &serializer,
             "unit_test_store",
             GIGABYTE,
+            page_cache_config_t(),
+            NULL,
             true,
             &get_global_perfmon_collection(),
             NULL,
@@ -370,6 +432,135 @@ TEST(RDBBtree, SindexPostConstruct) {
     run_in_thread_pool(&run_sindex_post_construction);
 }
 
+/* Builds the report of replacing `old_json`, stored at `old_ref`, with `new_json`,
+stored at `new_ref`.  Neither ref is ever followed. */
+rdb_modification_report_t make_replace_report(const char *old_json, char old_ref,
+                                              const char *new_json, char new_ref) {
+    scoped_cJSON_t old_row(cJSON_Parse(old_json));
+    scoped_cJSON_t new_row(cJSON_Parse(new_json));
+    counted_t<const ql::datum_t> old_datum = make_counted<ql::datum_t>(old_row);
+    counted_t<const ql::datum_t> new_datum = make_counted<ql::datum_t>(new_row);
+
+    rdb_modification_report_t report(
+        store_key_t(old_datum->get("id")->print_primary()));
+    report.info.deleted.first = old_datum;
+    report.info.deleted.second = std::vector<char>(blob::btree_maxreflen, old_ref);
+    report.info.added.first = new_datum;
+    report.info.added.second = std::vector<char>(blob::btree_maxreflen, new_ref);
+    return report;
+}
+
+store_key_t sid_key(const rdb_modification_report_t &report, double sid) {
+    return store_key_t(make_counted<const ql::datum_t>(sid)->print_secondary(
+                           report.primary_key));
+}
+
+/* `SindexChanges` checks which index entries `compute_sindex_changes` rewrites
+when a row is replaced.  An index that refers to the rows has to point the entry
+at the new blob even if the index value stays the same.  A covering index leaves
+the entry alone unless the index value or a covered field changed. */
+
+void run_sindex_changes_test() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            page_cache_config_t(),
+            NULL,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    const std::string plain_id = create_sindex(&store);
+    const std::string covering_id = create_sindex(
+        &store, uuid_to_str(generate_uuid()),
+        make_sindex_definition(sindex_multi_bool_t::SINGLE,
+                               sindex_covered_fields_t(make_vector(std::string("x")))));
+    rdb_compiled_sindex_t::func_acq_t plain(get_compiled_sindex(&store, plain_id));
+    rdb_compiled_sindex_t::func_acq_t covering(
+        get_compiled_sindex(&store, covering_id));
+
+    cond_t dummy_interruptor;
+    write_token_pair_t token_pair;
+    store.new_write_token_pair(&token_pair);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store.acquire_superblock_for_write(repli_timestamp_t::invalid,
+                                       1, write_durability_t::SOFT,
+                                       &token_pair, &txn, &superblock,
+                                       &dummy_interruptor);
+    buf_parent_t parent = superblock->expose_buf();
+
+    {
+        // Only a field that neither index looks at changes.
+        rdb_modification_report_t report = make_replace_report(
+            "{\"id\" : 0, \"sid\" : 1, \"x\" : 1, \"y\" : 1}", 'a',
+            "{\"id\" : 0, \"sid\" : 1, \"x\" : 1, \"y\" : 2}", 'b');
+
+        std::vector<sindex_change_t> changes;
+        compute_sindex_changes(parent, report, &plain, &changes);
+        ASSERT_EQ(1u, changes.size());
+        EXPECT_EQ(sid_key(report, 1), changes[0].key);
+        EXPECT_EQ(report.info.added.second, changes[0].value);
+
+        changes.clear();
+        compute_sindex_changes(parent, report, &covering, &changes);
+        EXPECT_EQ(0u, changes.size());
+    }
+
+    {
+        // A covered field changes, so the entry gets a new value under the same key.
+        rdb_modification_report_t report = make_replace_report(
+            "{\"id\" : 0, \"sid\" : 1, \"x\" : 1}", 'a',
+            "{\"id\" : 0, \"sid\" : 1, \"x\" : 2}", 'b');
+
+        std::vector<sindex_change_t> changes;
+        compute_sindex_changes(parent, report, &covering, &changes);
+        ASSERT_EQ(1u, changes.size());
+        EXPECT_EQ(sid_key(report, 1), changes[0].key);
+        EXPECT_FALSE(changes[0].value.empty());
+    }
+
+    {
+        // The index value changes, so the old entry goes away in both indexes.
+        rdb_modification_report_t report = make_replace_report(
+            "{\"id\" : 0, \"sid\" : 1, \"x\" : 1}", 'a',
+            "{\"id\" : 0, \"sid\" : 2, \"x\" : 1}", 'b');
+
+        for (int i = 0; i < 2; ++i) {
+            std::vector<sindex_change_t> changes;
+            compute_sindex_changes(parent, report, i == 0 ? &plain : &covering,
+                                   &changes);
+            ASSERT_EQ(2u, changes.size());
+            EXPECT_EQ(sid_key(report, 1), changes[0].key);
+            EXPECT_TRUE(changes[0].value.empty());
+            EXPECT_EQ(sid_key(report, 2), changes[1].key);
+            EXPECT_FALSE(changes[1].value.empty());
+        }
+    }
+}
+
+TEST(RDBBtree, SindexChanges) {
+    run_in_thread_pool(&run_sindex_changes_test);
+}
+
 void run_erase_range_test() {
     recreate_temporary_directory(base_path_t("."));
     temp_file_t temp_file;
@@ -390,6 +581,8 @@ void run_erase_range_test() {
             &serializer,
             "unit_test_store",
             GIGABYTE,
+            page_cache_config_t(),
+            NULL,
             true,
             &get_global_perfmon_collection(),
             NULL,
@@ -463,6 +656,8 @@ void run_sindex_interruption_via_drop_test() {
             &serializer,
             "unit_test_store",
             GIGABYTE,
+            page_cache_config_t(),
+            NULL,
             true,
             &get_global_perfmon_collection(),
             NULL,
@@ -508,6 +703,8 @@ void run_sindex_interruption_via_store_delete() {
             &serializer,
             "unit_test_store",
             GIGABYTE,
+            page_cache_config_t(),
+            NULL,
             true,
             &get_global_perfmon_collection(),
             NULL,
@@ -529,4 +726,71 @@ TEST(RDBBtree, SindexInterruptionViaStoreDelete) {
     run_in_thread_pool(&run_sindex_interruption_via_store_delete);
 }
 
+/* `CompiledSindexCache` checks that the store compiles a sindex once, and that it
+forgets the compiled form once the sindex goes away, whether through
+`drop_sindex` or `set_sindexes`, so that a new sindex under the same name gets
+compiled from its own definition. */
+
+void run_compiled_sindex_cache_test() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            page_cache_config_t(),
+            NULL,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    const std::string sindex_id = create_sindex(&store);
+
+    // The second use gets the same compiled form; the store holds the other reference.
+    counted_t<compiled_sindex_t> first = get_compiled_sindex(&store, sindex_id);
+    EXPECT_EQ(first.get(), get_compiled_sindex(&store, sindex_id).get());
+    EXPECT_EQ(2, counted_use_count(first.get()));
+
+    drop_sindex(&store, sindex_id);
+    EXPECT_EQ(1, counted_use_count(first.get()));
+
+    create_sindex(&store, sindex_id);
+    counted_t<compiled_sindex_t> second = get_compiled_sindex(&store, sindex_id);
+    EXPECT_NE(first.get(), second.get());
+    EXPECT_EQ(2, counted_use_count(second.get()));
+
+    // `set_sindexes` matches sindexes by name, so a redefinition under the same
+    // name shows up as the old sindex going away and the new one being created.
+    set_sindexes(&store, std::map<std::string, secondary_index_t>());
+    EXPECT_EQ(1, counted_use_count(second.get()));
+
+    std::map<std::string, secondary_index_t> redefined;
+    redefined[sindex_id].opaque_definition
+        = make_sindex_definition(sindex_multi_bool_t::MULTI);
+    set_sindexes(&store, redefined);
+    counted_t<compiled_sindex_t> third = get_compiled_sindex(&store, sindex_id);
+    EXPECT_NE(second.get(), third.get());
+    rdb_compiled_sindex_t::func_acq_t func(third);
+    EXPECT_EQ(sindex_multi_bool_t::MULTI, func.multi());
+}
+
+TEST(RDBBtree, CompiledSindexCache) {
+    run_in_thread_pool(&run_compiled_sindex_cache_test);
+}
+
 } //namespace unittest
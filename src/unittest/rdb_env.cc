@@ -113,6 +113,17 @@ void NORETURN mock_namespace_interface_t::read_visitor_t::operator()(UNUSED cons
     throw cannot_perform_query_exc_t("unimplemented");
 }
 
+void mock_namespace_interface_t::read_visitor_t::operator()(const rdb_protocol_t::batched_point_read_t &bpr) {
+    response->response = rdb_protocol_t::batched_point_read_response_t();
+    rdb_protocol_t::batched_point_read_response_t &res = boost::get<rdb_protocol_t::batched_point_read_response_t>(response->response);
+
+    for (auto it = bpr.keys.begin(); it != bpr.keys.end(); ++it) {
+        if (data->find(*it) != data->end()) {
+            res.data[*it] = make_counted<ql::datum_t>(scoped_cJSON_t(data->at(*it)->DeepCopy()));
+        }
+    }
+}
+
 mock_namespace_interface_t::read_visitor_t::read_visitor_t(std::map<store_key_t, scoped_cJSON_t *> *_data,
                                                            rdb_protocol_t::read_response_t *_response) :
     data(_data), response(_response) {
@@ -320,6 +331,7 @@ test_rdb_env_t::instance_t::instance_t(test_rdb_env_t *test_env) :
                            NULL,
                            &interruptor,
                            test_env->machine_id,
+                           temp_file_location_t(),
                            ql::protob_t<Query>()));
     rdb_ns_repo.set_env(env.get());
 
@@ -336,6 +348,19 @@ ql::env_t *test_rdb_env_t::instance_t::get() {
     return env.get();
 }
 
+void test_rdb_env_t::instance_t::make_extra_env(scoped_ptr_t<ql::env_t> *env_out) {
+    env_out->init(new ql::env_t(&extproc_pool,
+                                &rdb_ns_repo,
+                                namespaces_metadata,
+                                databases_metadata,
+                                dummy_semilattice_controller.get_view(),
+                                NULL,
+                                &interruptor,
+                                env->cluster_access.this_machine,
+                                temp_file_location_t(),
+                                ql::protob_t<Query>()));
+}
+
 std::map<store_key_t, scoped_cJSON_t*>* test_rdb_env_t::instance_t::get_data(const namespace_id_t &ns_id) {
     mock_namespace_interface_t *ns_if = rdb_ns_repo.get_ns_if(ns_id);
     guarantee(ns_if != NULL);
@@ -70,6 +70,7 @@ private:
         void NORETURN operator()(UNUSED const rdb_protocol_t::distribution_read_t &dg);
         void NORETURN operator()(UNUSED const rdb_protocol_t::sindex_list_t &sl);
         void NORETURN operator()(UNUSED const rdb_protocol_t::sindex_status_t &ss);
+        void operator()(const rdb_protocol_t::batched_point_read_t &bpr);
 
         read_visitor_t(std::map<store_key_t, scoped_cJSON_t*> *_data, rdb_protocol_t::read_response_t *_response);
 
@@ -162,6 +163,9 @@ public:
 
         ql::env_t *get();
         void interrupt();
+        // Makes another env_t with the same mocks, for code that owns its env_t
+        // (like `stream_cache2_t`).
+        void make_extra_env(scoped_ptr_t<ql::env_t> *env_out);
 
         std::map<store_key_t, scoped_cJSON_t*>* get_data(const namespace_id_t &ns_id);
 
@@ -0,0 +1,92 @@
+// Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/io/disk.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/rdb_env.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* `SpillingOrderBy` sorts rows in runs that are much smaller than the source, so
+that the runs have to be spilled and take several merge passes. */
+
+static const int num_orderby_rows = 1000;
+
+void run_spilling_orderby_test(test_rdb_env_t *test_env, size_t run_size) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    ql::env_t *env = env_instance->get();
+
+    recreate_temporary_directory(base_path_t("."));
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    env->temp_files = temp_file_location_t(&io_backender, base_path_t("."));
+
+    // The rows' "a" fields are a permutation of 0..999, so the sorted order is
+    // known.
+    std::vector<counted_t<const ql::datum_t> > rows;
+    for (int i = 0; i < num_orderby_rows; ++i) {
+        std::map<std::string, counted_t<const ql::datum_t> > row;
+        row["id"] = make_counted<const ql::datum_t>(static_cast<double>(i));
+        row["a"] = make_counted<const ql::datum_t>(
+            static_cast<double>((i * 7919) % num_orderby_rows));
+        rows.push_back(make_counted<const ql::datum_t>(std::move(row)));
+    }
+
+    const ql::protob_t<const Backtrace> bt = ql::make_counted_backtrace();
+    counted_t<ql::datum_stream_t> source = make_counted<ql::array_datum_stream_t>(
+        make_counted<const ql::datum_t>(std::move(rows)), bt);
+    std::vector<std::pair<ql::order_direction_t, counted_t<ql::func_t> > > comparisons;
+    comparisons.push_back(std::make_pair(
+        ql::order_direction_t::ASC,
+        ql::new_get_field_func(make_counted<const ql::datum_t>("a"), bt)));
+    counted_t<ql::datum_stream_t> sorted =
+        make_counted<ql::orderby_datum_stream_t>(source, comparisons, run_size);
+
+    // Sorting a table gave an array before rows could be spilled, and still does.
+    EXPECT_TRUE(sorted->is_array());
+
+    int num_read = 0;
+    ql::batchspec_t batchspec = ql::batchspec_t::user(ql::batch_type_t::NORMAL, env);
+    for (;;) {
+        std::vector<counted_t<const ql::datum_t> > batch = sorted->next_batch(env, batchspec);
+        if (batch.empty()) {
+            break;
+        }
+        for (auto it = batch.begin(); it != batch.end(); ++it, ++num_read) {
+            ASSERT_EQ(num_read, (*it)->get("a")->as_int());
+        }
+    }
+    EXPECT_EQ(num_orderby_rows, num_read);
+    EXPECT_TRUE(sorted->is_exhausted());
+}
+
+TEST(RDBOrderBy, SpillOneMergePass) {
+    test_rdb_env_t test_env;
+    // 4 runs are merged as the stream is read.
+    unittest::run_in_thread_pool(boost::bind(&run_spilling_orderby_test, &test_env, 250));
+}
+
+TEST(RDBOrderBy, SpillSeveralMergePasses) {
+    test_rdb_env_t test_env;
+    // 100 runs take two merge passes before the final merge.
+    unittest::run_in_thread_pool(boost::bind(&run_spilling_orderby_test, &test_env, 10));
+}
+
+TEST(RDBOrderBy, InMemory) {
+    test_rdb_env_t test_env;
+    unittest::run_in_thread_pool(boost::bind(&run_spilling_orderby_test, &test_env,
+                                             num_orderby_rows));
+}
+
+}  // namespace unittest
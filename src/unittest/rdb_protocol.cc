@@ -2,11 +2,13 @@
 #include "errors.hpp"
 #include <boost/shared_ptr.hpp>
 
+#include "buffer_cache/alt/config.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
 #include "memcached/protocol.hpp"
 #include "memcached/protocol_json_adapter.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rpc/directory/read_manager.hpp"
@@ -80,7 +82,7 @@ void run_with_namespace_interface(boost::function<void(namespace_interface_t<rdb
     for (size_t i = 0; i < store_shards.size(); ++i) {
         underlying_stores.push_back(
                 new rdb_protocol_t::store_t(serializers[i].get(),
-                    temp_files[i].name().permanent_path(), GIGABYTE, true,
+                    temp_files[i].name().permanent_path(), GIGABYTE, page_cache_config_t(), NULL, true,
                     &get_global_perfmon_collection(), &ctx,
                     &io_backender, base_path_t(".")));
     }
@@ -174,7 +176,10 @@ std::string create_sindex(namespace_interface_t<rdb_protocol_t> *nsi,
 
     ql::map_wire_func_t m(mapping, make_vector(arg), get_backtrace(mapping));
 
-    rdb_protocol_t::write_t write(rdb_protocol_t::sindex_create_t(id, m, sindex_multi_bool_t::SINGLE), profile_bool_t::PROFILE);
+    rdb_protocol_t::write_t write(
+        rdb_protocol_t::sindex_create_t(id, m, sindex_multi_bool_t::SINGLE,
+                                        sindex_covered_fields_t()),
+        profile_bool_t::PROFILE);
     rdb_protocol_t::write_response_t response;
 
     cond_t interruptor;
@@ -496,5 +501,180 @@ TEST(RDBProtocol, OvershardedMissingAttr) {
     run_in_thread_pool_with_namespace_interface(&run_sindex_missing_attr_test, true);
 }
 
+void write_row(namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource,
+               const std::string &row_json) {
+    scoped_cJSON_t json(cJSON_Parse(row_json.c_str()));
+    ASSERT_TRUE(json.get());
+    counted_t<const ql::datum_t> row = make_counted<ql::datum_t>(json);
+    store_key_t pk(row->get("id")->print_primary());
+
+    rdb_protocol_t::write_t write(
+        rdb_protocol_t::point_write_t(pk, row),
+        DURABILITY_REQUIREMENT_DEFAULT,
+        profile_bool_t::PROFILE);
+    rdb_protocol_t::write_response_t response;
+
+    cond_t interruptor;
+    nsi->write(write, &response,
+               osource->check_in("unittest::write_row(rdb_protocol_t.cc-A"),
+               &interruptor);
+
+    auto resp = boost::get<rdb_protocol_t::point_write_response_t>(&response.response);
+    ASSERT_TRUE(resp != NULL);
+    ASSERT_EQ(point_write_result_t::STORED, resp->result);
+}
+
+/* Replaces the rows with the primary keys `ids`, in order, in one
+`batched_replace_t`.  Every replacement adds a row's "step" to its "base" and sets
+"sid" to the sum, or deletes the row if its "step" is negative. */
+void batched_replace_rows(namespace_interface_t<rdb_protocol_t> *nsi,
+                          order_source_t *osource,
+                          const std::vector<double> &ids) {
+    std::vector<store_key_t> keys;
+    for (auto it = ids.begin(); it != ids.end(); ++it) {
+        keys.push_back(store_key_t(make_counted<const ql::datum_t>(*it)->print_primary()));
+    }
+
+    const ql::sym_t row(1);
+    ql::protob_t<const Term> body = ql::r::branch(
+        ql::r::var(row)["step"] < ql::r::expr(0.0),
+        ql::r::null(),
+        ql::r::var(row).merge(ql::r::object(
+            ql::r::optarg("base", ql::r::var(row)["base"] + ql::r::var(row)["step"]),
+            ql::r::optarg("sid", ql::r::var(row)["base"] + ql::r::var(row)["step"]))))
+        .release_counted();
+    ql::wire_func_t func(body, make_vector(row), get_backtrace(body));
+
+    rdb_protocol_t::write_t write(
+        rdb_protocol_t::batched_replace_t(
+            std::move(keys), "id", func.compile_wire_func(),
+            std::map<std::string, ql::wire_func_t>(), false),
+        DURABILITY_REQUIREMENT_DEFAULT,
+        profile_bool_t::PROFILE);
+    rdb_protocol_t::write_response_t response;
+
+    cond_t interruptor;
+    nsi->write(write, &response,
+               osource->check_in("unittest::batched_replace_rows(rdb_protocol_t.cc-A"),
+               &interruptor);
+
+    auto stats = boost::get<rdb_protocol_t::batched_replace_response_t>(
+        &response.response);
+    ASSERT_TRUE(stats != NULL);
+    counted_t<const ql::datum_t> first_error = (*stats)->get("first_error", ql::NOTHROW);
+    ASSERT_FALSE(first_error.has()) << first_error->print();
+}
+
+/* Checks that the sindex `id` maps `sid` to the row `row_json`, or to nothing if
+`row_json` is NULL. */
+void check_row_with_sid(namespace_interface_t<rdb_protocol_t> *nsi,
+                        order_source_t *osource,
+                        const std::string &id, double sid, const char *row_json) {
+    rdb_protocol_t::read_t read
+        = make_sindex_read(make_counted<const ql::datum_t>(sid), id);
+    rdb_protocol_t::read_response_t response;
+
+    cond_t interruptor;
+    nsi->read(read, &response,
+              osource->check_in("unittest::check_row_with_sid(rdb_protocol_t.cc-A"),
+              &interruptor);
+
+    auto rget_resp = boost::get<rdb_protocol_t::rget_read_response_t>(&response.response);
+    ASSERT_TRUE(rget_resp != NULL);
+    auto streams = boost::get<ql::grouped_t<ql::stream_t> >(&rget_resp->result);
+    ASSERT_TRUE(streams != NULL);
+    if (row_json == NULL) {
+        ASSERT_EQ(0, streams->size()) << "sid " << sid;
+        return;
+    }
+    ASSERT_EQ(1, streams->size()) << "sid " << sid;
+    auto stream = &streams->begin()->second;
+    ASSERT_EQ(1u, stream->size()) << "sid " << sid;
+    scoped_cJSON_t expected(cJSON_Parse(row_json));
+    ASSERT_EQ(ql::datum_t(expected.get()), *stream->at(0).data);
+}
+
+/* Writes four rows and replaces them in one batch: row 0 keeps its index value, row
+1 gets a new one, row 2 is deleted and row 3 is replaced twice.  If `indexed` is
+false, the rows start out without a "sid", so that the index is still empty when
+the batch arrives and gets bulk loaded.  Otherwise the batch updates the entries
+that the rows already have. */
+void run_sindex_batched_replace_test(namespace_interface_t<rdb_protocol_t> *nsi,
+                                     order_source_t *osource,
+                                     bool indexed) {
+    std::string sindex_id = create_sindex(nsi, osource);
+
+    // KSI: Ugh, why is sindex creation so slow that we need a nap?
+    nap(100);
+
+    std::vector<std::string> rows;
+    if (indexed) {
+        rows.push_back("{\"id\" : 0, \"base\" : 10, \"step\" : 0, \"sid\" : 10}");
+        rows.push_back("{\"id\" : 1, \"base\" : 11, \"step\" : 100, \"sid\" : 11}");
+        rows.push_back("{\"id\" : 2, \"base\" : 12, \"step\" : -1, \"sid\" : 12}");
+        rows.push_back("{\"id\" : 3, \"base\" : 13, \"step\" : 1000, \"sid\" : 13}");
+    } else {
+        rows.push_back("{\"id\" : 0, \"base\" : 10, \"step\" : 0}");
+        rows.push_back("{\"id\" : 1, \"base\" : 11, \"step\" : 100}");
+        rows.push_back("{\"id\" : 2, \"base\" : 12, \"step\" : -1}");
+        rows.push_back("{\"id\" : 3, \"base\" : 13, \"step\" : 1000}");
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        write_row(nsi, osource, rows[i]);
+        check_row_with_sid(nsi, osource, sindex_id, 10 + i,
+                           indexed ? rows[i].c_str() : NULL);
+    }
+
+    std::vector<double> ids;
+    ids.push_back(0);
+    ids.push_back(1);
+    ids.push_back(2);
+    ids.push_back(3);
+    ids.push_back(3);
+    batched_replace_rows(nsi, osource, ids);
+
+    check_row_with_sid(nsi, osource, sindex_id, 10,
+                       "{\"id\" : 0, \"base\" : 10, \"step\" : 0, \"sid\" : 10}");
+    check_row_with_sid(nsi, osource, sindex_id, 11, NULL);
+    check_row_with_sid(nsi, osource, sindex_id, 111,
+                       "{\"id\" : 1, \"base\" : 111, \"step\" : 100, \"sid\" : 111}");
+    check_row_with_sid(nsi, osource, sindex_id, 12, NULL);
+    // Only the last of the two replacements of row 3 may leave an entry.
+    check_row_with_sid(nsi, osource, sindex_id, 13, NULL);
+    check_row_with_sid(nsi, osource, sindex_id, 1013, NULL);
+    check_row_with_sid(nsi, osource, sindex_id, 2013,
+                       "{\"id\" : 3, \"base\" : 2013, \"step\" : 1000, \"sid\" : 2013}");
+}
+
+void run_sindex_batched_replace_bulk_load_test(
+        namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource) {
+    run_sindex_batched_replace_test(nsi, osource, false);
+}
+
+void run_sindex_batched_replace_incremental_test(
+        namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource) {
+    run_sindex_batched_replace_test(nsi, osource, true);
+}
+
+TEST(RDBProtocol, SindexBatchedReplaceBulkLoad) {
+    run_in_thread_pool_with_namespace_interface(
+        &run_sindex_batched_replace_bulk_load_test, false);
+}
+
+TEST(RDBProtocol, OvershardedSindexBatchedReplaceBulkLoad) {
+    run_in_thread_pool_with_namespace_interface(
+        &run_sindex_batched_replace_bulk_load_test, true);
+}
+
+TEST(RDBProtocol, SindexBatchedReplaceIncremental) {
+    run_in_thread_pool_with_namespace_interface(
+        &run_sindex_batched_replace_incremental_test, false);
+}
+
+TEST(RDBProtocol, OvershardedSindexBatchedReplaceIncremental) {
+    run_in_thread_pool_with_namespace_interface(
+        &run_sindex_batched_replace_incremental_test, true);
+}
+
 }   /* namespace unittest */
 
@@ -4,6 +4,7 @@
 
 #include "arch/runtime/thread_pool.hpp"
 #include "arch/timing.hpp"
+#include "concurrency/pmap.hpp"
 #include "containers/scoped.hpp"
 #include "containers/archive/socket_stream.hpp"
 #include "unittest/unittest_utils.hpp"
@@ -28,11 +29,8 @@ public:
         public:
             explicit writer_t(int _data) : data(_data) { }
             virtual ~writer_t() { }
-            void write(write_stream_t *stream) {
-                write_message_t msg;
-                msg << data;
-                int res = send_write_message(stream, &msg);
-                if (res) { throw fake_archive_exc_t(); }
+            void write(write_message_t *msg) {
+                *msg << data;
             }
             int32_t data;
         } writer(message);
@@ -208,6 +206,92 @@ TEST(RPCConnectivityTest, OrderingMultiThread) {
     unittest::run_in_thread_pool(&run_ordering_test, 3);
 }
 
+/* `Lanes` sends messages from every thread at once. A connection has one lane
+per thread, so this exercises all of them; messages sent from the same thread
+must still arrive in order. */
+
+void send_from_thread(int thread, recording_test_application_t *app, peer_id_t peer) {
+    on_thread_t th((threadnum_t(thread)));
+    for (int i = 0; i < 10; i++) {
+        app->send(thread * 100 + i, peer);
+    }
+}
+
+void run_lanes_test() {
+    connectivity_cluster_t c1, c2;
+    recording_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a1, 0, NULL);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a2, 0, NULL);
+
+    cr1.join(c2.get_peer_address(c2.get_me()));
+
+    let_stuff_happen();
+
+    pmap(get_num_threads(), boost::bind(&send_from_thread, _1, &a1, c2.get_me()));
+    pmap(get_num_threads(), boost::bind(&send_from_thread, _1, &a2, c1.get_me()));
+
+    let_stuff_happen();
+
+    for (int thread = 0; thread < get_num_threads(); thread++) {
+        for (int i = 0; i < 9; i++) {
+            a1.expect_order(thread * 100 + i, thread * 100 + i + 1);
+            a2.expect_order(thread * 100 + i, thread * 100 + i + 1);
+        }
+        a1.expect(thread * 100, c2.get_me());
+        a2.expect(thread * 100, c1.get_me());
+    }
+}
+TEST(RPCConnectivityTest, LanesMultiThread) {
+    unittest::run_in_thread_pool(&run_lanes_test, 3);
+}
+
+/* `LanesInvalidMessage` sends an invalid message on a lane other than the first
+one. The receiving node kills the connection from that lane's thread, like the
+mailbox manager does, which has to take down the whole connection. */
+
+class killing_message_handler_t : public message_handler_t {
+public:
+    explicit killing_message_handler_t(message_service_t *s) : service(s) { }
+    void on_message(peer_id_t peer, read_stream_t *stream) {
+        int i;
+        archive_result_t res = deserialize(stream, &i);
+        if (bad(res)) { throw fake_archive_exc_t(); }
+        if (i < 0) {
+            service->kill_connection(peer);
+        }
+    }
+private:
+    message_service_t *service;
+};
+
+void run_lanes_invalid_message_test() {
+    connectivity_cluster_t c1, c2;
+    recording_test_application_t a1(&c1);
+    killing_message_handler_t h2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a1, 0, NULL);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(), ANY_PORT, &h2, 0, NULL);
+
+    cr1.join(c2.get_peer_address(c2.get_me()));
+
+    let_stuff_happen();
+
+    ASSERT_EQ(2u, c1.get_peers_list().size());
+
+    {
+        /* Thread 1 sends on the second lane. */
+        on_thread_t th((threadnum_t(1)));
+        a1.send(-1, c2.get_me());
+    }
+
+    let_stuff_happen();
+
+    EXPECT_EQ(1u, c1.get_peers_list().size());
+    EXPECT_EQ(1u, c2.get_peers_list().size());
+}
+TEST(RPCConnectivityTest, LanesInvalidMessageMultiThread) {
+    unittest::run_in_thread_pool(&run_lanes_invalid_message_test, 3);
+}
+
 /* `GetPeersList` confirms that the behavior of `cluster_t::get_peers_list()` is
 correct. */
 
@@ -466,10 +550,16 @@ TEST(RPCConnectivityTest, BlobJoinMultiThread) {
 
 /* `Multiplexer` tests `message_multiplexer_t`. */
 
-void run_multiplexer_test() {
+void send_from_client(int i, recording_test_application_t *a,
+                      recording_test_application_t *b, peer_id_t peer) {
+    a->send(40000 + i, peer);
+    b->send(50000 + i, peer);
+}
+
+void run_multiplexer_test(bool coalesce) {
 
     connectivity_cluster_t c1, c2;
-    message_multiplexer_t c1m(&c1), c2m(&c2);
+    message_multiplexer_t c1m(&c1, coalesce), c2m(&c2, coalesce);
     message_multiplexer_t::client_t c1mcA(&c1m, 'A'), c2mcA(&c2m, 'A');
     recording_test_application_t c1aA(&c1mcA), c2aA(&c2mcA);
     message_multiplexer_t::client_t::run_t c1mcAr(&c1mcA, &c1aA), c2mcAr(&c2mcA, &c2aA);
@@ -494,10 +584,46 @@ void run_multiplexer_test() {
     c1aA.expect(65, c1.get_me());
     c2aA.expect_undelivered(10066);
     c2aB.expect_undelivered(10065);
+
+    /* Messages that one coroutine sends one after another must arrive in order. */
+    for (int i = 0; i < 20; ++i) {
+        c1aA.send(20000 + i, c2.get_me());
+        c1aB.send(30000 + i, c2.get_me());
+    }
+
+    let_stuff_happen();
+
+    for (int i = 0; i < 20; ++i) {
+        c2aA.expect(20000 + i, c1.get_me());
+        c2aB.expect(30000 + i, c1.get_me());
+    }
+    for (int i = 0; i < 19; ++i) {
+        c2aA.expect_order(20000 + i, 20000 + i + 1);
+        c2aB.expect_order(30000 + i, 30000 + i + 1);
+    }
+
+    /* Messages that several coroutines send at the same time end up in one batch
+    if we're coalescing; either way, they must all arrive. */
+    pmap(20, boost::bind(&send_from_client, _1, &c1aA, &c1aB, c2.get_me()));
+
+    let_stuff_happen();
+
+    for (int i = 0; i < 20; ++i) {
+        c2aA.expect(40000 + i, c1.get_me());
+        c2aB.expect(50000 + i, c1.get_me());
+    }
 }
 
 TEST(RPCConnectivityTest, Multiplexer) {
-    unittest::run_in_thread_pool(&run_multiplexer_test);
+    unittest::run_in_thread_pool(boost::bind(&run_multiplexer_test, false));
+}
+
+TEST(RPCConnectivityTest, MultiplexerCoalescing) {
+    unittest::run_in_thread_pool(boost::bind(&run_multiplexer_test, true));
+}
+
+TEST(RPCConnectivityTest, MultiplexerCoalescingMultiThread) {
+    unittest::run_in_thread_pool(boost::bind(&run_multiplexer_test, true), 3);
 }
 
 /* `BinaryData` makes sure that any octet can be sent over the wire. */
@@ -512,11 +638,10 @@ public:
         class dump_spectrum_writer_t : public send_message_write_callback_t {
         public:
             virtual ~dump_spectrum_writer_t() { }
-            void write(write_stream_t *stream) {
+            void write(write_message_t *msg) {
                 char spectrum[CHAR_MAX - CHAR_MIN + 1];
                 for (int i = CHAR_MIN; i <= CHAR_MAX; i++) spectrum[i - CHAR_MIN] = i;
-                int64_t res = stream->write(spectrum, CHAR_MAX - CHAR_MIN + 1);
-                if (res != CHAR_MAX - CHAR_MIN + 1) { throw fake_archive_exc_t(); }
+                msg->append(spectrum, CHAR_MAX - CHAR_MIN + 1);
             }
         } writer;
         service->send_message(peer, &writer);
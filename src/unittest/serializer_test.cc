@@ -86,5 +86,77 @@ TEST(SerializerTest, AddDeleteRepeatedlyWithIndex) {
     run_in_thread_pool(std::bind(run_AddDeleteRepeatedly, true), 4);
 }
 
+void run_CompressedBlocks() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    standard_serializer_t::dynamic_config_t dynamic_config;
+    dynamic_config.block_codec = block_codec_t::zlib;
+
+    // Block 0 compresses well, block 1 doesn't compress at all.
+    std::vector<std::vector<char> > contents(2);
+    {
+        standard_serializer_t ser(dynamic_config, &file_opener,
+                                  &get_global_perfmon_collection());
+        const uint32_t size = ser.max_block_size().value();
+        const std::string row = "{\"id\": 1234, \"name\": \"foo\"}";
+        for (uint32_t i = 0; i < size; ++i) {
+            contents[0].push_back(row[i % row.size()]);
+            contents[1].push_back(static_cast<char>(randint(256)));
+        }
+
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        std::vector<scoped_malloc_t<ser_buffer_t> > bufs;
+        std::vector<buf_write_info_t> infos;
+        for (size_t i = 0; i < contents.size(); ++i) {
+            bufs.push_back(ser.malloc());
+            memcpy(bufs[i]->cache_data, contents[i].data(), size);
+            infos.push_back(buf_write_info_t(bufs[i].get(), ser.max_block_size(), i));
+        }
+
+        struct : public iocallback_t, public cond_t {
+            void on_io_complete() {
+                pulse();
+            }
+        } cb;
+        std::vector<counted_t<standard_block_token_t> > tokens
+            = ser.block_writes(infos, account.get(), &cb);
+        cb.wait();
+
+        // Only the compressible block takes up less space on disk.
+        ASSERT_EQ(2u, tokens.size());
+        EXPECT_LT(tokens[0]->disk_block_size().value(), tokens[0]->block_size().value());
+        EXPECT_EQ(tokens[1]->block_size().value(), tokens[1]->disk_block_size().value());
+
+        std::vector<index_write_op_t> write_ops;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            write_ops.push_back(index_write_op_t(i, tokens[i],
+                                                 repli_timestamp_t::distant_past));
+        }
+        ser.index_write(write_ops, account.get());
+    }
+
+    // Read the blocks back after restarting, with compression turned off.
+    standard_serializer_t ser(standard_serializer_t::dynamic_config_t(),
+                              &file_opener,
+                              &get_global_perfmon_collection());
+    scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+    for (size_t i = 0; i < contents.size(); ++i) {
+        counted_t<standard_block_token_t> token = ser.index_read(i);
+        ASSERT_TRUE(token.has());
+        ASSERT_EQ(ser.max_block_size(), token->block_size());
+
+        scoped_malloc_t<ser_buffer_t> buf = ser.malloc();
+        ser.block_read(token, buf.get(), account.get());
+        EXPECT_EQ(i, buf->ser_header.block_id);
+        EXPECT_EQ(0, memcmp(contents[i].data(), buf->cache_data,
+                            ser.max_block_size().value()));
+    }
+}
+
+TEST(SerializerTest, CompressedBlocks) {
+    run_in_thread_pool(run_CompressedBlocks, 4);
+}
+
 
 }  // namespace unittest
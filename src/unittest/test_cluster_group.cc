@@ -9,6 +9,7 @@
 #include <boost/tokenizer.hpp>
 
 #include "arch/io/io_utils.hpp"
+#include "buffer_cache/alt/config.hpp"
 #include "clustering/administration/main/watchable_fields.hpp"
 #include "clustering/immediate_consistency/branch/multistore.hpp"
 #include "clustering/reactor/blueprint.hpp"
@@ -194,7 +195,7 @@ test_cluster_group_t<protocol_t>::test_cluster_group_t(int n_machines)
                                                         &get_global_perfmon_collection()));
         stores.push_back(
                 new typename protocol_t::store_t(&serializers[i],
-                    files[i].name().permanent_path(), GIGABYTE, true, NULL,
+                    files[i].name().permanent_path(), GIGABYTE, page_cache_config_t(), NULL, true, NULL,
                     &ctx, io_backender.get(), base_path_t(".")));
         store_view_t<protocol_t> *store_ptr = &stores[i];
         svses.push_back(new multistore_ptr_t<protocol_t>(&store_ptr, 1));
@@ -4,6 +4,7 @@
 
 import random
 import socket
+import struct
 import threading
 import SocketServer
 import datetime
@@ -20,6 +21,8 @@ path.insert(0, "../../drivers/python")
 # need to test for it
 from rethinkdb import *
 import rethinkdb as r
+from rethinkdb import ql2_pb2 as p
+from rethinkdb.ast import Datum
 
 server_build_dir = argv[1]
 use_default_port = bool(int(argv[2]))
@@ -325,6 +328,74 @@ class TestShutdown(TestWithConnection):
             r.expr(1).run, c)
 
 
+class TestPipelining(TestWithConnection):
+    # The driver waits for each response before it sends the next query, so we
+    # write the queries to the connection's socket ourselves.
+
+    def send_query(self, c, token, query_type, term=None, noreply=False):
+        query = p.Query()
+        query.type = query_type
+        query.token = token
+        query.accepts_r_json = True
+        if term is not None:
+            term.build(query.query)
+        if noreply:
+            pair = query.global_optargs.add()
+            pair.key = 'noreply'
+            r.expr(True).build(pair.val)
+        query_protobuf = query.SerializeToString()
+        c._sock_sendall(struct.pack("<L", len(query_protobuf)) + query_protobuf)
+
+    def read_response(self, c):
+        (response_len,) = struct.unpack("<L", self.read_exactly(c, 4))
+        response = p.Response()
+        response.ParseFromString(self.read_exactly(c, response_len))
+        return response
+
+    def read_exactly(self, c, length):
+        buf = b''
+        while len(buf) < length:
+            chunk = c._sock_recv(length - len(buf))
+            if len(chunk) == 0:
+                raise RqlDriverError("Connection is closed.")
+            buf += chunk
+        return buf
+
+    def test_pipelined_queries(self):
+        c = r.connect(port=self.port)
+        r.db('test').table_create('pipelined').run(c)
+
+        # A slow query, then a fast one that shouldn't have to wait for it.
+        self.send_query(c, 1, p.Query.START, r.js('while(true);', timeout=0.5))
+        self.send_query(c, 2, p.Query.START, r.expr(2))
+        # Writes that don't get a response, then a noreply_wait that has to wait
+        # for them and for the slow query.
+        for i in xrange(10):
+            self.send_query(c, 3 + i, p.Query.START,
+                            r.table('pipelined').insert({'id': i}), noreply=True)
+        self.send_query(c, 13, p.Query.NOREPLY_WAIT)
+        # Queries sent after the noreply_wait run after it.
+        self.send_query(c, 14, p.Query.START, r.table('pipelined').count())
+
+        responses = [self.read_response(c) for i in xrange(4)]
+        tokens = [response.token for response in responses]
+        self.assertEqual(sorted(tokens), [1, 2, 13, 14])
+        by_token = dict((response.token, response) for response in responses)
+
+        self.assertLess(tokens.index(2), tokens.index(1))
+        self.assertEqual(by_token[2].type, p.Response.SUCCESS_ATOM)
+        self.assertEqual(Datum.deconstruct(by_token[2].response[0]), 2)
+        self.assertEqual(by_token[1].type, p.Response.RUNTIME_ERROR)
+
+        self.assertLess(tokens.index(1), tokens.index(13))
+        self.assertEqual(by_token[13].type, p.Response.WAIT_COMPLETE)
+        self.assertEqual(by_token[14].type, p.Response.SUCCESS_ATOM)
+        self.assertEqual(Datum.deconstruct(by_token[14].response[0]), 10)
+
+        # The connection still works normally afterwards.
+        c.next_token = 15
+        self.assertEqual(r.table('pipelined').count().run(c), 10)
+
 # This doesn't really have anything to do with connections but it'll go
 # in here for the time being.
 class TestPrinting(unittest.TestCase):